@@ -0,0 +1,319 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmarks of the port against the simulated SoftDevice:
+ *
+ *  - dispatch:     host time spent by btle_processEvents() per event;
+ *  - notification: payload carried per virtual second by notifications sent
+ *                  from onDataSent(), for a few link configurations;
+ *  - discovery:    virtual time and connection events taken by a full
+ *                  service discovery of a peer database.
+ *
+ * Virtual figures only depend on the port and the connection event model of
+ * the simulator, so they are stable from one run to the next. With --quick,
+ * shorter runs are made and the results are checked for sanity; the exit
+ * status is non-zero if a check fails.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ble/BLE.h"
+#include "btle.h"
+#include "nRF5xGattServer.h"
+#include "softdevice.h"
+
+static bool quick    = false;
+static int  failures = 0;
+
+static void
+check(bool condition, const char *what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static uint64_t
+hostTimeNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/* Run the event loop of the application until the virtual time reaches endUs. */
+static void
+runUntil(BLE &ble, uint32_t endUs)
+{
+    while (sim_now() < endUs) {
+        ble.processEvents();
+        if (!btle_hasPendingEvents() && !sim_step()) {
+            break;
+        }
+    }
+    ble.processEvents();
+}
+
+static void
+disconnect(BLE &ble, uint16_t connHandle)
+{
+    sim_disconnect(connHandle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    ble.processEvents();
+}
+
+/*
+ * Dispatch
+ */
+static void
+benchmarkDispatch(BLE &ble)
+{
+    const unsigned rounds = quick ? 100 : 10000;
+    const unsigned batch  = 32;
+
+    uint16_t connHandle = sim_connect(BLE_GAP_ROLE_PERIPH, NULL);
+    ble.processEvents();
+
+    /* A TX complete with nothing queued goes through every event handler without side effects. */
+    ble_evt_t event;
+    memset(&event, 0, sizeof(event));
+    event.header.evt_id                       = BLE_EVT_TX_COMPLETE;
+    event.header.evt_len                      = sizeof(ble_common_evt_t);
+    event.evt.common_evt.conn_handle          = connHandle;
+    event.evt.common_evt.params.tx_complete.count = 1;
+    uint16_t len = offsetof(ble_evt_t, evt.common_evt.params) + sizeof(ble_evt_tx_complete_t);
+
+    btle_resetEventStatistics();
+    uint64_t elapsedNs = 0;
+    for (unsigned round = 0; round < rounds; round++) {
+        for (unsigned i = 0; i < batch; i++) {
+            sim_pushEvent(&event, len);
+        }
+        uint64_t start = hostTimeNs();
+        btle_processEvents(0, 0);
+        elapsedNs += hostTimeNs() - start;
+    }
+
+    const btle_eventStatistics_t *statistics = btle_getEventStatistics();
+    printf("dispatch: %u events in batches of %u, %.1f ns/event\n",
+           (unsigned) statistics->events, batch, (double) elapsedNs / statistics->events);
+    check(statistics->events == rounds * batch, "dispatch: every event is dispatched");
+    check(statistics->drains == rounds, "dispatch: one drain per batch");
+
+    disconnect(ble, connHandle);
+}
+
+/*
+ * Notification throughput
+ */
+class NotificationSource {
+public:
+    NotificationSource(BLE &bleIn, GattAttribute::Handle_t valueHandleIn) :
+        ble(bleIn), valueHandle(valueHandleIn), connHandle(BLE_CONN_HANDLE_INVALID) {
+        memset(payload, 0xA5, sizeof(payload));
+    }
+
+    void start(uint16_t connHandleIn) {
+        connHandle = connHandleIn;
+        fill();
+    }
+
+    void stop(void) {
+        connHandle = BLE_CONN_HANDLE_INVALID;
+    }
+
+    /* Keep the SoftDevice busy: send until it runs out of buffers. */
+    void onDataSent(unsigned count) {
+        fill();
+    }
+
+private:
+    void fill(void) {
+        if (connHandle == BLE_CONN_HANDLE_INVALID) {
+            return;
+        }
+        while (ble.gattServer().write(connHandle, valueHandle, payload, sizeof(payload)) == BLE_ERROR_NONE) {
+            /* The SoftDevice took it. */
+        }
+    }
+
+    BLE                     &ble;
+    GattAttribute::Handle_t  valueHandle;
+    uint16_t                 connHandle;
+    uint8_t                  payload[20];
+};
+
+static void
+benchmarkNotifications(BLE &ble, GattCharacteristic &characteristic, NotificationSource &source)
+{
+    static const sim_linkParams_t links[] = {
+        /* intervalUs, txBuffers, packetsPerEvent */
+        {  7500, 6, 6 },
+        {  7500, 6, 2 },
+        { 30000, 6, 6 },
+        { 30000, 3, 6 },
+    };
+    const uint32_t durationUs = quick ? 200000 : 2000000;
+
+    for (unsigned i = 0; i < sizeof(links) / sizeof(links[0]); i++) {
+        const sim_linkParams_t &link = links[i];
+
+        uint16_t connHandle = sim_connect(BLE_GAP_ROLE_PERIPH, &link);
+        ble.processEvents();
+
+        /* The peer subscribes; the CCCD follows the value. */
+        const uint8_t enable[] = { BLE_GATT_HVX_NOTIFICATION, 0 };
+        sim_peerWrite(connHandle, characteristic.getValueHandle() + 1, enable, sizeof(enable));
+        ble.processEvents();
+
+        uint32_t start = sim_now();
+        source.start(connHandle);
+        runUntil(ble, start + durationUs);
+        source.stop();
+
+        uint32_t elapsedUs = sim_now() - start;
+        uint32_t bytes     = sim_peerBytesReceived(connHandle);
+        uint32_t bound     = (uint32_t) ((uint64_t) elapsedUs / link.intervalUs * ((link.packetsPerEvent < link.txBuffers) ? link.packetsPerEvent : link.txBuffers) * 20);
+        printf("notification: %5.1fms interval, %u buffers, %u packets/event: %6.0f bytes/s (%u notifications, %3.0f%% of the link)\n",
+               link.intervalUs / 1000.0, link.txBuffers, link.packetsPerEvent,
+               bytes * 1000000.0 / elapsedUs, (unsigned) sim_peerNotificationsReceived(connHandle),
+               bound ? (100.0 * bytes / bound) : 0.0);
+
+        check(sim_peerNotificationsReceived(connHandle) > 0, "notification: notifications go over the air");
+        check(bytes * 10 >= bound * 9, "notification: at least 90% of the link is used");
+
+        disconnect(ble, connHandle);
+    }
+}
+
+/*
+ * Service discovery
+ */
+static unsigned discoveredServices;
+static unsigned discoveredCharacteristics;
+static bool     discoveryDone;
+
+static void
+onService(const DiscoveredService *service)
+{
+    discoveredServices++;
+}
+
+static void
+onCharacteristic(const DiscoveredCharacteristic *characteristic)
+{
+    discoveredCharacteristics++;
+}
+
+static void
+onDiscoveryTermination(Gap::Handle_t connHandle)
+{
+    discoveryDone = true;
+}
+
+static void
+benchmarkDiscovery(BLE &ble)
+{
+    static const struct {
+        unsigned services;
+        unsigned characteristics;
+        bool     longUUIDs;
+    } databases[] = {
+        { 2, 2, false },
+        { 4, 4, false },
+        { 4, 4, true  },
+        { 8, 6, true  },
+    };
+
+    ble.gattClient().onServiceDiscoveryTermination(onDiscoveryTermination);
+
+    for (unsigned i = 0; i < sizeof(databases) / sizeof(databases[0]); i++) {
+        sim_peerClearDatabase();
+        for (unsigned s = 0; s < databases[i].services; s++) {
+            uint8_t uuid[16] = { 0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0, 0x93, 0xF3, 0xA3, 0xB5, 0x00, 0x00, 0x40, 0x6E };
+            uuid[12] = s;
+            uuid[13] = 0x10;
+            sim_peerAddService(0x1810 + s, databases[i].longUUIDs ? uuid : NULL);
+            for (unsigned c = 0; c < databases[i].characteristics; c++) {
+                uuid[12] = c;
+                uuid[13] = 0x20 + s;
+                sim_peerAddCharacteristic(0x2A00 + c, databases[i].longUUIDs ? uuid : NULL, (c & 1) ? 0x10 /* notify */ : 0x02 /* read */);
+            }
+        }
+
+        uint16_t connHandle = sim_connect(BLE_GAP_ROLE_CENTRAL, NULL);
+        ble.processEvents();
+
+        discoveredServices        = 0;
+        discoveredCharacteristics = 0;
+        discoveryDone             = false;
+        uint32_t start  = sim_now();
+        uint32_t events = sim_connectionEvents();
+        ble_error_t rc  = ble.gattClient().launchServiceDiscovery(connHandle, onService, onCharacteristic);
+        check(rc == BLE_ERROR_NONE, "discovery: launched");
+
+        while (!discoveryDone && (sim_now() - start < 10000000)) {
+            runUntil(ble, sim_now() + 1);
+        }
+
+        printf("discovery: %u services x %u characteristics, %s UUIDs: %6.1fms, %u connection events\n",
+               databases[i].services, databases[i].characteristics, databases[i].longUUIDs ? "128-bit" : " 16-bit",
+               (sim_now() - start) / 1000.0, (unsigned) (sim_connectionEvents() - events));
+
+        check(discoveryDone, "discovery: terminates");
+        check(discoveredServices == databases[i].services, "discovery: every service is found");
+        check(discoveredCharacteristics == databases[i].services * databases[i].characteristics, "discovery: every characteristic is found");
+
+        disconnect(ble, connHandle);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            printf("usage: %s [--quick]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    sim_reset();
+
+    BLE &ble = BLE::Instance();
+    check(ble.init() == BLE_ERROR_NONE, "init");
+
+    uint8_t            value[20] = { 0 };
+    GattCharacteristic characteristic(UUID(0x2A37), value, sizeof(value), sizeof(value),
+                                      GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY);
+    GattCharacteristic *characteristics[] = { &characteristic };
+    GattService         service(UUID(0x180D), characteristics, 1);
+    check(ble.gattServer().addService(service) == BLE_ERROR_NONE, "addService");
+
+    NotificationSource source(ble, characteristic.getValueHandle());
+    ble.gattServer().onDataSent(&source, &NotificationSource::onDataSent);
+
+    benchmarkDispatch(ble);
+    benchmarkNotifications(ble, characteristic, source);
+    benchmarkDiscovery(ble);
+
+    return (failures == 0) ? 0 : 1;
+}
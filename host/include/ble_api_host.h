@@ -0,0 +1,1648 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for the subset of the mbed BLE API (ble ^2.7.0) which the
+ * port builds against. The classes keep the interfaces and the behaviour the
+ * port relies on; callbacks are dispatched as in the BLE API, but the
+ * features the port doesn't use (advertising payload builders, service
+ * helpers, ...) are left out.
+ */
+
+#ifndef __BLE_API_HOST_H__
+#define __BLE_API_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Parts of the port include the BLE API from within extern "C" blocks. */
+extern "C++" {
+
+/*
+ * blecommon.h
+ */
+enum {
+    BLE_UUID_UNKNOWN = 0x0000,
+};
+
+enum ble_error_t {
+    BLE_ERROR_NONE                      = 0,
+    BLE_ERROR_BUFFER_OVERFLOW           = 1,
+    BLE_ERROR_NOT_IMPLEMENTED           = 2,
+    BLE_ERROR_PARAM_OUT_OF_RANGE        = 3,
+    BLE_ERROR_INVALID_PARAM             = 4,
+    BLE_STACK_BUSY                      = 5,
+    BLE_ERROR_INVALID_STATE             = 6,
+    BLE_ERROR_NO_MEM                    = 7,
+    BLE_ERROR_OPERATION_NOT_PERMITTED   = 8,
+    BLE_ERROR_INITIALIZATION_INCOMPLETE = 9,
+    BLE_ERROR_ALREADY_INITIALIZED       = 10,
+    BLE_ERROR_UNSPECIFIED               = 11,
+    BLE_ERROR_INTERNAL_STACK_FAILURE    = 12,
+};
+
+enum HVXType_t {
+    BLE_HVX_NOTIFICATION = 0x01,
+    BLE_HVX_INDICATION   = 0x02,
+};
+
+/*
+ * BLEProtocol.h
+ */
+namespace BLEProtocol {
+    struct AddressType {
+        enum Type {
+            PUBLIC = 0,
+            RANDOM_STATIC,
+            RANDOM_PRIVATE_RESOLVABLE,
+            RANDOM_PRIVATE_NON_RESOLVABLE
+        };
+    };
+    typedef AddressType::Type AddressType_t;
+
+    static const size_t ADDR_LEN = 6;
+    typedef uint8_t AddressBytes_t[ADDR_LEN];
+
+    struct Address_t {
+        AddressType_t  type;
+        AddressBytes_t address;
+    };
+}
+
+/*
+ * FunctionPointerWithContext.h and CallChainOfFunctionPointersWithContext.h
+ */
+template <typename ContextType>
+class FunctionPointerWithContext {
+public:
+    typedef FunctionPointerWithContext<ContextType> *pFunctionPointerWithContext_t;
+    typedef const FunctionPointerWithContext<ContextType> *cpFunctionPointerWithContext_t;
+    typedef void (*pvoidfcontext_t)(ContextType context);
+
+    FunctionPointerWithContext(void (*function)(ContextType context) = NULL) :
+        _object(NULL), _caller(NULL), _next(NULL) {
+        attach(function);
+    }
+
+    template <typename T>
+    FunctionPointerWithContext(T *object, void (T::*member)(ContextType context)) :
+        _object(NULL), _caller(NULL), _next(NULL) {
+        attach(object, member);
+    }
+
+    void attach(void (*function)(ContextType context) = NULL) {
+        _function = function;
+        _object   = NULL;
+        _caller   = (function != NULL) ? &FunctionPointerWithContext::functioncaller : NULL;
+    }
+
+    template <typename T>
+    void attach(T *object, void (T::*member)(ContextType context)) {
+        typedef void (T::*Member_t)(ContextType);
+        typedef char MemberFits[(sizeof(Member_t) <= sizeof(_member)) ? 1 : -1];
+        (void) sizeof(MemberFits);
+
+        _function = NULL;
+        _object   = object;
+        memcpy(_member, reinterpret_cast<const char *>(&member), sizeof(member));
+        _caller   = &FunctionPointerWithContext::template membercaller<T>;
+    }
+
+    void call(ContextType context) const {
+        if (_caller != NULL) {
+            _caller(this, context);
+        }
+    }
+
+    void operator()(ContextType context) const {
+        call(context);
+    }
+
+    typedef void (FunctionPointerWithContext::*bool_type)() const;
+    operator bool_type() const {
+        return (_caller != NULL) ? &FunctionPointerWithContext::trueValue : 0;
+    }
+
+    void chainAsNext(pFunctionPointerWithContext_t next) {
+        _next = next;
+    }
+
+    pFunctionPointerWithContext_t getNext(void) const {
+        return _next;
+    }
+
+    pvoidfcontext_t get_function() const {
+        return _function;
+    }
+
+    friend bool operator==(const FunctionPointerWithContext &lhs, const FunctionPointerWithContext &rhs) {
+        return (lhs._caller == rhs._caller) &&
+               (lhs._function == rhs._function) &&
+               (lhs._object == rhs._object) &&
+               ((lhs._object == NULL) || (memcmp(lhs._member, rhs._member, sizeof(lhs._member)) == 0));
+    }
+
+private:
+    class UndefinedClass;
+    typedef void (UndefinedClass::*GenericMember_t)(ContextType);
+
+    template <typename T>
+    static void membercaller(cpFunctionPointerWithContext_t self, ContextType context) {
+        void (T::*member)(ContextType);
+        memcpy(reinterpret_cast<char *>(&member), self->_member, sizeof(member));
+        (static_cast<T *>(self->_object)->*member)(context);
+    }
+
+    static void functioncaller(cpFunctionPointerWithContext_t self, ContextType context) {
+        self->_function(context);
+    }
+
+    void trueValue() const {}
+
+    pvoidfcontext_t  _function;
+    void            *_object;
+    char             _member[sizeof(GenericMember_t) * 2];
+    void           (*_caller)(cpFunctionPointerWithContext_t, ContextType);
+    pFunctionPointerWithContext_t _next;
+};
+
+template <typename ContextType>
+FunctionPointerWithContext<ContextType> makeFunctionPointer(void (*function)(ContextType context)) {
+    return FunctionPointerWithContext<ContextType>(function);
+}
+
+template <typename T, typename ContextType>
+FunctionPointerWithContext<ContextType> makeFunctionPointer(T *object, void (T::*member)(ContextType context)) {
+    return FunctionPointerWithContext<ContextType>(object, member);
+}
+
+/**
+ * Fixed capacity chain: the BLE API allocates the links from the heap, which
+ * makes no difference to the port.
+ */
+template <typename ContextType>
+class CallChainOfFunctionPointersWithContext {
+public:
+    typedef FunctionPointerWithContext<ContextType> Callback_t;
+
+    static const unsigned MAX_CALLBACKS = 8;
+
+    CallChainOfFunctionPointersWithContext() : count(0) {}
+
+    void add(const Callback_t &callback) {
+        if ((count < MAX_CALLBACKS) && callback) {
+            callbacks[count++] = callback;
+        }
+    }
+
+    void add(void (*function)(ContextType context)) {
+        add(Callback_t(function));
+    }
+
+    template <typename T>
+    void add(T *object, void (T::*member)(ContextType context)) {
+        add(Callback_t(object, member));
+    }
+
+    bool detach(const Callback_t &callback) {
+        for (unsigned i = 0; i < count; i++) {
+            if (callbacks[i] == callback) {
+                for (unsigned j = i + 1; j < count; j++) {
+                    callbacks[j - 1] = callbacks[j];
+                }
+                count--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear(void) {
+        count = 0;
+    }
+
+    bool hasCallbacksAttached(void) const {
+        return count != 0;
+    }
+
+    void call(ContextType context) const {
+        for (unsigned i = 0; i < count; i++) {
+            callbacks[i].call(context);
+        }
+    }
+
+    void operator()(ContextType context) const {
+        call(context);
+    }
+
+private:
+    Callback_t callbacks[MAX_CALLBACKS];
+    unsigned   count;
+};
+
+/*
+ * UUID.h
+ */
+class UUID {
+public:
+    enum UUID_Type_t {
+        UUID_TYPE_SHORT = 0,
+        UUID_TYPE_LONG  = 1
+    };
+
+    typedef enum {
+        MSB, /**< Most significant byte first, as UUIDs are written. */
+        LSB  /**< Least significant byte first, as they go over the air. */
+    } ByteOrder_t;
+
+    typedef uint16_t ShortUUIDBytes_t;
+
+    static const unsigned LENGTH_OF_LONG_UUID = 16;
+    typedef uint8_t LongUUIDBytes_t[LENGTH_OF_LONG_UUID];
+
+    UUID(const LongUUIDBytes_t longUUID, ByteOrder_t order = UUID::MSB) : type(UUID_TYPE_LONG), baseUUID(), shortUUID(0) {
+        setupLong(longUUID, order);
+    }
+
+    UUID(ShortUUIDBytes_t _shortUUID) : type(UUID_TYPE_SHORT), baseUUID(), shortUUID(_shortUUID) {
+    }
+
+    UUID(void) : type(UUID_TYPE_SHORT), baseUUID(), shortUUID(BLE_UUID_UNKNOWN) {
+    }
+
+    void setupLong(const LongUUIDBytes_t longUUID, ByteOrder_t order = UUID::MSB) {
+        type = UUID_TYPE_LONG;
+        if (order == UUID::MSB) {
+            /* The internal representation is LSB first. */
+            for (unsigned i = 0; i < LENGTH_OF_LONG_UUID; i++) {
+                baseUUID[i] = longUUID[LENGTH_OF_LONG_UUID - 1 - i];
+            }
+        } else {
+            memcpy(baseUUID, longUUID, LENGTH_OF_LONG_UUID);
+        }
+        shortUUID = (uint16_t)((baseUUID[13] << 8) | (baseUUID[12]));
+    }
+
+    UUID_Type_t shortOrLong(void) const {
+        return type;
+    }
+
+    /**
+     * @return the 16 bytes of a long UUID, LSB first, or the 2 bytes of a short one.
+     */
+    const uint8_t *getBaseUUID(void) const {
+        if (type == UUID_TYPE_SHORT) {
+            return reinterpret_cast<const uint8_t *>(&shortUUID);
+        }
+        return baseUUID;
+    }
+
+    ShortUUIDBytes_t getShortUUID(void) const {
+        return shortUUID;
+    }
+
+    uint8_t getLen(void) const {
+        return (type == UUID_TYPE_SHORT) ? sizeof(ShortUUIDBytes_t) : LENGTH_OF_LONG_UUID;
+    }
+
+    bool operator==(const UUID &other) const {
+        if ((type == UUID_TYPE_SHORT) && (other.type == UUID_TYPE_SHORT)) {
+            return shortUUID == other.shortUUID;
+        }
+        if ((type == UUID_TYPE_LONG) && (other.type == UUID_TYPE_LONG)) {
+            return memcmp(baseUUID, other.baseUUID, LENGTH_OF_LONG_UUID) == 0;
+        }
+        return false;
+    }
+
+    bool operator!=(const UUID &other) const {
+        return !(*this == other);
+    }
+
+private:
+    UUID_Type_t      type;
+    LongUUIDBytes_t  baseUUID;
+    ShortUUIDBytes_t shortUUID;
+};
+
+/*
+ * GapAdvertisingData.h, GapAdvertisingParams.h and GapScanningParams.h
+ */
+class GapAdvertisingData {
+public:
+    enum Appearance {
+        UNKNOWN     = 0,
+        GENERIC_TAG = 512,
+    };
+
+    GapAdvertisingData(void) : _payload(), _payloadLen(0), _appearance(GENERIC_TAG) {}
+
+    const uint8_t *getPayload(void) const {
+        return _payload;
+    }
+
+    uint8_t getPayloadLen(void) const {
+        return _payloadLen;
+    }
+
+    uint16_t getAppearance(void) const {
+        return (uint16_t) _appearance;
+    }
+
+private:
+    uint8_t    _payload[31];
+    uint8_t    _payloadLen;
+    Appearance _appearance;
+};
+
+#define GAP_ADVERTISING_DATA_MAX_PAYLOAD (31)
+
+class GapAdvertisingParams {
+public:
+    static const unsigned GAP_ADV_PARAMS_INTERVAL_MIN        = 0x0020;
+    static const unsigned GAP_ADV_PARAMS_INTERVAL_MIN_NONCON = 0x00A0;
+    static const unsigned GAP_ADV_PARAMS_INTERVAL_MAX        = 0x4000;
+    static const unsigned GAP_ADV_PARAMS_TIMEOUT_MAX         = 0x3FFF;
+
+    enum AdvertisingType_t {
+        ADV_CONNECTABLE_UNDIRECTED,
+        ADV_CONNECTABLE_DIRECTED,
+        ADV_SCANNABLE_UNDIRECTED,
+        ADV_NON_CONNECTABLE_UNDIRECTED
+    };
+    typedef enum AdvertisingType_t AdvertisingType;
+
+    GapAdvertisingParams(AdvertisingType_t advType = ADV_CONNECTABLE_UNDIRECTED, uint16_t interval = GAP_ADV_PARAMS_INTERVAL_MIN_NONCON, uint16_t timeout = 0) :
+        _advType(advType), _interval(interval), _timeout(timeout) {}
+
+    static uint16_t MSEC_TO_ADVERTISEMENT_DURATION_UNITS(uint32_t durationInMillis) {
+        return (durationInMillis * 1000) / 625;
+    }
+
+    static uint16_t ADVERTISEMENT_DURATION_UNITS_TO_MS(uint16_t gapUnits) {
+        return (gapUnits * 625) / 1000;
+    }
+
+    AdvertisingType_t getAdvertisingType(void) const {
+        return _advType;
+    }
+
+    uint16_t getInterval(void) const {
+        return ADVERTISEMENT_DURATION_UNITS_TO_MS(_interval);
+    }
+
+    uint16_t getIntervalInADVUnits(void) const {
+        return _interval;
+    }
+
+    uint16_t getTimeout(void) const {
+        return _timeout;
+    }
+
+private:
+    AdvertisingType_t _advType;
+    uint16_t          _interval;
+    uint16_t          _timeout;
+};
+
+class GapScanningParams {
+public:
+    GapScanningParams(uint16_t interval = 0x0100, uint16_t window = 0x0100, uint16_t timeout = 0, bool activeScanning = false) :
+        _interval(interval), _window(window), _timeout(timeout), _activeScanning(activeScanning) {}
+
+    uint16_t getInterval(void) const {
+        return _interval;
+    }
+
+    uint16_t getWindow(void) const {
+        return _window;
+    }
+
+    uint16_t getTimeout(void) const {
+        return _timeout;
+    }
+
+    bool getActiveScanning(void) const {
+        return _activeScanning;
+    }
+
+private:
+    uint16_t _interval;
+    uint16_t _window;
+    uint16_t _timeout;
+    bool     _activeScanning;
+};
+
+/*
+ * Gap.h
+ */
+class Gap {
+public:
+    typedef BLEProtocol::AddressType_t AddressType_t;
+    typedef BLEProtocol::AddressType_t addr_type_t;
+
+    static const unsigned ADDR_LEN = BLEProtocol::ADDR_LEN;
+    typedef BLEProtocol::AddressBytes_t Address_t;
+    typedef BLEProtocol::AddressBytes_t address_t;
+
+    enum TimeoutSource_t {
+        TIMEOUT_SRC_ADVERTISING      = 0x00,
+        TIMEOUT_SRC_SECURITY_REQUEST = 0x01,
+        TIMEOUT_SRC_SCAN             = 0x02,
+        TIMEOUT_SRC_CONN             = 0x03,
+    };
+
+    enum DisconnectionReason_t {
+        CONNECTION_TIMEOUT                          = 0x08,
+        REMOTE_USER_TERMINATED_CONNECTION           = 0x13,
+        REMOTE_DEV_TERMINATION_DUE_TO_LOW_RESOURCES = 0x14,
+        REMOTE_DEV_TERMINATION_DUE_TO_POWER_OFF     = 0x15,
+        LOCAL_HOST_TERMINATED_CONNECTION            = 0x16,
+        CONN_INTERVAL_UNACCEPTABLE                  = 0x3B,
+    };
+
+    enum AdvertisingPolicyMode_t {
+        ADV_POLICY_IGNORE_WHITELIST = 0,
+        ADV_POLICY_FILTER_SCAN_REQS = 1,
+        ADV_POLICY_FILTER_CONN_REQS = 2,
+        ADV_POLICY_FILTER_ALL_REQS  = 3,
+    };
+
+    enum ScanningPolicyMode_t {
+        SCAN_POLICY_IGNORE_WHITELIST = 0,
+        SCAN_POLICY_FILTER_ALL_ADV   = 1,
+    };
+
+    enum InitiatorPolicyMode_t {
+        INIT_POLICY_IGNORE_WHITELIST = 0,
+        INIT_POLICY_FILTER_ALL_ADV   = 1,
+    };
+
+    struct Whitelist_t {
+        BLEProtocol::Address_t *addresses;
+        uint8_t                 size;
+        uint8_t                 capacity;
+    };
+
+    struct GapState_t {
+        unsigned advertising : 1;
+        unsigned connected   : 1;
+    };
+
+    typedef uint16_t Handle_t;
+
+    typedef struct {
+        uint16_t minConnectionInterval;
+        uint16_t maxConnectionInterval;
+        uint16_t slaveLatency;
+        uint16_t connectionSupervisionTimeout;
+    } ConnectionParams_t;
+
+    enum Role_t {
+        PERIPHERAL = 0x1,
+        CENTRAL    = 0x2,
+    };
+
+    struct AdvertisementCallbackParams_t {
+        BLEProtocol::AddressBytes_t                peerAddr;
+        int8_t                                     rssi;
+        bool                                       isScanResponse;
+        GapAdvertisingParams::AdvertisingType_t    type;
+        uint8_t                                    advertisingDataLen;
+        const uint8_t                             *advertisingData;
+    };
+    typedef FunctionPointerWithContext<const AdvertisementCallbackParams_t *> AdvertisementReportCallback_t;
+
+    struct ConnectionCallbackParams_t {
+        Handle_t                    handle;
+        Role_t                      role;
+        BLEProtocol::AddressType_t  peerAddrType;
+        BLEProtocol::AddressBytes_t peerAddr;
+        BLEProtocol::AddressType_t  ownAddrType;
+        BLEProtocol::AddressBytes_t ownAddr;
+        const ConnectionParams_t   *connectionParams;
+    };
+
+    struct DisconnectionCallbackParams_t {
+        Handle_t              handle;
+        DisconnectionReason_t reason;
+    };
+
+    static const uint16_t UNIT_1_25_MS  = 1250;
+    static const uint16_t UNIT_0_625_MS = 625;
+    static uint16_t MSEC_TO_GAP_DURATION_UNITS(uint32_t durationInMillis) {
+        return (durationInMillis * 1000) / UNIT_1_25_MS;
+    }
+
+    typedef FunctionPointerWithContext<TimeoutSource_t> TimeoutEventCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<TimeoutSource_t> TimeoutEventCallbackChain_t;
+
+    typedef FunctionPointerWithContext<const ConnectionCallbackParams_t *> ConnectionEventCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<const ConnectionCallbackParams_t *> ConnectionEventCallbackChain_t;
+
+    typedef FunctionPointerWithContext<const DisconnectionCallbackParams_t *> DisconnectionEventCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<const DisconnectionCallbackParams_t *> DisconnectionEventCallbackChain_t;
+
+    typedef FunctionPointerWithContext<bool> RadioNotificationEventCallback_t;
+
+public:
+    virtual ble_error_t setAddress(AddressType_t type, const Address_t address) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t getAddress(AddressType_t *typeP, Address_t address) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual uint16_t getMinAdvertisingInterval(void) const { return 0; }
+    virtual uint16_t getMinNonConnectableAdvertisingInterval(void) const { return 0; }
+    virtual uint16_t getMaxAdvertisingInterval(void) const { return 0xFFFF; }
+    virtual ble_error_t stopAdvertising(void) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t stopScan() { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t connect(const BLEProtocol::AddressBytes_t peerAddr, BLEProtocol::AddressType_t peerAddrType, const ConnectionParams_t *connectionParams, const GapScanningParams *scanParams) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t disconnect(Handle_t connectionHandle, DisconnectionReason_t reason) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t disconnect(DisconnectionReason_t reason) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t getPreferredConnectionParams(ConnectionParams_t *params) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setPreferredConnectionParams(const ConnectionParams_t *params) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t updateConnectionParams(Handle_t handle, const ConnectionParams_t *params) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setDeviceName(const uint8_t *deviceName) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t getDeviceName(uint8_t *deviceName, unsigned *lengthP) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setAppearance(GapAdvertisingData::Appearance appearance) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t getAppearance(GapAdvertisingData::Appearance *appearanceP) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setTxPower(int8_t txPower) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual void getPermittedTxPowerValues(const int8_t **valueArrayPP, size_t *countP) { *countP = 0; }
+    virtual uint8_t getMaxWhitelistSize(void) const { return 0; }
+    virtual ble_error_t getWhitelist(Whitelist_t &whitelist) const { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setWhitelist(const Whitelist_t &whitelist) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setAdvertisingPolicyMode(AdvertisingPolicyMode_t mode) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setScanningPolicyMode(ScanningPolicyMode_t mode) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setInitiatorPolicyMode(InitiatorPolicyMode_t mode) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual AdvertisingPolicyMode_t getAdvertisingPolicyMode(void) const { return ADV_POLICY_IGNORE_WHITELIST; }
+    virtual ScanningPolicyMode_t getScanningPolicyMode(void) const { return SCAN_POLICY_IGNORE_WHITELIST; }
+    virtual InitiatorPolicyMode_t getInitiatorPolicyMode(void) const { return INIT_POLICY_IGNORE_WHITELIST; }
+    virtual ble_error_t initRadioNotification(void) { return BLE_ERROR_NOT_IMPLEMENTED; }
+
+    GapState_t getState(void) const {
+        return state;
+    }
+
+    void onTimeout(TimeoutEventCallback_t callback) {
+        timeoutCallbackChain.add(callback);
+    }
+
+    void onConnection(ConnectionEventCallback_t callback) {
+        connectionCallChain.add(callback);
+    }
+
+    template <typename T>
+    void onConnection(T *tptr, void (T::*mptr)(const ConnectionCallbackParams_t *)) {
+        connectionCallChain.add(tptr, mptr);
+    }
+
+    void onDisconnection(DisconnectionEventCallback_t callback) {
+        disconnectionCallChain.add(callback);
+    }
+
+    template <typename T>
+    void onDisconnection(T *tptr, void (T::*mptr)(const DisconnectionCallbackParams_t *)) {
+        disconnectionCallChain.add(tptr, mptr);
+    }
+
+    void onRadioNotification(void (*callback)(bool param)) {
+        radioNotificationCallback.attach(callback);
+        initRadioNotification();
+    }
+
+    virtual ble_error_t reset(void) {
+        state.advertising = 0;
+        state.connected   = 0;
+        timeoutCallbackChain.clear();
+        connectionCallChain.clear();
+        disconnectionCallChain.clear();
+        radioNotificationCallback = NULL;
+        onAdvertisementReport     = NULL;
+        return BLE_ERROR_NONE;
+    }
+
+protected:
+    Gap() : _scanningParams(), state(), timeoutCallbackChain(), radioNotificationCallback(), onAdvertisementReport(),
+            connectionCallChain(), disconnectionCallChain() {
+        state.advertising = 0;
+        state.connected   = 0;
+    }
+
+    virtual ~Gap() {}
+
+public:
+    void processConnectionEvent(Handle_t                           handle,
+                                Role_t                             role,
+                                BLEProtocol::AddressType_t         peerAddrType,
+                                const BLEProtocol::AddressBytes_t  peerAddr,
+                                BLEProtocol::AddressType_t         ownAddrType,
+                                const BLEProtocol::AddressBytes_t  ownAddr,
+                                const ConnectionParams_t          *connectionParams) {
+        state.advertising = 0;
+        state.connected   = 1;
+
+        ConnectionCallbackParams_t callbackParams;
+        callbackParams.handle       = handle;
+        callbackParams.role         = role;
+        callbackParams.peerAddrType = peerAddrType;
+        memcpy(callbackParams.peerAddr, peerAddr, ADDR_LEN);
+        callbackParams.ownAddrType  = ownAddrType;
+        memcpy(callbackParams.ownAddr, ownAddr, ADDR_LEN);
+        callbackParams.connectionParams = connectionParams;
+        connectionCallChain.call(&callbackParams);
+    }
+
+    void processDisconnectionEvent(Handle_t handle, DisconnectionReason_t reason) {
+        state.connected = 0;
+
+        DisconnectionCallbackParams_t callbackParams = { handle, reason };
+        disconnectionCallChain.call(&callbackParams);
+    }
+
+    void processAdvertisementReport(const BLEProtocol::AddressBytes_t        peerAddr,
+                                    int8_t                                   rssi,
+                                    bool                                     isScanResponse,
+                                    GapAdvertisingParams::AdvertisingType_t  type,
+                                    uint8_t                                  advertisingDataLen,
+                                    const uint8_t                           *advertisingData) {
+        AdvertisementCallbackParams_t params;
+        memcpy(params.peerAddr, peerAddr, ADDR_LEN);
+        params.rssi               = rssi;
+        params.isScanResponse     = isScanResponse;
+        params.type               = type;
+        params.advertisingDataLen = advertisingDataLen;
+        params.advertisingData    = advertisingData;
+        onAdvertisementReport.call(&params);
+    }
+
+    void processTimeoutEvent(TimeoutSource_t source) {
+        if (source == TIMEOUT_SRC_ADVERTISING) {
+            state.advertising = 0;
+        }
+        timeoutCallbackChain.call(source);
+    }
+
+protected:
+    GapScanningParams                 _scanningParams;
+    GapState_t                        state;
+    TimeoutEventCallbackChain_t       timeoutCallbackChain;
+    RadioNotificationEventCallback_t  radioNotificationCallback;
+    AdvertisementReportCallback_t     onAdvertisementReport;
+    ConnectionEventCallbackChain_t    connectionCallChain;
+    DisconnectionEventCallbackChain_t disconnectionCallChain;
+
+private:
+    Gap(const Gap &);
+    Gap& operator=(const Gap &);
+};
+
+/*
+ * SecurityManager.h
+ */
+class SecurityManager {
+public:
+    enum SecurityMode_t {
+        SECURITY_MODE_NO_ACCESS,
+        SECURITY_MODE_ENCRYPTION_OPEN_LINK,
+        SECURITY_MODE_ENCRYPTION_NO_MITM,
+        SECURITY_MODE_ENCRYPTION_WITH_MITM,
+        SECURITY_MODE_SIGNED_NO_MITM,
+        SECURITY_MODE_SIGNED_WITH_MITM,
+    };
+
+    enum LinkSecurityStatus_t {
+        NOT_ENCRYPTED,
+        ENCRYPTION_IN_PROGRESS,
+        ENCRYPTED,
+    };
+
+    enum SecurityIOCapabilities_t {
+        IO_CAPS_DISPLAY_ONLY     = 0x00,
+        IO_CAPS_DISPLAY_YESNO    = 0x01,
+        IO_CAPS_KEYBOARD_ONLY    = 0x02,
+        IO_CAPS_NONE             = 0x03,
+        IO_CAPS_KEYBOARD_DISPLAY = 0x04,
+    };
+
+    enum SecurityCompletionStatus_t {
+        SEC_STATUS_SUCCESS = 0x00,
+        SEC_STATUS_TIMEOUT = 0x01,
+        SEC_STATUS_PDU_INVALID = 0x02,
+        SEC_STATUS_UNSPECIFIED = 0x88,
+    };
+
+    static const unsigned PASSKEY_LEN = 6;
+    typedef uint8_t Passkey_t[PASSKEY_LEN];
+
+    typedef FunctionPointerWithContext<Gap::Handle_t> HandleSpecificEvent_t;
+
+public:
+    virtual ble_error_t init(bool enableBonding = true, bool requireMITM = true, SecurityIOCapabilities_t iocaps = IO_CAPS_NONE, const Passkey_t passkey = NULL) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t getLinkSecurity(Gap::Handle_t connectionHandle, LinkSecurityStatus_t *securityStatusP) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t setLinkSecurity(Gap::Handle_t connectionHandle, SecurityMode_t securityMode) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t purgeAllBondingState(void) { return BLE_ERROR_NOT_IMPLEMENTED; }
+    virtual ble_error_t getAddressesFromBondTable(Gap::Whitelist_t &addresses) const { return BLE_ERROR_NOT_IMPLEMENTED; }
+
+    void onSecurityContextStored(HandleSpecificEvent_t callback) {
+        securityContextStoredCallback = callback;
+    }
+
+    void processSecuritySetupInitiatedEvent(Gap::Handle_t handle, bool allowBonding, bool requireMITM, SecurityIOCapabilities_t iocaps) {}
+    void processSecuritySetupCompletedEvent(Gap::Handle_t handle, SecurityCompletionStatus_t status) {}
+    void processLinkSecuredEvent(Gap::Handle_t handle, SecurityMode_t securityMode) {}
+
+    void processSecurityContextStoredEvent(Gap::Handle_t handle) {
+        securityContextStoredCallback.call(handle);
+    }
+
+    void processPasskeyDisplayEvent(Gap::Handle_t handle, const Passkey_t passkey) {}
+
+    virtual ble_error_t reset(void) {
+        securityContextStoredCallback = NULL;
+        return BLE_ERROR_NONE;
+    }
+
+protected:
+    SecurityManager() : securityContextStoredCallback() {}
+    virtual ~SecurityManager() {}
+
+private:
+    HandleSpecificEvent_t securityContextStoredCallback;
+};
+
+/*
+ * GattCallbackParamTypes.h
+ */
+enum GattAuthCallbackReply_t {
+    AUTH_CALLBACK_REPLY_SUCCESS                       = 0x00,
+    AUTH_CALLBACK_REPLY_ATTERR_INVALID_HANDLE         = 0x0101,
+    AUTH_CALLBACK_REPLY_ATTERR_READ_NOT_PERMITTED     = 0x0102,
+    AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED    = 0x0103,
+    AUTH_CALLBACK_REPLY_ATTERR_INVALID_OFFSET         = 0x0107,
+    AUTH_CALLBACK_REPLY_ATTERR_INSUF_AUTHORIZATION    = 0x0108,
+    AUTH_CALLBACK_REPLY_ATTERR_ATTRIBUTE_NOT_LONG     = 0x010B,
+    AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH = 0x010D,
+    AUTH_CALLBACK_REPLY_ATTERR_UNLIKELY_ERROR         = 0x010E,
+    AUTH_CALLBACK_REPLY_ATTERR_INSUF_RESOURCES        = 0x0111,
+};
+
+struct GattWriteCallbackParams {
+    enum WriteOp_t {
+        OP_INVALID               = 0x00,
+        OP_WRITE_REQ             = 0x01,
+        OP_WRITE_CMD             = 0x02,
+        OP_SIGN_WRITE_CMD        = 0x03,
+        OP_PREP_WRITE_REQ        = 0x04,
+        OP_EXEC_WRITE_REQ_CANCEL = 0x05,
+        OP_EXEC_WRITE_REQ_NOW    = 0x06,
+    };
+
+    Gap::Handle_t            connHandle;
+    uint16_t                 handle;
+    WriteOp_t                writeOp;
+    uint16_t                 offset;
+    uint16_t                 len;
+    const uint8_t           *data;
+};
+
+struct GattReadCallbackParams {
+    Gap::Handle_t  connHandle;
+    uint16_t       handle;
+    uint16_t       offset;
+    uint16_t       len;
+    const uint8_t *data;
+};
+
+struct GattWriteAuthCallbackParams {
+    Gap::Handle_t            connHandle;
+    uint16_t                 handle;
+    uint16_t                 offset;
+    uint16_t                 len;
+    const uint8_t           *data;
+    GattAuthCallbackReply_t  authorizationReply;
+};
+
+struct GattReadAuthCallbackParams {
+    Gap::Handle_t            connHandle;
+    uint16_t                 handle;
+    uint16_t                 offset;
+    uint16_t                 len;
+    uint8_t                 *data;
+    GattAuthCallbackReply_t  authorizationReply;
+};
+
+struct GattHVXCallbackParams {
+    Gap::Handle_t  connHandle;
+    uint16_t       handle;
+    HVXType_t      type;
+    uint16_t       len;
+    const uint8_t *data;
+};
+
+/*
+ * GattAttribute.h
+ */
+class GattAttribute {
+public:
+    typedef uint16_t Handle_t;
+    static const Handle_t INVALID_HANDLE = 0x0000;
+
+public:
+    GattAttribute(const UUID &uuid, uint8_t *valuePtr = NULL, uint16_t len = 0, uint16_t maxLen = 0, bool hasVariableLen = true) :
+        _uuid(uuid), _valuePtr(valuePtr), _lenMax(maxLen), _len(len), _hasVariableLen(hasVariableLen), _handle() {
+    }
+
+    Handle_t getHandle(void) const {
+        return _handle;
+    }
+
+    const UUID &getUUID(void) const {
+        return _uuid;
+    }
+
+    uint16_t getLength(void) const {
+        return _len;
+    }
+
+    uint16_t getMaxLength(void) const {
+        return _lenMax;
+    }
+
+    uint16_t *getLengthPtr(void) {
+        return &_len;
+    }
+
+    void setHandle(Handle_t id) {
+        _handle = id;
+    }
+
+    uint8_t *getValuePtr(void) {
+        return _valuePtr;
+    }
+
+    bool hasVariableLength(void) const {
+        return _hasVariableLen;
+    }
+
+private:
+    UUID      _uuid;
+    uint8_t  *_valuePtr;
+    uint16_t  _lenMax;
+    uint16_t  _len;
+    bool      _hasVariableLen;
+    Handle_t  _handle;
+
+private:
+    GattAttribute(const GattAttribute &);
+    GattAttribute& operator=(const GattAttribute &);
+};
+
+/*
+ * GattCharacteristic.h
+ */
+class GattCharacteristic {
+public:
+    enum {
+        BLE_GATT_CHAR_PROPERTIES_NONE                        = 0x00,
+        BLE_GATT_CHAR_PROPERTIES_BROADCAST                   = 0x01,
+        BLE_GATT_CHAR_PROPERTIES_READ                        = 0x02,
+        BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE      = 0x04,
+        BLE_GATT_CHAR_PROPERTIES_WRITE                       = 0x08,
+        BLE_GATT_CHAR_PROPERTIES_NOTIFY                      = 0x10,
+        BLE_GATT_CHAR_PROPERTIES_INDICATE                    = 0x20,
+        BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES = 0x40,
+        BLE_GATT_CHAR_PROPERTIES_EXTENDED_PROPERTIES         = 0x80
+    };
+
+public:
+    GattCharacteristic(const UUID    &uuid,
+                       uint8_t       *valuePtr       = NULL,
+                       uint16_t       len            = 0,
+                       uint16_t       maxLen         = 0,
+                       uint8_t        props          = BLE_GATT_CHAR_PROPERTIES_NONE,
+                       GattAttribute *descriptors[]  = NULL,
+                       unsigned       numDescriptors = 0,
+                       bool           hasVariableLen = true) :
+        _valueAttribute(uuid, valuePtr, len, maxLen, hasVariableLen),
+        _properties(props),
+        _requiredSecurity(SecurityManager::SECURITY_MODE_ENCRYPTION_OPEN_LINK),
+        _descriptors(descriptors),
+        _descriptorCount(numDescriptors),
+        enabledReadAuthorization(false),
+        enabledWriteAuthorization(false),
+        readAuthorizationCallback(),
+        writeAuthorizationCallback() {
+    }
+
+public:
+    void requireSecurity(SecurityManager::SecurityMode_t securityMode) {
+        _requiredSecurity = securityMode;
+    }
+
+    void setWriteAuthorizationCallback(void (*callback)(GattWriteAuthCallbackParams *)) {
+        writeAuthorizationCallback.attach(callback);
+        enabledWriteAuthorization = true;
+    }
+
+    void setReadAuthorizationCallback(void (*callback)(GattReadAuthCallbackParams *)) {
+        readAuthorizationCallback.attach(callback);
+        enabledReadAuthorization = true;
+    }
+
+    GattAuthCallbackReply_t authorizeWrite(GattWriteAuthCallbackParams *params) {
+        if (!isWriteAuthorizationEnabled()) {
+            return AUTH_CALLBACK_REPLY_SUCCESS;
+        }
+
+        params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+        writeAuthorizationCallback.call(params);
+        return params->authorizationReply;
+    }
+
+    GattAuthCallbackReply_t authorizeRead(GattReadAuthCallbackParams *params) {
+        if (!isReadAuthorizationEnabled()) {
+            return AUTH_CALLBACK_REPLY_SUCCESS;
+        }
+
+        params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+        readAuthorizationCallback.call(params);
+        return params->authorizationReply;
+    }
+
+    GattAttribute &getValueAttribute() {
+        return _valueAttribute;
+    }
+
+    const GattAttribute &getValueAttribute() const {
+        return _valueAttribute;
+    }
+
+    GattAttribute::Handle_t getValueHandle(void) const {
+        return getValueAttribute().getHandle();
+    }
+
+    uint8_t getProperties(void) const {
+        return _properties;
+    }
+
+    SecurityManager::SecurityMode_t getRequiredSecurity() const {
+        return _requiredSecurity;
+    }
+
+    uint8_t getDescriptorCount(void) const {
+        return _descriptorCount;
+    }
+
+    bool isReadAuthorizationEnabled() const {
+        return enabledReadAuthorization;
+    }
+
+    bool isWriteAuthorizationEnabled() const {
+        return enabledWriteAuthorization;
+    }
+
+    GattAttribute *getDescriptor(uint8_t index) {
+        if (index >= _descriptorCount) {
+            return NULL;
+        }
+        return _descriptors[index];
+    }
+
+private:
+    GattAttribute                                       _valueAttribute;
+    uint8_t                                             _properties;
+    SecurityManager::SecurityMode_t                     _requiredSecurity;
+    GattAttribute                                     **_descriptors;
+    uint8_t                                             _descriptorCount;
+    bool                                                enabledReadAuthorization;
+    bool                                                enabledWriteAuthorization;
+    FunctionPointerWithContext<GattReadAuthCallbackParams *>  readAuthorizationCallback;
+    FunctionPointerWithContext<GattWriteAuthCallbackParams *> writeAuthorizationCallback;
+
+private:
+    GattCharacteristic(const GattCharacteristic &);
+    GattCharacteristic& operator=(const GattCharacteristic &);
+};
+
+/*
+ * GattService.h
+ */
+class GattService {
+public:
+    GattService(const UUID &uuid, GattCharacteristic *characteristics[], unsigned numCharacteristics) :
+        _primaryServiceID(uuid),
+        _characteristicCount(numCharacteristics),
+        _characteristics(characteristics),
+        _handle(0) {
+    }
+
+    const UUID &getUUID(void) const {
+        return _primaryServiceID;
+    }
+
+    uint16_t getHandle(void) const {
+        return _handle;
+    }
+
+    uint8_t getCharacteristicCount(void) const {
+        return _characteristicCount;
+    }
+
+    void setHandle(uint16_t handle) {
+        _handle = handle;
+    }
+
+    GattCharacteristic *getCharacteristic(uint8_t index) {
+        if (index >= _characteristicCount) {
+            return NULL;
+        }
+        return _characteristics[index];
+    }
+
+private:
+    UUID                 _primaryServiceID;
+    uint8_t              _characteristicCount;
+    GattCharacteristic **_characteristics;
+    uint16_t             _handle;
+};
+
+/*
+ * GattServerEvents.h and GattServer.h
+ */
+class GattServerEvents {
+public:
+    typedef enum gattEvent_e {
+        GATT_EVENT_DATA_SENT               = 1,
+        GATT_EVENT_DATA_WRITTEN            = 2,
+        GATT_EVENT_UPDATES_ENABLED         = 3,
+        GATT_EVENT_UPDATES_DISABLED        = 4,
+        GATT_EVENT_CONFIRMATION_RECEIVED   = 5,
+        GATT_EVENT_READ_AUTHORIZATION_REQ  = 6,
+        GATT_EVENT_WRITE_AUTHORIZATION_REQ = 7,
+    } gattEvent_t;
+};
+
+class GattServer {
+public:
+    typedef FunctionPointerWithContext<unsigned> DataSentCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<unsigned> DataSentCallbackChain_t;
+
+    typedef FunctionPointerWithContext<const GattWriteCallbackParams *> DataWrittenCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<const GattWriteCallbackParams *> DataWrittenCallbackChain_t;
+
+    typedef FunctionPointerWithContext<const GattReadCallbackParams *> DataReadCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<const GattReadCallbackParams *> DataReadCallbackChain_t;
+
+    typedef FunctionPointerWithContext<GattAttribute::Handle_t> EventCallback_t;
+
+protected:
+    GattServer() :
+        serviceCount(0),
+        characteristicCount(0),
+        dataSentCallChain(),
+        dataWrittenCallChain(),
+        dataReadCallChain(),
+        updatesEnabledCallback(NULL),
+        updatesDisabledCallback(NULL),
+        confirmationReceivedCallback(NULL) {
+    }
+
+public:
+    virtual ~GattServer() {}
+
+    virtual ble_error_t addService(GattService &service) = 0;
+    virtual ble_error_t read(GattAttribute::Handle_t attributeHandle, uint8_t buffer[], uint16_t *lengthP) = 0;
+    virtual ble_error_t read(Gap::Handle_t connectionHandle, GattAttribute::Handle_t attributeHandle, uint8_t *buffer, uint16_t *lengthP) = 0;
+    virtual ble_error_t write(GattAttribute::Handle_t attributeHandle, const uint8_t *value, uint16_t size, bool localOnly = false) = 0;
+    virtual ble_error_t write(Gap::Handle_t connectionHandle, GattAttribute::Handle_t attributeHandle, const uint8_t *value, uint16_t size, bool localOnly = false) = 0;
+    virtual ble_error_t areUpdatesEnabled(const GattCharacteristic &characteristic, bool *enabledP) = 0;
+    virtual ble_error_t areUpdatesEnabled(Gap::Handle_t connectionHandle, const GattCharacteristic &characteristic, bool *enabledP) = 0;
+
+    virtual bool isOnDataReadAvailable() const {
+        return false;
+    }
+
+public:
+    void onDataSent(const DataSentCallback_t &callback) {
+        dataSentCallChain.add(callback);
+    }
+
+    template <typename T>
+    void onDataSent(T *objPtr, void (T::*memberPtr)(unsigned count)) {
+        dataSentCallChain.add(objPtr, memberPtr);
+    }
+
+    void onDataWritten(const DataWrittenCallback_t &callback) {
+        dataWrittenCallChain.add(callback);
+    }
+
+    template <typename T>
+    void onDataWritten(T *objPtr, void (T::*memberPtr)(const GattWriteCallbackParams *context)) {
+        dataWrittenCallChain.add(objPtr, memberPtr);
+    }
+
+    ble_error_t onDataRead(const DataReadCallback_t &callback) {
+        if (!isOnDataReadAvailable()) {
+            return BLE_ERROR_NOT_IMPLEMENTED;
+        }
+
+        dataReadCallChain.add(callback);
+        return BLE_ERROR_NONE;
+    }
+
+    void onUpdatesEnabled(EventCallback_t callback) {
+        updatesEnabledCallback = callback;
+    }
+
+    void onUpdatesDisabled(EventCallback_t callback) {
+        updatesDisabledCallback = callback;
+    }
+
+    void onConfirmationReceived(EventCallback_t callback) {
+        confirmationReceivedCallback = callback;
+    }
+
+protected:
+    void handleDataWrittenEvent(const GattWriteCallbackParams *params) {
+        dataWrittenCallChain.call(params);
+    }
+
+    void handleDataReadEvent(const GattReadCallbackParams *params) {
+        dataReadCallChain.call(params);
+    }
+
+    void handleEvent(GattServerEvents::gattEvent_e type, GattAttribute::Handle_t attributeHandle) {
+        switch (type) {
+            case GattServerEvents::GATT_EVENT_UPDATES_ENABLED:
+                updatesEnabledCallback.call(attributeHandle);
+                break;
+            case GattServerEvents::GATT_EVENT_UPDATES_DISABLED:
+                updatesDisabledCallback.call(attributeHandle);
+                break;
+            case GattServerEvents::GATT_EVENT_CONFIRMATION_RECEIVED:
+                confirmationReceivedCallback.call(attributeHandle);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void handleDataSentEvent(unsigned count) {
+        dataSentCallChain.call(count);
+    }
+
+public:
+    virtual ble_error_t reset(void) {
+        serviceCount        = 0;
+        characteristicCount = 0;
+
+        dataSentCallChain.clear();
+        dataWrittenCallChain.clear();
+        dataReadCallChain.clear();
+        updatesEnabledCallback       = NULL;
+        updatesDisabledCallback      = NULL;
+        confirmationReceivedCallback = NULL;
+
+        return BLE_ERROR_NONE;
+    }
+
+protected:
+    uint8_t serviceCount;
+    uint8_t characteristicCount;
+
+private:
+    DataSentCallbackChain_t    dataSentCallChain;
+    DataWrittenCallbackChain_t dataWrittenCallChain;
+    DataReadCallbackChain_t    dataReadCallChain;
+    EventCallback_t            updatesEnabledCallback;
+    EventCallback_t            updatesDisabledCallback;
+    EventCallback_t            confirmationReceivedCallback;
+
+private:
+    GattServer(const GattServer &);
+    GattServer& operator=(const GattServer &);
+};
+
+/*
+ * DiscoveredService.h, DiscoveredCharacteristic.h and
+ * DiscoveredCharacteristicDescriptor.h
+ */
+class GattClient;
+
+class DiscoveredService {
+public:
+    void setup(UUID uuidIn, GattAttribute::Handle_t startHandleIn, GattAttribute::Handle_t endHandleIn) {
+        uuid        = uuidIn;
+        startHandle = startHandleIn;
+        endHandle   = endHandleIn;
+    }
+
+    void setup(GattAttribute::Handle_t startHandleIn, GattAttribute::Handle_t endHandleIn) {
+        startHandle = startHandleIn;
+        endHandle   = endHandleIn;
+    }
+
+    void setupLongUUID(UUID::LongUUIDBytes_t longUUID, UUID::ByteOrder_t order = UUID::MSB) {
+        uuid.setupLong(longUUID, order);
+    }
+
+    const UUID &getUUID(void) const {
+        return uuid;
+    }
+
+    const GattAttribute::Handle_t &getStartHandle(void) const {
+        return startHandle;
+    }
+
+    const GattAttribute::Handle_t &getEndHandle(void) const {
+        return endHandle;
+    }
+
+public:
+    DiscoveredService() : uuid(UUID::ShortUUIDBytes_t(0)), startHandle(GattAttribute::INVALID_HANDLE), endHandle(GattAttribute::INVALID_HANDLE) {
+    }
+
+private:
+    UUID                    uuid;
+    GattAttribute::Handle_t startHandle;
+    GattAttribute::Handle_t endHandle;
+};
+
+class DiscoveredCharacteristicDescriptor {
+public:
+    DiscoveredCharacteristicDescriptor(GattClient *client, Gap::Handle_t connectionHandle, GattAttribute::Handle_t attributeHandle, const UUID &uuid) :
+        _client(client), _connectionHandle(connectionHandle), _uuid(uuid), _gattHandle(attributeHandle) {
+    }
+
+    GattClient *getGattClient() {
+        return _client;
+    }
+
+    const GattClient *getGattClient() const {
+        return _client;
+    }
+
+    Gap::Handle_t getConnectionHandle() const {
+        return _connectionHandle;
+    }
+
+    const UUID &getUUID(void) const {
+        return _uuid;
+    }
+
+    GattAttribute::Handle_t getAttributeHandle() const {
+        return _gattHandle;
+    }
+
+private:
+    GattClient              *_client;
+    Gap::Handle_t            _connectionHandle;
+    UUID                     _uuid;
+    GattAttribute::Handle_t  _gattHandle;
+};
+
+class DiscoveredCharacteristic;
+
+struct CharacteristicDescriptorDiscovery {
+    struct DiscoveryCallbackParams_t {
+        const DiscoveredCharacteristic           &characteristic;
+        const DiscoveredCharacteristicDescriptor &descriptor;
+    };
+
+    struct TerminationCallbackParams_t {
+        const DiscoveredCharacteristic &characteristic;
+        ble_error_t                     status;
+    };
+
+    typedef FunctionPointerWithContext<const DiscoveryCallbackParams_t *> DiscoveryCallback_t;
+    typedef FunctionPointerWithContext<const TerminationCallbackParams_t *> TerminationCallback_t;
+};
+
+class DiscoveredCharacteristic {
+public:
+    struct Properties_t {
+        uint8_t _broadcast       :1;
+        uint8_t _read            :1;
+        uint8_t _writeWoResp     :1;
+        uint8_t _write           :1;
+        uint8_t _notify          :1;
+        uint8_t _indicate        :1;
+        uint8_t _authSignedWrite :1;
+
+    public:
+        bool broadcast(void)       const { return _broadcast;       }
+        bool read(void)            const { return _read;            }
+        bool writeWoResp(void)     const { return _writeWoResp;     }
+        bool write(void)           const { return _write;           }
+        bool notify(void)          const { return _notify;          }
+        bool indicate(void)        const { return _indicate;        }
+        bool authSignedWrite(void) const { return _authSignedWrite; }
+    };
+
+public:
+    void setupLongUUID(UUID::LongUUIDBytes_t longUUID, UUID::ByteOrder_t order = UUID::MSB) {
+        uuid.setupLong(longUUID, order);
+    }
+
+    const UUID &getUUID(void) const {
+        return uuid;
+    }
+
+    const Properties_t &getProperties(void) const {
+        return props;
+    }
+
+    GattAttribute::Handle_t getDeclHandle(void) const {
+        return declHandle;
+    }
+
+    GattAttribute::Handle_t getValueHandle(void) const {
+        return valueHandle;
+    }
+
+    GattAttribute::Handle_t getLastHandle(void) const {
+        return lastHandle;
+    }
+
+    void setLastHandle(GattAttribute::Handle_t last) {
+        lastHandle = last;
+    }
+
+    GattClient *getGattClient() {
+        return gattc;
+    }
+
+    const GattClient *getGattClient() const {
+        return gattc;
+    }
+
+    Gap::Handle_t getConnectionHandle() const {
+        return connHandle;
+    }
+
+    friend bool operator==(const DiscoveredCharacteristic &lhs, const DiscoveredCharacteristic &rhs) {
+        return (lhs.gattc == rhs.gattc) &&
+               (lhs.uuid == rhs.uuid) &&
+               (lhs.declHandle == rhs.declHandle) &&
+               (lhs.valueHandle == rhs.valueHandle) &&
+               (lhs.lastHandle == rhs.lastHandle) &&
+               (lhs.connHandle == rhs.connHandle);
+    }
+
+    friend bool operator!=(const DiscoveredCharacteristic &lhs, const DiscoveredCharacteristic &rhs) {
+        return !(lhs == rhs);
+    }
+
+public:
+    DiscoveredCharacteristic() :
+        gattc(NULL),
+        uuid(UUID::ShortUUIDBytes_t(0)),
+        props(),
+        declHandle(GattAttribute::INVALID_HANDLE),
+        valueHandle(GattAttribute::INVALID_HANDLE),
+        lastHandle(GattAttribute::INVALID_HANDLE),
+        connHandle() {
+    }
+
+protected:
+    GattClient              *gattc;
+
+protected:
+    UUID                     uuid;
+    Properties_t             props;
+    GattAttribute::Handle_t  declHandle;
+    GattAttribute::Handle_t  valueHandle;
+    GattAttribute::Handle_t  lastHandle;
+
+    Gap::Handle_t            connHandle;
+};
+
+/*
+ * ServiceDiscovery.h
+ */
+class ServiceDiscovery {
+public:
+    typedef FunctionPointerWithContext<const DiscoveredService *> ServiceCallback_t;
+    typedef FunctionPointerWithContext<const DiscoveredCharacteristic *> CharacteristicCallback_t;
+    typedef FunctionPointerWithContext<Gap::Handle_t> TerminationCallback_t;
+
+public:
+    virtual ble_error_t launch(Gap::Handle_t             connectionHandle,
+                               ServiceCallback_t         sc                           = NULL,
+                               CharacteristicCallback_t  cc                           = NULL,
+                               const UUID               &matchingServiceUUID          = UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN),
+                               const UUID               &matchingCharacteristicUUIDIn = UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) = 0;
+    virtual bool isActive(void) const = 0;
+    virtual void terminate(void) = 0;
+    virtual void onTermination(TerminationCallback_t callback) = 0;
+
+    virtual ble_error_t reset(void) {
+        connHandle                 = 0;
+        matchingServiceUUID        = UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN);
+        serviceCallback            = NULL;
+        matchingCharacteristicUUID = UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN);
+        characteristicCallback     = NULL;
+
+        return BLE_ERROR_NONE;
+    }
+
+    virtual ~ServiceDiscovery() {}
+
+protected:
+    Gap::Handle_t            connHandle;
+    UUID                     matchingServiceUUID;
+    ServiceCallback_t        serviceCallback;
+    UUID                     matchingCharacteristicUUID;
+    CharacteristicCallback_t characteristicCallback;
+};
+
+/*
+ * GattClient.h
+ */
+class GattClient {
+public:
+    typedef FunctionPointerWithContext<const GattReadCallbackParams *> ReadCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<const GattReadCallbackParams *> ReadCallbackChain_t;
+
+    enum WriteOp_t {
+        GATT_OP_WRITE_REQ = 0x01,
+        GATT_OP_WRITE_CMD = 0x02,
+    };
+
+    typedef FunctionPointerWithContext<const GattWriteCallbackParams *> WriteCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<const GattWriteCallbackParams *> WriteCallbackChain_t;
+
+    typedef FunctionPointerWithContext<const GattHVXCallbackParams *> HVXCallback_t;
+    typedef CallChainOfFunctionPointersWithContext<const GattHVXCallbackParams *> HVXCallbackChain_t;
+
+public:
+    virtual ble_error_t launchServiceDiscovery(Gap::Handle_t                               connectionHandle,
+                                               ServiceDiscovery::ServiceCallback_t         sc                           = NULL,
+                                               ServiceDiscovery::CharacteristicCallback_t  cc                           = NULL,
+                                               const UUID                                 &matchingServiceUUID          = UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN),
+                                               const UUID                                 &matchingCharacteristicUUIDIn = UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) {
+        return BLE_ERROR_NOT_IMPLEMENTED;
+    }
+
+    virtual void onServiceDiscoveryTermination(ServiceDiscovery::TerminationCallback_t callback) {}
+    virtual bool isServiceDiscoveryActive(void) const { return false; }
+    virtual void terminateServiceDiscovery(void) {}
+
+    virtual ble_error_t read(Gap::Handle_t connHandle, GattAttribute::Handle_t attributeHandle, uint16_t offset) const {
+        return BLE_ERROR_NOT_IMPLEMENTED;
+    }
+
+    virtual ble_error_t write(GattClient::WriteOp_t cmd, Gap::Handle_t connHandle, GattAttribute::Handle_t attributeHandle, size_t length, const uint8_t *value) const {
+        return BLE_ERROR_NOT_IMPLEMENTED;
+    }
+
+    virtual ble_error_t discoverCharacteristicDescriptors(const DiscoveredCharacteristic                          &characteristic,
+                                                          const CharacteristicDescriptorDiscovery::DiscoveryCallback_t   &discoveryCallback,
+                                                          const CharacteristicDescriptorDiscovery::TerminationCallback_t &terminationCallback) {
+        return BLE_ERROR_NOT_IMPLEMENTED;
+    }
+
+    virtual bool isCharacteristicDescriptorDiscoveryActive(const DiscoveredCharacteristic &characteristic) const { return false; }
+    virtual void terminateCharacteristicDescriptorDiscovery(const DiscoveredCharacteristic &characteristic) {}
+
+    void onDataRead(ReadCallback_t callback) {
+        onDataReadCallbackChain.add(callback);
+    }
+
+    void onDataWritten(WriteCallback_t callback) {
+        onDataWriteCallbackChain.add(callback);
+    }
+
+    void onHVX(HVXCallback_t callback) {
+        onHVXCallbackChain.add(callback);
+    }
+
+    virtual ble_error_t reset(void) {
+        onDataReadCallbackChain.clear();
+        onDataWriteCallbackChain.clear();
+        onHVXCallbackChain.clear();
+
+        return BLE_ERROR_NONE;
+    }
+
+public:
+    void processReadResponse(const GattReadCallbackParams *params) {
+        onDataReadCallbackChain(params);
+    }
+
+    void processWriteResponse(const GattWriteCallbackParams *params) {
+        onDataWriteCallbackChain(params);
+    }
+
+    void processHVXEvent(const GattHVXCallbackParams *params) {
+        onHVXCallbackChain(params);
+    }
+
+protected:
+    GattClient() {}
+    virtual ~GattClient() {}
+
+protected:
+    ReadCallbackChain_t  onDataReadCallbackChain;
+    WriteCallbackChain_t onDataWriteCallbackChain;
+    HVXCallbackChain_t   onHVXCallbackChain;
+
+private:
+    GattClient(const GattClient &);
+    GattClient& operator=(const GattClient &);
+};
+
+/*
+ * BLE.h and BLEInstanceBase.h
+ */
+class BLEInstanceBase;
+
+class BLE {
+public:
+    typedef unsigned InstanceID_t;
+
+    static const InstanceID_t DEFAULT_INSTANCE = 0;
+    static const InstanceID_t NUM_INSTANCES    = 1;
+
+    struct InitializationCompleteCallbackContext {
+        BLE         &ble;
+        ble_error_t  error;
+    };
+    typedef void (*InitializationCompleteCallback_t)(InitializationCompleteCallbackContext *context);
+
+    struct OnEventsToProcessCallbackContext {
+        BLE &ble;
+    };
+    typedef FunctionPointerWithContext<OnEventsToProcessCallbackContext *> OnEventsToProcessCallback_t;
+
+    static BLE &Instance(InstanceID_t id = DEFAULT_INSTANCE);
+
+    ble_error_t init(InitializationCompleteCallback_t callback = NULL);
+    bool hasInitialized(void) const;
+    ble_error_t shutdown(void);
+
+    Gap &gap();
+    GattServer &gattServer();
+    GattClient &gattClient();
+    SecurityManager &securityManager();
+
+    void processEvents();
+    void onEventsToProcess(const OnEventsToProcessCallback_t &callback);
+
+private:
+    friend class BLEInstanceBase;
+
+    BLE(InstanceID_t instanceID = DEFAULT_INSTANCE);
+
+    void signalEventsToProcess();
+
+    BLE(const BLE &);
+    BLE &operator=(const BLE &);
+
+private:
+    InstanceID_t                instanceID;
+    BLEInstanceBase            *transport;
+    OnEventsToProcessCallback_t whenEventsToProcess;
+};
+
+class BLEInstanceBase {
+public:
+    BLEInstanceBase() {}
+    virtual ~BLEInstanceBase() {}
+
+    virtual ble_error_t init(BLE::InstanceID_t instanceID, FunctionPointerWithContext<BLE::InitializationCompleteCallbackContext *> callback) = 0;
+    virtual bool hasInitialized(void) const = 0;
+    virtual ble_error_t shutdown(void) = 0;
+    virtual const char *getVersion(void) = 0;
+    virtual Gap &getGap() = 0;
+    virtual const Gap &getGap() const = 0;
+    virtual GattServer &getGattServer() = 0;
+    virtual const GattServer &getGattServer() const = 0;
+    virtual GattClient &getGattClient() = 0;
+    virtual SecurityManager &getSecurityManager() = 0;
+    virtual const SecurityManager &getSecurityManager() const = 0;
+    virtual void waitForEvent(void) = 0;
+    virtual void processEvents() = 0;
+
+    void signalEventsToProcess(BLE::InstanceID_t id);
+};
+
+/**
+ * Provided by the transport, i.e. nRF5xn.cpp.
+ */
+extern BLEInstanceBase *createBLEInstance(void);
+
+} /* extern "C++" */
+
+#endif /* __BLE_API_HOST_H__ */
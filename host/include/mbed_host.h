@@ -0,0 +1,57 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for the parts of mbed used by the port. us_ticker_read()
+ * returns the virtual time of the simulator.
+ */
+
+#ifndef __MBED_HOST_H__
+#define __MBED_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "softdevice_host.h"
+#include "ble_api_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t us_ticker_read(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * The port only uses timeouts with a delay of 0, to take radio notifications
+ * out of the radio interrupt; there are no interrupts here, so the callback
+ * is called right away.
+ */
+class Timeout {
+public:
+    template <typename T>
+    void attach_us(T *object, void (T::*member)(void), uint32_t delayUs) {
+        (void) delayUs;
+        (object->*member)();
+    }
+};
+
+#endif /* __MBED_HOST_H__ */
@@ -0,0 +1,926 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host stand-in for the S130 SoftDevice headers and the parts of the nRF51
+ * SDK used by the port (pstorage, device manager, SoftDevice handler). Only
+ * the declarations the port uses are provided; their layout follows the
+ * SoftDevice where the port depends on it. The functions are implemented by
+ * the simulator, see simulator/softdevice.h.
+ */
+
+#ifndef __SOFTDEVICE_HOST_H__
+#define __SOFTDEVICE_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Errors
+ */
+#define NRF_ERROR_BASE_NUM                  (0x0)
+#define NRF_SUCCESS                         (NRF_ERROR_BASE_NUM + 0)
+#define NRF_ERROR_SVC_HANDLER_MISSING       (NRF_ERROR_BASE_NUM + 1)
+#define NRF_ERROR_SOFTDEVICE_NOT_ENABLED    (NRF_ERROR_BASE_NUM + 2)
+#define NRF_ERROR_INTERNAL                  (NRF_ERROR_BASE_NUM + 3)
+#define NRF_ERROR_NO_MEM                    (NRF_ERROR_BASE_NUM + 4)
+#define NRF_ERROR_NOT_FOUND                 (NRF_ERROR_BASE_NUM + 5)
+#define NRF_ERROR_NOT_SUPPORTED             (NRF_ERROR_BASE_NUM + 6)
+#define NRF_ERROR_INVALID_PARAM             (NRF_ERROR_BASE_NUM + 7)
+#define NRF_ERROR_INVALID_STATE             (NRF_ERROR_BASE_NUM + 8)
+#define NRF_ERROR_INVALID_LENGTH            (NRF_ERROR_BASE_NUM + 9)
+#define NRF_ERROR_INVALID_FLAGS             (NRF_ERROR_BASE_NUM + 10)
+#define NRF_ERROR_INVALID_DATA              (NRF_ERROR_BASE_NUM + 11)
+#define NRF_ERROR_DATA_SIZE                 (NRF_ERROR_BASE_NUM + 12)
+#define NRF_ERROR_TIMEOUT                   (NRF_ERROR_BASE_NUM + 13)
+#define NRF_ERROR_NULL                      (NRF_ERROR_BASE_NUM + 14)
+#define NRF_ERROR_FORBIDDEN                 (NRF_ERROR_BASE_NUM + 15)
+#define NRF_ERROR_INVALID_ADDR              (NRF_ERROR_BASE_NUM + 16)
+#define NRF_ERROR_BUSY                      (NRF_ERROR_BASE_NUM + 17)
+
+#define BLE_ERROR_NOT_ENABLED               (0x3001)
+#define BLE_ERROR_INVALID_CONN_HANDLE       (0x3002)
+#define BLE_ERROR_INVALID_ATTR_HANDLE       (0x3003)
+#define BLE_ERROR_NO_TX_BUFFERS             (0x3004)
+#define BLE_ERROR_GAP_INVALID_BLE_ADDR      (0x3202)
+#define BLE_ERROR_GAP_WHITELIST_IN_USE      (0x3203)
+#define BLE_ERROR_GATTS_INVALID_ATTR_TYPE   (0x3400)
+#define BLE_ERROR_GATTS_SYS_ATTR_MISSING    (0x3401)
+
+typedef uint32_t ret_code_t;
+
+/*
+ * Common
+ */
+#define BLE_CONN_HANDLE_INVALID             0xFFFF
+
+#define BLE_EVT_BASE                        0x01
+#define BLE_EVT_LAST                        0x0F
+#define BLE_GAP_EVT_BASE                    0x10
+#define BLE_GAP_EVT_LAST                    0x2F
+#define BLE_GATTC_EVT_BASE                  0x30
+#define BLE_GATTC_EVT_LAST                  0x4F
+#define BLE_GATTS_EVT_BASE                  0x50
+#define BLE_GATTS_EVT_LAST                  0x6F
+
+enum {
+    BLE_EVT_TX_COMPLETE = BLE_EVT_BASE,
+    BLE_EVT_USER_MEM_REQUEST,
+    BLE_EVT_USER_MEM_RELEASE,
+};
+
+#define BLE_USER_MEM_TYPE_GATTS_QUEUED_WRITES 0x01
+
+#define BLE_UUID_TYPE_UNKNOWN               0x00
+#define BLE_UUID_TYPE_BLE                   0x01
+#define BLE_UUID_TYPE_VENDOR_BEGIN          0x02
+
+#define BLE_UUID_SERVICE_PRIMARY            0x2800
+#define BLE_UUID_SERVICE_SECONDARY          0x2801
+#define BLE_UUID_CHARACTERISTIC             0x2803
+#define BLE_UUID_DESCRIPTOR_CHAR_USER_DESC  0x2901
+#define BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG 0x2902
+#define BLE_UUID_GATT                       0x1801
+#define BLE_UUID_GATT_CHARACTERISTIC_SERVICE_CHANGED 0x2A05
+
+typedef struct {
+    uint16_t uuid;
+    uint8_t  type;
+} ble_uuid_t;
+
+typedef struct {
+    uint8_t uuid128[16];
+} ble_uuid128_t;
+
+typedef struct {
+    uint8_t  *p_mem;
+    uint16_t  len;
+} ble_user_mem_block_t;
+
+typedef struct {
+    uint8_t  version_number;
+    uint16_t company_id;
+    uint16_t subversion_number;
+} ble_version_t;
+
+/*
+ * GAP
+ */
+#define BLE_GAP_ADDR_LEN                    6
+#define BLE_GAP_ADDR_TYPE_PUBLIC                        0x00
+#define BLE_GAP_ADDR_TYPE_RANDOM_STATIC                 0x01
+#define BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_RESOLVABLE     0x02
+#define BLE_GAP_ADDR_TYPE_RANDOM_PRIVATE_NON_RESOLVABLE 0x03
+#define BLE_GAP_ADDR_CYCLE_MODE_NONE        0x00
+#define BLE_GAP_ADDR_CYCLE_MODE_AUTO        0x01
+
+#define BLE_GAP_ADV_INTERVAL_MIN            0x0020
+#define BLE_GAP_ADV_NONCON_INTERVAL_MIN     0x00A0
+#define BLE_GAP_ADV_INTERVAL_MAX            0x4000
+#define BLE_GAP_ADV_TYPE_ADV_IND            0x00
+#define BLE_GAP_ADV_FP_ANY                  0x00
+#define BLE_GAP_ADV_FP_FILTER_SCANREQ       0x01
+#define BLE_GAP_ADV_FP_FILTER_CONNREQ       0x02
+#define BLE_GAP_ADV_FP_FILTER_BOTH          0x03
+#define BLE_GAP_ADV_MAX_SIZE                31
+
+#define BLE_GAP_WHITELIST_ADDR_MAX_COUNT    8
+#define BLE_GAP_WHITELIST_IRK_MAX_COUNT     8
+
+#define BLE_GAP_ROLE_INVALID                0x0
+#define BLE_GAP_ROLE_PERIPH                 0x1
+#define BLE_GAP_ROLE_CENTRAL                0x2
+
+#define BLE_GAP_IO_CAPS_NONE                0x03
+#define BLE_GAP_SEC_STATUS_SUCCESS          0x00
+#define BLE_GAP_OPT_PASSKEY                 0x22
+#define BLE_GAP_PASSKEY_LEN                 6
+#define BLE_GAP_DEVNAME_MAX_LEN             31
+
+#define BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(ptr)          do {(ptr)->sm = 0; (ptr)->lv = 0;} while (0)
+#define BLE_GAP_CONN_SEC_MODE_SET_OPEN(ptr)               do {(ptr)->sm = 1; (ptr)->lv = 1;} while (0)
+#define BLE_GAP_CONN_SEC_MODE_SET_ENC_NO_MITM(ptr)        do {(ptr)->sm = 1; (ptr)->lv = 2;} while (0)
+#define BLE_GAP_CONN_SEC_MODE_SET_ENC_WITH_MITM(ptr)      do {(ptr)->sm = 1; (ptr)->lv = 3;} while (0)
+#define BLE_GAP_CONN_SEC_MODE_SET_SIGNED_NO_MITM(ptr)     do {(ptr)->sm = 2; (ptr)->lv = 1;} while (0)
+#define BLE_GAP_CONN_SEC_MODE_SET_SIGNED_WITH_MITM(ptr)   do {(ptr)->sm = 2; (ptr)->lv = 2;} while (0)
+
+enum {
+    BLE_GAP_EVT_CONNECTED = BLE_GAP_EVT_BASE,
+    BLE_GAP_EVT_DISCONNECTED,
+    BLE_GAP_EVT_CONN_PARAM_UPDATE,
+    BLE_GAP_EVT_SEC_PARAMS_REQUEST,
+    BLE_GAP_EVT_SEC_INFO_REQUEST,
+    BLE_GAP_EVT_PASSKEY_DISPLAY,
+    BLE_GAP_EVT_AUTH_KEY_REQUEST,
+    BLE_GAP_EVT_AUTH_STATUS,
+    BLE_GAP_EVT_CONN_SEC_UPDATE,
+    BLE_GAP_EVT_TIMEOUT,
+    BLE_GAP_EVT_RSSI_CHANGED,
+    BLE_GAP_EVT_ADV_REPORT,
+    BLE_GAP_EVT_SEC_REQUEST,
+    BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST,
+    BLE_GAP_EVT_SCAN_REQ_REPORT,
+};
+
+typedef struct {
+    uint8_t addr_type;
+    uint8_t addr[BLE_GAP_ADDR_LEN];
+} ble_gap_addr_t;
+
+typedef struct {
+    uint8_t irk[16];
+} ble_gap_irk_t;
+
+typedef struct {
+    ble_gap_addr_t **pp_addrs;
+    uint8_t          addr_count;
+    ble_gap_irk_t  **pp_irks;
+    uint8_t          irk_count;
+} ble_gap_whitelist_t;
+
+typedef struct {
+    uint16_t min_conn_interval;  /**< In units of 1.25 ms. */
+    uint16_t max_conn_interval;  /**< In units of 1.25 ms. */
+    uint16_t slave_latency;
+    uint16_t conn_sup_timeout;   /**< In units of 10 ms. */
+} ble_gap_conn_params_t;
+
+typedef struct {
+    uint8_t sm : 4;
+    uint8_t lv : 4;
+} ble_gap_conn_sec_mode_t;
+
+typedef struct {
+    ble_gap_conn_sec_mode_t sec_mode;
+    uint8_t                 encr_key_size;
+} ble_gap_conn_sec_t;
+
+typedef struct {
+    uint8_t enc  : 1;
+    uint8_t id   : 1;
+    uint8_t sign : 1;
+} ble_gap_sec_kdist_t;
+
+typedef struct {
+    uint8_t             bond    : 1;
+    uint8_t             mitm    : 1;
+    uint8_t             io_caps : 3;
+    uint8_t             oob     : 1;
+    uint8_t             min_key_size;
+    uint8_t             max_key_size;
+    ble_gap_sec_kdist_t kdist_periph;
+    ble_gap_sec_kdist_t kdist_central;
+} ble_gap_sec_params_t;
+
+typedef struct {
+    uint8_t               type;
+    ble_gap_addr_t       *p_peer_addr;
+    uint8_t               fp;
+    ble_gap_whitelist_t  *p_whitelist;
+    uint16_t              interval;
+    uint16_t              timeout;
+    struct {
+        uint8_t channel_37 : 1;
+        uint8_t channel_38 : 1;
+        uint8_t channel_39 : 1;
+    } channel_mask;
+} ble_gap_adv_params_t;
+
+typedef struct {
+    uint8_t              active    : 1;
+    uint8_t              selective : 1;
+    ble_gap_whitelist_t *p_whitelist;
+    uint16_t             interval;
+    uint16_t             window;
+    uint16_t             timeout;
+} ble_gap_scan_params_t;
+
+typedef struct {
+    ble_gap_addr_t        peer_addr;
+    ble_gap_addr_t        own_addr;
+    uint8_t               irk_match     : 1;
+    uint8_t               irk_match_idx : 7;
+    ble_gap_conn_params_t conn_params;
+    uint8_t               role;
+} ble_gap_evt_connected_t;
+
+typedef struct {
+    uint8_t reason;
+} ble_gap_evt_disconnected_t;
+
+typedef struct {
+    ble_gap_conn_params_t conn_params;
+} ble_gap_evt_conn_param_update_t;
+
+typedef struct {
+    uint8_t passkey[BLE_GAP_PASSKEY_LEN];
+} ble_gap_evt_passkey_display_t;
+
+typedef struct {
+    uint8_t src;
+} ble_gap_evt_timeout_t;
+
+typedef struct {
+    ble_gap_addr_t peer_addr;
+    int8_t         rssi;
+    uint8_t        scan_rsp : 1;
+    uint8_t        type     : 2;
+    uint8_t        dlen     : 5;
+    uint8_t        data[BLE_GAP_ADV_MAX_SIZE];
+} ble_gap_evt_adv_report_t;
+
+typedef struct {
+    ble_gap_sec_params_t peer_params;
+} ble_gap_evt_sec_params_request_t;
+
+typedef struct {
+    uint8_t             auth_status;
+    uint8_t             error_src : 2;
+    uint8_t             bonded    : 1;
+    ble_gap_sec_kdist_t kdist_periph;
+    ble_gap_sec_kdist_t kdist_central;
+} ble_gap_evt_auth_status_t;
+
+typedef struct {
+    ble_gap_conn_sec_t conn_sec;
+} ble_gap_evt_conn_sec_update_t;
+
+typedef struct {
+    uint16_t conn_handle;
+    union {
+        ble_gap_evt_connected_t          connected;
+        ble_gap_evt_disconnected_t       disconnected;
+        ble_gap_evt_conn_param_update_t  conn_param_update;
+        ble_gap_evt_sec_params_request_t sec_params_request;
+        ble_gap_evt_passkey_display_t    passkey_display;
+        ble_gap_evt_auth_status_t        auth_status;
+        ble_gap_evt_conn_sec_update_t    conn_sec_update;
+        ble_gap_evt_timeout_t            timeout;
+        ble_gap_evt_adv_report_t         adv_report;
+    } params;
+} ble_gap_evt_t;
+
+typedef struct {
+    uint8_t *p_passkey;
+} ble_gap_opt_passkey_t;
+
+typedef union {
+    ble_gap_opt_passkey_t passkey;
+} ble_gap_opt_t;
+
+typedef union {
+    ble_gap_opt_t gap_opt;
+} ble_opt_t;
+
+/*
+ * GATT
+ */
+#define BLE_GATT_ATT_MTU_DEFAULT            23
+#define GATT_MTU_SIZE_DEFAULT               BLE_GATT_ATT_MTU_DEFAULT
+#define BLE_GATT_HANDLE_INVALID             0x0000
+#define BLE_GATT_HANDLE_START               0x0001
+#define BLE_GATT_HANDLE_END                 0xFFFF
+
+#define BLE_GATT_HVX_INVALID                0x00
+#define BLE_GATT_HVX_NOTIFICATION           0x01
+#define BLE_GATT_HVX_INDICATION             0x02
+
+#define BLE_GATT_OP_INVALID                 0x00
+#define BLE_GATT_OP_WRITE_REQ               0x01
+#define BLE_GATT_OP_WRITE_CMD               0x02
+#define BLE_GATT_OP_SIGN_WRITE_CMD          0x03
+#define BLE_GATT_OP_PREP_WRITE_REQ          0x04
+#define BLE_GATT_OP_EXEC_WRITE_REQ          0x05
+
+#define BLE_GATT_STATUS_SUCCESS                     0x0000
+#define BLE_GATT_STATUS_ATTERR_INVALID_HANDLE       0x0101
+#define BLE_GATT_STATUS_ATTERR_READ_NOT_PERMITTED   0x0102
+#define BLE_GATT_STATUS_ATTERR_WRITE_NOT_PERMITTED  0x0103
+#define BLE_GATT_STATUS_ATTERR_INVALID_OFFSET       0x0107
+#define BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND  0x010A
+#define BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH 0x010D
+#define BLE_GATT_STATUS_ATTERR_UNLIKELY_ERROR       0x010E
+#define BLE_GATT_STATUS_ATTERR_INSUF_RESOURCES      0x0111
+
+typedef struct {
+    uint8_t broadcast      : 1;
+    uint8_t read           : 1;
+    uint8_t write_wo_resp  : 1;
+    uint8_t write          : 1;
+    uint8_t notify         : 1;
+    uint8_t indicate       : 1;
+    uint8_t auth_signed_wr : 1;
+} ble_gatt_char_props_t;
+
+typedef struct {
+    uint8_t reliable_wr : 1;
+    uint8_t wr_aux      : 1;
+} ble_gatt_char_ext_props_t;
+
+/*
+ * GATT server
+ */
+#define BLE_GATTS_ATTR_TAB_SIZE_MIN         216
+#define BLE_GATTS_ATTR_TAB_SIZE_DEFAULT     0x600
+
+#define BLE_GATTS_SRVC_TYPE_PRIMARY         0x01
+#define BLE_GATTS_SRVC_TYPE_SECONDARY       0x02
+
+#define BLE_GATTS_VLOC_INVALID              0x00
+#define BLE_GATTS_VLOC_STACK                0x01
+#define BLE_GATTS_VLOC_USER                 0x02
+
+#define BLE_GATTS_OP_INVALID                0x00
+#define BLE_GATTS_OP_WRITE_REQ              0x01
+#define BLE_GATTS_OP_WRITE_CMD              0x02
+#define BLE_GATTS_OP_SIGN_WRITE_CMD         0x03
+#define BLE_GATTS_OP_PREP_WRITE_REQ         0x04
+#define BLE_GATTS_OP_EXEC_WRITE_REQ_CANCEL  0x05
+#define BLE_GATTS_OP_EXEC_WRITE_REQ_NOW     0x06
+
+#define BLE_GATTS_AUTHORIZE_TYPE_INVALID    0x00
+#define BLE_GATTS_AUTHORIZE_TYPE_READ       0x01
+#define BLE_GATTS_AUTHORIZE_TYPE_WRITE      0x02
+
+#define BLE_GATTS_SYS_ATTR_FLAG_SYS_SRVCS   (1 << 0)
+#define BLE_GATTS_SYS_ATTR_FLAG_USR_SRVCS   (1 << 1)
+
+enum {
+    BLE_GATTS_EVT_WRITE = BLE_GATTS_EVT_BASE,
+    BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST,
+    BLE_GATTS_EVT_SYS_ATTR_MISSING,
+    BLE_GATTS_EVT_HVC,
+    BLE_GATTS_EVT_SC_CONFIRM,
+    BLE_GATTS_EVT_TIMEOUT,
+};
+
+typedef struct {
+    ble_gap_conn_sec_mode_t read_perm;
+    ble_gap_conn_sec_mode_t write_perm;
+    uint8_t                 vlen    : 1;
+    uint8_t                 vloc    : 2;
+    uint8_t                 rd_auth : 1;
+    uint8_t                 wr_auth : 1;
+} ble_gatts_attr_md_t;
+
+typedef struct {
+    ble_uuid_t          *p_uuid;
+    ble_gatts_attr_md_t *p_attr_md;
+    uint16_t             init_len;
+    uint16_t             init_offs;
+    uint16_t             max_len;
+    uint8_t             *p_value;
+} ble_gatts_attr_t;
+
+typedef struct {
+    uint16_t  len;
+    uint16_t  offset;
+    uint8_t  *p_value;
+} ble_gatts_value_t;
+
+typedef struct {
+    uint8_t  format;
+    int8_t   exponent;
+    uint16_t unit;
+    uint8_t  name_space;
+    uint16_t desc;
+} ble_gatts_char_pf_t;
+
+typedef struct {
+    ble_gatt_char_props_t      char_props;
+    ble_gatt_char_ext_props_t  char_ext_props;
+    uint8_t                   *p_char_user_desc;
+    uint16_t                   char_user_desc_max_size;
+    uint16_t                   char_user_desc_size;
+    ble_gatts_char_pf_t       *p_char_pf;
+    ble_gatts_attr_md_t       *p_user_desc_md;
+    ble_gatts_attr_md_t       *p_cccd_md;
+    ble_gatts_attr_md_t       *p_sccd_md;
+} ble_gatts_char_md_t;
+
+typedef struct {
+    uint16_t value_handle;
+    uint16_t user_desc_handle;
+    uint16_t cccd_handle;
+    uint16_t sccd_handle;
+} ble_gatts_char_handles_t;
+
+typedef struct {
+    uint16_t        handle;
+    uint8_t         type;
+    uint16_t        offset;
+    uint16_t       *p_len;
+    uint8_t const  *p_data;
+} ble_gatts_hvx_params_t;
+
+typedef struct {
+    uint16_t       gatt_status;
+    uint8_t        update : 1;
+    uint16_t       offset;
+    uint16_t       len;
+    uint8_t const *p_data;
+} ble_gatts_read_authorize_reply_params_t;
+
+typedef struct {
+    uint16_t gatt_status;
+} ble_gatts_write_authorize_reply_params_t;
+
+typedef struct {
+    uint8_t type;
+    union {
+        ble_gatts_read_authorize_reply_params_t  read;
+        ble_gatts_write_authorize_reply_params_t write;
+    } params;
+} ble_gatts_rw_authorize_reply_params_t;
+
+typedef struct {
+    uint8_t  service_changed : 1;
+    uint32_t attr_tab_size;
+} ble_gatts_enable_params_t;
+
+typedef struct {
+    ble_gatts_enable_params_t gatts_enable_params;
+} ble_enable_params_t;
+
+typedef struct {
+    uint16_t   handle;
+    ble_uuid_t uuid;
+    uint8_t    op;
+    uint8_t    auth_required;
+    uint16_t   offset;
+    uint16_t   len;
+    uint8_t    data[1];  /**< Variable length. */
+} ble_gatts_evt_write_t;
+
+typedef struct {
+    uint16_t   handle;
+    ble_uuid_t uuid;
+    uint16_t   offset;
+} ble_gatts_evt_read_t;
+
+typedef struct {
+    uint8_t type;
+    union {
+        ble_gatts_evt_read_t  read;
+        ble_gatts_evt_write_t write;
+    } request;
+} ble_gatts_evt_rw_authorize_request_t;
+
+typedef struct {
+    uint8_t hint;
+} ble_gatts_evt_sys_attr_missing_t;
+
+typedef struct {
+    uint16_t handle;
+} ble_gatts_evt_hvc_t;
+
+typedef struct {
+    uint16_t conn_handle;
+    union {
+        ble_gatts_evt_write_t                write;
+        ble_gatts_evt_rw_authorize_request_t authorize_request;
+        ble_gatts_evt_sys_attr_missing_t     sys_attr_missing;
+        ble_gatts_evt_hvc_t                  hvc;
+    } params;
+} ble_gatts_evt_t;
+
+/*
+ * GATT client
+ */
+enum {
+    BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP = BLE_GATTC_EVT_BASE,
+    BLE_GATTC_EVT_REL_DISC_RSP,
+    BLE_GATTC_EVT_CHAR_DISC_RSP,
+    BLE_GATTC_EVT_DESC_DISC_RSP,
+    BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP,
+    BLE_GATTC_EVT_READ_RSP,
+    BLE_GATTC_EVT_CHAR_VALS_READ_RSP,
+    BLE_GATTC_EVT_WRITE_RSP,
+    BLE_GATTC_EVT_HVX,
+    BLE_GATTC_EVT_TIMEOUT,
+};
+
+typedef struct {
+    uint16_t start_handle;
+    uint16_t end_handle;
+} ble_gattc_handle_range_t;
+
+typedef struct {
+    ble_uuid_t               uuid;
+    ble_gattc_handle_range_t handle_range;
+} ble_gattc_service_t;
+
+typedef struct {
+    ble_uuid_t            uuid;
+    ble_gatt_char_props_t char_props;
+    uint8_t               char_ext_props : 1;
+    uint16_t              handle_decl;
+    uint16_t              handle_value;
+} ble_gattc_char_t;
+
+typedef struct {
+    uint16_t   handle;
+    ble_uuid_t uuid;
+} ble_gattc_desc_t;
+
+typedef struct {
+    uint8_t   write_op;
+    uint8_t   flags;
+    uint16_t  handle;
+    uint16_t  offset;
+    uint16_t  len;
+    uint8_t  *p_value;
+} ble_gattc_write_params_t;
+
+typedef struct {
+    uint16_t            count;
+    ble_gattc_service_t services[1];  /**< Variable length. */
+} ble_gattc_evt_prim_srvc_disc_rsp_t;
+
+typedef struct {
+    uint16_t         count;
+    ble_gattc_char_t chars[1];  /**< Variable length. */
+} ble_gattc_evt_char_disc_rsp_t;
+
+typedef struct {
+    uint16_t         count;
+    ble_gattc_desc_t descs[1];  /**< Variable length. */
+} ble_gattc_evt_desc_disc_rsp_t;
+
+typedef struct {
+    uint16_t  handle;
+    uint8_t  *p_value;
+} ble_gattc_handle_value_t;
+
+typedef struct {
+    uint16_t                 count;
+    uint16_t                 value_len;
+    ble_gattc_handle_value_t handle_value[1];  /**< Variable length; the values follow. */
+} ble_gattc_evt_char_val_by_uuid_read_rsp_t;
+
+typedef struct {
+    uint16_t handle;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t  data[1];  /**< Variable length. */
+} ble_gattc_evt_read_rsp_t;
+
+typedef struct {
+    uint16_t len;
+    uint8_t  values[1];  /**< Variable length. */
+} ble_gattc_evt_char_vals_read_rsp_t;
+
+typedef struct {
+    uint16_t handle;
+    uint8_t  write_op;
+    uint16_t offset;
+    uint16_t len;
+    uint8_t  data[1];  /**< Variable length. */
+} ble_gattc_evt_write_rsp_t;
+
+typedef struct {
+    uint16_t handle;
+    uint8_t  type;
+    uint16_t len;
+    uint8_t  data[1];  /**< Variable length. */
+} ble_gattc_evt_hvx_t;
+
+typedef struct {
+    uint8_t src;
+} ble_gattc_evt_timeout_t;
+
+typedef struct {
+    uint16_t conn_handle;
+    uint16_t gatt_status;
+    uint16_t error_handle;
+    union {
+        ble_gattc_evt_prim_srvc_disc_rsp_t        prim_srvc_disc_rsp;
+        ble_gattc_evt_char_disc_rsp_t             char_disc_rsp;
+        ble_gattc_evt_desc_disc_rsp_t             desc_disc_rsp;
+        ble_gattc_evt_char_val_by_uuid_read_rsp_t char_val_by_uuid_read_rsp;
+        ble_gattc_evt_read_rsp_t                  read_rsp;
+        ble_gattc_evt_char_vals_read_rsp_t        char_vals_read_rsp;
+        ble_gattc_evt_write_rsp_t                 write_rsp;
+        ble_gattc_evt_hvx_t                       hvx;
+        ble_gattc_evt_timeout_t                   timeout;
+    } params;
+} ble_gattc_evt_t;
+
+/*
+ * Events
+ */
+typedef struct {
+    uint8_t count;
+} ble_evt_tx_complete_t;
+
+typedef struct {
+    uint8_t type;
+} ble_evt_user_mem_request_t;
+
+typedef struct {
+    uint8_t              type;
+    ble_user_mem_block_t mem_block;
+} ble_evt_user_mem_release_t;
+
+typedef struct {
+    uint16_t conn_handle;
+    union {
+        ble_evt_tx_complete_t      tx_complete;
+        ble_evt_user_mem_request_t user_mem_request;
+        ble_evt_user_mem_release_t user_mem_release;
+    } params;
+} ble_common_evt_t;
+
+typedef struct {
+    uint16_t evt_id;
+    uint16_t evt_len;
+} ble_evt_hdr_t;
+
+typedef struct {
+    ble_evt_hdr_t header;
+    union {
+        ble_common_evt_t common_evt;
+        ble_gap_evt_t    gap_evt;
+        ble_gattc_evt_t  gattc_evt;
+        ble_gatts_evt_t  gatts_evt;
+    } evt;
+} ble_evt_t;
+
+#define BLE_STACK_EVT_MSG_BUF_SIZE (sizeof(ble_evt_t) + (GATT_MTU_SIZE_DEFAULT))
+
+/* SoC events. */
+enum {
+    NRF_EVT_FLASH_OPERATION_SUCCESS = 2,
+    NRF_EVT_FLASH_OPERATION_ERROR   = 3,
+};
+
+#define NRF_APP_PRIORITY_HIGH                   1
+#define NRF_RADIO_NOTIFICATION_DISTANCE_800US   1
+
+/* HCI status codes. */
+#define BLE_HCI_STATUS_CODE_SUCCESS                 0x00
+#define BLE_HCI_CONNECTION_TIMEOUT                  0x08
+#define BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION   0x13
+#define BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION    0x16
+#define BLE_HCI_CONN_INTERVAL_UNACCEPTABLE          0x3B
+
+/*
+ * SoftDevice calls
+ */
+uint32_t sd_ble_enable(ble_enable_params_t *p_ble_enable_params);
+uint32_t sd_ble_evt_get(uint8_t *p_dest, uint16_t *p_len);
+uint32_t sd_ble_version_get(ble_version_t *p_version);
+uint32_t sd_ble_opt_set(uint32_t opt_id, ble_opt_t const *p_opt);
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const *p_vs_uuid, uint8_t *p_uuid_type);
+uint32_t sd_ble_uuid_decode(uint8_t uuid_le_len, uint8_t const *p_uuid_le, ble_uuid_t *p_uuid);
+uint32_t sd_ble_user_mem_reply(uint16_t conn_handle, ble_user_mem_block_t const *p_block);
+
+uint32_t sd_ble_gap_address_set(uint8_t addr_cycle_mode, ble_gap_addr_t const *p_addr);
+uint32_t sd_ble_gap_address_get(ble_gap_addr_t *p_addr);
+uint32_t sd_ble_gap_adv_data_set(uint8_t const *p_data, uint8_t dlen, uint8_t const *p_sr_data, uint8_t srdlen);
+uint32_t sd_ble_gap_adv_start(ble_gap_adv_params_t const *p_adv_params);
+uint32_t sd_ble_gap_adv_stop(void);
+uint32_t sd_ble_gap_scan_start(ble_gap_scan_params_t const *p_scan_params);
+uint32_t sd_ble_gap_scan_stop(void);
+uint32_t sd_ble_gap_connect(ble_gap_addr_t const *p_peer_addr, ble_gap_scan_params_t const *p_scan_params, ble_gap_conn_params_t const *p_conn_params);
+uint32_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code);
+uint32_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params);
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params);
+uint32_t sd_ble_gap_ppcp_get(ble_gap_conn_params_t *p_conn_params);
+uint32_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name, uint16_t len);
+uint32_t sd_ble_gap_device_name_get(uint8_t *p_dev_name, uint16_t *p_len);
+uint32_t sd_ble_gap_appearance_set(uint16_t appearance);
+uint32_t sd_ble_gap_appearance_get(uint16_t *p_appearance);
+uint32_t sd_ble_gap_tx_power_set(int8_t tx_power);
+uint32_t sd_ble_gap_authenticate(uint16_t conn_handle, ble_gap_sec_params_t const *p_sec_params);
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const *p_uuid, uint16_t *p_handle);
+uint32_t sd_ble_gatts_characteristic_add(uint16_t service_handle, ble_gatts_char_md_t const *p_char_md, ble_gatts_attr_t const *p_attr_char_value, ble_gatts_char_handles_t *p_handles);
+uint32_t sd_ble_gatts_descriptor_add(uint16_t char_handle, ble_gatts_attr_t const *p_attr, uint16_t *p_handle);
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value);
+uint32_t sd_ble_gatts_value_get(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value);
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const *p_hvx_params);
+uint32_t sd_ble_gatts_rw_authorize_reply(uint16_t conn_handle, ble_gatts_rw_authorize_reply_params_t const *p_rw_authorize_reply_params);
+uint32_t sd_ble_gatts_sys_attr_set(uint16_t conn_handle, uint8_t const *p_sys_attr_data, uint16_t len, uint32_t flags);
+uint32_t sd_ble_gatts_sys_attr_get(uint16_t conn_handle, uint8_t *p_sys_attr_data, uint16_t *p_len, uint32_t flags);
+
+uint32_t sd_ble_gattc_primary_services_discover(uint16_t conn_handle, uint16_t start_handle, ble_uuid_t const *p_srvc_uuid);
+uint32_t sd_ble_gattc_characteristics_discover(uint16_t conn_handle, ble_gattc_handle_range_t const *p_handle_range);
+uint32_t sd_ble_gattc_descriptors_discover(uint16_t conn_handle, ble_gattc_handle_range_t const *p_handle_range);
+uint32_t sd_ble_gattc_char_value_by_uuid_read(uint16_t conn_handle, ble_uuid_t const *p_uuid, ble_gattc_handle_range_t const *p_handle_range);
+uint32_t sd_ble_gattc_read(uint16_t conn_handle, uint16_t handle, uint16_t offset);
+uint32_t sd_ble_gattc_char_values_read(uint16_t conn_handle, uint16_t const *p_handles, uint16_t handle_count);
+uint32_t sd_ble_gattc_write(uint16_t conn_handle, ble_gattc_write_params_t const *p_write_params);
+uint32_t sd_ble_gattc_hv_confirm(uint16_t conn_handle, uint16_t handle);
+
+uint32_t sd_evt_get(uint32_t *p_evt_id);
+uint32_t sd_app_evt_wait(void);
+uint32_t sd_nvic_critical_region_enter(uint8_t *p_is_nested_critical_region);
+uint32_t sd_nvic_critical_region_exit(uint8_t is_nested_critical_region);
+
+/*
+ * Clock, as selected by btle_init().
+ */
+typedef enum {
+    NRF_CLOCK_LFCLKSRC_SYNTH_250_PPM,
+    NRF_CLOCK_LFCLKSRC_XTAL_20_PPM,
+    NRF_CLOCK_LFCLKSRC_RC_250_PPM_4000MS_CALIBRATION,
+} nrf_clock_lfclksrc_t;
+
+typedef struct {
+    uint32_t LFCLKSRC;
+} NRF_CLOCK_Type;
+
+extern NRF_CLOCK_Type *NRF_CLOCK;
+
+#define CLOCK_LFCLKSRC_SRC_Pos  (0UL)
+#define CLOCK_LFCLKSRC_SRC_Xtal (1UL)
+
+void NVIC_SystemReset(void);
+void nrf_delay_us(uint32_t number_of_us);
+
+/*
+ * SDK: SoftDevice handler
+ */
+typedef void (*ble_evt_handler_t)(ble_evt_t *p_ble_evt);
+typedef void (*sys_evt_handler_t)(uint32_t evt_id);
+typedef uint32_t (*softdevice_evt_schedule_func_t)(void);
+
+uint32_t softdevice_handler_init(nrf_clock_lfclksrc_t clock_source, void *p_ble_evt_buffer, uint16_t ble_evt_buffer_size, softdevice_evt_schedule_func_t evt_schedule_func);
+uint32_t softdevice_handler_sd_disable(void);
+uint32_t softdevice_ble_evt_handler_set(ble_evt_handler_t ble_evt_handler);
+uint32_t softdevice_sys_evt_handler_set(sys_evt_handler_t sys_evt_handler);
+
+#define SOFTDEVICE_HANDLER_INIT(CLOCK_SOURCE, EVT_HANDLER) \
+    do { \
+        uint32_t ERR_CODE = softdevice_handler_init((CLOCK_SOURCE), NULL, 0, (EVT_HANDLER)); \
+        (void) ERR_CODE; \
+    } while (0)
+
+/*
+ * SDK: persistent storage
+ */
+typedef uint32_t pstorage_size_t;
+
+typedef struct {
+    uint32_t module_id;
+    uint32_t block_id;  /**< Address of the block; flash is memory mapped. */
+} pstorage_handle_t;
+
+typedef void (*pstorage_ntf_cb_t)(pstorage_handle_t *p_handle, uint8_t op_code, uint32_t result, uint8_t *p_data, uint32_t data_len);
+
+typedef struct {
+    pstorage_ntf_cb_t cb;
+    pstorage_size_t   block_size;
+    pstorage_size_t   block_count;
+} pstorage_module_param_t;
+
+#define PSTORAGE_STORE_OP_CODE  0x01
+#define PSTORAGE_LOAD_OP_CODE   0x02
+#define PSTORAGE_CLEAR_OP_CODE  0x03
+#define PSTORAGE_UPDATE_OP_CODE 0x04
+
+uint32_t pstorage_init(void);
+uint32_t pstorage_register(pstorage_module_param_t *p_module_param, pstorage_handle_t *p_block_id);
+uint32_t pstorage_block_identifier_get(pstorage_handle_t *p_base_id, pstorage_size_t block_num, pstorage_handle_t *p_block_id);
+uint32_t pstorage_store(pstorage_handle_t *p_dest, uint8_t *p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_update(pstorage_handle_t *p_dest, uint8_t *p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_load(uint8_t *p_dest, pstorage_handle_t *p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_clear(pstorage_handle_t *p_base_id, pstorage_size_t size);
+void pstorage_sys_event_handler(uint32_t sys_evt);
+
+/*
+ * SDK: device manager
+ */
+#define DEVICE_MANAGER_MAX_BONDS        7
+#define DM_INVALID_ID                   0xFF
+#define DM_PROTOCOL_CNTXT_NONE          0x00
+#define DM_PROTOCOL_CNTXT_GATT_SRVR_ID  0x01
+#define DM_PROTOCOL_CNTXT_GATT_CLI_ID   0x02
+
+enum {
+    DM_EVT_CONNECTION              = 0x11,
+    DM_EVT_DISCONNECTION           = 0x12,
+    DM_EVT_SECURITY_SETUP          = 0x21,
+    DM_EVT_SECURITY_SETUP_COMPLETE = 0x22,
+    DM_EVT_LINK_SECURED            = 0x23,
+    DM_EVT_SECURITY_SETUP_REFRESH  = 0x24,
+    DM_EVT_DEVICE_CONTEXT_LOADED   = 0x31,
+    DM_EVT_DEVICE_CONTEXT_STORED   = 0x32,
+    DM_EVT_DEVICE_CONTEXT_DELETED  = 0x33,
+};
+
+typedef uint8_t dm_application_instance_t;
+typedef uint8_t dm_security_status_t;
+
+typedef struct {
+    uint8_t appl_id;
+    uint8_t connection_id;
+    uint8_t device_id;
+    uint8_t service_id;
+} dm_handle_t;
+
+typedef struct {
+    uint8_t event_id;
+    union {
+        ble_gap_evt_t *p_gap_param;
+    } event_param;
+    uint16_t event_paramlen;
+} dm_event_t;
+
+typedef ret_code_t (*dm_event_cb_t)(dm_handle_t const *p_handle, dm_event_t const *p_event, ret_code_t event_result);
+
+typedef struct {
+    bool clear_persistent_data;
+} dm_init_param_t;
+
+typedef struct {
+    dm_event_cb_t        evt_handler;
+    uint8_t              service_type;
+    ble_gap_sec_params_t sec_param;
+} dm_application_param_t;
+
+ret_code_t dm_init(dm_init_param_t const *p_init_param);
+ret_code_t dm_register(dm_application_instance_t *p_appl_instance, dm_application_param_t const *p_appl_param);
+ret_code_t dm_device_delete_all(dm_application_instance_t const *p_application);
+ret_code_t dm_handle_get(uint16_t conn_handle, dm_handle_t *p_handle);
+ret_code_t dm_peer_addr_get(dm_handle_t const *p_handle, ble_gap_addr_t *p_addr);
+ret_code_t dm_security_status_req(dm_handle_t const *p_handle, dm_security_status_t *p_status);
+ret_code_t dm_whitelist_create(dm_application_instance_t const *p_handle, ble_gap_whitelist_t *p_whitelist);
+void dm_ble_evt_handler(ble_evt_t *p_ble_evt);
+
+bool im_address_resolve(ble_gap_addr_t const *p_addr, ble_gap_irk_t const *p_irk);
+void ah(uint8_t const *p_k, uint8_t const *p_r, uint8_t *p_local_hash);
+
+/*
+ * SDK: connection parameters negotiation and radio notification
+ */
+#define SDK_CONN_PARAMS_MODULE_ENABLE 0
+
+void ble_conn_params_on_ble_evt(ble_evt_t *p_ble_evt);
+uint32_t ble_radio_notification_init(uint32_t irq_priority, uint8_t distance, void (*evt_handler)(bool radio_active));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SOFTDEVICE_HOST_H__ */
@@ -0,0 +1,113 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Out of line parts of the host BLE API, after BLE.cpp of the BLE API.
+ */
+
+#include "ble/BLE.h"
+#include "ble/BLEInstanceBase.h"
+
+BLE &
+BLE::Instance(InstanceID_t id)
+{
+    static BLE *singletons[NUM_INSTANCES];
+    if (id >= NUM_INSTANCES) {
+        id = DEFAULT_INSTANCE;
+    }
+    if (singletons[id] == NULL) {
+        singletons[id] = new BLE(id);
+    }
+
+    return *singletons[id];
+}
+
+BLE::BLE(InstanceID_t instanceIDIn) : instanceID(instanceIDIn), transport(NULL), whenEventsToProcess()
+{
+    transport = createBLEInstance();
+}
+
+ble_error_t
+BLE::init(InitializationCompleteCallback_t callback)
+{
+    FunctionPointerWithContext<InitializationCompleteCallbackContext *> callbackPointer(callback);
+    return transport->init(instanceID, callbackPointer);
+}
+
+bool
+BLE::hasInitialized(void) const
+{
+    return transport->hasInitialized();
+}
+
+ble_error_t
+BLE::shutdown(void)
+{
+    return transport->shutdown();
+}
+
+Gap &
+BLE::gap()
+{
+    return transport->getGap();
+}
+
+GattServer &
+BLE::gattServer()
+{
+    return transport->getGattServer();
+}
+
+GattClient &
+BLE::gattClient()
+{
+    return transport->getGattClient();
+}
+
+SecurityManager &
+BLE::securityManager()
+{
+    return transport->getSecurityManager();
+}
+
+void
+BLE::processEvents()
+{
+    transport->processEvents();
+}
+
+void
+BLE::onEventsToProcess(const OnEventsToProcessCallback_t &callback)
+{
+    whenEventsToProcess = callback;
+}
+
+void
+BLE::signalEventsToProcess()
+{
+    if (whenEventsToProcess) {
+        OnEventsToProcessCallbackContext params = {
+            *this
+        };
+        whenEventsToProcess.call(&params);
+    }
+}
+
+void
+BLEInstanceBase::signalEventsToProcess(BLE::InstanceID_t id)
+{
+    BLE::Instance(id).signalEventsToProcess();
+}
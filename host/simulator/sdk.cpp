@@ -0,0 +1,340 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host versions of the nRF51 SDK modules used by the port: persistent storage
+ * on a RAM backed flash, and a device manager whose bonds are made by the
+ * simulation rather than by pairing.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <deque>
+
+#include "softdevice.h"
+
+namespace {
+
+/*
+ * Flash. Operations are queued and run one at a time, as pstorage does; each
+ * completes with a system event, after which the data is in flash and the
+ * module is notified.
+ */
+const unsigned FLASH_SIZE  = 16 * 1024;
+const unsigned MAX_MODULES = 4;
+
+uint8_t flash[FLASH_SIZE] __attribute__((aligned(4)));
+uint32_t flashUsed = 0;
+
+struct StorageModule {
+    pstorage_ntf_cb_t cb;
+    uint32_t          base;
+    pstorage_size_t   blockSize;
+    pstorage_size_t   blockCount;
+};
+
+StorageModule modules[MAX_MODULES];
+unsigned      moduleCount = 0;
+
+struct FlashOperation {
+    uint8_t           opCode;
+    pstorage_handle_t handle;
+    uint8_t          *src;
+    pstorage_size_t   size;
+    pstorage_size_t   offset;
+};
+
+std::deque<FlashOperation> flashOperations;
+unsigned                   flashFailures = 0;
+
+/*
+ * Device manager
+ */
+const unsigned MAX_CONNECTIONS = 8;
+
+struct Bond {
+    bool           valid;
+    ble_gap_addr_t address;
+};
+
+Bond    bonds[DEVICE_MANAGER_MAX_BONDS];
+uint8_t connectionDevice[MAX_CONNECTIONS];
+bool    deviceManagerInitialized = false;
+dm_event_cb_t applicationHandler = NULL;
+
+NRF_CLOCK_Type clock;
+
+uint32_t queueFlashOperation(uint8_t opCode, pstorage_handle_t *p_handle, uint8_t *p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+    if ((p_handle->module_id >= moduleCount) ||
+        ((p_handle->block_id + offset + size) > (reinterpret_cast<uintptr_t>(flash) + flashUsed))) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    FlashOperation operation = { opCode, *p_handle, p_src, size, offset };
+    flashOperations.push_back(operation);
+    if (flashOperations.size() == 1) {
+        sim_pushSysEvent(flashFailures ? NRF_EVT_FLASH_OPERATION_ERROR : NRF_EVT_FLASH_OPERATION_SUCCESS);
+    }
+    return NRF_SUCCESS;
+}
+
+} /* namespace */
+
+NRF_CLOCK_Type *NRF_CLOCK = &clock;
+
+void sim_failFlashOperations(unsigned count)
+{
+    flashFailures = count;
+}
+
+void sim_resetSdk(void)
+{
+    memset(flash, 0xFF, sizeof(flash));
+    flashUsed   = 0;
+    moduleCount = 0;
+    flashOperations.clear();
+    flashFailures = 0;
+
+    for (unsigned i = 0; i < DEVICE_MANAGER_MAX_BONDS; i++) {
+        bonds[i].valid = false;
+    }
+    memset(connectionDevice, DM_INVALID_ID, sizeof(connectionDevice));
+    deviceManagerInitialized = false;
+    applicationHandler       = NULL;
+}
+
+void sim_bond(uint16_t conn_handle, uint8_t device_id, const ble_gap_addr_t *peer_addr)
+{
+    bonds[device_id].valid   = true;
+    bonds[device_id].address = *peer_addr;
+    connectionDevice[conn_handle] = device_id;
+}
+
+void NVIC_SystemReset(void)
+{
+    sim_reset();
+}
+
+/*
+ * Persistent storage
+ */
+uint32_t pstorage_init(void)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t pstorage_register(pstorage_module_param_t *p_module_param, pstorage_handle_t *p_block_id)
+{
+    uint32_t size = (p_module_param->block_size * p_module_param->block_count + 3) & ~3u;
+    if ((moduleCount == MAX_MODULES) || ((flashUsed + size) > FLASH_SIZE)) {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    /* block_id holds the address, which has to fit in 32 bits; see the host CMakeLists.txt. */
+    uintptr_t base = reinterpret_cast<uintptr_t>(flash) + flashUsed;
+    if (base != static_cast<uint32_t>(base)) {
+        return NRF_ERROR_INTERNAL;
+    }
+
+    StorageModule &module = modules[moduleCount];
+    module.cb         = p_module_param->cb;
+    module.base       = base;
+    module.blockSize  = p_module_param->block_size;
+    module.blockCount = p_module_param->block_count;
+
+    p_block_id->module_id = moduleCount++;
+    p_block_id->block_id  = module.base;
+    flashUsed += size;
+    return NRF_SUCCESS;
+}
+
+uint32_t pstorage_block_identifier_get(pstorage_handle_t *p_base_id, pstorage_size_t block_num, pstorage_handle_t *p_block_id)
+{
+    if ((p_base_id->module_id >= moduleCount) || (block_num >= modules[p_base_id->module_id].blockCount)) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    const StorageModule &module = modules[p_base_id->module_id];
+    p_block_id->module_id = p_base_id->module_id;
+    p_block_id->block_id  = module.base + block_num * module.blockSize;
+    return NRF_SUCCESS;
+}
+
+uint32_t pstorage_store(pstorage_handle_t *p_dest, uint8_t *p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+    return queueFlashOperation(PSTORAGE_STORE_OP_CODE, p_dest, p_src, size, offset);
+}
+
+uint32_t pstorage_update(pstorage_handle_t *p_dest, uint8_t *p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+    return queueFlashOperation(PSTORAGE_UPDATE_OP_CODE, p_dest, p_src, size, offset);
+}
+
+uint32_t pstorage_load(uint8_t *p_dest, pstorage_handle_t *p_src, pstorage_size_t size, pstorage_size_t offset)
+{
+    memcpy(p_dest, reinterpret_cast<const uint8_t *>(static_cast<uintptr_t>(p_src->block_id)) + offset, size);
+    return NRF_SUCCESS;
+}
+
+uint32_t pstorage_clear(pstorage_handle_t *p_base_id, pstorage_size_t size)
+{
+    return queueFlashOperation(PSTORAGE_CLEAR_OP_CODE, p_base_id, NULL, size, 0);
+}
+
+void pstorage_sys_event_handler(uint32_t sys_evt)
+{
+    if (((sys_evt != NRF_EVT_FLASH_OPERATION_SUCCESS) && (sys_evt != NRF_EVT_FLASH_OPERATION_ERROR)) || flashOperations.empty()) {
+        return;
+    }
+
+    FlashOperation operation = flashOperations.front();
+    flashOperations.pop_front();
+
+    uint32_t result = NRF_SUCCESS;
+    if (sys_evt == NRF_EVT_FLASH_OPERATION_ERROR) {
+        flashFailures--;
+        result = NRF_ERROR_TIMEOUT;
+    } else {
+        uint8_t *dest = reinterpret_cast<uint8_t *>(static_cast<uintptr_t>(operation.handle.block_id)) + operation.offset;
+        if (operation.opCode == PSTORAGE_CLEAR_OP_CODE) {
+            memset(dest, 0xFF, operation.size);
+        } else {
+            memcpy(dest, operation.src, operation.size);
+        }
+    }
+
+    if (!flashOperations.empty()) {
+        sim_pushSysEvent(flashFailures ? NRF_EVT_FLASH_OPERATION_ERROR : NRF_EVT_FLASH_OPERATION_SUCCESS);
+    }
+
+    pstorage_ntf_cb_t cb = modules[operation.handle.module_id].cb;
+    if (cb != NULL) {
+        cb(&operation.handle, operation.opCode, result, operation.src, operation.size);
+    }
+}
+
+/*
+ * Device manager
+ */
+ret_code_t dm_init(dm_init_param_t const *p_init_param)
+{
+    deviceManagerInitialized = true;
+    return NRF_SUCCESS;
+}
+
+ret_code_t dm_register(dm_application_instance_t *p_appl_instance, dm_application_param_t const *p_appl_param)
+{
+    if (!deviceManagerInitialized) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (applicationHandler != NULL) {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    applicationHandler = p_appl_param->evt_handler;
+    *p_appl_instance   = 0;
+    return NRF_SUCCESS;
+}
+
+ret_code_t dm_device_delete_all(dm_application_instance_t const *p_application)
+{
+    for (uint8_t device_id = 0; device_id < DEVICE_MANAGER_MAX_BONDS; device_id++) {
+        if (!bonds[device_id].valid) {
+            continue;
+        }
+        bonds[device_id].valid = false;
+
+        if (applicationHandler != NULL) {
+            dm_handle_t handle = { *p_application, DM_INVALID_ID, device_id, DM_INVALID_ID };
+            dm_event_t  event;
+            memset(&event, 0, sizeof(event));
+            event.event_id = DM_EVT_DEVICE_CONTEXT_DELETED;
+            applicationHandler(&handle, &event, NRF_SUCCESS);
+        }
+    }
+    memset(connectionDevice, DM_INVALID_ID, sizeof(connectionDevice));
+    return NRF_SUCCESS;
+}
+
+ret_code_t dm_handle_get(uint16_t conn_handle, dm_handle_t *p_handle)
+{
+    if (conn_handle >= MAX_CONNECTIONS) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    p_handle->connection_id = conn_handle;
+    p_handle->device_id     = connectionDevice[conn_handle];
+    p_handle->service_id    = DM_INVALID_ID;
+    return NRF_SUCCESS;
+}
+
+ret_code_t dm_peer_addr_get(dm_handle_t const *p_handle, ble_gap_addr_t *p_addr)
+{
+    if ((p_handle->device_id >= DEVICE_MANAGER_MAX_BONDS) || !bonds[p_handle->device_id].valid) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    *p_addr = bonds[p_handle->device_id].address;
+    return NRF_SUCCESS;
+}
+
+ret_code_t dm_security_status_req(dm_handle_t const *p_handle, dm_security_status_t *p_status)
+{
+    /* Links are never encrypted here: there is no pairing. */
+    *p_status = 0;
+    return NRF_SUCCESS;
+}
+
+ret_code_t dm_whitelist_create(dm_application_instance_t const *p_handle, ble_gap_whitelist_t *p_whitelist)
+{
+    if (p_whitelist == NULL) {
+        return NRF_ERROR_NULL;
+    }
+
+    p_whitelist->addr_count = 0;
+    p_whitelist->irk_count  = 0;
+    return NRF_SUCCESS;
+}
+
+void dm_ble_evt_handler(ble_evt_t *p_ble_evt)
+{
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_DISCONNECTED) {
+        uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+        if (conn_handle < MAX_CONNECTIONS) {
+            connectionDevice[conn_handle] = DM_INVALID_ID;
+        }
+    }
+}
+
+bool im_address_resolve(ble_gap_addr_t const *p_addr, ble_gap_irk_t const *p_irk)
+{
+    return false;
+}
+
+void ah(uint8_t const *p_k, uint8_t const *p_r, uint8_t *p_local_hash)
+{
+    memset(p_local_hash, 0, 3);
+}
+
+/*
+ * Radio notification: there is no radio.
+ */
+uint32_t ble_radio_notification_init(uint32_t irq_priority, uint8_t distance, void (*evt_handler)(bool radio_active))
+{
+    return NRF_SUCCESS;
+}
@@ -0,0 +1,1691 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "softdevice.h"
+
+namespace {
+
+const unsigned MAX_CONNECTIONS    = 8;
+const unsigned MAX_VS_UUIDS       = 10;  /**< Default vs_uuid_count of S130. */
+const unsigned ATT_MTU            = GATT_MTU_SIZE_DEFAULT;
+const unsigned ATTRIBUTE_OVERHEAD = 8;   /**< Attribute table bytes taken by each attribute besides its value. */
+
+const sim_linkParams_t DEFAULT_LINK = {
+    /* .intervalUs      = */ 7500,
+    /* .txBuffers       = */ 6,
+    /* .packetsPerEvent = */ 6,
+};
+
+/*
+ * Events
+ */
+typedef std::vector<uint32_t> EventStorage_t; /* Words, as sd_ble_evt_get() requires word alignment. */
+
+struct QueuedEvent {
+    uint16_t       len;
+    EventStorage_t data;
+};
+
+std::deque<QueuedEvent>        bleEvents;
+std::deque<uint32_t>           sysEvents;
+softdevice_evt_schedule_func_t scheduleFunction = NULL;
+bool                           enabled          = false;
+
+/*
+ * Attributes, of the local GATT server and of the peer's database.
+ */
+enum AttributeKind {
+    ATTR_SERVICE,
+    ATTR_CHAR_DECL,
+    ATTR_VALUE,
+    ATTR_CCCD,
+    ATTR_DESCRIPTOR,
+};
+
+struct Attribute {
+    uint16_t             handle;
+    AttributeKind        kind;
+    bool                 longUUID;
+    uint16_t             uuid16;       /**< Short UUID, or bytes 12-13 of a long one. */
+    uint8_t              uuid128[16];  /**< LSB first. */
+    uint8_t              properties;   /**< ATTR_CHAR_DECL and ATTR_VALUE. */
+    uint16_t             valueHandle;  /**< ATTR_CHAR_DECL and ATTR_CCCD: value handle of the characteristic. */
+    uint8_t              vloc;
+    bool                 vlen;
+    uint16_t             maxLen;
+    uint16_t             len;
+    std::vector<uint8_t> value;        /**< BLE_GATTS_VLOC_STACK. */
+    uint8_t             *userValue;    /**< BLE_GATTS_VLOC_USER. */
+
+    uint8_t *valuePtr() {
+        return (vloc == BLE_GATTS_VLOC_USER) ? userValue : &value[0];
+    }
+};
+
+typedef std::vector<Attribute> AttributeTable_t;
+
+AttributeTable_t localAttributes;
+AttributeTable_t peerAttributes;
+uint32_t         attributeTableSize = 0;
+uint32_t         attributeTableUsed = 0;
+
+std::vector<ble_uuid128_t> vendorUUIDs;
+
+/*
+ * Connections
+ */
+struct Packet {
+    uint16_t len;
+    bool     notification; /**< Rather than a write command. */
+};
+
+enum GattcState {
+    GATTC_IDLE,
+    GATTC_QUEUED,    /**< Request waiting for the next connection event. */
+    GATTC_IN_FLIGHT, /**< Response expected in the next connection event. */
+};
+
+enum IndicationState {
+    INDICATION_NONE,
+    INDICATION_QUEUED,
+    INDICATION_SENT,
+};
+
+struct Connection {
+    bool                         active;
+    uint8_t                      role;
+    sim_linkParams_t             link;
+    uint64_t                     nextEventUs;
+    uint16_t                     pendingIntervalUs; /**< Connection parameter update to apply; 0 if none. */
+
+    std::deque<Packet>           txQueue;
+    IndicationState              indication;
+    uint16_t                     indicationHandle;
+    uint16_t                     indicationLen;
+
+    GattcState                   gattc;
+    QueuedEvent                  gattcResponse;
+
+    bool                         sysAttrsSet;
+    bool                         sysAttrMissingReported;
+    std::map<uint16_t, uint16_t> cccds;
+    std::vector<QueuedEvent>     heldWrites; /**< CCCD writes waiting for the system attributes. */
+
+    uint32_t                     notificationsReceived;
+    uint32_t                     bytesReceived;
+};
+
+Connection connections[MAX_CONNECTIONS];
+uint64_t   nowUs            = 0;
+uint32_t   connectionEvents = 0;
+
+/*
+ * GAP
+ */
+ble_gap_addr_t        ownAddress = { BLE_GAP_ADDR_TYPE_RANDOM_STATIC, { 0x01, 0x02, 0x03, 0x04, 0x05, 0xC6 } };
+ble_gap_conn_params_t ppcp       = { 6, 6, 0, 400 };
+uint8_t               deviceName[BLE_GAP_DEVNAME_MAX_LEN];
+uint16_t              deviceNameLen = 0;
+uint16_t              appearance    = 0;
+
+/*
+ * Helpers
+ */
+ble_evt_t *newEvent(QueuedEvent &event, uint16_t evt_id, uint16_t len)
+{
+    assert(len <= BLE_STACK_EVT_MSG_BUF_SIZE);
+    event.len = len;
+    event.data.assign((BLE_STACK_EVT_MSG_BUF_SIZE + sizeof(uint32_t) - 1) / sizeof(uint32_t), 0);
+
+    ble_evt_t *p_ble_evt = reinterpret_cast<ble_evt_t *>(&event.data[0]);
+    p_ble_evt->header.evt_id  = evt_id;
+    p_ble_evt->header.evt_len = len - sizeof(ble_evt_hdr_t);
+    return p_ble_evt;
+}
+
+void pushEvent(const QueuedEvent &event)
+{
+    bleEvents.push_back(event);
+    if (scheduleFunction != NULL) {
+        scheduleFunction();
+    }
+}
+
+Connection *findConnection(uint16_t conn_handle)
+{
+    if ((conn_handle >= MAX_CONNECTIONS) || !connections[conn_handle].active) {
+        return NULL;
+    }
+    return &connections[conn_handle];
+}
+
+Attribute *findAttribute(AttributeTable_t &table, uint16_t handle)
+{
+    for (size_t i = 0; i < table.size(); i++) {
+        if (table[i].handle == handle) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+bool vendorBaseMatches(const uint8_t *base, const uint8_t *uuid128)
+{
+    for (unsigned i = 0; i < 16; i++) {
+        if ((i != 12) && (i != 13) && (base[i] != uuid128[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @return the vendor UUID type of a long UUID, or BLE_UUID_TYPE_UNKNOWN if its base wasn't added.
+ */
+uint8_t vendorType(const uint8_t *uuid128)
+{
+    for (size_t i = 0; i < vendorUUIDs.size(); i++) {
+        if (vendorBaseMatches(vendorUUIDs[i].uuid128, uuid128)) {
+            return BLE_UUID_TYPE_VENDOR_BEGIN + i;
+        }
+    }
+    return BLE_UUID_TYPE_UNKNOWN;
+}
+
+ble_uuid_t reportedUUID(const Attribute &attribute)
+{
+    ble_uuid_t uuid;
+    uuid.uuid = attribute.uuid16;
+    uuid.type = attribute.longUUID ? vendorType(attribute.uuid128) : BLE_UUID_TYPE_BLE;
+    return uuid;
+}
+
+/**
+ * Fill in the UUID of an attribute from a SoftDevice UUID.
+ */
+bool setAttributeUUID(Attribute &attribute, const ble_uuid_t *p_uuid)
+{
+    attribute.uuid16   = p_uuid->uuid;
+    attribute.longUUID = false;
+    memset(attribute.uuid128, 0, sizeof(attribute.uuid128));
+
+    if (p_uuid->type == BLE_UUID_TYPE_BLE) {
+        return true;
+    }
+    if ((p_uuid->type < BLE_UUID_TYPE_VENDOR_BEGIN) || ((unsigned)(p_uuid->type - BLE_UUID_TYPE_VENDOR_BEGIN) >= vendorUUIDs.size())) {
+        return false;
+    }
+
+    attribute.longUUID = true;
+    memcpy(attribute.uuid128, vendorUUIDs[p_uuid->type - BLE_UUID_TYPE_VENDOR_BEGIN].uuid128, 16);
+    attribute.uuid128[12] = p_uuid->uuid & 0xFF;
+    attribute.uuid128[13] = p_uuid->uuid >> 8;
+    return true;
+}
+
+/**
+ * @return the attribute type, i.e. the UUID a Read By Type request matches.
+ */
+uint16_t attributeType(const Attribute &attribute)
+{
+    switch (attribute.kind) {
+        case ATTR_SERVICE:   return BLE_UUID_SERVICE_PRIMARY;
+        case ATTR_CHAR_DECL: return BLE_UUID_CHARACTERISTIC;
+        case ATTR_CCCD:      return BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG;
+        default:             return attribute.longUUID ? 0 : attribute.uuid16;
+    }
+}
+
+/**
+ * @return the value of an attribute as seen over the air; for declarations, as built by the server.
+ */
+std::vector<uint8_t> attributeValue(AttributeTable_t &table, Attribute &attribute, Connection *connection)
+{
+    std::vector<uint8_t> value;
+
+    switch (attribute.kind) {
+        case ATTR_SERVICE:
+            if (attribute.longUUID) {
+                value.assign(attribute.uuid128, attribute.uuid128 + 16);
+            } else {
+                value.push_back(attribute.uuid16 & 0xFF);
+                value.push_back(attribute.uuid16 >> 8);
+            }
+            break;
+
+        case ATTR_CHAR_DECL:
+            value.push_back(attribute.properties);
+            value.push_back(attribute.valueHandle & 0xFF);
+            value.push_back(attribute.valueHandle >> 8);
+            if (attribute.longUUID) {
+                value.insert(value.end(), attribute.uuid128, attribute.uuid128 + 16);
+            } else {
+                value.push_back(attribute.uuid16 & 0xFF);
+                value.push_back(attribute.uuid16 >> 8);
+            }
+            break;
+
+        case ATTR_CCCD: {
+            uint16_t cccd = (connection != NULL) ? connection->cccds[attribute.handle] : 0;
+            value.push_back(cccd & 0xFF);
+            value.push_back(cccd >> 8);
+            break;
+        }
+
+        default:
+            value.assign(attribute.valuePtr(), attribute.valuePtr() + attribute.len);
+            break;
+    }
+
+    return value;
+}
+
+uint16_t nextHandle(const AttributeTable_t &table)
+{
+    return table.empty() ? BLE_GATT_HANDLE_START : (table.back().handle + 1);
+}
+
+Attribute &appendAttribute(AttributeTable_t &table, AttributeKind kind)
+{
+    Attribute attribute;
+    memset(attribute.uuid128, 0, sizeof(attribute.uuid128));
+    attribute.handle      = nextHandle(table);
+    attribute.kind        = kind;
+    attribute.longUUID    = false;
+    attribute.uuid16      = 0;
+    attribute.properties  = 0;
+    attribute.valueHandle = BLE_GATT_HANDLE_INVALID;
+    attribute.vloc        = BLE_GATTS_VLOC_STACK;
+    attribute.vlen        = true;
+    attribute.maxLen      = 0;
+    attribute.len         = 0;
+    attribute.userValue   = NULL;
+    table.push_back(attribute);
+    return table.back();
+}
+
+void setStackValue(Attribute &attribute, const uint8_t *value, uint16_t len, uint16_t maxLen)
+{
+    attribute.vloc   = BLE_GATTS_VLOC_STACK;
+    attribute.maxLen = maxLen;
+    attribute.len    = len;
+    attribute.value.assign(maxLen + 1, 0); /* +1 keeps &value[0] valid for empty values. */
+    if (value != NULL) {
+        memcpy(&attribute.value[0], value, len);
+    }
+}
+
+/**
+ * Add an attribute to the local table, accounting for its room in the attribute table.
+ */
+Attribute *addLocalAttribute(AttributeKind kind, const ble_uuid_t *p_uuid, const ble_gatts_attr_t *p_attr)
+{
+    uint32_t size = ATTRIBUTE_OVERHEAD;
+    if ((p_attr != NULL) && (p_attr->p_attr_md->vloc == BLE_GATTS_VLOC_STACK)) {
+        size += (p_attr->max_len + 3) & ~3;
+    }
+    if (attributeTableUsed + size > attributeTableSize) {
+        return NULL;
+    }
+
+    Attribute &attribute = appendAttribute(localAttributes, kind);
+    if (!setAttributeUUID(attribute, p_uuid)) {
+        localAttributes.pop_back();
+        return NULL;
+    }
+    attributeTableUsed += size;
+
+    if (p_attr != NULL) {
+        if (p_attr->p_attr_md->vloc == BLE_GATTS_VLOC_USER) {
+            attribute.vloc      = BLE_GATTS_VLOC_USER;
+            attribute.maxLen    = p_attr->max_len;
+            attribute.len       = p_attr->init_len;
+            attribute.userValue = p_attr->p_value;
+        } else {
+            setStackValue(attribute, p_attr->p_value, p_attr->init_len, p_attr->max_len);
+        }
+        attribute.vlen = p_attr->p_attr_md->vlen;
+    }
+    return &attribute;
+}
+
+/**
+ * Add the GAP and GATT services which the SoftDevice populates itself.
+ */
+void addBuiltinServices(bool serviceChanged)
+{
+    static const ble_gatts_attr_md_t stackMetadata = { {1, 1}, {1, 1}, 1, BLE_GATTS_VLOC_STACK, 0, 0 };
+    static const uint16_t gapCharacteristics[] = { 0x2A00 /* Device Name */, 0x2A01 /* Appearance */, 0x2A04 /* PPCP */ };
+
+    ble_uuid_t uuid = { 0x1800, BLE_UUID_TYPE_BLE };
+    addLocalAttribute(ATTR_SERVICE, &uuid, NULL);
+    for (unsigned i = 0; i < sizeof(gapCharacteristics) / sizeof(gapCharacteristics[0]); i++) {
+        uuid.uuid = gapCharacteristics[i];
+        ble_gatts_attr_t attr = { &uuid, const_cast<ble_gatts_attr_md_t *>(&stackMetadata), 0, 0, BLE_GAP_DEVNAME_MAX_LEN, NULL };
+        Attribute *decl = addLocalAttribute(ATTR_CHAR_DECL, &uuid, NULL);
+        decl->properties  = 0x02; /* read */
+        decl->valueHandle = decl->handle + 1;
+        addLocalAttribute(ATTR_VALUE, &uuid, &attr)->properties = 0x02;
+    }
+
+    uuid.uuid = BLE_UUID_GATT;
+    addLocalAttribute(ATTR_SERVICE, &uuid, NULL);
+    if (serviceChanged) {
+        uuid.uuid = BLE_UUID_GATT_CHARACTERISTIC_SERVICE_CHANGED;
+        ble_gatts_attr_t attr = { &uuid, const_cast<ble_gatts_attr_md_t *>(&stackMetadata), 4, 0, 4, NULL };
+        Attribute *decl = addLocalAttribute(ATTR_CHAR_DECL, &uuid, NULL);
+        decl->properties  = 0x20; /* indicate */
+        decl->valueHandle = decl->handle + 1;
+        addLocalAttribute(ATTR_VALUE, &uuid, &attr)->properties = 0x20;
+
+        uuid.uuid = BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG;
+        addLocalAttribute(ATTR_CCCD, &uuid, NULL)->valueHandle = decl->valueHandle;
+    }
+}
+
+/**
+ * Queue a GATT client response, to be delivered once the request has gone over the air.
+ */
+uint32_t queueGattcResponse(Connection *connection, const QueuedEvent &response)
+{
+    connection->gattc         = GATTC_QUEUED;
+    connection->gattcResponse = response;
+    return NRF_SUCCESS;
+}
+
+ble_gattc_evt_t *newGattcEvent(QueuedEvent &event, uint16_t conn_handle, uint16_t evt_id, uint16_t paramsLen)
+{
+    ble_evt_t *p_ble_evt = newEvent(event, evt_id, offsetof(ble_evt_t, evt.gattc_evt.params) + paramsLen);
+    p_ble_evt->evt.gattc_evt.conn_handle = conn_handle;
+    p_ble_evt->evt.gattc_evt.gatt_status = BLE_GATT_STATUS_SUCCESS;
+    return &p_ble_evt->evt.gattc_evt;
+}
+
+uint32_t gattcNotFound(Connection *connection, uint16_t conn_handle, uint16_t evt_id, uint16_t error_handle)
+{
+    QueuedEvent      response;
+    ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, evt_id, sizeof(uint16_t));
+    gattc->gatt_status  = BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND;
+    gattc->error_handle = error_handle;
+    return queueGattcResponse(connection, response);
+}
+
+/**
+ * Check the preconditions shared by the GATT client procedures.
+ */
+uint32_t gattcCheck(uint16_t conn_handle, Connection **connectionP)
+{
+    Connection *connection = findConnection(conn_handle);
+    if (connection == NULL) {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (connection->gattc != GATTC_IDLE) {
+        return NRF_ERROR_BUSY;
+    }
+    *connectionP = connection;
+    return NRF_SUCCESS;
+}
+
+void applyParamUpdate(uint16_t conn_handle, Connection &connection)
+{
+    connection.link.intervalUs  = connection.pendingIntervalUs;
+    connection.pendingIntervalUs = 0;
+
+    QueuedEvent event;
+    ble_evt_t *p_ble_evt = newEvent(event, BLE_GAP_EVT_CONN_PARAM_UPDATE, offsetof(ble_evt_t, evt.gap_evt.params) + sizeof(ble_gap_evt_conn_param_update_t));
+    p_ble_evt->evt.gap_evt.conn_handle = conn_handle;
+    ble_gap_conn_params_t &params = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params;
+    params.min_conn_interval = connection.link.intervalUs / 1250;
+    params.max_conn_interval = connection.link.intervalUs / 1250;
+    params.slave_latency     = 0;
+    params.conn_sup_timeout  = 400;
+    pushEvent(event);
+}
+
+/**
+ * Run a connection event: the link carries up to packetsPerEvent packets, the
+ * GATT client request or response first, then the indication and the
+ * notifications and write commands in the order they were queued.
+ */
+void runConnectionEvent(uint16_t conn_handle, Connection &connection)
+{
+    connectionEvents++;
+    unsigned budget = connection.link.packetsPerEvent;
+
+    if (connection.gattc == GATTC_IN_FLIGHT) {
+        connection.gattc = GATTC_IDLE;
+        pushEvent(connection.gattcResponse);
+        budget--;
+    } else if (connection.gattc == GATTC_QUEUED) {
+        connection.gattc = GATTC_IN_FLIGHT;
+        budget--;
+    }
+
+    if (connection.indication == INDICATION_SENT) {
+        connection.indication = INDICATION_NONE;
+
+        QueuedEvent event;
+        ble_evt_t *p_ble_evt = newEvent(event, BLE_GATTS_EVT_HVC, offsetof(ble_evt_t, evt.gatts_evt.params) + sizeof(ble_gatts_evt_hvc_t));
+        p_ble_evt->evt.gatts_evt.conn_handle       = conn_handle;
+        p_ble_evt->evt.gatts_evt.params.hvc.handle = connection.indicationHandle;
+        pushEvent(event);
+    } else if ((connection.indication == INDICATION_QUEUED) && (budget > 0)) {
+        connection.indication = INDICATION_SENT;
+        connection.notificationsReceived++;
+        connection.bytesReceived += connection.indicationLen;
+        budget--;
+    }
+
+    uint8_t sent = 0;
+    while ((budget > 0) && !connection.txQueue.empty()) {
+        const Packet &packet = connection.txQueue.front();
+        if (packet.notification) {
+            connection.notificationsReceived++;
+            connection.bytesReceived += packet.len;
+        }
+        connection.txQueue.pop_front();
+        budget--;
+        sent++;
+    }
+
+    if (sent != 0) {
+        QueuedEvent event;
+        ble_evt_t *p_ble_evt = newEvent(event, BLE_EVT_TX_COMPLETE, offsetof(ble_evt_t, evt.common_evt.params) + sizeof(ble_evt_tx_complete_t));
+        p_ble_evt->evt.common_evt.conn_handle             = conn_handle;
+        p_ble_evt->evt.common_evt.params.tx_complete.count = sent;
+        pushEvent(event);
+    }
+
+    if (connection.pendingIntervalUs != 0) {
+        applyParamUpdate(conn_handle, connection);
+    }
+}
+
+/**
+ * Apply a write from the peer to the local GATT server and report it.
+ */
+void deliverPeerWrite(uint16_t conn_handle, Connection &connection, const QueuedEvent &event)
+{
+    const ble_evt_t *p_ble_evt = reinterpret_cast<const ble_evt_t *>(&event.data[0]);
+    const ble_gatts_evt_write_t &write = p_ble_evt->evt.gatts_evt.params.write;
+
+    Attribute *attribute = findAttribute(localAttributes, write.handle);
+    if (attribute->kind == ATTR_CCCD) {
+        connection.cccds[write.handle] = write.data[0] | (write.data[1] << 8);
+    } else {
+        memcpy(attribute->valuePtr(), write.data, write.len);
+        attribute->len = write.len;
+    }
+
+    pushEvent(event);
+}
+
+} /* namespace */
+
+/*
+ * Simulation control
+ */
+void sim_reset(void)
+{
+    bleEvents.clear();
+    sysEvents.clear();
+    scheduleFunction = NULL;
+    enabled          = false;
+
+    localAttributes.clear();
+    peerAttributes.clear();
+    attributeTableSize = 0;
+    attributeTableUsed = 0;
+    vendorUUIDs.clear();
+
+    for (unsigned i = 0; i < MAX_CONNECTIONS; i++) {
+        connections[i] = Connection();
+        connections[i].active = false;
+    }
+    nowUs            = 0;
+    connectionEvents = 0;
+
+    deviceNameLen = 0;
+    appearance    = 0;
+
+    sim_resetSdk();
+}
+
+uint32_t sim_now(void)
+{
+    return (uint32_t) nowUs;
+}
+
+extern "C" uint32_t us_ticker_read(void)
+{
+    return sim_now();
+}
+
+bool sim_step(void)
+{
+    Connection *next       = NULL;
+    uint16_t    nextHandle = BLE_CONN_HANDLE_INVALID;
+    for (unsigned i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].active && ((next == NULL) || (connections[i].nextEventUs < next->nextEventUs))) {
+            next       = &connections[i];
+            nextHandle = i;
+        }
+    }
+    if (next == NULL) {
+        return false;
+    }
+
+    if (next->nextEventUs > nowUs) {
+        nowUs = next->nextEventUs;
+    }
+    next->nextEventUs += next->link.intervalUs;
+    runConnectionEvent(nextHandle, *next);
+    return true;
+}
+
+uint32_t sim_connectionEvents(void)
+{
+    return connectionEvents;
+}
+
+void sim_pushEvent(const ble_evt_t *p_ble_evt, uint16_t len)
+{
+    QueuedEvent event;
+    newEvent(event, p_ble_evt->header.evt_id, len);
+    memcpy(&event.data[0], p_ble_evt, len);
+    pushEvent(event);
+}
+
+void sim_pushSysEvent(uint32_t evt_id)
+{
+    sysEvents.push_back(evt_id);
+    if (scheduleFunction != NULL) {
+        scheduleFunction();
+    }
+}
+
+unsigned sim_pendingEvents(void)
+{
+    return bleEvents.size() + sysEvents.size();
+}
+
+uint16_t sim_connect(uint8_t role, const sim_linkParams_t *link)
+{
+    uint16_t conn_handle;
+    for (conn_handle = 0; conn_handle < MAX_CONNECTIONS; conn_handle++) {
+        if (!connections[conn_handle].active) {
+            break;
+        }
+    }
+    if (conn_handle == MAX_CONNECTIONS) {
+        return BLE_CONN_HANDLE_INVALID;
+    }
+
+    Connection &connection = connections[conn_handle];
+    connection = Connection();
+    connection.active                 = true;
+    connection.role                   = role;
+    connection.link                   = (link != NULL) ? *link : DEFAULT_LINK;
+    connection.nextEventUs            = nowUs + connection.link.intervalUs;
+    connection.pendingIntervalUs      = 0;
+    connection.indication             = INDICATION_NONE;
+    connection.gattc                  = GATTC_IDLE;
+    connection.sysAttrsSet            = false;
+    connection.sysAttrMissingReported = false;
+    connection.notificationsReceived  = 0;
+    connection.bytesReceived          = 0;
+
+    QueuedEvent event;
+    ble_evt_t *p_ble_evt = newEvent(event, BLE_GAP_EVT_CONNECTED, offsetof(ble_evt_t, evt.gap_evt.params) + sizeof(ble_gap_evt_connected_t));
+    p_ble_evt->evt.gap_evt.conn_handle = conn_handle;
+    ble_gap_evt_connected_t &connected = p_ble_evt->evt.gap_evt.params.connected;
+    connected.peer_addr.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+    for (unsigned i = 0; i < BLE_GAP_ADDR_LEN; i++) {
+        connected.peer_addr.addr[i] = 0x10 + conn_handle + i;
+    }
+    connected.peer_addr.addr[BLE_GAP_ADDR_LEN - 1] |= 0xC0;
+    connected.own_addr                      = ownAddress;
+    connected.role                          = role;
+    connected.conn_params.min_conn_interval = connection.link.intervalUs / 1250;
+    connected.conn_params.max_conn_interval = connection.link.intervalUs / 1250;
+    connected.conn_params.slave_latency     = 0;
+    connected.conn_params.conn_sup_timeout  = 400;
+    pushEvent(event);
+
+    return conn_handle;
+}
+
+void sim_disconnect(uint16_t conn_handle, uint8_t reason)
+{
+    Connection *connection = findConnection(conn_handle);
+    if (connection == NULL) {
+        return;
+    }
+    connection->active = false;
+
+    QueuedEvent event;
+    ble_evt_t *p_ble_evt = newEvent(event, BLE_GAP_EVT_DISCONNECTED, offsetof(ble_evt_t, evt.gap_evt.params) + sizeof(ble_gap_evt_disconnected_t));
+    p_ble_evt->evt.gap_evt.conn_handle                = conn_handle;
+    p_ble_evt->evt.gap_evt.params.disconnected.reason = reason;
+    pushEvent(event);
+}
+
+void sim_peerWrite(uint16_t conn_handle, uint16_t handle, const uint8_t *data, uint16_t len)
+{
+    Connection *connection = findConnection(conn_handle);
+    Attribute  *attribute  = findAttribute(localAttributes, handle);
+    assert((connection != NULL) && (attribute != NULL) && (len <= ATT_MTU - 3));
+
+    QueuedEvent event;
+    ble_evt_t *p_ble_evt = newEvent(event, BLE_GATTS_EVT_WRITE, offsetof(ble_evt_t, evt.gatts_evt.params.write.data) + len);
+    p_ble_evt->evt.gatts_evt.conn_handle = conn_handle;
+    ble_gatts_evt_write_t &write = p_ble_evt->evt.gatts_evt.params.write;
+    write.handle    = handle;
+    write.uuid.uuid = attribute->uuid16;
+    write.uuid.type = attribute->longUUID ? vendorType(attribute->uuid128) : BLE_UUID_TYPE_BLE;
+    write.op        = BLE_GATTS_OP_WRITE_REQ;
+    write.offset    = 0;
+    write.len       = len;
+    memcpy(write.data, data, len);
+
+    if ((attribute->kind == ATTR_CCCD) && !connection->sysAttrsSet) {
+        /* The SoftDevice holds the request until the application provides the system attributes. */
+        connection->heldWrites.push_back(event);
+        if (!connection->sysAttrMissingReported) {
+            connection->sysAttrMissingReported = true;
+
+            QueuedEvent missing;
+            ble_evt_t *p_missing = newEvent(missing, BLE_GATTS_EVT_SYS_ATTR_MISSING, offsetof(ble_evt_t, evt.gatts_evt.params) + sizeof(ble_gatts_evt_sys_attr_missing_t));
+            p_missing->evt.gatts_evt.conn_handle = conn_handle;
+            pushEvent(missing);
+        }
+        return;
+    }
+
+    deliverPeerWrite(conn_handle, *connection, event);
+}
+
+uint32_t sim_peerNotificationsReceived(uint16_t conn_handle)
+{
+    return (conn_handle < MAX_CONNECTIONS) ? connections[conn_handle].notificationsReceived : 0;
+}
+
+uint32_t sim_peerBytesReceived(uint16_t conn_handle)
+{
+    return (conn_handle < MAX_CONNECTIONS) ? connections[conn_handle].bytesReceived : 0;
+}
+
+void sim_peerClearDatabase(void)
+{
+    peerAttributes.clear();
+}
+
+static void setPeerUUID(Attribute &attribute, uint16_t uuid16, const uint8_t *uuid128)
+{
+    if (uuid128 != NULL) {
+        attribute.longUUID = true;
+        memcpy(attribute.uuid128, uuid128, 16);
+        attribute.uuid16 = uuid128[12] | (uuid128[13] << 8);
+    } else {
+        attribute.uuid16 = uuid16;
+    }
+}
+
+uint16_t sim_peerAddService(uint16_t uuid16, const uint8_t *uuid128)
+{
+    Attribute &service = appendAttribute(peerAttributes, ATTR_SERVICE);
+    setPeerUUID(service, uuid16, uuid128);
+    return service.handle;
+}
+
+uint16_t sim_peerAddCharacteristic(uint16_t uuid16, const uint8_t *uuid128, uint8_t properties)
+{
+    Attribute &decl = appendAttribute(peerAttributes, ATTR_CHAR_DECL);
+    setPeerUUID(decl, uuid16, uuid128);
+    decl.properties  = properties;
+    decl.valueHandle = decl.handle + 1;
+    uint16_t valueHandle = decl.valueHandle;
+
+    Attribute &value = appendAttribute(peerAttributes, ATTR_VALUE);
+    setPeerUUID(value, uuid16, uuid128);
+    value.properties = properties;
+    setStackValue(value, NULL, 0, ATT_MTU - 3);
+
+    if (properties & (0x10 /* notify */ | 0x20 /* indicate */)) {
+        Attribute &cccd = appendAttribute(peerAttributes, ATTR_CCCD);
+        cccd.uuid16      = BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG;
+        cccd.valueHandle = valueHandle;
+    }
+
+    return valueHandle;
+}
+
+uint16_t sim_peerAddDescriptor(uint16_t uuid16)
+{
+    Attribute &descriptor = appendAttribute(peerAttributes, ATTR_DESCRIPTOR);
+    descriptor.uuid16 = uuid16;
+    setStackValue(descriptor, NULL, 0, ATT_MTU - 3);
+    return descriptor.handle;
+}
+
+/*
+ * SoftDevice handler
+ */
+uint32_t softdevice_handler_init(nrf_clock_lfclksrc_t clock_source, void *p_ble_evt_buffer, uint16_t ble_evt_buffer_size, softdevice_evt_schedule_func_t evt_schedule_func)
+{
+    scheduleFunction = evt_schedule_func;
+    enabled          = true;
+    return NRF_SUCCESS;
+}
+
+uint32_t softdevice_handler_sd_disable(void)
+{
+    enabled = false;
+    return NRF_SUCCESS;
+}
+
+uint32_t softdevice_ble_evt_handler_set(ble_evt_handler_t ble_evt_handler)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t softdevice_sys_evt_handler_set(sys_evt_handler_t sys_evt_handler)
+{
+    return NRF_SUCCESS;
+}
+
+/*
+ * Common
+ */
+uint32_t sd_ble_enable(ble_enable_params_t *p_ble_enable_params)
+{
+    if (!enabled) {
+        return NRF_ERROR_SOFTDEVICE_NOT_ENABLED;
+    }
+    if (p_ble_enable_params->gatts_enable_params.attr_tab_size < BLE_GATTS_ATTR_TAB_SIZE_MIN) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    attributeTableSize = p_ble_enable_params->gatts_enable_params.attr_tab_size;
+    attributeTableUsed = 0;
+    localAttributes.clear();
+    addBuiltinServices(p_ble_enable_params->gatts_enable_params.service_changed);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_evt_get(uint8_t *p_dest, uint16_t *p_len)
+{
+    if (bleEvents.empty()) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    const QueuedEvent &event = bleEvents.front();
+    if (p_dest == NULL) {
+        *p_len = event.len;
+        return NRF_SUCCESS;
+    }
+    if (*p_len < event.len) {
+        *p_len = event.len;
+        return NRF_ERROR_DATA_SIZE;
+    }
+
+    memcpy(p_dest, &event.data[0], event.len);
+    *p_len = event.len;
+
+    /* The values of a Read By Type response follow the handle-value array; point to them in p_dest. */
+    ble_evt_t *p_ble_evt = reinterpret_cast<ble_evt_t *>(p_dest);
+    if (p_ble_evt->header.evt_id == BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP) {
+        ble_gattc_evt_char_val_by_uuid_read_rsp_t &rsp = p_ble_evt->evt.gattc_evt.params.char_val_by_uuid_read_rsp;
+        uint8_t *values = reinterpret_cast<uint8_t *>(&rsp.handle_value[rsp.count]);
+        for (unsigned i = 0; i < rsp.count; i++) {
+            rsp.handle_value[i].p_value = values + (i * rsp.value_len);
+        }
+    }
+
+    bleEvents.pop_front();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_version_get(ble_version_t *p_version)
+{
+    p_version->version_number    = 0x08;
+    p_version->company_id        = 0x0059;
+    p_version->subversion_number = 0x0087;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_opt_set(uint32_t opt_id, ble_opt_t const *p_opt)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const *p_vs_uuid, uint8_t *p_uuid_type)
+{
+    uint8_t type = vendorType(p_vs_uuid->uuid128);
+    if (type == BLE_UUID_TYPE_UNKNOWN) {
+        if (vendorUUIDs.size() == MAX_VS_UUIDS) {
+            return NRF_ERROR_NO_MEM;
+        }
+        vendorUUIDs.push_back(*p_vs_uuid);
+        type = BLE_UUID_TYPE_VENDOR_BEGIN + vendorUUIDs.size() - 1;
+    }
+
+    *p_uuid_type = type;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_uuid_decode(uint8_t uuid_le_len, uint8_t const *p_uuid_le, ble_uuid_t *p_uuid)
+{
+    if (uuid_le_len == 2) {
+        p_uuid->uuid = p_uuid_le[0] | (p_uuid_le[1] << 8);
+        p_uuid->type = BLE_UUID_TYPE_BLE;
+        return NRF_SUCCESS;
+    }
+    if (uuid_le_len != 16) {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    p_uuid->uuid = p_uuid_le[12] | (p_uuid_le[13] << 8);
+    p_uuid->type = vendorType(p_uuid_le);
+    return (p_uuid->type == BLE_UUID_TYPE_UNKNOWN) ? NRF_ERROR_NOT_FOUND : NRF_SUCCESS;
+}
+
+uint32_t sd_ble_user_mem_reply(uint16_t conn_handle, ble_user_mem_block_t const *p_block)
+{
+    return (findConnection(conn_handle) != NULL) ? NRF_SUCCESS : BLE_ERROR_INVALID_CONN_HANDLE;
+}
+
+/*
+ * GAP
+ */
+uint32_t sd_ble_gap_address_set(uint8_t addr_cycle_mode, ble_gap_addr_t const *p_addr)
+{
+    ownAddress = *p_addr;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_address_get(ble_gap_addr_t *p_addr)
+{
+    *p_addr = ownAddress;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_data_set(uint8_t const *p_data, uint8_t dlen, uint8_t const *p_sr_data, uint8_t srdlen)
+{
+    return ((dlen > BLE_GAP_ADV_MAX_SIZE) || (srdlen > BLE_GAP_ADV_MAX_SIZE)) ? NRF_ERROR_INVALID_LENGTH : NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_start(ble_gap_adv_params_t const *p_adv_params)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_stop(void)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_scan_start(ble_gap_scan_params_t const *p_scan_params)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_scan_stop(void)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_connect(ble_gap_addr_t const *p_peer_addr, ble_gap_scan_params_t const *p_scan_params, ble_gap_conn_params_t const *p_conn_params)
+{
+    /* The connection is only established when the simulation says so, see sim_connect(). */
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code)
+{
+    if (findConnection(conn_handle) == NULL) {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+
+    sim_disconnect(conn_handle, BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_conn_param_update(uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params)
+{
+    Connection *connection = findConnection(conn_handle);
+    if (connection == NULL) {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (connection->pendingIntervalUs != 0) {
+        return NRF_ERROR_BUSY;
+    }
+
+    const ble_gap_conn_params_t *params = (p_conn_params != NULL) ? p_conn_params : &ppcp;
+    connection->pendingIntervalUs = params->max_conn_interval * 1250;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params)
+{
+    ppcp = *p_conn_params;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_ppcp_get(ble_gap_conn_params_t *p_conn_params)
+{
+    *p_conn_params = ppcp;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_device_name_set(ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name, uint16_t len)
+{
+    if (len > BLE_GAP_DEVNAME_MAX_LEN) {
+        return NRF_ERROR_DATA_SIZE;
+    }
+    memcpy(deviceName, p_dev_name, len);
+    deviceNameLen = len;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_device_name_get(uint8_t *p_dev_name, uint16_t *p_len)
+{
+    if (p_dev_name != NULL) {
+        if (*p_len < deviceNameLen) {
+            return NRF_ERROR_DATA_SIZE;
+        }
+        memcpy(p_dev_name, deviceName, deviceNameLen);
+    }
+    *p_len = deviceNameLen;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_appearance_set(uint16_t value)
+{
+    appearance = value;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_appearance_get(uint16_t *p_appearance)
+{
+    *p_appearance = appearance;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_tx_power_set(int8_t tx_power)
+{
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_authenticate(uint16_t conn_handle, ble_gap_sec_params_t const *p_sec_params)
+{
+    return (findConnection(conn_handle) != NULL) ? NRF_SUCCESS : BLE_ERROR_INVALID_CONN_HANDLE;
+}
+
+/*
+ * GATT server
+ */
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const *p_uuid, uint16_t *p_handle)
+{
+    Attribute *service = addLocalAttribute(ATTR_SERVICE, p_uuid, NULL);
+    if (service == NULL) {
+        return (p_uuid->type == BLE_UUID_TYPE_UNKNOWN) ? NRF_ERROR_INVALID_PARAM : NRF_ERROR_NO_MEM;
+    }
+
+    *p_handle = service->handle;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_characteristic_add(uint16_t service_handle, ble_gatts_char_md_t const *p_char_md, ble_gatts_attr_t const *p_attr_char_value, ble_gatts_char_handles_t *p_handles)
+{
+    uint8_t properties;
+    memcpy(&properties, &p_char_md->char_props, 1);
+
+    Attribute *decl = addLocalAttribute(ATTR_CHAR_DECL, p_attr_char_value->p_uuid, NULL);
+    if (decl == NULL) {
+        return NRF_ERROR_NO_MEM;
+    }
+    decl->properties  = properties;
+    decl->valueHandle = decl->handle + 1;
+
+    Attribute *value = addLocalAttribute(ATTR_VALUE, p_attr_char_value->p_uuid, p_attr_char_value);
+    if (value == NULL) {
+        return NRF_ERROR_NO_MEM;
+    }
+    value->properties = properties;
+
+    p_handles->value_handle     = value->handle;
+    p_handles->user_desc_handle = BLE_GATT_HANDLE_INVALID;
+    p_handles->cccd_handle      = BLE_GATT_HANDLE_INVALID;
+    p_handles->sccd_handle      = BLE_GATT_HANDLE_INVALID;
+
+    if (p_char_md->p_char_user_desc != NULL) {
+        static const ble_gatts_attr_md_t userDescriptionMetadata = { {1, 1}, {0, 0}, 1, BLE_GATTS_VLOC_STACK, 0, 0 };
+        ble_uuid_t       uuid = { BLE_UUID_DESCRIPTOR_CHAR_USER_DESC, BLE_UUID_TYPE_BLE };
+        ble_gatts_attr_t attr = { &uuid, const_cast<ble_gatts_attr_md_t *>(&userDescriptionMetadata),
+                                  p_char_md->char_user_desc_size, 0, p_char_md->char_user_desc_max_size, p_char_md->p_char_user_desc };
+        Attribute *userDescription = addLocalAttribute(ATTR_DESCRIPTOR, &uuid, &attr);
+        if (userDescription == NULL) {
+            return NRF_ERROR_NO_MEM;
+        }
+        p_handles->user_desc_handle = userDescription->handle;
+    }
+
+    if (p_char_md->char_props.notify || p_char_md->char_props.indicate) {
+        ble_uuid_t uuid = { BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG, BLE_UUID_TYPE_BLE };
+        Attribute *cccd = addLocalAttribute(ATTR_CCCD, &uuid, NULL);
+        if (cccd == NULL) {
+            return NRF_ERROR_NO_MEM;
+        }
+        cccd->valueHandle      = value->handle;
+        p_handles->cccd_handle = cccd->handle;
+    }
+
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_descriptor_add(uint16_t char_handle, ble_gatts_attr_t const *p_attr, uint16_t *p_handle)
+{
+    Attribute *descriptor = addLocalAttribute(ATTR_DESCRIPTOR, p_attr->p_uuid, p_attr);
+    if (descriptor == NULL) {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    *p_handle = descriptor->handle;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value)
+{
+    Attribute *attribute = findAttribute(localAttributes, handle);
+    if (attribute == NULL) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    if (attribute->kind == ATTR_CCCD) {
+        Connection *connection = findConnection(conn_handle);
+        if (connection == NULL) {
+            return BLE_ERROR_INVALID_CONN_HANDLE;
+        }
+        if ((p_value->offset != 0) || (p_value->len != 2)) {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        connection->cccds[handle] = p_value->p_value[0] | (p_value->p_value[1] << 8);
+        return NRF_SUCCESS;
+    }
+
+    if ((attribute->kind == ATTR_SERVICE) || (attribute->kind == ATTR_CHAR_DECL)) {
+        return BLE_ERROR_GATTS_INVALID_ATTR_TYPE;
+    }
+    if ((p_value->offset > attribute->maxLen) || ((p_value->offset + p_value->len) > attribute->maxLen)) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (p_value->p_value != NULL) {
+        memmove(attribute->valuePtr() + p_value->offset, p_value->p_value, p_value->len);
+    }
+    if (attribute->vlen || ((p_value->offset + p_value->len) > attribute->len)) {
+        attribute->len = p_value->offset + p_value->len;
+    }
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_get(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t *p_value)
+{
+    Attribute *attribute = findAttribute(localAttributes, handle);
+    if (attribute == NULL) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    Connection *connection = NULL;
+    if (attribute->kind == ATTR_CCCD) {
+        connection = findConnection(conn_handle);
+        if (connection == NULL) {
+            return BLE_ERROR_INVALID_CONN_HANDLE;
+        }
+    }
+
+    std::vector<uint8_t> value = attributeValue(localAttributes, *attribute, connection);
+    if (p_value->offset > value.size()) {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    uint16_t available = value.size() - p_value->offset;
+    if (p_value->p_value != NULL) {
+        if (p_value->len > available) {
+            p_value->len = available;
+        }
+        memcpy(p_value->p_value, &value[0] + p_value->offset, p_value->len);
+    } else {
+        p_value->len = available;
+    }
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const *p_hvx_params)
+{
+    Connection *connection = findConnection(conn_handle);
+    if (connection == NULL) {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+
+    Attribute *attribute = findAttribute(localAttributes, p_hvx_params->handle);
+    if ((attribute == NULL) || (attribute->kind != ATTR_VALUE)) {
+        return BLE_ERROR_INVALID_ATTR_HANDLE;
+    }
+    if (!connection->sysAttrsSet) {
+        return BLE_ERROR_GATTS_SYS_ATTR_MISSING;
+    }
+
+    /* The CCCD follows the value and its optional user description. */
+    uint16_t cccdHandle = BLE_GATT_HANDLE_INVALID;
+    for (size_t i = 0; i < localAttributes.size(); i++) {
+        if ((localAttributes[i].kind == ATTR_CCCD) && (localAttributes[i].valueHandle == attribute->handle)) {
+            cccdHandle = localAttributes[i].handle;
+        }
+    }
+    if ((cccdHandle == BLE_GATT_HANDLE_INVALID) || !(connection->cccds[cccdHandle] & p_hvx_params->type)) {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    uint16_t len = *p_hvx_params->p_len;
+    if (len > ATT_MTU - 3) {
+        len = ATT_MTU - 3;
+    }
+
+    if (p_hvx_params->type == BLE_GATT_HVX_INDICATION) {
+        if (connection->indication != INDICATION_NONE) {
+            return NRF_ERROR_BUSY;
+        }
+    } else if (connection->txQueue.size() >= connection->link.txBuffers) {
+        return BLE_ERROR_NO_TX_BUFFERS;
+    }
+
+    if (p_hvx_params->p_data != NULL) {
+        ble_gatts_value_t value = { len, p_hvx_params->offset, const_cast<uint8_t *>(p_hvx_params->p_data) };
+        uint32_t rc = sd_ble_gatts_value_set(conn_handle, p_hvx_params->handle, &value);
+        if (rc != NRF_SUCCESS) {
+            return rc;
+        }
+    }
+
+    if (p_hvx_params->type == BLE_GATT_HVX_INDICATION) {
+        connection->indication       = INDICATION_QUEUED;
+        connection->indicationHandle = p_hvx_params->handle;
+        connection->indicationLen    = len;
+    } else {
+        Packet packet = { len, true };
+        connection->txQueue.push_back(packet);
+    }
+
+    *p_hvx_params->p_len = len;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_rw_authorize_reply(uint16_t conn_handle, ble_gatts_rw_authorize_reply_params_t const *p_rw_authorize_reply_params)
+{
+    return (findConnection(conn_handle) != NULL) ? NRF_SUCCESS : BLE_ERROR_INVALID_CONN_HANDLE;
+}
+
+/*
+ * System attributes are stored as (handle, value) pairs of the CCCDs
+ * followed by a 16-bit check value, as the SoftDevice does.
+ */
+uint32_t sd_ble_gatts_sys_attr_set(uint16_t conn_handle, uint8_t const *p_sys_attr_data, uint16_t len, uint32_t flags)
+{
+    Connection *connection = findConnection(conn_handle);
+    if (connection == NULL) {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+
+    std::map<uint16_t, uint16_t> cccds;
+    if (p_sys_attr_data != NULL) {
+        if ((len < 2) || (((len - 2) % 4) != 0)) {
+            return NRF_ERROR_INVALID_DATA;
+        }
+
+        uint16_t check = 0;
+        for (unsigned i = 0; i < len - 2u; i++) {
+            check += p_sys_attr_data[i];
+        }
+        if (check != (p_sys_attr_data[len - 2] | (p_sys_attr_data[len - 1] << 8))) {
+            return NRF_ERROR_INVALID_DATA;
+        }
+
+        for (unsigned i = 0; i < len - 2u; i += 4) {
+            uint16_t   handle    = p_sys_attr_data[i] | (p_sys_attr_data[i + 1] << 8);
+            Attribute *attribute = findAttribute(localAttributes, handle);
+            if ((attribute == NULL) || (attribute->kind != ATTR_CCCD)) {
+                return NRF_ERROR_INVALID_DATA;
+            }
+            cccds[handle] = p_sys_attr_data[i + 2] | (p_sys_attr_data[i + 3] << 8);
+        }
+    }
+
+    connection->cccds       = cccds;
+    connection->sysAttrsSet = true;
+
+    for (size_t i = 0; i < connection->heldWrites.size(); i++) {
+        deliverPeerWrite(conn_handle, *connection, connection->heldWrites[i]);
+    }
+    connection->heldWrites.clear();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_sys_attr_get(uint16_t conn_handle, uint8_t *p_sys_attr_data, uint16_t *p_len, uint32_t flags)
+{
+    Connection *connection = findConnection(conn_handle);
+    if (connection == NULL) {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (!connection->sysAttrsSet) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < localAttributes.size(); i++) {
+        if (localAttributes[i].kind == ATTR_CCCD) {
+            uint16_t handle = localAttributes[i].handle;
+            uint16_t value  = connection->cccds[handle];
+            data.push_back(handle & 0xFF);
+            data.push_back(handle >> 8);
+            data.push_back(value & 0xFF);
+            data.push_back(value >> 8);
+        }
+    }
+    uint16_t check = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        check += data[i];
+    }
+    data.push_back(check & 0xFF);
+    data.push_back(check >> 8);
+
+    if (p_sys_attr_data != NULL) {
+        if (*p_len < data.size()) {
+            return NRF_ERROR_DATA_SIZE;
+        }
+        memcpy(p_sys_attr_data, &data[0], data.size());
+    }
+    *p_len = data.size();
+    return NRF_SUCCESS;
+}
+
+/*
+ * GATT client. Responses are packed as in an ATT_MTU of 23 bytes: entries
+ * of one response share the length of their UUID or value.
+ */
+uint32_t sd_ble_gattc_primary_services_discover(uint16_t conn_handle, uint16_t start_handle, ble_uuid_t const *p_srvc_uuid)
+{
+    Connection *connection;
+    uint32_t    rc = gattcCheck(conn_handle, &connection);
+    if (rc != NRF_SUCCESS) {
+        return rc;
+    }
+
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < peerAttributes.size(); i++) {
+        if ((peerAttributes[i].kind == ATTR_SERVICE) && (peerAttributes[i].handle >= start_handle)) {
+            if (!matches.empty() && (peerAttributes[i].longUUID != peerAttributes[matches[0]].longUUID)) {
+                break;
+            }
+            matches.push_back(i);
+            if ((matches.size() * (peerAttributes[i].longUUID ? 20 : 6)) > (ATT_MTU - 2 - (peerAttributes[i].longUUID ? 20 : 6))) {
+                break;
+            }
+        }
+    }
+    if (matches.empty()) {
+        return gattcNotFound(connection, conn_handle, BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP, start_handle);
+    }
+
+    QueuedEvent      response;
+    ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP,
+                                           offsetof(ble_gattc_evt_prim_srvc_disc_rsp_t, services) + matches.size() * sizeof(ble_gattc_service_t));
+    gattc->params.prim_srvc_disc_rsp.count = matches.size();
+    for (size_t i = 0; i < matches.size(); i++) {
+        const Attribute &service = peerAttributes[matches[i]];
+
+        uint16_t end_handle = BLE_GATT_HANDLE_END;
+        for (size_t j = matches[i] + 1; j < peerAttributes.size(); j++) {
+            if (peerAttributes[j].kind == ATTR_SERVICE) {
+                end_handle = peerAttributes[j].handle - 1;
+                break;
+            }
+        }
+
+        ble_gattc_service_t &entry = gattc->params.prim_srvc_disc_rsp.services[i];
+        entry.uuid                      = reportedUUID(service);
+        entry.handle_range.start_handle = service.handle;
+        entry.handle_range.end_handle   = end_handle;
+    }
+    return queueGattcResponse(connection, response);
+}
+
+uint32_t sd_ble_gattc_characteristics_discover(uint16_t conn_handle, ble_gattc_handle_range_t const *p_handle_range)
+{
+    Connection *connection;
+    uint32_t    rc = gattcCheck(conn_handle, &connection);
+    if (rc != NRF_SUCCESS) {
+        return rc;
+    }
+
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < peerAttributes.size(); i++) {
+        const Attribute &attribute = peerAttributes[i];
+        if ((attribute.handle < p_handle_range->start_handle) || (attribute.handle > p_handle_range->end_handle)) {
+            continue;
+        }
+        if (attribute.kind == ATTR_CHAR_DECL) {
+            if (!matches.empty() && (attribute.longUUID != peerAttributes[matches[0]].longUUID)) {
+                break;
+            }
+            matches.push_back(i);
+            if ((matches.size() * (attribute.longUUID ? 21 : 7)) > (ATT_MTU - 2 - (attribute.longUUID ? 21 : 7))) {
+                break;
+            }
+        }
+    }
+    if (matches.empty()) {
+        return gattcNotFound(connection, conn_handle, BLE_GATTC_EVT_CHAR_DISC_RSP, p_handle_range->start_handle);
+    }
+
+    QueuedEvent      response;
+    ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_CHAR_DISC_RSP,
+                                           offsetof(ble_gattc_evt_char_disc_rsp_t, chars) + matches.size() * sizeof(ble_gattc_char_t));
+    gattc->params.char_disc_rsp.count = matches.size();
+    for (size_t i = 0; i < matches.size(); i++) {
+        const Attribute  &decl  = peerAttributes[matches[i]];
+        ble_gattc_char_t &entry = gattc->params.char_disc_rsp.chars[i];
+        entry.uuid = reportedUUID(decl);
+        memcpy(&entry.char_props, &decl.properties, 1);
+        entry.char_ext_props = 0;
+        entry.handle_decl    = decl.handle;
+        entry.handle_value   = decl.valueHandle;
+    }
+    return queueGattcResponse(connection, response);
+}
+
+uint32_t sd_ble_gattc_descriptors_discover(uint16_t conn_handle, ble_gattc_handle_range_t const *p_handle_range)
+{
+    Connection *connection;
+    uint32_t    rc = gattcCheck(conn_handle, &connection);
+    if (rc != NRF_SUCCESS) {
+        return rc;
+    }
+
+    /* Find Information reports every attribute in the range. */
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < peerAttributes.size(); i++) {
+        const Attribute &attribute = peerAttributes[i];
+        if ((attribute.handle < p_handle_range->start_handle) || (attribute.handle > p_handle_range->end_handle)) {
+            continue;
+        }
+        bool longUUID = (attribute.kind == ATTR_VALUE) && attribute.longUUID;
+        if (!matches.empty() && (longUUID != ((peerAttributes[matches[0]].kind == ATTR_VALUE) && peerAttributes[matches[0]].longUUID))) {
+            break;
+        }
+        matches.push_back(i);
+        if ((matches.size() * (longUUID ? 18 : 4)) > (ATT_MTU - 2 - (longUUID ? 18 : 4))) {
+            break;
+        }
+    }
+    if (matches.empty()) {
+        return gattcNotFound(connection, conn_handle, BLE_GATTC_EVT_DESC_DISC_RSP, p_handle_range->start_handle);
+    }
+
+    QueuedEvent      response;
+    ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_DESC_DISC_RSP,
+                                           offsetof(ble_gattc_evt_desc_disc_rsp_t, descs) + matches.size() * sizeof(ble_gattc_desc_t));
+    gattc->params.desc_disc_rsp.count = matches.size();
+    for (size_t i = 0; i < matches.size(); i++) {
+        const Attribute  &attribute = peerAttributes[matches[i]];
+        ble_gattc_desc_t &entry     = gattc->params.desc_disc_rsp.descs[i];
+        entry.handle = attribute.handle;
+        if (attribute.kind == ATTR_VALUE) {
+            entry.uuid = reportedUUID(attribute);
+        } else {
+            entry.uuid.uuid = attributeType(attribute);
+            entry.uuid.type = BLE_UUID_TYPE_BLE;
+        }
+    }
+    return queueGattcResponse(connection, response);
+}
+
+uint32_t sd_ble_gattc_char_value_by_uuid_read(uint16_t conn_handle, ble_uuid_t const *p_uuid, ble_gattc_handle_range_t const *p_handle_range)
+{
+    Connection *connection;
+    uint32_t    rc = gattcCheck(conn_handle, &connection);
+    if (rc != NRF_SUCCESS) {
+        return rc;
+    }
+    if (p_uuid->type != BLE_UUID_TYPE_BLE) {
+        return NRF_ERROR_NOT_SUPPORTED;
+    }
+
+    std::vector<uint16_t>             handles;
+    std::vector<std::vector<uint8_t> > values;
+    for (size_t i = 0; i < peerAttributes.size(); i++) {
+        Attribute &attribute = peerAttributes[i];
+        if ((attribute.handle < p_handle_range->start_handle) || (attribute.handle > p_handle_range->end_handle) ||
+            (attributeType(attribute) != p_uuid->uuid)) {
+            continue;
+        }
+
+        std::vector<uint8_t> value = attributeValue(peerAttributes, attribute, NULL);
+        if (value.size() > ATT_MTU - 4) {
+            value.resize(ATT_MTU - 4);
+        }
+        if (!values.empty() && ((value.size() != values[0].size()) || (((values.size() + 1) * (2 + value.size())) > (ATT_MTU - 2)))) {
+            break;
+        }
+        handles.push_back(attribute.handle);
+        values.push_back(value);
+    }
+    if (values.empty()) {
+        return gattcNotFound(connection, conn_handle, BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP, p_handle_range->start_handle);
+    }
+
+    /* The values follow the handle-value array; sd_ble_evt_get() points to them. */
+    uint16_t arrayLen = offsetof(ble_gattc_evt_char_val_by_uuid_read_rsp_t, handle_value) + handles.size() * sizeof(ble_gattc_handle_value_t);
+    QueuedEvent      response;
+    ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP, arrayLen + handles.size() * values[0].size());
+    ble_gattc_evt_char_val_by_uuid_read_rsp_t &rsp = gattc->params.char_val_by_uuid_read_rsp;
+    rsp.count     = handles.size();
+    rsp.value_len = values[0].size();
+    uint8_t *p_values = reinterpret_cast<uint8_t *>(&rsp.handle_value[rsp.count]);
+    for (size_t i = 0; i < handles.size(); i++) {
+        rsp.handle_value[i].handle  = handles[i];
+        rsp.handle_value[i].p_value = NULL;
+        memcpy(p_values + (i * rsp.value_len), &values[i][0], rsp.value_len);
+    }
+    return queueGattcResponse(connection, response);
+}
+
+uint32_t sd_ble_gattc_read(uint16_t conn_handle, uint16_t handle, uint16_t offset)
+{
+    Connection *connection;
+    uint32_t    rc = gattcCheck(conn_handle, &connection);
+    if (rc != NRF_SUCCESS) {
+        return rc;
+    }
+
+    QueuedEvent response;
+    Attribute  *attribute = findAttribute(peerAttributes, handle);
+    if (attribute == NULL) {
+        ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_READ_RSP, offsetof(ble_gattc_evt_read_rsp_t, data));
+        gattc->gatt_status              = BLE_GATT_STATUS_ATTERR_INVALID_HANDLE;
+        gattc->error_handle             = handle;
+        gattc->params.read_rsp.handle   = handle;
+        return queueGattcResponse(connection, response);
+    }
+
+    std::vector<uint8_t> value = attributeValue(peerAttributes, *attribute, NULL);
+    uint16_t len = (offset < value.size()) ? (value.size() - offset) : 0;
+    if (len > ATT_MTU - 1) {
+        len = ATT_MTU - 1;
+    }
+
+    ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_READ_RSP, offsetof(ble_gattc_evt_read_rsp_t, data) + len);
+    gattc->params.read_rsp.handle = handle;
+    gattc->params.read_rsp.offset = offset;
+    gattc->params.read_rsp.len    = len;
+    if (len != 0) {
+        memcpy(gattc->params.read_rsp.data, &value[offset], len);
+    }
+    return queueGattcResponse(connection, response);
+}
+
+uint32_t sd_ble_gattc_char_values_read(uint16_t conn_handle, uint16_t const *p_handles, uint16_t handle_count)
+{
+    Connection *connection;
+    uint32_t    rc = gattcCheck(conn_handle, &connection);
+    if (rc != NRF_SUCCESS) {
+        return rc;
+    }
+
+    std::vector<uint8_t> values;
+    for (unsigned i = 0; i < handle_count; i++) {
+        Attribute *attribute = findAttribute(peerAttributes, p_handles[i]);
+        if (attribute == NULL) {
+            QueuedEvent      response;
+            ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_CHAR_VALS_READ_RSP, offsetof(ble_gattc_evt_char_vals_read_rsp_t, values));
+            gattc->gatt_status  = BLE_GATT_STATUS_ATTERR_INVALID_HANDLE;
+            gattc->error_handle = p_handles[i];
+            return queueGattcResponse(connection, response);
+        }
+        std::vector<uint8_t> value = attributeValue(peerAttributes, *attribute, NULL);
+        values.insert(values.end(), value.begin(), value.end());
+    }
+    if (values.size() > ATT_MTU - 1) {
+        values.resize(ATT_MTU - 1);
+    }
+
+    QueuedEvent      response;
+    ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_CHAR_VALS_READ_RSP, offsetof(ble_gattc_evt_char_vals_read_rsp_t, values) + values.size());
+    gattc->params.char_vals_read_rsp.len = values.size();
+    if (!values.empty()) {
+        memcpy(gattc->params.char_vals_read_rsp.values, &values[0], values.size());
+    }
+    return queueGattcResponse(connection, response);
+}
+
+uint32_t sd_ble_gattc_write(uint16_t conn_handle, ble_gattc_write_params_t const *p_write_params)
+{
+    Connection *connection = findConnection(conn_handle);
+    if (connection == NULL) {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (p_write_params->len > ATT_MTU - 3) {
+        return NRF_ERROR_DATA_SIZE;
+    }
+
+    Attribute *attribute = findAttribute(peerAttributes, p_write_params->handle);
+
+    if (p_write_params->write_op == BLE_GATT_OP_WRITE_CMD) {
+        /* Write commands take TX buffers, as notifications do. */
+        if (connection->txQueue.size() >= connection->link.txBuffers) {
+            return BLE_ERROR_NO_TX_BUFFERS;
+        }
+        if ((attribute != NULL) && (attribute->kind == ATTR_VALUE)) {
+            memcpy(attribute->valuePtr(), p_write_params->p_value, p_write_params->len);
+            attribute->len = p_write_params->len;
+        }
+        Packet packet = { p_write_params->len, false };
+        connection->txQueue.push_back(packet);
+        return NRF_SUCCESS;
+    }
+
+    if (p_write_params->write_op != BLE_GATT_OP_WRITE_REQ) {
+        return NRF_ERROR_NOT_SUPPORTED;
+    }
+    if (connection->gattc != GATTC_IDLE) {
+        return NRF_ERROR_BUSY;
+    }
+
+    QueuedEvent      response;
+    ble_gattc_evt_t *gattc = newGattcEvent(response, conn_handle, BLE_GATTC_EVT_WRITE_RSP, offsetof(ble_gattc_evt_write_rsp_t, data) + p_write_params->len);
+    gattc->params.write_rsp.handle   = p_write_params->handle;
+    gattc->params.write_rsp.write_op = p_write_params->write_op;
+    gattc->params.write_rsp.offset   = p_write_params->offset;
+    gattc->params.write_rsp.len      = p_write_params->len;
+    if (p_write_params->len != 0) {
+        memcpy(gattc->params.write_rsp.data, p_write_params->p_value, p_write_params->len);
+    }
+
+    if (attribute == NULL) {
+        gattc->gatt_status  = BLE_GATT_STATUS_ATTERR_INVALID_HANDLE;
+        gattc->error_handle = p_write_params->handle;
+    } else if ((attribute->kind == ATTR_VALUE) || (attribute->kind == ATTR_DESCRIPTOR)) {
+        memcpy(attribute->valuePtr(), p_write_params->p_value, p_write_params->len);
+        attribute->len = p_write_params->len;
+    } else if (attribute->kind != ATTR_CCCD) {
+        gattc->gatt_status  = BLE_GATT_STATUS_ATTERR_WRITE_NOT_PERMITTED;
+        gattc->error_handle = p_write_params->handle;
+    }
+    return queueGattcResponse(connection, response);
+}
+
+uint32_t sd_ble_gattc_hv_confirm(uint16_t conn_handle, uint16_t handle)
+{
+    return (findConnection(conn_handle) != NULL) ? NRF_SUCCESS : BLE_ERROR_INVALID_CONN_HANDLE;
+}
+
+/*
+ * SoC
+ */
+uint32_t sd_evt_get(uint32_t *p_evt_id)
+{
+    if (sysEvents.empty()) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    *p_evt_id = sysEvents.front();
+    sysEvents.pop_front();
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_app_evt_wait(void)
+{
+    /* Sleep until the next connection event, unless an event is already pending. */
+    if (sim_pendingEvents() == 0) {
+        sim_step();
+    }
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_nvic_critical_region_enter(uint8_t *p_is_nested_critical_region)
+{
+    *p_is_nested_critical_region = 0;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_nvic_critical_region_exit(uint8_t is_nested_critical_region)
+{
+    return NRF_SUCCESS;
+}
+
+void nrf_delay_us(uint32_t number_of_us)
+{
+    nowUs += number_of_us;
+}
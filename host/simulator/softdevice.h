@@ -0,0 +1,136 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Simulated S130 SoftDevice, for running the port on a host.
+ *
+ * Time is virtual: it only moves when the simulation is stepped, from one
+ * connection event to the next, and us_ticker_read() returns it. Within a
+ * connection event the link carries a bounded number of packets, so the
+ * TX buffer, ATT round-trip and flow control behaviour of the port can be
+ * measured without a radio. Events are queued as the SoftDevice would and
+ * signaled through the schedule function given to softdevice_handler_init().
+ *
+ * The peer is scripted through the sim_* functions: it connects, writes
+ * CCCDs, holds a GATT database for the local GATT client to discover, and
+ * can be bonded so that the device manager recognizes it.
+ */
+
+#ifndef __SIMULATOR_SOFTDEVICE_H__
+#define __SIMULATOR_SOFTDEVICE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "softdevice_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Link parameters of simulated connections.
+ */
+typedef struct {
+    uint16_t intervalUs;       /**< Connection interval. */
+    uint8_t  txBuffers;        /**< Notifications and write commands the SoftDevice can hold at once. */
+    uint8_t  packetsPerEvent;  /**< Packets carried by a connection event; the peer's stack limits it. */
+} sim_linkParams_t;
+
+/**
+ * Restore the simulated SoftDevice to its state after reset, including flash.
+ */
+void     sim_reset(void);
+
+/**
+ * Current virtual time; also returned by us_ticker_read().
+ */
+uint32_t sim_now(void);
+
+/**
+ * Advance the virtual time to the next connection event and run it.
+ *
+ * @return false if there is no connection, in which case time doesn't move.
+ */
+bool     sim_step(void);
+
+/**
+ * Number of connection events run since the last sim_reset().
+ */
+uint32_t sim_connectionEvents(void);
+
+/**
+ * Queue a BLE event as if the SoftDevice had generated it.
+ */
+void     sim_pushEvent(const ble_evt_t *p_ble_evt, uint16_t len);
+void     sim_pushSysEvent(uint32_t evt_id);
+
+/**
+ * @return the number of BLE and system events not pulled yet.
+ */
+unsigned sim_pendingEvents(void);
+
+/**
+ * Connect a peer; the BLE_GAP_EVT_CONNECTED event is queued right away.
+ *
+ * @param[in]  role  Local role, BLE_GAP_ROLE_PERIPH or BLE_GAP_ROLE_CENTRAL.
+ * @param[in]  link  Link parameters; NULL for a 7.5ms interval with 6 TX buffers and 6 packets per event.
+ *
+ * @return the connection handle, or BLE_CONN_HANDLE_INVALID if no more connections are allowed.
+ */
+uint16_t sim_connect(uint8_t role, const sim_linkParams_t *link);
+void     sim_disconnect(uint16_t conn_handle, uint8_t reason);
+
+/**
+ * Make the peer of a connection known to the device manager as bonded.
+ */
+void     sim_bond(uint16_t conn_handle, uint8_t device_id, const ble_gap_addr_t *peer_addr);
+
+/**
+ * Peer writes to the local GATT server, e.g. to a CCCD.
+ */
+void     sim_peerWrite(uint16_t conn_handle, uint16_t handle, const uint8_t *data, uint16_t len);
+
+/**
+ * Number of notifications and indications which went over the air, and their payload.
+ */
+uint32_t sim_peerNotificationsReceived(uint16_t conn_handle);
+uint32_t sim_peerBytesReceived(uint16_t conn_handle);
+
+/**
+ * Build the GATT database of the peer, which the local GATT client sees on
+ * every connection. Handles are allocated in the order of the calls. Long
+ * UUIDs are given LSB first, as on the air; they are reported as
+ * BLE_UUID_TYPE_UNKNOWN unless their base was added with sd_ble_uuid_vs_add().
+ */
+void     sim_peerClearDatabase(void);
+uint16_t sim_peerAddService(uint16_t uuid16, const uint8_t *uuid128);
+uint16_t sim_peerAddCharacteristic(uint16_t uuid16, const uint8_t *uuid128, uint8_t properties);
+uint16_t sim_peerAddDescriptor(uint16_t uuid16);
+
+/**
+ * Make the next flash operations report NRF_EVT_FLASH_OPERATION_ERROR.
+ */
+void     sim_failFlashOperations(unsigned count);
+
+/* Internal to the simulator: flash operations completed by sdk.cpp. */
+void     sim_resetSdk(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIMULATOR_SOFTDEVICE_H__ */
@@ -0,0 +1,183 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Round trip of a peer database through the GATT client database cache: a
+ * discovery of a bonded peer is recorded to flash, then read back, both
+ * directly and by the discovery of the next connection, and has to come
+ * back with the same UUIDs and handles.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ble/BLE.h"
+#include "btle_databaseCache.h"
+#include "softdevice.h"
+
+static int failures = 0;
+
+static void
+check(bool condition, const char *what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+/* 128-bit UUIDs of the peer, LSB first as on the air. */
+static const uint8_t serviceUUID[UUID::LENGTH_OF_LONG_UUID] = {
+    0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0, 0x93, 0xF3, 0xA3, 0xB5, 0x01, 0x00, 0x40, 0x6E
+};
+static const uint8_t characteristicUUID[UUID::LENGTH_OF_LONG_UUID] = {
+    0x9E, 0xCA, 0xDC, 0x24, 0x0E, 0xE5, 0xA9, 0xE0, 0x93, 0xF3, 0xA3, 0xB5, 0x02, 0x00, 0x40, 0x6E
+};
+
+static UUID
+longUUID(const uint8_t *lsb)
+{
+    UUID::LongUUIDBytes_t bytes;
+    memcpy(bytes, lsb, UUID::LENGTH_OF_LONG_UUID);
+    return UUID(bytes, UUID::LSB);
+}
+
+/*
+ * Results of a discovery.
+ */
+struct Discovered {
+    unsigned                services;
+    unsigned                characteristics;
+    UUID                    uuids[4];
+    GattAttribute::Handle_t handles[4];
+    bool                    done;
+};
+
+static Discovered discovered;
+
+static void
+onService(const DiscoveredService *service)
+{
+    if (discovered.services + discovered.characteristics < 4) {
+        discovered.uuids[discovered.services + discovered.characteristics]   = service->getUUID();
+        discovered.handles[discovered.services + discovered.characteristics] = service->getStartHandle();
+    }
+    discovered.services++;
+}
+
+static void
+onCharacteristic(const DiscoveredCharacteristic *characteristic)
+{
+    if (discovered.services + discovered.characteristics < 4) {
+        discovered.uuids[discovered.services + discovered.characteristics]   = characteristic->getUUID();
+        discovered.handles[discovered.services + discovered.characteristics] = characteristic->getValueHandle();
+    }
+    discovered.characteristics++;
+}
+
+static void
+onDiscoveryTermination(Gap::Handle_t connHandle)
+{
+    discovered.done = true;
+}
+
+static void
+discover(BLE &ble, uint16_t connHandle)
+{
+    discovered = Discovered();
+    check(ble.gattClient().launchServiceDiscovery(connHandle, onService, onCharacteristic) == BLE_ERROR_NONE, "discovery launched");
+
+    while (!discovered.done && sim_step()) {
+        ble.processEvents();
+    }
+    check(discovered.done, "discovery terminates");
+}
+
+int
+main(void)
+{
+    sim_reset();
+
+    BLE &ble = BLE::Instance();
+    check(ble.init() == BLE_ERROR_NONE, "init");
+    check(ble.securityManager().init() == BLE_ERROR_NONE, "security init");
+    ble.gattClient().onServiceDiscoveryTermination(onDiscoveryTermination);
+
+    /* One 128-bit service holding a 128-bit and a 16-bit characteristic. */
+    uint16_t serviceHandle = sim_peerAddService(0, serviceUUID);
+    uint16_t longHandle    = sim_peerAddCharacteristic(0, characteristicUUID, 0x12 /* read, notify */);
+    uint16_t shortHandle   = sim_peerAddCharacteristic(0x2A19, NULL, 0x02 /* read */);
+
+    const ble_gap_addr_t peer = { BLE_GAP_ADDR_TYPE_PUBLIC, { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 } };
+    uint16_t connHandle = sim_connect(BLE_GAP_ROLE_CENTRAL, NULL);
+    sim_bond(connHandle, 0, &peer);
+    ble.processEvents();
+
+    /* The first discovery goes over the air and is recorded. */
+    discover(ble, connHandle);
+    check(discovered.services == 1, "service discovered");
+    check(discovered.characteristics == 2, "characteristics discovered");
+    check(discovered.uuids[0] == longUUID(serviceUUID), "service UUID discovered");
+    check(discovered.uuids[1] == longUUID(characteristicUUID), "characteristic UUID discovered");
+
+    /* Let the flash write complete. */
+    ble.processEvents();
+    check(sim_pendingEvents() == 0, "cache written");
+
+    btle_databaseCacheCursor_t cursor;
+    btle_databaseCacheEntry_t  entry;
+    check(btle_openDatabaseCache(connHandle, &cursor), "cache opened");
+
+    check(btle_readDatabaseCache(&cursor, &entry) && (entry.type == BTLE_DATABASE_CACHE_SERVICE), "service read back");
+    check(entry.uuid == longUUID(serviceUUID), "service UUID read back");
+    check(memcmp(entry.uuid.getBaseUUID(), serviceUUID, UUID::LENGTH_OF_LONG_UUID) == 0, "service UUID bytes read back");
+    check(entry.startHandle == serviceHandle, "service start handle read back");
+    check(entry.endHandle == BLE_GATT_HANDLE_END, "service end handle read back");
+
+    check(btle_readDatabaseCache(&cursor, &entry) && (entry.type == BTLE_DATABASE_CACHE_CHARACTERISTIC), "characteristic read back");
+    check(entry.uuid == longUUID(characteristicUUID), "characteristic UUID read back");
+    check(entry.uuid.getShortUUID() == 0x0002, "characteristic short UUID read back");
+    check(entry.valueHandle == longHandle, "characteristic value handle read back");
+    check(entry.properties.read && entry.properties.notify && !entry.properties.write, "characteristic properties read back");
+
+    check(btle_readDatabaseCache(&cursor, &entry) && (entry.type == BTLE_DATABASE_CACHE_CHARACTERISTIC), "16-bit characteristic read back");
+    check(entry.uuid == UUID(0x2A19), "16-bit characteristic UUID read back");
+    check(entry.valueHandle == shortHandle, "16-bit characteristic value handle read back");
+
+    check(!btle_readDatabaseCache(&cursor, &entry), "no more entries");
+
+    /* On the next connection, the peer is served from the cache. */
+    sim_disconnect(connHandle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    ble.processEvents();
+    connHandle = sim_connect(BLE_GAP_ROLE_CENTRAL, NULL);
+    sim_bond(connHandle, 0, &peer);
+    ble.processEvents();
+
+    Discovered first = discovered;
+    uint32_t   connectionEvents = sim_connectionEvents();
+    discover(ble, connHandle);
+    check(sim_connectionEvents() == connectionEvents, "cached discovery doesn't go over the air");
+    check((discovered.services == first.services) && (discovered.characteristics == first.characteristics), "cached discovery complete");
+    for (unsigned i = 0; i < 3; i++) {
+        check(discovered.uuids[i] == first.uuids[i], "cached discovery UUIDs");
+        check(discovered.handles[i] == first.handles[i], "cached discovery handles");
+    }
+
+    if (failures == 0) {
+        printf("databaseCache: OK\n");
+    }
+    return (failures == 0) ? 0 : 1;
+}
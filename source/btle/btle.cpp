@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include "common/common.h"
 #include "nordic_common.h"
 
@@ -28,6 +30,11 @@
 
 #include "ble/GapEvents.h"
 #include "nRF5xn.h"
+#ifdef YOTTA_CFG_MBED_OS
+    #include "mbed-drivers/mbed.h"
+#else
+    #include "mbed.h"
+#endif
 
 extern "C" {
 #include "pstorage.h"
@@ -38,23 +45,75 @@ extern "C" {
 
 #include "ble_hci.h"
 #include "btle_discovery.h"
+#include "btle_instrumentation.h"
+#include "btle_capture.h"
 
 #include "nRF5xGattClient.h"
 #include "nRF5xServiceDiscovery.h"
 #include "nRF5xCharacteristicDescriptorDiscoverer.h"
 
-bool isEventsSignaled = false;
+/*
+ * Event signaling between the SWI2 interrupt (producer) and thread mode
+ * (consumer). Each counter has a single writer; 32-bit accesses are atomic
+ * on Cortex-M, so no lock is needed. Events are pending while the counters
+ * differ, and the application is signaled when the producer finds them
+ * equal, i.e. when the consumer may have gone idle.
+ */
+static volatile uint32_t eventsSignaled = 0; /**< Written by signalEvent() only. */
+static volatile uint32_t eventsConsumed = 0; /**< Written by btle_processEvents() only. */
+
+/* Storage for the BLE event fetched or being dispatched, word-aligned as sd_ble_evt_get() requires. */
+static uint32_t eventBuffer[(BLE_STACK_EVT_MSG_BUF_SIZE + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+
+/* Event pulled out of the SoftDevice but not dispatched yet, see btle_fetchEvent(). */
+enum {
+    FETCHED_NONE,
+    FETCHED_SYS,
+    FETCHED_BLE,
+};
+static uint8_t  fetchedEvent = FETCHED_NONE;
+static uint32_t fetchedSysEvent;
+
+static btle_eventStatistics_t eventStatistics;
 
 extern "C" void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name);
 void            app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name);
 
 static void btle_handler(ble_evt_t *p_ble_evt);
+static void btle_gapEventHandler(ble_evt_t *p_ble_evt);
+static void btle_gattServerEventHandler(ble_evt_t *p_ble_evt);
+
+/* Number of entries in the table of SoftDevice event handlers. */
+#ifndef YOTTA_CFG_NRF5X_EVENT_HANDLERS
+    #define YOTTA_CFG_NRF5X_EVENT_HANDLERS 8
+#endif
+
+typedef struct {
+    btle_eventHandler_t handler; /**< NULL if the entry has been unregistered. */
+    uint8_t             groups;
+    uint8_t             order;
+} btle_eventHandlerEntry_t;
+
+/* Handlers sorted by order; unregistered entries are only compacted on registration so that
+ * a handler can unregister itself while events are being dispatched. */
+static btle_eventHandlerEntry_t eventHandlers[YOTTA_CFG_NRF5X_EVENT_HANDLERS];
+static unsigned                 eventHandlerCount = 0;
 
 static void sys_evt_dispatch(uint32_t sys_evt)
 {
     pstorage_sys_event_handler(sys_evt);
 }
 
+/**
+ * Size of the SoftDevice attribute table, which holds the attributes and the
+ * values kept by the stack (BLE_GATTS_VLOC_STACK). Applications registering
+ * their values as user-located can shrink it; the application RAM start in
+ * the linker script must then be lowered accordingly.
+ */
+#ifndef YOTTA_CFG_NRF5X_GATTS_ATTR_TAB_SIZE
+    #define YOTTA_CFG_NRF5X_GATTS_ATTR_TAB_SIZE BLE_GATTS_ATTR_TAB_SIZE_DEFAULT
+#endif
+
 /**
  * This function is called in interrupt context to handle BLE events; i.e. pull
  * system and user events out of the pending events-queue of the BLE stack. The
@@ -68,13 +127,122 @@ static void sys_evt_dispatch(uint32_t sys_evt)
  */
 static uint32_t signalEvent()
 {
-    if(isEventsSignaled == false) {
-        isEventsSignaled = true;
+    uint32_t signaled = eventsSignaled;
+    eventsSignaled = signaled + 1;
+    if (signaled == eventsConsumed) {
         nRF5xn::Instance(BLE::DEFAULT_INSTANCE).signalEventsToProcess(BLE::DEFAULT_INSTANCE);
     }
     return NRF_SUCCESS;
 }
 
+bool btle_hasPendingEvents(void)
+{
+    return eventsSignaled != eventsConsumed;
+}
+
+/**
+ * Pull the next event out of the SoftDevice, unless one is already held;
+ * system events go first, as in intern_softdevice_events_execute(). The
+ * event stays held until btle_dispatchEvent(), so that btle_processEvents()
+ * can tell whether events are left without dispatching them.
+ *
+ * @return false if no event was pending.
+ */
+static bool btle_fetchEvent(void)
+{
+    if (fetchedEvent != FETCHED_NONE) {
+        return true;
+    }
+
+    if (sd_evt_get(&fetchedSysEvent) == NRF_SUCCESS) {
+        fetchedEvent = FETCHED_SYS;
+        return true;
+    }
+
+    uint16_t len = sizeof(eventBuffer);
+    if (sd_ble_evt_get(reinterpret_cast<uint8_t *>(eventBuffer), &len) == NRF_SUCCESS) {
+        fetchedEvent = FETCHED_BLE;
+        return true;
+    }
+
+    return false;
+}
+
+static void btle_dispatchEvent(void)
+{
+    uint8_t fetched = fetchedEvent;
+    fetchedEvent = FETCHED_NONE;
+
+    if (fetched == FETCHED_SYS) {
+        sys_evt_dispatch(fetchedSysEvent);
+    } else if (fetched == FETCHED_BLE) {
+        btle_handler(reinterpret_cast<ble_evt_t *>(eventBuffer));
+    }
+}
+
+bool btle_processEvents(unsigned maxEvents, uint32_t budgetUs)
+{
+    uint32_t start  = us_ticker_read();
+    unsigned events = 0;
+    bool     more   = false;
+
+    /* eventsConsumed catches up before the events are executed, so the first
+     * event signaled meanwhile finds the counters equal and signals again: at
+     * worst a spurious wake-up. Later ones find the counters apart and don't.
+     * Loop until they are equal, so that the events signaled meanwhile are
+     * picked up by this call and btle_hasPendingEvents() is accurate on return;
+     * the extra wake-up then finds nothing left to do. */
+    uint32_t signaled;
+    while (!more && ((signaled = eventsSignaled) != eventsConsumed)) {
+        eventsConsumed = signaled;
+
+        while (btle_fetchEvent()) {
+            /* An event is left: stop here if the limits are reached, and keep it for the next call. */
+            if ((events != 0) &&
+                (((maxEvents != 0) && (events >= maxEvents)) ||
+                 ((budgetUs != 0) && ((us_ticker_read() - start) >= budgetUs)))) {
+                more = true;
+                break;
+            }
+            btle_dispatchEvent();
+            events++;
+        }
+    }
+
+    if (more) {
+        /* Keep the counters apart, so that the interrupt doesn't signal the
+         * events left behind a second time, and signal them from here. */
+        eventsConsumed = eventsSignaled - 1;
+        eventStatistics.deferred++;
+        nRF5xn::Instance(BLE::DEFAULT_INSTANCE).signalEventsToProcess(BLE::DEFAULT_INSTANCE);
+    }
+
+    if (events != 0) {
+        uint32_t elapsed = us_ticker_read() - start;
+        eventStatistics.drains++;
+        eventStatistics.events           += events;
+        eventStatistics.totalDrainTimeUs += elapsed;
+        if (elapsed > eventStatistics.maxDrainTimeUs) {
+            eventStatistics.maxDrainTimeUs = elapsed;
+        }
+        if (events > eventStatistics.maxEventsPerDrain) {
+            eventStatistics.maxEventsPerDrain = (events > 0xFFFF) ? 0xFFFF : events;
+        }
+    }
+
+    return more;
+}
+
+const btle_eventStatistics_t *btle_getEventStatistics(void)
+{
+    return &eventStatistics;
+}
+
+void btle_resetEventStatistics(void)
+{
+    memset(&eventStatistics, 0, sizeof(eventStatistics));
+}
+
 error_t btle_init(void)
 {
     nrf_clock_lfclksrc_t clockSource;
@@ -102,7 +270,8 @@ error_t btle_init(void)
     static const bool IS_SRVC_CHANGED_CHARACT_PRESENT = true;
     ble_enable_params_t enableParams = {
         .gatts_enable_params = {
-            .service_changed = IS_SRVC_CHANGED_CHARACT_PRESENT
+            .service_changed = IS_SRVC_CHANGED_CHARACT_PRESENT,
+            .attr_tab_size   = YOTTA_CFG_NRF5X_GATTS_ATTR_TAB_SIZE
         }
     };
     if (sd_ble_enable(&enableParams) != NRF_SUCCESS) {
@@ -117,31 +286,121 @@ error_t btle_init(void)
         return ERROR_INVALID_PARAM;
     }
 
+    /* Library service handlers */
+#if SDK_CONN_PARAMS_MODULE_ENABLE
+    ASSERT_STATUS( btle_registerEventHandler(ble_conn_params_on_ble_evt, BTLE_EVENT_GROUP_GAP | BTLE_EVENT_GROUP_GATTS, BTLE_EVENT_ORDER_CONN_PARAMS));
+#endif
+    ASSERT_STATUS( btle_registerEventHandler(dm_ble_evt_handler, BTLE_EVENT_GROUP_GAP | BTLE_EVENT_GROUP_GATTS, BTLE_EVENT_ORDER_DEVICE_MANAGER));
+    ASSERT_STATUS( btle_registerEventHandler(btle_gapEventHandler, BTLE_EVENT_GROUP_GAP, BTLE_EVENT_ORDER_GAP));
+    ASSERT_STATUS( btle_registerEventHandler(btle_gattServerEventHandler,
+                                             BTLE_EVENT_GROUP_COMMON | BTLE_EVENT_GROUP_GAP | BTLE_EVENT_GROUP_GATTS,
+                                             BTLE_EVENT_ORDER_GATT_SERVER));
+    /* The GATT client subscribes itself once it is instantiated; see nRF5xn::getGattClient(). */
+
     ASSERT_STATUS( softdevice_ble_evt_handler_set(btle_handler));
     ASSERT_STATUS( softdevice_sys_evt_handler_set(sys_evt_dispatch));
 
     return btle_gap_init();
 }
 
+error_t btle_registerEventHandler(btle_eventHandler_t handler, uint8_t groups, uint8_t order)
+{
+    for (unsigned i = 0; i < eventHandlerCount; i++) {
+        if (eventHandlers[i].handler == handler) {
+            eventHandlers[i].groups = groups;
+            return ERROR_NONE;
+        }
+    }
+
+    /* Drop the unregistered entries. */
+    unsigned count = 0;
+    for (unsigned i = 0; i < eventHandlerCount; i++) {
+        if (eventHandlers[i].handler != NULL) {
+            eventHandlers[count++] = eventHandlers[i];
+        }
+    }
+    eventHandlerCount = count;
+
+    if (eventHandlerCount == YOTTA_CFG_NRF5X_EVENT_HANDLERS) {
+        return ERROR_NO_MEM;
+    }
+
+    /* Go after the handlers of the same order, so that registration order is kept among them. */
+    unsigned position = eventHandlerCount;
+    while ((position > 0) && (eventHandlers[position - 1].order > order)) {
+        eventHandlers[position] = eventHandlers[position - 1];
+        position--;
+    }
+    eventHandlers[position].handler = handler;
+    eventHandlers[position].groups  = groups;
+    eventHandlers[position].order   = order;
+    eventHandlerCount++;
+
+    return ERROR_NONE;
+}
+
+void btle_unregisterEventHandler(btle_eventHandler_t handler)
+{
+    for (unsigned i = 0; i < eventHandlerCount; i++) {
+        if (eventHandlers[i].handler == handler) {
+            eventHandlers[i].handler = NULL;
+            eventHandlers[i].groups  = 0;
+        }
+    }
+}
+
+static uint8_t btle_eventGroup(uint16_t evt_id)
+{
+    if (evt_id < BLE_GAP_EVT_BASE) {
+        return BTLE_EVENT_GROUP_COMMON;
+    } else if (evt_id == BLE_GAP_EVT_DISCONNECTED) {
+        return BTLE_EVENT_GROUP_GAP | BTLE_EVENT_GROUP_DISCONNECTED;
+    } else if (evt_id < BLE_GATTC_EVT_BASE) {
+        return BTLE_EVENT_GROUP_GAP;
+    } else if (evt_id < BLE_GATTS_EVT_BASE) {
+        return BTLE_EVENT_GROUP_GATTC;
+    } else if (evt_id <= BLE_GATTS_EVT_LAST) {
+        return BTLE_EVENT_GROUP_GATTS;
+    }
+    return BTLE_EVENT_GROUP_OTHER;
+}
+
 static void btle_handler(ble_evt_t *p_ble_evt)
 {
-    /* Library service handlers */
-#if SDK_CONN_PARAMS_MODULE_ENABLE
-    ble_conn_params_on_ble_evt(p_ble_evt);
-#endif
+    BTLE_CAPTURE_EVENT(p_ble_evt);
+    BTLE_INSTRUMENT_EVENT_BEGIN();
 
-    dm_ble_evt_handler(p_ble_evt);
+    uint8_t group = btle_eventGroup(p_ble_evt->header.evt_id);
 
-#if !defined(TARGET_MCU_NRF51_16K_S110) && !defined(TARGET_MCU_NRF51_32K_S110)
-    bleGattcEventHandler(p_ble_evt);
-#endif
+    for (unsigned i = 0; i < eventHandlerCount; i++) {
+        if (eventHandlers[i].groups & group) {
+            eventHandlers[i].handler(p_ble_evt);
+        }
+    }
+
+    BTLE_INSTRUMENT_EVENT_END(p_ble_evt->header.evt_id);
+}
 
+void btle_replayEvent(ble_evt_t *p_ble_evt, uint32_t timestampUs)
+{
+    /* Replayed events mustn't end up in the capture next to the live ones. */
+    bool wasCapturing = btle_captureSetEnabled(false);
+    btle_handler(p_ble_evt);
+    btle_captureSetEnabled(wasCapturing);
+}
+
+static void btle_gattServerEventHandler(ble_evt_t *p_ble_evt)
+{
+    nRF5xGattServer &gattServer = (nRF5xGattServer &) nRF5xn::Instance(BLE::DEFAULT_INSTANCE).getGattServer();
+    gattServer.hwCallback(p_ble_evt);
+}
+
+static void btle_gapEventHandler(ble_evt_t *p_ble_evt)
+{
     nRF5xn               &ble             = nRF5xn::Instance(BLE::DEFAULT_INSTANCE);
     nRF5xGap             &gap             = (nRF5xGap &) ble.getGap();
-    nRF5xGattServer      &gattServer      = (nRF5xGattServer &) ble.getGattServer();
     nRF5xSecurityManager &securityManager = (nRF5xSecurityManager &) ble.getSecurityManager();
 
-    /* Custom event handler */
     switch (p_ble_evt->header.evt_id) {
         case BLE_GAP_EVT_CONNECTED: {
             Gap::Handle_t handle = p_ble_evt->evt.gap_evt.conn_handle;
@@ -152,6 +411,7 @@ static void btle_handler(ble_evt_t *p_ble_evt)
             Gap::Role_t role = static_cast<Gap::Role_t>(p_ble_evt->evt.gap_evt.params.connected.role);
 #endif
             gap.setConnectionHandle(handle);
+            gap.addConnection(handle);
             const Gap::ConnectionParams_t *params = reinterpret_cast<Gap::ConnectionParams_t *>(&(p_ble_evt->evt.gap_evt.params.connected.conn_params));
             const ble_gap_addr_t *peer = &p_ble_evt->evt.gap_evt.params.connected.peer_addr;
             const ble_gap_addr_t *own  = &p_ble_evt->evt.gap_evt.params.connected.own_addr;
@@ -168,6 +428,7 @@ static void btle_handler(ble_evt_t *p_ble_evt)
             // Since we are not in a connection and have not started advertising,
             // store bonds
             gap.setConnectionHandle (BLE_CONN_HANDLE_INVALID);
+            gap.removeConnection(handle);
 
             Gap::DisconnectionReason_t reason;
             switch (p_ble_evt->evt.gap_evt.params.disconnected.reason) {
@@ -187,13 +448,6 @@ static void btle_handler(ble_evt_t *p_ble_evt)
                     break;
             }
 
-#if !defined(TARGET_MCU_NRF51_16K_S110) && !defined(TARGET_MCU_NRF51_32K_S110)
-            // Close all pending discoveries for this connection
-            nRF5xGattClient& gattClient = ble.getGattClient();
-            gattClient.characteristicDescriptorDiscoverer().terminate(handle, BLE_ERROR_INVALID_STATE);
-            gattClient.discovery().terminate(handle);
-#endif
-
             gap.processDisconnectionEvent(handle, reason);
             break;
         }
@@ -206,13 +460,6 @@ static void btle_handler(ble_evt_t *p_ble_evt)
             gap.processTimeoutEvent(static_cast<Gap::TimeoutSource_t>(p_ble_evt->evt.gap_evt.params.timeout.src));
             break;
 
-        case BLE_GATTC_EVT_TIMEOUT:
-        case BLE_GATTS_EVT_TIMEOUT:
-            // Disconnect on GATT Server and Client timeout events.
-            // ASSERT_STATUS_RET_VOID (sd_ble_gap_disconnect(m_conn_handle,
-            // BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION));
-            break;
-
         case BLE_GAP_EVT_ADV_REPORT: {
             const ble_gap_evt_adv_report_t *advReport = &p_ble_evt->evt.gap_evt.params.adv_report;
             gap.processAdvertisementReport(advReport->peer_addr.addr,
@@ -227,8 +474,6 @@ static void btle_handler(ble_evt_t *p_ble_evt)
         default:
             break;
     }
-
-    gattServer.hwCallback(p_ble_evt);
 }
 
 /*! @brief      Callback when an error occurs inside the SoftDevice */
@@ -28,11 +28,89 @@ extern "C" {
 
 error_t     btle_init(void);
 
-// flag indicating if events have been signaled or not
-// It is used by processEvents and signalEventsToProcess
-// signalEventsToProcess raise the flag and processEvents
-// clears it.
-extern bool isEventsSignaled;
+/**
+ * Groups of SoftDevice events, by range of evt_id, to which an event handler
+ * can subscribe.
+ */
+#define BTLE_EVENT_GROUP_COMMON (1 << 0) /**< BLE_EVT_BASE .. BLE_EVT_LAST, e.g. BLE_EVT_TX_COMPLETE. */
+#define BTLE_EVENT_GROUP_GAP    (1 << 1)
+#define BTLE_EVENT_GROUP_GATTC  (1 << 2)
+#define BTLE_EVENT_GROUP_GATTS  (1 << 3)
+#define BTLE_EVENT_GROUP_OTHER  (1 << 4) /**< L2CAP and anything beyond BLE_GATTS_EVT_LAST. */
+#define BTLE_EVENT_GROUP_DISCONNECTED (1 << 5) /**< BLE_GAP_EVT_DISCONNECTED alone, for handlers with no use for the rest of the GAP group. */
+#define BTLE_EVENT_GROUP_ALL    0x3F
+
+/**
+ * Position of the handlers of the stack modules in the dispatch order;
+ * handlers with a lower order see an event first.
+ */
+#define BTLE_EVENT_ORDER_CONN_PARAMS    0
+#define BTLE_EVENT_ORDER_DEVICE_MANAGER 10
+#define BTLE_EVENT_ORDER_GATT_CLIENT    20
+#define BTLE_EVENT_ORDER_GAP            30
+#define BTLE_EVENT_ORDER_GATT_SERVER    40
+#define BTLE_EVENT_ORDER_APPLICATION    50
+
+typedef void (*btle_eventHandler_t)(ble_evt_t *p_ble_evt);
+
+/**
+ * Subscribe a handler to groups of SoftDevice events. Registering a handler
+ * again replaces its groups.
+ *
+ * @param[in]  handler  Function called from the event dispatch loop.
+ * @param[in]  groups   Bitmask of BTLE_EVENT_GROUP_* values.
+ * @param[in]  order    Position in the dispatch order, see BTLE_EVENT_ORDER_*.
+ *
+ * @return ERROR_NONE on success, ERROR_NO_MEM if the handler table is full.
+ */
+error_t     btle_registerEventHandler(btle_eventHandler_t handler, uint8_t groups, uint8_t order);
+
+/**
+ * Stop dispatching events to a handler. May be called from within a handler.
+ */
+void        btle_unregisterEventHandler(btle_eventHandler_t handler);
+
+/**
+ * Test, from thread mode, whether the SoftDevice has signaled events which
+ * haven't been processed by btle_processEvents() yet.
+ */
+bool        btle_hasPendingEvents(void);
+
+/**
+ * Pull and dispatch the SoftDevice events, from thread mode, until none is
+ * left or a budget is exhausted. signalEventsToProcess() is called again for
+ * the first event signaled after this returns; if the budget stopped the
+ * draining, it is called right away so that the remaining events are
+ * processed on the next pass.
+ *
+ * @param[in]  maxEvents  Maximum number of events to dispatch; 0 for no limit.
+ * @param[in]  budgetUs   Time after which no more events are pulled; 0 for no limit.
+ *
+ * @return true if events were left in the SoftDevice queue.
+ */
+bool        btle_processEvents(unsigned maxEvents, uint32_t budgetUs);
+
+/**
+ * Statistics of the calls to btle_processEvents() which dispatched events.
+ */
+typedef struct {
+    uint32_t drains;            /**< Number of calls which dispatched at least one event. */
+    uint32_t events;            /**< Number of events dispatched. */
+    uint32_t deferred;          /**< Number of calls which ran out of budget with events left. */
+    uint32_t totalDrainTimeUs;
+    uint32_t maxDrainTimeUs;
+    uint16_t maxEventsPerDrain; /**< Deepest backlog seen by a single call. */
+} btle_eventStatistics_t;
+
+/**
+ * Dispatch an event which was recorded earlier (see btle_capture.h) as if
+ * the SoftDevice had just delivered it. Its signature allows it to be passed
+ * to btle_captureReplay() directly.
+ */
+void        btle_replayEvent(ble_evt_t *p_ble_evt, uint32_t timestampUs);
+
+const btle_eventStatistics_t *btle_getEventStatistics(void);
+void        btle_resetEventStatistics(void);
 
 #ifdef __cplusplus
 }
@@ -17,6 +17,7 @@
 
 #include "ble_advdata.h"
 #include "btle.h"
+#include "btle_instrumentation.h"
 
 /**************************************************************************/
 /*!
@@ -40,7 +41,7 @@ error_t btle_advertising_start(void)
                                                                * ms */
     adv_para.timeout     = CFG_GAP_ADV_TIMEOUT_S;
 
-    ASSERT_STATUS( sd_ble_gap_adv_start(&adv_para));
+    ASSERT_STATUS( BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_ADV_START, sd_ble_gap_adv_start(&adv_para)));
 
     return ERROR_NONE;
 }
@@ -0,0 +1,202 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "btle_capture.h"
+
+/* Largest event accepted by a replay; events are recorded whole, as sd_ble_evt_get() returned them. */
+static const size_t MAX_EVENT_SIZE = sizeof(ble_evt_t) + GATT_MTU_SIZE_DEFAULT;
+
+static uint32_t getLittleEndian(const uint8_t *p, unsigned bytes)
+{
+    uint32_t value = 0;
+    for (unsigned i = 0; i < bytes; i++) {
+        value |= (uint32_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+int btle_captureReplay(const uint8_t *dump, size_t len, btle_captureReplayHandler_t handler)
+{
+    if ((dump == NULL) || (len < BTLE_CAPTURE_HEADER_SIZE) ||
+        (memcmp(dump, BTLE_CAPTURE_MAGIC, 4) != 0) || (dump[4] != BTLE_CAPTURE_FORMAT_VERSION)) {
+        return -1;
+    }
+
+    unsigned       records = getLittleEndian(&dump[5], 2);
+    const uint8_t *p       = dump + BTLE_CAPTURE_HEADER_SIZE;
+    const uint8_t *end     = dump + len;
+
+    /* Copy each event out of the byte stream so that the handler sees it properly aligned. */
+    uint32_t event[(MAX_EVENT_SIZE + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+
+    for (unsigned i = 0; i < records; i++) {
+        if ((p + BTLE_CAPTURE_RECORD_OVERHEAD) > end) {
+            return -1;
+        }
+        uint16_t eventLength = getLittleEndian(p, 2);
+        uint32_t timestamp   = getLittleEndian(p + 2, 4);
+        p += BTLE_CAPTURE_RECORD_OVERHEAD;
+        if ((eventLength > sizeof(event)) || ((p + eventLength) > end)) {
+            return -1;
+        }
+
+        memset(event, 0, sizeof(event));
+        memcpy(event, p, eventLength);
+        p += eventLength;
+
+        if (handler) {
+            handler(reinterpret_cast<ble_evt_t *>(event), timestamp);
+        }
+    }
+
+    return records;
+}
+
+#if YOTTA_CFG_NRF5X_EVENT_CAPTURE_SIZE
+
+#ifdef YOTTA_CFG_MBED_OS
+    #include "mbed-drivers/mbed.h"
+#else
+    #include "mbed.h"
+#endif
+
+static const size_t CAPTURE_SIZE = YOTTA_CFG_NRF5X_EVENT_CAPTURE_SIZE;
+
+/* Byte ring of records in the dump format; records wrap around the end of the storage. */
+static uint8_t  captureStorage[CAPTURE_SIZE];
+static size_t   captureHead    = 0; /**< Offset of the oldest record. */
+static size_t   captureCount   = 0; /**< Number of bytes in use. */
+static uint16_t captureRecords = 0;
+static uint32_t captureDropped = 0;
+static bool     captureEnabled = true;
+
+static void ringWrite(const uint8_t *data, size_t len)
+{
+    size_t tail = (captureHead + captureCount) % CAPTURE_SIZE;
+    for (size_t i = 0; i < len; i++) {
+        captureStorage[tail] = data[i];
+        tail = (tail + 1) % CAPTURE_SIZE;
+    }
+    captureCount += len;
+}
+
+static uint8_t ringPeek(size_t offset)
+{
+    return captureStorage[(captureHead + offset) % CAPTURE_SIZE];
+}
+
+static void dropOldestRecord(void)
+{
+    size_t recordSize = BTLE_CAPTURE_RECORD_OVERHEAD + (ringPeek(0) | (ringPeek(1) << 8));
+    captureHead   = (captureHead + recordSize) % CAPTURE_SIZE;
+    captureCount -= recordSize;
+    captureRecords--;
+    captureDropped++;
+}
+
+void btle_captureEvent(const ble_evt_t *p_ble_evt)
+{
+    if (!captureEnabled) {
+        return;
+    }
+
+    size_t eventLength = sizeof(ble_evt_hdr_t) + p_ble_evt->header.evt_len;
+    if (eventLength > MAX_EVENT_SIZE) {
+        eventLength = MAX_EVENT_SIZE;
+    }
+    size_t recordSize = BTLE_CAPTURE_RECORD_OVERHEAD + eventLength;
+    if ((recordSize > CAPTURE_SIZE) || (captureRecords == 0xFFFF)) {
+        captureDropped++;
+        return;
+    }
+
+    while ((CAPTURE_SIZE - captureCount) < recordSize) {
+        dropOldestRecord();
+    }
+
+    uint32_t timestamp = us_ticker_read();
+    uint8_t  header[BTLE_CAPTURE_RECORD_OVERHEAD] = {
+        (uint8_t)eventLength, (uint8_t)(eventLength >> 8),
+        (uint8_t)timestamp, (uint8_t)(timestamp >> 8), (uint8_t)(timestamp >> 16), (uint8_t)(timestamp >> 24)
+    };
+    ringWrite(header, sizeof(header));
+    ringWrite(reinterpret_cast<const uint8_t *>(p_ble_evt), eventLength);
+    captureRecords++;
+}
+
+bool btle_captureSetEnabled(bool enabled)
+{
+    bool wasEnabled = captureEnabled;
+    captureEnabled  = enabled;
+    return wasEnabled;
+}
+
+void btle_captureReset(void)
+{
+    captureHead    = 0;
+    captureCount   = 0;
+    captureRecords = 0;
+    captureDropped = 0;
+}
+
+size_t btle_captureDump(btle_captureWriter_t writer)
+{
+    bool wasEnabled = btle_captureSetEnabled(false);
+
+    uint8_t header[BTLE_CAPTURE_HEADER_SIZE] = {
+        BTLE_CAPTURE_MAGIC[0], BTLE_CAPTURE_MAGIC[1], BTLE_CAPTURE_MAGIC[2], BTLE_CAPTURE_MAGIC[3],
+        BTLE_CAPTURE_FORMAT_VERSION,
+        (uint8_t)captureRecords, (uint8_t)(captureRecords >> 8),
+        (uint8_t)captureDropped, (uint8_t)(captureDropped >> 8), (uint8_t)(captureDropped >> 16), (uint8_t)(captureDropped >> 24)
+    };
+    writer(header, sizeof(header));
+
+    /* The records are stored in the dump format already; write them in at most two chunks. */
+    size_t first = CAPTURE_SIZE - captureHead;
+    if (first > captureCount) {
+        first = captureCount;
+    }
+    if (first != 0) {
+        writer(&captureStorage[captureHead], first);
+    }
+    if (captureCount > first) {
+        writer(captureStorage, captureCount - first);
+    }
+
+    captureEnabled = wasEnabled;
+    return sizeof(header) + captureCount;
+}
+
+#else /* #if YOTTA_CFG_NRF5X_EVENT_CAPTURE_SIZE */
+
+bool btle_captureSetEnabled(bool enabled)
+{
+    return false;
+}
+
+void btle_captureReset(void)
+{
+    /* empty */
+}
+
+size_t btle_captureDump(btle_captureWriter_t writer)
+{
+    return 0;
+}
+
+#endif /* #if YOTTA_CFG_NRF5X_EVENT_CAPTURE_SIZE */
@@ -0,0 +1,87 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BTLE_CAPTURE_H_
+#define _BTLE_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nrf_ble.h"
+
+/*
+ * Size in bytes of the RAM ring buffer recording the SoftDevice events which
+ * reach the dispatcher. 0 compiles the capture out. Once the buffer is full,
+ * the oldest events are dropped to make room for new ones.
+ */
+#ifndef YOTTA_CFG_NRF5X_EVENT_CAPTURE_SIZE
+    #define YOTTA_CFG_NRF5X_EVENT_CAPTURE_SIZE 0
+#endif
+
+/*
+ * Format of a dump, all fields little endian:
+ *   - header: magic "BLEC" (4 bytes), format version (1 byte), number of
+ *     records (2 bytes), number of events dropped before the first record
+ *     (4 bytes);
+ *   - records, oldest first: length of the event (2 bytes), timestamp in
+ *     microseconds (4 bytes), then the ble_evt_t as delivered by
+ *     sd_ble_evt_get(): its header followed by header.evt_len bytes.
+ * The format doesn't depend on the SoftDevice being present, so that a dump
+ * can be parsed and replayed by a host build against a stubbed SoftDevice.
+ */
+#define BTLE_CAPTURE_MAGIC           "BLEC"
+#define BTLE_CAPTURE_FORMAT_VERSION  1
+#define BTLE_CAPTURE_HEADER_SIZE     11
+#define BTLE_CAPTURE_RECORD_OVERHEAD 6
+
+typedef void (*btle_captureWriter_t)(const uint8_t *data, size_t len);
+typedef void (*btle_captureReplayHandler_t)(ble_evt_t *p_ble_evt, uint32_t timestampUs);
+
+/**
+ * Suspend or resume the recording; it is enabled by default.
+ * @return whether the recording was enabled.
+ */
+bool   btle_captureSetEnabled(bool enabled);
+
+/**
+ * Discard the recorded events.
+ */
+void   btle_captureReset(void);
+
+/**
+ * Stream the recorded events, in the dump format, through a writer such as
+ * a UART transmit routine. The recording is suspended meanwhile.
+ *
+ * @return the number of bytes written; 0 if the capture is compiled out.
+ */
+size_t btle_captureDump(btle_captureWriter_t writer);
+
+/**
+ * Parse a dump and hand each event to a handler, in the order they were
+ * recorded. Available whether or not the capture is compiled in.
+ *
+ * @return the number of events replayed, or -1 if the dump is malformed.
+ */
+int    btle_captureReplay(const uint8_t *dump, size_t len, btle_captureReplayHandler_t handler);
+
+#if YOTTA_CFG_NRF5X_EVENT_CAPTURE_SIZE
+void   btle_captureEvent(const ble_evt_t *p_ble_evt);
+    #define BTLE_CAPTURE_EVENT(p_ble_evt) btle_captureEvent(p_ble_evt)
+#else
+    #define BTLE_CAPTURE_EVENT(p_ble_evt)
+#endif
+
+#endif /* _BTLE_CAPTURE_H_ */
@@ -0,0 +1,423 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "nrf_ble.h"
+
+extern "C" {
+#include "pstorage.h"
+#include "device_manager.h"
+}
+
+#include "btle_security.h"
+#include "btle_databaseCache.h"
+
+/*
+ * Records of the cached databases, in little endian:
+ *   service:        type, start handle (2), end handle (2), UUID length, UUID
+ *   characteristic: type, declaration handle (2), value handle (2),
+ *                   last handle (2), properties, UUID length, UUID
+ * 128-bit UUIDs are stored in the byte order of UUID::getBaseUUID().
+ */
+static const unsigned SERVICE_RECORD_HEADER_SIZE        = 6;
+static const unsigned CHARACTERISTIC_RECORD_HEADER_SIZE = 9;
+
+static uint8_t *encodeHandle(uint8_t *p, GattAttribute::Handle_t handle)
+{
+    p[0] = (uint8_t)handle;
+    p[1] = (uint8_t)(handle >> 8);
+    return p + 2;
+}
+
+static GattAttribute::Handle_t decodeHandle(const uint8_t *p)
+{
+    return (GattAttribute::Handle_t)(p[0] | (p[1] << 8));
+}
+
+bool
+btle_readDatabaseCache(btle_databaseCacheCursor_t *cursor, btle_databaseCacheEntry_t *entry)
+{
+    const uint8_t *p         = cursor->next;
+    size_t         remaining = cursor->end - p;
+
+    unsigned headerSize;
+    if ((remaining > 0) && (p[0] == BTLE_DATABASE_CACHE_SERVICE)) {
+        headerSize = SERVICE_RECORD_HEADER_SIZE;
+    } else if ((remaining > 0) && (p[0] == BTLE_DATABASE_CACHE_CHARACTERISTIC)) {
+        headerSize = CHARACTERISTIC_RECORD_HEADER_SIZE;
+    } else {
+        return false;
+    }
+
+    if (remaining < headerSize) {
+        return false;
+    }
+    uint8_t uuidLength = p[headerSize - 1];
+    if (((uuidLength != sizeof(UUID::ShortUUIDBytes_t)) && (uuidLength != UUID::LENGTH_OF_LONG_UUID)) ||
+        (remaining < headerSize + uuidLength)) {
+        return false;
+    }
+
+    entry->type        = (btle_databaseCacheEntryType_t)p[0];
+    entry->startHandle = decodeHandle(&p[1]);
+    if (entry->type == BTLE_DATABASE_CACHE_SERVICE) {
+        entry->endHandle   = decodeHandle(&p[3]);
+        entry->valueHandle = 0;
+        memset(&entry->properties, 0, sizeof(entry->properties));
+    } else {
+        entry->valueHandle               = decodeHandle(&p[3]);
+        entry->endHandle                 = decodeHandle(&p[5]);
+        entry->properties.broadcast      = (p[7] >> 0) & 1;
+        entry->properties.read           = (p[7] >> 1) & 1;
+        entry->properties.write_wo_resp  = (p[7] >> 2) & 1;
+        entry->properties.write          = (p[7] >> 3) & 1;
+        entry->properties.notify         = (p[7] >> 4) & 1;
+        entry->properties.indicate       = (p[7] >> 5) & 1;
+        entry->properties.auth_signed_wr = (p[7] >> 6) & 1;
+    }
+
+    const uint8_t *uuid = &p[headerSize];
+    if (uuidLength == UUID::LENGTH_OF_LONG_UUID) {
+        UUID::LongUUIDBytes_t longUUID;
+        memcpy(longUUID, uuid, UUID::LENGTH_OF_LONG_UUID);
+        entry->uuid = UUID(longUUID, UUID::LSB);
+    } else {
+        entry->uuid = UUID(decodeHandle(uuid));
+    }
+
+    cursor->next = p + headerSize + uuidLength;
+    return true;
+}
+
+#if YOTTA_CFG_NRF5X_GATTC_DATABASE_CACHE_SIZE > 0
+
+typedef struct {
+    uint16_t length;                         /**< Length of records; 0 or 0xFFFF (erased flash) if nothing is stored. */
+    uint8_t  peerAddressType;
+    uint8_t  peerAddress[BLE_GAP_ADDR_LEN];  /**< Identity of the bond the database belongs to. */
+    uint8_t  reserved[3];
+    uint8_t  records[(YOTTA_CFG_NRF5X_GATTC_DATABASE_CACHE_SIZE + 3) & ~3]; /**< pstorage operates on whole words. */
+} databaseBlock_t;
+
+static bool
+isServiceChangedHandle(btle_databaseCacheCursor_t *cursor, GattAttribute::Handle_t handle)
+{
+    btle_databaseCacheEntry_t entry;
+    while (btle_readDatabaseCache(cursor, &entry)) {
+        if ((entry.type == BTLE_DATABASE_CACHE_CHARACTERISTIC) &&
+            (entry.uuid == UUID::ShortUUIDBytes_t(BLE_UUID_GATT_CHARACTERISTIC_SERVICE_CHANGED))) {
+            return entry.valueHandle == handle;
+        }
+    }
+
+    return false;
+}
+
+static pstorage_handle_t databaseStorage;
+static bool              databaseStorageRegistered = false;
+
+/*
+ * The database being recorded. It is also the buffer pstorage reads from
+ * until the database is written to flash, and holds the latest copy of it
+ * meanwhile.
+ */
+static databaseBlock_t   recordBlock;
+static Gap::Handle_t     recordConnection = BLE_CONN_HANDLE_INVALID; /**< Connection being recorded, if any. */
+static uint8_t           recordDeviceId   = DM_INVALID_ID;           /**< Bond of the database in recordBlock. */
+static bool              recordFlushing   = false;
+
+/*
+ * Invalidations overwrite the length of the stored database with 0. Until they
+ * complete, a stale database may still be in flash, so none is used.
+ */
+static uint32_t          invalidLength    = 0;
+static unsigned          invalidationsPending = 0;
+
+static void
+databaseStorageCallback(pstorage_handle_t *handle, uint8_t opCode, uint32_t result, uint8_t *data, uint32_t dataLen)
+{
+    if (opCode == PSTORAGE_UPDATE_OP_CODE) {
+        if (data == reinterpret_cast<uint8_t *>(&invalidLength)) {
+            invalidationsPending--;
+        } else if (data == reinterpret_cast<uint8_t *>(&recordBlock)) {
+            recordFlushing = false;
+            recordDeviceId = DM_INVALID_ID;
+        }
+    }
+}
+
+void
+btle_initializeDatabaseCache(void)
+{
+    pstorage_module_param_t param = {
+        .cb          = databaseStorageCallback,
+        .block_size  = sizeof(databaseBlock_t),
+        .block_count = DEVICE_MANAGER_MAX_BONDS
+    };
+    /* Without storage, peers are simply discovered on every connection. */
+    databaseStorageRegistered = (pstorage_register(&param, &databaseStorage) == NRF_SUCCESS);
+}
+
+void
+btle_purgeDatabaseCache(void)
+{
+    if (!databaseStorageRegistered) {
+        return;
+    }
+
+    recordConnection = BLE_CONN_HANDLE_INVALID;
+    if (!recordFlushing) {
+        recordDeviceId = DM_INVALID_ID;
+    }
+    pstorage_clear(&databaseStorage, sizeof(databaseBlock_t) * DEVICE_MANAGER_MAX_BONDS);
+}
+
+static bool
+databasePeer(Gap::Handle_t connectionHandle, uint8_t *deviceId, ble_gap_addr_t *address)
+{
+    return databaseStorageRegistered && btle_getBondedPeer(connectionHandle, deviceId, address);
+}
+
+/* Database saved for a bonded peer, or NULL if there isn't one. */
+static const databaseBlock_t *
+databaseLookup(uint8_t deviceId, const ble_gap_addr_t &address)
+{
+    const databaseBlock_t *stored;
+    if (invalidationsPending > 0) {
+        return NULL;
+    }
+
+    if (recordFlushing && (recordDeviceId == deviceId)) {
+        stored = &recordBlock;
+    } else {
+        pstorage_handle_t block;
+        if (pstorage_block_identifier_get(&databaseStorage, deviceId, &block) != NRF_SUCCESS) {
+            return NULL;
+        }
+
+        /* Flash is memory mapped. */
+        stored = reinterpret_cast<const databaseBlock_t *>(block.block_id);
+    }
+
+    /* The device ID of a deleted bond is reused by the next one. */
+    if ((stored->length == 0) || (stored->length > sizeof(stored->records)) ||
+        (stored->peerAddressType != address.addr_type) ||
+        (memcmp(stored->peerAddress, address.addr, BLE_GAP_ADDR_LEN) != 0)) {
+        return NULL;
+    }
+
+    return stored;
+}
+
+bool
+btle_openDatabaseCache(Gap::Handle_t connectionHandle, btle_databaseCacheCursor_t *cursor)
+{
+    uint8_t        deviceId;
+    ble_gap_addr_t address;
+    if (!databasePeer(connectionHandle, &deviceId, &address)) {
+        return false;
+    }
+
+    const databaseBlock_t *stored = databaseLookup(deviceId, address);
+    if (stored == NULL) {
+        return false;
+    }
+
+    cursor->next = stored->records;
+    cursor->end  = stored->records + stored->length;
+    return true;
+}
+
+bool
+btle_startDatabaseRecording(Gap::Handle_t connectionHandle)
+{
+    uint8_t        deviceId;
+    ble_gap_addr_t address;
+    if ((recordConnection != BLE_CONN_HANDLE_INVALID) || recordFlushing ||
+        !databasePeer(connectionHandle, &deviceId, &address)) {
+        return false;
+    }
+
+    recordConnection = connectionHandle;
+    recordDeviceId   = deviceId;
+
+    recordBlock.length          = 0;
+    recordBlock.peerAddressType = address.addr_type;
+    memcpy(recordBlock.peerAddress, address.addr, BLE_GAP_ADDR_LEN);
+    memset(recordBlock.reserved, 0xFF, sizeof(recordBlock.reserved));
+    return true;
+}
+
+static void
+abandonRecording(Gap::Handle_t connectionHandle)
+{
+    if (recordConnection == connectionHandle) {
+        recordConnection = BLE_CONN_HANDLE_INVALID;
+        if (!recordFlushing) {
+            recordDeviceId = DM_INVALID_ID;
+        }
+    }
+}
+
+/* Space for a record of the given size, or NULL if the connection isn't recorded. */
+static uint8_t *
+appendRecord(Gap::Handle_t connectionHandle, const UUID &uuid, unsigned headerSize)
+{
+    if (recordConnection != connectionHandle) {
+        return NULL;
+    }
+
+    /* Databases are only cached whole, with every UUID resolved. */
+    unsigned size = headerSize + uuid.getLen();
+    if ((uuid == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) ||
+        (recordBlock.length + size > sizeof(recordBlock.records))) {
+        abandonRecording(connectionHandle);
+        return NULL;
+    }
+
+    uint8_t *record = &recordBlock.records[recordBlock.length];
+    recordBlock.length += size;
+
+    record[headerSize - 1] = uuid.getLen();
+    if (uuid.shortOrLong() == UUID::UUID_TYPE_LONG) {
+        memcpy(&record[headerSize], uuid.getBaseUUID(), UUID::LENGTH_OF_LONG_UUID);
+    } else {
+        encodeHandle(&record[headerSize], uuid.getShortUUID());
+    }
+    return record;
+}
+
+void
+btle_recordDiscoveredService(Gap::Handle_t connectionHandle, const DiscoveredService &service)
+{
+    uint8_t *p = appendRecord(connectionHandle, service.getUUID(), SERVICE_RECORD_HEADER_SIZE);
+    if (p == NULL) {
+        return;
+    }
+
+    *p++ = BTLE_DATABASE_CACHE_SERVICE;
+    p    = encodeHandle(p, service.getStartHandle());
+    encodeHandle(p, service.getEndHandle());
+}
+
+void
+btle_recordDiscoveredCharacteristic(Gap::Handle_t connectionHandle, const DiscoveredCharacteristic &characteristic)
+{
+    uint8_t *p = appendRecord(connectionHandle, characteristic.getUUID(), CHARACTERISTIC_RECORD_HEADER_SIZE);
+    if (p == NULL) {
+        return;
+    }
+
+    const DiscoveredCharacteristic::Properties_t &props = characteristic.getProperties();
+
+    *p++ = BTLE_DATABASE_CACHE_CHARACTERISTIC;
+    p    = encodeHandle(p, characteristic.getDeclHandle());
+    p    = encodeHandle(p, characteristic.getValueHandle());
+    p    = encodeHandle(p, characteristic.getLastHandle());
+    *p   = (props._broadcast       << 0) |
+           (props._read            << 1) |
+           (props._writeWoResp     << 2) |
+           (props._write           << 3) |
+           (props._notify          << 4) |
+           (props._indicate        << 5) |
+           (props._authSignedWrite << 6);
+}
+
+void
+btle_stopDatabaseRecording(Gap::Handle_t connectionHandle, bool complete)
+{
+    if (recordConnection != connectionHandle) {
+        return;
+    }
+    recordConnection = BLE_CONN_HANDLE_INVALID;
+
+    pstorage_handle_t block;
+    if (!complete || (recordBlock.length == 0) ||
+        (pstorage_block_identifier_get(&databaseStorage, recordDeviceId, &block) != NRF_SUCCESS)) {
+        recordDeviceId = DM_INVALID_ID;
+        return;
+    }
+
+    /* Only write the records in use, padded to a whole word. */
+    uint16_t paddedLength = (recordBlock.length + 3) & ~3;
+    memset(&recordBlock.records[recordBlock.length], 0xFF, paddedLength - recordBlock.length);
+
+    if (pstorage_update(&block, reinterpret_cast<uint8_t *>(&recordBlock),
+                        offsetof(databaseBlock_t, records) + paddedLength, 0) != NRF_SUCCESS) {
+        recordDeviceId = DM_INVALID_ID; /* The peer will be discovered again on its next connection. */
+        return;
+    }
+    recordFlushing = true;
+}
+
+void
+btle_invalidateDatabaseCache(Gap::Handle_t connectionHandle)
+{
+    /* A recording is based on the database as it was before the change. */
+    abandonRecording(connectionHandle);
+
+    uint8_t        deviceId;
+    ble_gap_addr_t address;
+    if (!databasePeer(connectionHandle, &deviceId, &address)) {
+        return;
+    }
+
+    if (recordDeviceId == deviceId) {
+        recordDeviceId = DM_INVALID_ID; /* Stop serving the copy being written. */
+    }
+
+    pstorage_handle_t block;
+    if ((pstorage_block_identifier_get(&databaseStorage, deviceId, &block) == NRF_SUCCESS) &&
+        (pstorage_update(&block, reinterpret_cast<uint8_t *>(&invalidLength), sizeof(invalidLength), 0) == NRF_SUCCESS)) {
+        invalidationsPending++;
+    }
+}
+
+void
+btle_processDatabaseCacheIndication(Gap::Handle_t connectionHandle, GattAttribute::Handle_t handle)
+{
+    btle_databaseCacheCursor_t cursor;
+    bool                       changed = false;
+
+    if (recordConnection == connectionHandle) {
+        cursor.next = recordBlock.records;
+        cursor.end  = recordBlock.records + recordBlock.length;
+        changed     = isServiceChangedHandle(&cursor, handle);
+    }
+    if (!changed && btle_openDatabaseCache(connectionHandle, &cursor)) {
+        changed = isServiceChangedHandle(&cursor, handle);
+    }
+
+    if (changed) {
+        btle_invalidateDatabaseCache(connectionHandle);
+    }
+}
+
+#else /* YOTTA_CFG_NRF5X_GATTC_DATABASE_CACHE_SIZE > 0 */
+
+void btle_initializeDatabaseCache(void) {}
+void btle_purgeDatabaseCache(void) {}
+bool btle_openDatabaseCache(Gap::Handle_t, btle_databaseCacheCursor_t *) { return false; }
+bool btle_startDatabaseRecording(Gap::Handle_t) { return false; }
+void btle_recordDiscoveredService(Gap::Handle_t, const DiscoveredService &) {}
+void btle_recordDiscoveredCharacteristic(Gap::Handle_t, const DiscoveredCharacteristic &) {}
+void btle_stopDatabaseRecording(Gap::Handle_t, bool) {}
+void btle_invalidateDatabaseCache(Gap::Handle_t) {}
+void btle_processDatabaseCacheIndication(Gap::Handle_t, GattAttribute::Handle_t) {}
+
+#endif /* YOTTA_CFG_NRF5X_GATTC_DATABASE_CACHE_SIZE > 0 */
@@ -0,0 +1,129 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BTLE_DATABASE_CACHE_H_
+#define _BTLE_DATABASE_CACHE_H_
+
+#include "ble/Gap.h"
+#include "ble/UUID.h"
+#include "ble/GattAttribute.h"
+#include "ble/DiscoveredService.h"
+#include "ble/DiscoveredCharacteristic.h"
+
+#include "ble_gatt.h"
+
+/*
+ * Cache of the GATT database of bonded peers, kept in a pstorage block per
+ * bond, so that reconnecting to a peer doesn't require a new discovery.
+ *
+ * Size of the database a peer can have in the cache; larger databases are
+ * discovered on every connection. A service takes 8 bytes, a characteristic
+ * 11, and 14 more are needed for each 128-bit UUID. 0 disables the cache.
+ */
+#ifndef YOTTA_CFG_NRF5X_GATTC_DATABASE_CACHE_SIZE
+    #define YOTTA_CFG_NRF5X_GATTC_DATABASE_CACHE_SIZE 256
+#endif
+
+typedef enum {
+    BTLE_DATABASE_CACHE_SERVICE        = 0x01,
+    BTLE_DATABASE_CACHE_CHARACTERISTIC = 0x02,
+} btle_databaseCacheEntryType_t;
+
+/**
+ * A service or characteristic read from the cache. Entries come in the order
+ * of discovery: each service is followed by its characteristics.
+ */
+typedef struct {
+    btle_databaseCacheEntryType_t type;
+    UUID                          uuid;
+    GattAttribute::Handle_t       startHandle; /**< Start handle of a service, or declaration handle of a characteristic. */
+    GattAttribute::Handle_t       endHandle;   /**< End handle of a service, or last handle of a characteristic. */
+    GattAttribute::Handle_t       valueHandle; /**< Characteristics only. */
+    ble_gatt_char_props_t         properties;  /**< Characteristics only. */
+} btle_databaseCacheEntry_t;
+
+typedef struct {
+    const uint8_t *next;
+    const uint8_t *end;
+} btle_databaseCacheCursor_t;
+
+/**
+ * Register the persistent storage of the cache. Called along with the
+ * initialization of the device manager, which identifies the bonded peers.
+ */
+void btle_initializeDatabaseCache(void);
+
+/**
+ * Forget the databases of all the peers; for use when the bonds are deleted.
+ */
+void btle_purgeDatabaseCache(void);
+
+/**
+ * Start reading the database cached for the peer of a connection.
+ *
+ * @return true if the peer is bonded and its database is cached.
+ */
+bool btle_openDatabaseCache(Gap::Handle_t connectionHandle, btle_databaseCacheCursor_t *cursor);
+
+/**
+ * Read the next entry of a cached database.
+ *
+ * @return false once all the entries have been read.
+ */
+bool btle_readDatabaseCache(btle_databaseCacheCursor_t *cursor, btle_databaseCacheEntry_t *entry);
+
+/**
+ * Start recording the database of the peer of a connection, as it gets
+ * discovered. Only one database is recorded at a time.
+ *
+ * @return true if the peer is bonded and the recording has started.
+ */
+bool btle_startDatabaseRecording(Gap::Handle_t connectionHandle);
+
+/**
+ * Add a service to the database being recorded for a connection. The
+ * recording is abandoned if the UUID of the service isn't known, or if the
+ * database outgrows the cache.
+ */
+void btle_recordDiscoveredService(Gap::Handle_t connectionHandle, const DiscoveredService &service);
+
+/**
+ * Add a characteristic, with its last handle set, to the database being
+ * recorded for a connection.
+ */
+void btle_recordDiscoveredCharacteristic(Gap::Handle_t connectionHandle, const DiscoveredCharacteristic &characteristic);
+
+/**
+ * End the recording for a connection.
+ *
+ * @param[in] complete
+ *              true if the discovery went through the whole database, which
+ *              is then written to flash; false to discard it.
+ */
+void btle_stopDatabaseRecording(Gap::Handle_t connectionHandle, bool complete);
+
+/**
+ * Forget the database cached for the peer of a connection.
+ */
+void btle_invalidateDatabaseCache(Gap::Handle_t connectionHandle);
+
+/**
+ * Invalidate the database of the peer of a connection if an indication is
+ * received from its Service Changed characteristic.
+ */
+void btle_processDatabaseCacheIndication(Gap::Handle_t connectionHandle, GattAttribute::Handle_t handle);
+
+#endif /* _BTLE_DATABASE_CACHE_H_ */
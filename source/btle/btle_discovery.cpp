@@ -18,47 +18,82 @@
 #include "nRF5xCharacteristicDescriptorDiscoverer.h"
 #include "nRF5xGattClient.h"
 #include "nRF5xn.h"
+#include "btle_instrumentation.h"
+#include "btle_databaseCache.h"
 
 #if !defined(TARGET_MCU_NRF51_16K_S110) && !defined(TARGET_MCU_NRF51_32K_S110)
-void bleGattcEventHandler(const ble_evt_t *p_ble_evt)
+void bleGattcEventHandler(ble_evt_t *p_ble_evt)
 {
     nRF5xn                &ble         = nRF5xn::Instance(BLE::DEFAULT_INSTANCE);
     nRF5xGap              &gap         = (nRF5xGap &) ble.getGap();
     nRF5xGattClient       &gattClient  = (nRF5xGattClient &) ble.getGattClient();
-    nRF5xServiceDiscovery &sdSingleton = gattClient.discovery();
     nRF5xCharacteristicDescriptorDiscoverer &characteristicDescriptorDiscoverer =
         gattClient.characteristicDescriptorDiscoverer();
 
+    BTLE_INSTRUMENT_EVENT_BEGIN();
+
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_DISCONNECTED) {
+        /* Close all pending discoveries and operations for this connection */
+        characteristicDescriptorDiscoverer.terminate(p_ble_evt->evt.gap_evt.conn_handle, BLE_ERROR_INVALID_STATE);
+        gattClient.terminateServiceDiscovery(p_ble_evt->evt.gap_evt.conn_handle);
+        gattClient.operationQueue().abort(p_ble_evt->evt.gap_evt.conn_handle, BLE_ERROR_INVALID_STATE);
+        gattClient.subscriptions().removeConnection(p_ble_evt->evt.gap_evt.conn_handle);
+        return;
+    }
+
+    if (p_ble_evt->header.evt_id == BLE_EVT_TX_COMPLETE) {
+        /* Write commands waiting for TX buffers. */
+        gattClient.operationQueue().pump();
+        return;
+    }
+    if ((p_ble_evt->header.evt_id < BLE_GATTC_EVT_BASE) || (p_ble_evt->header.evt_id >= BLE_GATTS_EVT_BASE)) {
+        /* Only GATT client events carry a gattc_evt. */
+        return;
+    }
+
+    /* The service discovery running on this connection, if any */
+    nRF5xServiceDiscovery *sd = gattClient.discovery(p_ble_evt->evt.gattc_evt.conn_handle);
+
     switch (p_ble_evt->header.evt_id) {
         case BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP:
+            if (sd == NULL) {
+                break;
+            }
             switch (p_ble_evt->evt.gattc_evt.gatt_status) {
                 case BLE_GATT_STATUS_SUCCESS:
-                    sdSingleton.setupDiscoveredServices(&p_ble_evt->evt.gattc_evt.params.prim_srvc_disc_rsp);
+                    sd->setupDiscoveredServices(&p_ble_evt->evt.gattc_evt.params.prim_srvc_disc_rsp);
                     break;
 
                 case BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND:
+                    /* There are no more services. */
+                    sd->terminateServiceDiscovery(true);
+                    break;
+
                 default:
-                    sdSingleton.terminate();
+                    sd->terminate();
                     break;
             }
             break;
 
         case BLE_GATTC_EVT_CHAR_DISC_RSP:
+            if (sd == NULL) {
+                break;
+            }
             switch (p_ble_evt->evt.gattc_evt.gatt_status) {
                 case BLE_GATT_STATUS_SUCCESS:
-                    sdSingleton.setupDiscoveredCharacteristics(&p_ble_evt->evt.gattc_evt.params.char_disc_rsp);
+                    sd->setupDiscoveredCharacteristics(&p_ble_evt->evt.gattc_evt.params.char_disc_rsp);
                     break;
 
                 case BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND:
                 default:
-                    sdSingleton.terminateCharacteristicDiscovery(BLE_ERROR_NONE);
+                    sd->terminateCharacteristicDiscovery(BLE_ERROR_NONE);
                     break;
             }
             break;
 
         case BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP:
-            if (sdSingleton.isActive()) {
-                sdSingleton.processDiscoverUUIDResponse(&p_ble_evt->evt.gattc_evt.params.char_val_by_uuid_read_rsp);
+            if (sd != NULL) {
+                sd->processDiscoverUUIDResponse(&p_ble_evt->evt.gattc_evt.params.char_val_by_uuid_read_rsp);
             }
             break;
 
@@ -70,10 +105,28 @@ void bleGattcEventHandler(const ble_evt_t *p_ble_evt)
                     .len        = p_ble_evt->evt.gattc_evt.params.read_rsp.len,
                     .data       = p_ble_evt->evt.gattc_evt.params.read_rsp.data,
                 };
+                gattClient.operationQueue().processResponse(response.connHandle,
+                                                            nRF5xGattClientQueue::OP_READ,
+                                                            response.handle,
+                                                            p_ble_evt->evt.gattc_evt.gatt_status,
+                                                            response.data,
+                                                            response.len);
                 gattClient.processReadResponse(&response);
             }
             break;
 
+        case BLE_GATTC_EVT_CHAR_VALS_READ_RSP: {
+                /* The values are concatenated: the queue splits them according to the lengths of the request. */
+                bool success = (p_ble_evt->evt.gattc_evt.gatt_status == BLE_GATT_STATUS_SUCCESS);
+                gattClient.operationQueue().processResponse(p_ble_evt->evt.gattc_evt.conn_handle,
+                                                            nRF5xGattClientQueue::OP_READ_MULTIPLE,
+                                                            p_ble_evt->evt.gattc_evt.error_handle,
+                                                            p_ble_evt->evt.gattc_evt.gatt_status,
+                                                            success ? p_ble_evt->evt.gattc_evt.params.char_vals_read_rsp.values : NULL,
+                                                            success ? p_ble_evt->evt.gattc_evt.params.char_vals_read_rsp.len : 0);
+            }
+            break;
+
         case BLE_GATTC_EVT_WRITE_RSP: {
                 GattWriteCallbackParams response = {
                     .connHandle = p_ble_evt->evt.gattc_evt.conn_handle,
@@ -83,10 +136,21 @@ void bleGattcEventHandler(const ble_evt_t *p_ble_evt)
                     .len        = p_ble_evt->evt.gattc_evt.params.write_rsp.len,
                     .data       = p_ble_evt->evt.gattc_evt.params.write_rsp.data,
                 };
+                gattClient.operationQueue().processResponse(response.connHandle,
+                                                            nRF5xGattClientQueue::OP_WRITE_REQ,
+                                                            response.handle,
+                                                            p_ble_evt->evt.gattc_evt.gatt_status,
+                                                            NULL,
+                                                            0);
                 gattClient.processWriteResponse(&response);
             }
             break;
 
+        case BLE_GATTC_EVT_TIMEOUT:
+            /* No more ATT requests can be sent on this connection. */
+            gattClient.operationQueue().abort(p_ble_evt->evt.gattc_evt.conn_handle, BLE_ERROR_UNSPECIFIED);
+            break;
+
         case BLE_GATTC_EVT_HVX: {
                 GattHVXCallbackParams params;
                 params.connHandle = p_ble_evt->evt.gattc_evt.conn_handle;
@@ -95,7 +159,15 @@ void bleGattcEventHandler(const ble_evt_t *p_ble_evt)
                 params.len        = p_ble_evt->evt.gattc_evt.params.hvx.len;
                 params.data       = p_ble_evt->evt.gattc_evt.params.hvx.data;
 
-                gattClient.processHVXEvent(&params);
+                if (params.type == BLE_HVX_INDICATION) {
+                    /* The peer can't send anything else until the indication is confirmed: do it before the callbacks run. */
+                    BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_HV_CONFIRM, sd_ble_gattc_hv_confirm(params.connHandle, params.handle));
+                    btle_processDatabaseCacheIndication(params.connHandle, params.handle);
+                }
+
+                if (!gattClient.subscriptions().dispatch(&params)) {
+                    gattClient.processHVXEvent(&params);
+                }
             }
             break;
 
@@ -122,8 +194,15 @@ void bleGattcEventHandler(const ble_evt_t *p_ble_evt)
         }   break;
     }
 
-    sdSingleton.progressCharacteristicDiscovery();
-    sdSingleton.progressServiceDiscovery();
+    if (sd != NULL) {
+        sd->progressCharacteristicDiscovery();
+        sd->progressServiceDiscovery();
+    }
+
+    /* Issue the operations which were waiting for the procedure answered by this event. */
+    gattClient.operationQueue().pump();
+
+    BTLE_INSTRUMENT_GATTC_EVENT_END(p_ble_evt->header.evt_id);
 }
 #endif
 
@@ -17,6 +17,11 @@
 #ifndef _BTLE_DISCOVERY_H_
 #define _BTLE_DISCOVERY_H_
 
-void bleGattcEventHandler(const ble_evt_t *p_ble_evt);
+/**
+ * Handler of the GATT client events, and of the disconnections which end the
+ * procedures in progress. It is subscribed to the event dispatcher (see
+ * btle_registerEventHandler()) when the GATT client is instantiated.
+ */
+void bleGattcEventHandler(ble_evt_t *p_ble_evt);
 
 #endif /*_BTLE_DISCOVERY_H_*/
@@ -0,0 +1,187 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "btle_instrumentation.h"
+
+#if YOTTA_CFG_NRF5X_INSTRUMENTATION
+
+#ifdef YOTTA_CFG_MBED_OS
+    #include "mbed-drivers/mbed.h"
+#else
+    #include "mbed.h"
+#endif
+
+#include "nrf_ble.h"
+
+btle_instrumentation_t btle_instrumentation;
+
+static const uint8_t SNAPSHOT_FORMAT_VERSION = 1;
+
+/* First evt_id of each range of event counters. */
+static const uint8_t eventRangeBases[BTLE_INSTRUMENTATION_EVENT_RANGES] = {
+    0, BLE_GAP_EVT_BASE, BLE_GATTC_EVT_BASE, BLE_GATTS_EVT_BASE, BLE_GATTS_EVT_LAST + 1
+};
+
+uint32_t btle_instrumentationTimestamp(void)
+{
+    return us_ticker_read();
+}
+
+static void recordElapsedTime(btle_eventCounters_t &counters, uint32_t elapsedUs)
+{
+    counters.count++;
+
+    unsigned bucket = 0;
+    while ((elapsedUs >= 4) && (bucket < (BTLE_INSTRUMENTATION_HISTOGRAM_BUCKETS - 1))) {
+        elapsedUs >>= 2;
+        bucket++;
+    }
+    if (counters.histogram[bucket] != 0xFFFF) {
+        counters.histogram[bucket]++;
+    }
+}
+
+void btle_recordEvent(uint16_t evt_id, uint32_t elapsedUs)
+{
+    unsigned range = BTLE_INSTRUMENTATION_EVENT_RANGES - 1;
+    while ((range > 0) && (evt_id < eventRangeBases[range])) {
+        range--;
+    }
+
+    unsigned index = evt_id - eventRangeBases[range];
+    if (index >= BTLE_INSTRUMENTATION_EVENTS_PER_RANGE) {
+        index = BTLE_INSTRUMENTATION_EVENTS_PER_RANGE - 1;
+    }
+    recordElapsedTime(btle_instrumentation.events[(range * BTLE_INSTRUMENTATION_EVENTS_PER_RANGE) + index], elapsedUs);
+}
+
+void btle_recordGattcEvent(uint16_t evt_id, uint32_t elapsedUs)
+{
+    if (evt_id < BLE_GATTC_EVT_BASE) {
+        return; /* Disconnections are handled there too; they aren't GATT client events. */
+    }
+
+    unsigned index = evt_id - BLE_GATTC_EVT_BASE;
+    if (index >= BTLE_INSTRUMENTATION_EVENTS_PER_RANGE) {
+        index = BTLE_INSTRUMENTATION_EVENTS_PER_RANGE - 1;
+    }
+    recordElapsedTime(btle_instrumentation.gattcEvents[index], elapsedUs);
+}
+
+const btle_instrumentation_t *btle_getInstrumentation(void)
+{
+    return &btle_instrumentation;
+}
+
+void btle_resetInstrumentation(void)
+{
+    memset(&btle_instrumentation, 0, sizeof(btle_instrumentation));
+}
+
+static uint8_t *putLittleEndian(uint8_t *p, uint32_t value, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; i++) {
+        *p++ = (uint8_t)(value >> (8 * i));
+    }
+    return p;
+}
+
+static const size_t SNAPSHOT_HEADER_SIZE       = 3;
+static const size_t SNAPSHOT_EVENT_RECORD_SIZE = 1 + 1 + 4 + (2 * BTLE_INSTRUMENTATION_HISTOGRAM_BUCKETS);
+static const size_t SNAPSHOT_SVC_RECORD_SIZE   = 1 + 4 + 4 + 2;
+
+static uint8_t *snapshotEvents(uint8_t *p, const uint8_t *end, const btle_eventCounters_t *counters, unsigned slots,
+                               bool gattClient, uint8_t *records)
+{
+    for (unsigned i = 0; i < slots; i++) {
+        if (counters[i].count == 0) {
+            continue;
+        }
+        if ((p + SNAPSHOT_EVENT_RECORD_SIZE) > end) {
+            break;
+        }
+
+        uint8_t evt_id = gattClient ? (BLE_GATTC_EVT_BASE + i) :
+                                      (eventRangeBases[i / BTLE_INSTRUMENTATION_EVENTS_PER_RANGE] + (i % BTLE_INSTRUMENTATION_EVENTS_PER_RANGE));
+        p = putLittleEndian(p, evt_id, 1);
+        p = putLittleEndian(p, gattClient ? 1 : 0, 1);
+        p = putLittleEndian(p, counters[i].count, 4);
+        for (unsigned bucket = 0; bucket < BTLE_INSTRUMENTATION_HISTOGRAM_BUCKETS; bucket++) {
+            p = putLittleEndian(p, counters[i].histogram[bucket], 2);
+        }
+        (*records)++;
+    }
+    return p;
+}
+
+size_t btle_snapshotInstrumentation(uint8_t *buffer, size_t size)
+{
+    if ((buffer == NULL) || (size < SNAPSHOT_HEADER_SIZE)) {
+        return 0;
+    }
+
+    const uint8_t *end          = buffer + size;
+    uint8_t        eventRecords = 0;
+    uint8_t        svcRecords   = 0;
+    uint8_t       *p            = buffer + SNAPSHOT_HEADER_SIZE;
+
+    p = snapshotEvents(p, end, btle_instrumentation.events,
+                       BTLE_INSTRUMENTATION_EVENT_RANGES * BTLE_INSTRUMENTATION_EVENTS_PER_RANGE, false, &eventRecords);
+    p = snapshotEvents(p, end, btle_instrumentation.gattcEvents,
+                       BTLE_INSTRUMENTATION_EVENTS_PER_RANGE, true, &eventRecords);
+
+    for (unsigned site = 0; site < BTLE_SVC_COUNT; site++) {
+        const btle_svcCounters_t &counters = btle_instrumentation.svcs[site];
+        if (counters.calls == 0) {
+            continue;
+        }
+        if ((p + SNAPSHOT_SVC_RECORD_SIZE) > end) {
+            break;
+        }
+
+        p = putLittleEndian(p, site, 1);
+        p = putLittleEndian(p, counters.calls, 4);
+        p = putLittleEndian(p, counters.failures, 4);
+        p = putLittleEndian(p, counters.lastError, 2);
+        svcRecords++;
+    }
+
+    buffer[0] = SNAPSHOT_FORMAT_VERSION;
+    buffer[1] = eventRecords;
+    buffer[2] = svcRecords;
+    return p - buffer;
+}
+
+#else /* #if YOTTA_CFG_NRF5X_INSTRUMENTATION */
+
+const btle_instrumentation_t *btle_getInstrumentation(void)
+{
+    return NULL;
+}
+
+void btle_resetInstrumentation(void)
+{
+    /* empty */
+}
+
+size_t btle_snapshotInstrumentation(uint8_t *buffer, size_t size)
+{
+    return 0;
+}
+
+#endif /* #if YOTTA_CFG_NRF5X_INSTRUMENTATION */
@@ -0,0 +1,143 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _BTLE_INSTRUMENTATION_H_
+#define _BTLE_INSTRUMENTATION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Set to 1 to count the SoftDevice events and SVC calls of the port and
+ * measure the time spent handling each event type. When left to 0, the
+ * instrumentation macros expand to nothing (or to the bare SVC call) and no
+ * RAM is reserved.
+ */
+#ifndef YOTTA_CFG_NRF5X_INSTRUMENTATION
+    #define YOTTA_CFG_NRF5X_INSTRUMENTATION 0
+#endif
+
+/**
+ * SoftDevice calls whose outcome is counted.
+ */
+typedef enum {
+    BTLE_SVC_GATTS_HVX,
+    BTLE_SVC_GATTS_VALUE_SET,
+    BTLE_SVC_GATTS_VALUE_GET,
+    BTLE_SVC_GATTS_RW_AUTHORIZE_REPLY,
+    BTLE_SVC_GATTC_PRIMARY_SERVICES_DISCOVER,
+    BTLE_SVC_GATTC_CHARACTERISTICS_DISCOVER,
+    BTLE_SVC_GATTC_DESCRIPTORS_DISCOVER,
+    BTLE_SVC_GATTC_CHAR_VALUE_BY_UUID_READ,
+    BTLE_SVC_GATTC_READ,
+    BTLE_SVC_GATTC_CHAR_VALUES_READ,
+    BTLE_SVC_GATTC_WRITE,
+    BTLE_SVC_GATTC_HV_CONFIRM,
+    BTLE_SVC_GAP_ADV_START,
+    BTLE_SVC_GAP_ADV_STOP,
+    BTLE_SVC_GAP_SCAN_START,
+    BTLE_SVC_GAP_SCAN_STOP,
+    BTLE_SVC_GAP_CONNECT,
+    BTLE_SVC_GAP_DISCONNECT,
+    BTLE_SVC_GAP_CONN_PARAM_UPDATE,
+    BTLE_SVC_COUNT
+} btle_svcSite_t;
+
+/*
+ * Event types are counted in slots of 16 per evt_id range (common, GAP,
+ * GATTC, GATTS, others); ids beyond the 16th of a range share its last slot.
+ * Handling times go to histogram buckets of increasing powers of 4 us:
+ * [0, 4), [4, 16), ... [4096, 16384), [16384, inf).
+ */
+#define BTLE_INSTRUMENTATION_EVENT_RANGES      5
+#define BTLE_INSTRUMENTATION_EVENTS_PER_RANGE  16
+#define BTLE_INSTRUMENTATION_HISTOGRAM_BUCKETS 8
+
+typedef struct {
+    uint32_t count;
+    uint16_t histogram[BTLE_INSTRUMENTATION_HISTOGRAM_BUCKETS]; /**< Saturating. */
+} btle_eventCounters_t;
+
+typedef struct {
+    uint32_t calls;
+    uint32_t failures;
+    uint32_t lastError; /**< Last value other than NRF_SUCCESS. */
+} btle_svcCounters_t;
+
+typedef struct {
+    btle_eventCounters_t events[BTLE_INSTRUMENTATION_EVENT_RANGES * BTLE_INSTRUMENTATION_EVENTS_PER_RANGE]; /**< Time in btle_handler(). */
+    btle_eventCounters_t gattcEvents[BTLE_INSTRUMENTATION_EVENTS_PER_RANGE];                               /**< Share of it in bleGattcEventHandler(). */
+    btle_svcCounters_t   svcs[BTLE_SVC_COUNT];
+} btle_instrumentation_t;
+
+/**
+ * @return the counters, or NULL if the instrumentation is compiled out.
+ */
+const btle_instrumentation_t *btle_getInstrumentation(void);
+
+void btle_resetInstrumentation(void);
+
+/**
+ * Serialize the non-zero counters, e.g. to send them over a UART or through
+ * a diagnostics characteristic. All fields are little endian:
+ *   - header: format version (1 byte, 1), number of event records (1 byte),
+ *     number of SVC records (1 byte);
+ *   - event records: evt_id (1 byte), source (1 byte; 0 for btle_handler(),
+ *     1 for bleGattcEventHandler()), count (4 bytes), histogram (8 x 2 bytes);
+ *   - SVC records: btle_svcSite_t (1 byte), calls (4 bytes), failures
+ *     (4 bytes), last error (2 bytes).
+ * Records which don't fit in the buffer are left out.
+ *
+ * @return the number of bytes written; 0 if the instrumentation is compiled out.
+ */
+size_t btle_snapshotInstrumentation(uint8_t *buffer, size_t size);
+
+#if YOTTA_CFG_NRF5X_INSTRUMENTATION
+
+extern btle_instrumentation_t btle_instrumentation;
+
+uint32_t btle_instrumentationTimestamp(void);
+void     btle_recordEvent(uint16_t evt_id, uint32_t elapsedUs);
+void     btle_recordGattcEvent(uint16_t evt_id, uint32_t elapsedUs);
+
+static inline uint32_t btle_recordSvc(btle_svcSite_t site, uint32_t rc)
+{
+    btle_svcCounters_t &counters = btle_instrumentation.svcs[site];
+    counters.calls++;
+    if (rc != 0) {
+        counters.failures++;
+        counters.lastError = rc;
+    }
+    return rc;
+}
+
+/* Evaluates to the result of the call. */
+#define BTLE_INSTRUMENT_SVC(site, call)           btle_recordSvc((site), (call))
+
+#define BTLE_INSTRUMENT_EVENT_BEGIN()             uint32_t btleInstrumentationStart = btle_instrumentationTimestamp()
+#define BTLE_INSTRUMENT_EVENT_END(evt_id)         btle_recordEvent((evt_id), btle_instrumentationTimestamp() - btleInstrumentationStart)
+#define BTLE_INSTRUMENT_GATTC_EVENT_END(evt_id)   btle_recordGattcEvent((evt_id), btle_instrumentationTimestamp() - btleInstrumentationStart)
+
+#else /* #if YOTTA_CFG_NRF5X_INSTRUMENTATION */
+
+#define BTLE_INSTRUMENT_SVC(site, call)           (call)
+#define BTLE_INSTRUMENT_EVENT_BEGIN()
+#define BTLE_INSTRUMENT_EVENT_END(evt_id)
+#define BTLE_INSTRUMENT_GATTC_EVENT_END(evt_id)
+
+#endif /* #if YOTTA_CFG_NRF5X_INSTRUMENTATION */
+
+#endif /* _BTLE_INSTRUMENTATION_H_ */
@@ -25,11 +25,54 @@ extern "C" {
 }
 
 #include "btle_security.h"
+#include "btle_databaseCache.h"
 
 static dm_application_instance_t applicationInstance;
 static bool                      initialized = false;
 static ret_code_t dm_handler(dm_handle_t const *p_handle, dm_event_t const *p_event, ret_code_t event_result);
 
+/*
+ * Persistent store for the GATT server system attributes (CCCDs) of bonded
+ * peers; the device manager is registered for the GATT client context only,
+ * so the server side is kept here, in a pstorage block per bond.
+ */
+#ifndef YOTTA_CFG_NRF5X_SYS_ATTR_MAX_SIZE
+    #define YOTTA_CFG_NRF5X_SYS_ATTR_MAX_SIZE 96
+#endif
+
+typedef struct {
+    uint16_t length;    /**< Length of data; 0 or 0xFFFF (erased flash) if nothing is stored. */
+    uint8_t  peerAddressType;
+    uint8_t  peerAddress[BLE_GAP_ADDR_LEN];  /**< Identity of the bond the attributes belong to. */
+    uint8_t  reserved[3];
+    uint8_t  data[(YOTTA_CFG_NRF5X_SYS_ATTR_MAX_SIZE + 3) & ~3]; /**< pstorage operates on whole words. */
+} sysAttrBlock_t;
+
+/*
+ * Attributes of a bonded peer which is connected, or whose attributes are
+ * waiting to be written to flash.
+ */
+typedef struct {
+    Gap::Handle_t  connectionHandle; /**< BLE_CONN_HANDLE_INVALID once disconnected. */
+    uint8_t        deviceId;         /**< DM_INVALID_ID if the slot is free. */
+    bool           dirty;            /**< block differs from flash. */
+    ble_gap_addr_t address;          /**< Address of the peer, as stored with the bond. */
+    sysAttrBlock_t block;
+} sysAttrSlot_t;
+
+static pstorage_handle_t sysAttrStorage;
+static bool              sysAttrStorageRegistered = false;
+static sysAttrSlot_t     sysAttrSlots[YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS];
+static sysAttrBlock_t    sysAttrFlushBuffer;     /**< pstorage reads from it until the update completes. */
+static sysAttrSlot_t    *sysAttrFlushSlot = NULL; /**< Slot whose update is in progress, if any. */
+
+/* Connections whose system attributes have been set, or whose CCCDs have been written by the peer. */
+static Gap::Handle_t     sysAttrLiveConnections[YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS];
+
+static void sysAttrInit(void);
+static bool sysAttrBind(Gap::Handle_t connectionHandle, const dm_handle_t *dmHandle);
+static void sysAttrForget(uint8_t deviceId);
+
 // default security parameters
 static ble_gap_sec_params_t securityParameters = {
     .bond          = true,         /**< Perform bonding. */
@@ -114,6 +157,9 @@ btle_initializeSecurity(bool                                      enableBonding,
         }
     }
 
+    sysAttrInit();
+    btle_initializeDatabaseCache();
+
     initialized = true;
     return BLE_ERROR_NONE;
 }
@@ -121,6 +167,15 @@ btle_initializeSecurity(bool                                      enableBonding,
 ble_error_t
 btle_purgeAllBondingState(void)
 {
+    if (sysAttrStorageRegistered) {
+        for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+            sysAttrSlots[i].deviceId = DM_INVALID_ID;
+            sysAttrSlots[i].dirty    = false;
+        }
+        pstorage_clear(&sysAttrStorage, sizeof(sysAttrBlock_t) * DEVICE_MANAGER_MAX_BONDS);
+    }
+    btle_purgeDatabaseCache();
+
     ret_code_t rc;
     if ((rc = dm_device_delete_all(&applicationInstance)) == NRF_SUCCESS) {
         return BLE_ERROR_NONE;
@@ -212,6 +267,7 @@ dm_handler(dm_handle_t const *p_handle, dm_event_t const *p_event, ret_code_t ev
 {
     nRF5xn               &ble             = nRF5xn::Instance(BLE::DEFAULT_INSTANCE);
     nRF5xSecurityManager &securityManager = (nRF5xSecurityManager &) ble.getSecurityManager();
+    nRF5xGattServer      &gattServer      = (nRF5xGattServer &) ble.getGattServer();
 
     switch (p_event->event_id) {
         case DM_EVT_SECURITY_SETUP: /* started */ {
@@ -223,6 +279,10 @@ dm_handler(dm_handle_t const *p_handle, dm_event_t const *p_event, ret_code_t ev
             break;
         }
         case DM_EVT_SECURITY_SETUP_COMPLETE:
+            if ((p_event->event_param.p_gap_param->params.auth_status.auth_status == BLE_GAP_SEC_STATUS_SUCCESS) &&
+                sysAttrBind(p_event->event_param.p_gap_param->conn_handle, p_handle)) {
+                gattServer.reloadCachedCCCDs(p_event->event_param.p_gap_param->conn_handle);
+            }
             securityManager.
                 processSecuritySetupCompletedEvent(p_event->event_param.p_gap_param->conn_handle,
                                                    (SecurityManager::SecurityCompletionStatus_t)(p_event->event_param.p_gap_param->params.auth_status.auth_status));
@@ -257,12 +317,21 @@ dm_handler(dm_handle_t const *p_handle, dm_event_t const *p_event, ret_code_t ev
                     break;
             }
 
+            /* Bonded peers using private addresses are only identified once the link is secured. */
+            if (sysAttrBind(p_event->event_param.p_gap_param->conn_handle, p_handle)) {
+                gattServer.reloadCachedCCCDs(p_event->event_param.p_gap_param->conn_handle);
+            }
+
             securityManager.processLinkSecuredEvent(p_event->event_param.p_gap_param->conn_handle, resolvedSecurityMode);
             break;
         }
         case DM_EVT_DEVICE_CONTEXT_STORED:
             securityManager.processSecurityContextStoredEvent(p_event->event_param.p_gap_param->conn_handle);
             break;
+        case DM_EVT_DEVICE_CONTEXT_DELETED:
+            /* The device_id may be given to another peer. */
+            sysAttrForget(p_handle->device_id);
+            break;
         default:
             break;
     }
@@ -314,3 +383,366 @@ btle_generateResolvableAddress(const ble_gap_irk_t &irk, ble_gap_addr_t &address
     /* Calculate the hash and store it in the top half of the address */
     ah(irk.irk, &address.addr[BLE_GAP_ADDR_LEN - 3], address.addr);
 }
+
+static void
+sysAttrFlush(void)
+{
+    if (sysAttrFlushSlot != NULL) {
+        return; /* Resumed from sysAttrStorageCallback(). */
+    }
+
+    for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+        sysAttrSlot_t *slot = &sysAttrSlots[i];
+        if (!slot->dirty) {
+            continue;
+        }
+
+        pstorage_handle_t block;
+        if (pstorage_block_identifier_get(&sysAttrStorage, slot->deviceId, &block) != NRF_SUCCESS) {
+            slot->dirty = false;
+            continue;
+        }
+
+        /* Let the slot take newer attributes while flash is being written. */
+        sysAttrFlushBuffer = slot->block;
+        if (pstorage_update(&block, reinterpret_cast<uint8_t *>(&sysAttrFlushBuffer), sizeof(sysAttrFlushBuffer), 0) != NRF_SUCCESS) {
+            return; /* Retried on the next disconnection. */
+        }
+        slot->dirty      = false;
+        sysAttrFlushSlot = slot;
+        return;
+    }
+}
+
+static void
+sysAttrStorageCallback(pstorage_handle_t *handle, uint8_t opCode, uint32_t result, uint8_t *data, uint32_t dataLen)
+{
+    if ((opCode != PSTORAGE_UPDATE_OP_CODE) || (sysAttrFlushSlot == NULL)) {
+        return;
+    }
+
+    /* Keep a slot until its attributes are in flash; restoring from it meanwhile gives the latest values. */
+    sysAttrSlot_t *slot = sysAttrFlushSlot;
+    sysAttrFlushSlot = NULL;
+    if (result != NRF_SUCCESS) {
+        /* The block holds what failed to be written, or newer attributes. Retried on the next flush. */
+        slot->dirty = true;
+        return;
+    }
+    if ((slot->connectionHandle == BLE_CONN_HANDLE_INVALID) && !slot->dirty) {
+        slot->deviceId = DM_INVALID_ID;
+    }
+
+    sysAttrFlush();
+}
+
+static void
+sysAttrInit(void)
+{
+    for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+        sysAttrSlots[i].connectionHandle = BLE_CONN_HANDLE_INVALID;
+        sysAttrSlots[i].deviceId         = DM_INVALID_ID;
+        sysAttrSlots[i].dirty            = false;
+        sysAttrLiveConnections[i]        = BLE_CONN_HANDLE_INVALID;
+    }
+
+    pstorage_module_param_t param = {
+        .cb          = sysAttrStorageCallback,
+        .block_size  = sizeof(sysAttrBlock_t),
+        .block_count = DEVICE_MANAGER_MAX_BONDS
+    };
+    /* Without storage, peers simply have to subscribe again on every connection. */
+    sysAttrStorageRegistered = (pstorage_register(&param, &sysAttrStorage) == NRF_SUCCESS);
+}
+
+static sysAttrSlot_t *
+sysAttrFindSlot(Gap::Handle_t connectionHandle)
+{
+    for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+        if ((sysAttrSlots[i].deviceId != DM_INVALID_ID) && (sysAttrSlots[i].connectionHandle == connectionHandle)) {
+            return &sysAttrSlots[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool
+sysAttrIsLive(Gap::Handle_t connectionHandle)
+{
+    for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+        if (sysAttrLiveConnections[i] == connectionHandle) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+sysAttrSetLive(Gap::Handle_t connectionHandle, bool live)
+{
+    Gap::Handle_t match = live ? BLE_CONN_HANDLE_INVALID : connectionHandle;
+    if (live && sysAttrIsLive(connectionHandle)) {
+        return;
+    }
+
+    for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+        if (sysAttrLiveConnections[i] == match) {
+            sysAttrLiveConnections[i] = live ? connectionHandle : BLE_CONN_HANDLE_INVALID;
+            return;
+        }
+    }
+}
+
+static bool
+sysAttrBelongsTo(const sysAttrBlock_t *block, const ble_gap_addr_t &address)
+{
+    return (block->peerAddressType == address.addr_type) &&
+           (memcmp(block->peerAddress, address.addr, BLE_GAP_ADDR_LEN) == 0);
+}
+
+/* Attributes in flash for a bond, whichever peer they belong to, or NULL if there aren't any. */
+static const sysAttrBlock_t *
+sysAttrStored(uint8_t deviceId)
+{
+    pstorage_handle_t block;
+    if (pstorage_block_identifier_get(&sysAttrStorage, deviceId, &block) != NRF_SUCCESS) {
+        return NULL;
+    }
+
+    /* Flash is memory mapped. */
+    const sysAttrBlock_t *stored = reinterpret_cast<const sysAttrBlock_t *>(block.block_id);
+    if ((stored->length == 0) || (stored->length > sizeof(stored->data))) {
+        return NULL;
+    }
+
+    return stored;
+}
+
+/* Latest attributes saved for a bonded peer, or NULL if there aren't any. */
+static const sysAttrBlock_t *
+sysAttrLookup(uint8_t deviceId, const ble_gap_addr_t &address)
+{
+    for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+        if ((sysAttrSlots[i].deviceId == deviceId) && sysAttrSlots[i].dirty) {
+            return sysAttrBelongsTo(&sysAttrSlots[i].block, address) ? &sysAttrSlots[i].block : NULL;
+        }
+    }
+
+    const sysAttrBlock_t *stored = sysAttrStored(deviceId);
+    if ((stored == NULL) || !sysAttrBelongsTo(stored, address)) {
+        return NULL;
+    }
+
+    return stored;
+}
+
+/*
+ * Drop the attributes saved under a device_id, in RAM and in flash, when its
+ * bond is deleted or given to another peer.
+ */
+static void
+sysAttrForget(uint8_t deviceId)
+{
+    if (!sysAttrStorageRegistered || (deviceId == DM_INVALID_ID) || (deviceId >= DEVICE_MANAGER_MAX_BONDS)) {
+        return;
+    }
+
+    for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+        sysAttrSlot_t *slot = &sysAttrSlots[i];
+        if (slot->deviceId != deviceId) {
+            continue;
+        }
+        slot->dirty = false;
+        if ((slot->connectionHandle == BLE_CONN_HANDLE_INVALID) && (slot != sysAttrFlushSlot)) {
+            slot->deviceId = DM_INVALID_ID;
+        }
+    }
+
+    /* Queued after any update of the block in progress, so it takes precedence. */
+    pstorage_handle_t block;
+    if ((sysAttrStored(deviceId) != NULL) &&
+        (pstorage_block_identifier_get(&sysAttrStorage, deviceId, &block) == NRF_SUCCESS)) {
+        pstorage_clear(&block, sizeof(sysAttrBlock_t));
+    }
+}
+
+/*
+ * Associate a connection with a bonded peer and apply the attributes saved
+ * for it, if any. The attributes aren't applied to a connection which already
+ * has some, as that would overwrite the CCCDs written by the peer since it
+ * connected. Returns true if system attributes were applied.
+ */
+static bool
+sysAttrBind(Gap::Handle_t connectionHandle, const dm_handle_t *dmHandle)
+{
+    uint8_t deviceId = dmHandle->device_id;
+    if (!sysAttrStorageRegistered || (deviceId == DM_INVALID_ID) || (deviceId >= DEVICE_MANAGER_MAX_BONDS)) {
+        return false;
+    }
+
+    ble_gap_addr_t address;
+    if (dm_peer_addr_get(dmHandle, &address) != NRF_SUCCESS) {
+        return false;
+    }
+
+    sysAttrSlot_t *slot = sysAttrFindSlot(connectionHandle);
+    if (slot != NULL) {
+        if ((slot->deviceId == deviceId) &&
+            (slot->address.addr_type == address.addr_type) &&
+            (memcmp(slot->address.addr, address.addr, BLE_GAP_ADDR_LEN) == 0)) {
+            return false; /* Already bound and applied. */
+        }
+
+        /* The peer has been bonded anew; leave the previous bond's attributes alone. */
+        slot->connectionHandle = BLE_CONN_HANDLE_INVALID;
+        if (!slot->dirty && (slot != sysAttrFlushSlot)) {
+            slot->deviceId = DM_INVALID_ID;
+        }
+        slot = NULL;
+    }
+
+    /* A device_id reused by a new bond must not hand over the attributes of the previous peer. */
+    const sysAttrBlock_t *stored = sysAttrStored(deviceId);
+    bool                  stale  = (stored != NULL) && !sysAttrBelongsTo(stored, address);
+    for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+        if ((sysAttrSlots[i].deviceId == deviceId) && sysAttrSlots[i].dirty && !sysAttrBelongsTo(&sysAttrSlots[i].block, address)) {
+            stale = true;
+        }
+    }
+    if (stale) {
+        sysAttrForget(deviceId);
+    }
+
+    if (slot == NULL) {
+        /* Prefer the slot still holding the attributes of this peer. */
+        for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+            if ((sysAttrSlots[i].deviceId == deviceId) && (sysAttrSlots[i].connectionHandle == BLE_CONN_HANDLE_INVALID)) {
+                slot = &sysAttrSlots[i];
+                break;
+            }
+        }
+    }
+    if (slot == NULL) {
+        for (unsigned i = 0; i < YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS; i++) {
+            if (sysAttrSlots[i].deviceId == DM_INVALID_ID) {
+                slot = &sysAttrSlots[i];
+                slot->dirty = false;
+                break;
+            }
+        }
+    }
+
+    if (slot != NULL) {
+        slot->connectionHandle = connectionHandle;
+        slot->deviceId         = deviceId;
+        slot->address          = address;
+    }
+
+    if (sysAttrIsLive(connectionHandle)) {
+        return false;
+    }
+
+    stored = sysAttrLookup(deviceId, address);
+    bool applied = (stored != NULL) &&
+                   (sd_ble_gatts_sys_attr_set(connectionHandle, stored->data, stored->length, 0) == NRF_SUCCESS);
+    if (applied) {
+        sysAttrSetLive(connectionHandle, true);
+    }
+
+    return applied;
+}
+
+bool
+btle_getBondedPeer(Gap::Handle_t connectionHandle, uint8_t *deviceId, ble_gap_addr_t *address)
+{
+    if (!initialized) {
+        return false;
+    }
+
+    dm_handle_t dmHandle = {
+        .appl_id = applicationInstance,
+    };
+    if ((dm_handle_get(connectionHandle, &dmHandle) != NRF_SUCCESS) ||
+        (dmHandle.device_id == DM_INVALID_ID) || (dmHandle.device_id >= DEVICE_MANAGER_MAX_BONDS)) {
+        return false;
+    }
+    if (dm_peer_addr_get(&dmHandle, address) != NRF_SUCCESS) {
+        return false;
+    }
+
+    *deviceId = dmHandle.device_id;
+    return true;
+}
+
+void
+btle_restoreSystemAttributes(Gap::Handle_t connectionHandle)
+{
+    /* The SoftDevice asks for attributes it doesn't have: whatever was set before is gone. */
+    sysAttrSetLive(connectionHandle, false);
+
+    if (sysAttrStorageRegistered && (sysAttrFindSlot(connectionHandle) == NULL)) {
+        /* Peers with identity addresses are recognized by the device manager as soon as they connect. */
+        dm_handle_t dmHandle = {
+            .appl_id = applicationInstance,
+        };
+        if ((dm_handle_get(connectionHandle, &dmHandle) == NRF_SUCCESS) && sysAttrBind(connectionHandle, &dmHandle)) {
+            return;
+        }
+    }
+
+    sysAttrSlot_t *slot = sysAttrFindSlot(connectionHandle);
+    if (slot != NULL) {
+        const sysAttrBlock_t *stored = sysAttrLookup(slot->deviceId, slot->address);
+        if ((stored != NULL) && (sd_ble_gatts_sys_attr_set(connectionHandle, stored->data, stored->length, 0) == NRF_SUCCESS)) {
+            sysAttrSetLive(connectionHandle, true);
+            return;
+        }
+    }
+
+    /* Unknown peer, or the saved attributes don't match the current GATT table. */
+    sd_ble_gatts_sys_attr_set(connectionHandle, NULL, 0, 0);
+    sysAttrSetLive(connectionHandle, true);
+}
+
+void
+btle_noteSystemAttributesWritten(Gap::Handle_t connectionHandle)
+{
+    sysAttrSetLive(connectionHandle, true);
+}
+
+void
+btle_storeSystemAttributes(Gap::Handle_t connectionHandle)
+{
+    sysAttrSetLive(connectionHandle, false);
+
+    sysAttrSlot_t *slot = sysAttrFindSlot(connectionHandle);
+    if (slot == NULL) {
+        return;
+    }
+    slot->connectionHandle = BLE_CONN_HANDLE_INVALID;
+
+    sysAttrBlock_t current;
+    uint16_t       length = sizeof(current.data);
+    if (sd_ble_gatts_sys_attr_get(connectionHandle, current.data, &length, 0) == NRF_SUCCESS) {
+        current.length          = length;
+        current.peerAddressType = slot->address.addr_type;
+        memcpy(current.peerAddress, slot->address.addr, BLE_GAP_ADDR_LEN);
+        memset(current.reserved, 0xFF, sizeof(current.reserved));
+
+        /* Only write flash if something has changed. */
+        const sysAttrBlock_t *stored = sysAttrLookup(slot->deviceId, slot->address);
+        if ((stored == NULL) || (stored->length != length) || (memcmp(stored->data, current.data, length) != 0)) {
+            slot->block = current;
+            slot->dirty = true;
+        }
+    }
+
+    if (!slot->dirty && (slot != sysAttrFlushSlot)) {
+        slot->deviceId = DM_INVALID_ID;
+        return;
+    }
+
+    sysAttrFlush();
+}
@@ -125,4 +125,50 @@ bool btle_matchAddressAndIrk(ble_gap_addr_t const * p_addr, ble_gap_irk_t const
  */
 void btle_generateResolvableAddress(const ble_gap_irk_t &irk, ble_gap_addr_t &address);
 
+/**
+ * Identify the bonded peer of a connection.
+ *
+ * @param[in]   connectionHandle
+ *                  Handle to identify the connection.
+ * @param[out]  deviceId
+ *                  Device manager index of the bond.
+ * @param[out]  address
+ *                  Address of the peer, as stored with the bond.
+ *
+ * @return true if the peer of the connection is bonded.
+ */
+bool btle_getBondedPeer(Gap::Handle_t connectionHandle, uint8_t *deviceId, ble_gap_addr_t *address);
+
+/**
+ * Apply the GATT server system attributes (i.e. the CCCD values) of a
+ * connection in response to BLE_GATTS_EVT_SYS_ATTR_MISSING. The attributes
+ * saved for a bonded peer are restored; other connections start from
+ * cleared system attributes.
+ *
+ * @param[in]   connectionHandle
+ *                  Handle to identify the connection.
+ */
+void btle_restoreSystemAttributes(Gap::Handle_t connectionHandle);
+
+/**
+ * Note that the peer of a connection has written a CCCD, so that the
+ * attributes saved for its bond don't overwrite it once the link is secured.
+ *
+ * @param[in]   connectionHandle
+ *                  Handle to identify the connection.
+ */
+void btle_noteSystemAttributesWritten(Gap::Handle_t connectionHandle);
+
+/**
+ * Save the GATT server system attributes of a bonded peer to persistent
+ * storage. Meant to be called upon disconnection, while the SoftDevice still
+ * holds the attributes of the connection. Flash is only written if the
+ * attributes have changed since they were last saved; updates waiting to be
+ * written are coalesced per peer.
+ *
+ * @param[in]   connectionHandle
+ *                  Handle to identify the connection.
+ */
+void btle_storeSystemAttributes(Gap::Handle_t connectionHandle);
+
 #endif /* _BTLE_SECURITY_H_ */
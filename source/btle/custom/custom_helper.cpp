@@ -29,8 +29,27 @@ typedef struct {
 static const unsigned UUID_TABLE_MAX_ENTRIES = 4; /* This is the maximum number of 128-bit UUIDs with distinct bases that
                                                    * we expect to be in use; increase this limit if needed. */
 static unsigned uuidTableEntries = 0; /* current usage of the table */
+static unsigned uuidTableLastHit = 0; /* characteristics of a service usually share its base; try the last match first */
 converted_uuid_table_entry_t convertedUUIDTable[UUID_TABLE_MAX_ENTRIES];
 
+static bool
+matchConvertedUUIDTableEntry(unsigned index, const UUID::LongUUIDBytes_t uuid)
+{
+    for (unsigned byteIndex = 0; byteIndex < UUID::LENGTH_OF_LONG_UUID; byteIndex++) {
+        /* Skip bytes 2 and 3, because they contain the shortUUID (16-bit) version of the
+         * long UUID; and we're comparing against the remainder. */
+        if ((byteIndex == 2) || (byteIndex == 3)) {
+            continue;
+        }
+
+        if (convertedUUIDTable[index].uuid[byteIndex] != uuid[byteIndex]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /**
  * lookup the cache of previously converted 128-bit UUIDs to find a type value.
  * @param  uuid          base 128-bit UUID
@@ -40,23 +59,16 @@ converted_uuid_table_entry_t convertedUUIDTable[UUID_TABLE_MAX_ENTRIES];
 static bool
 lookupConvertedUUIDTable(const UUID::LongUUIDBytes_t uuid, uint8_t *recoveredType)
 {
+    if ((uuidTableLastHit < uuidTableEntries) && matchConvertedUUIDTableEntry(uuidTableLastHit, uuid)) {
+        *recoveredType = convertedUUIDTable[uuidTableLastHit].type;
+        return true;
+    }
+
     unsigned i;
     for (i = 0; i < uuidTableEntries; i++) {
-        unsigned byteIndex;
-        for (byteIndex = 0; byteIndex < UUID::LENGTH_OF_LONG_UUID; byteIndex++) {
-            /* Skip bytes 2 and 3, because they contain the shortUUID (16-bit) version of the
-             * long UUID; and we're comparing against the remainder. */
-            if ((byteIndex == 2) || (byteIndex == 3)) {
-                continue;
-            }
-
-            if (convertedUUIDTable[i].uuid[byteIndex] != uuid[byteIndex]) {
-                break;
-            }
-        }
-
-        if (byteIndex == UUID::LENGTH_OF_LONG_UUID) {
-            *recoveredType = convertedUUIDTable[i].type;
+        if (matchConvertedUUIDTableEntry(i, uuid)) {
+            uuidTableLastHit = i;
+            *recoveredType   = convertedUUIDTable[i].type;
             return true;
         }
     }
@@ -67,6 +79,9 @@ lookupConvertedUUIDTable(const UUID::LongUUIDBytes_t uuid, uint8_t *recoveredTyp
 static void
 addToConvertedUUIDTable(const UUID::LongUUIDBytes_t uuid, uint8_t type)
 {
+    if (type == BLE_UUID_TYPE_UNKNOWN) {
+        return; /* the base couldn't be added; don't cache the failure. */
+    }
     if (uuidTableEntries == UUID_TABLE_MAX_ENTRIES) {
         return; /* recovery needed; or at least the user should be warned about this fact.*/
     }
@@ -75,6 +90,7 @@ addToConvertedUUIDTable(const UUID::LongUUIDBytes_t uuid, uint8_t type)
     convertedUUIDTable[uuidTableEntries].uuid[2] = 0;
     convertedUUIDTable[uuidTableEntries].uuid[3] = 0;
     convertedUUIDTable[uuidTableEntries].type    = type;
+    uuidTableLastHit = uuidTableEntries;
     uuidTableEntries++;
 }
 
@@ -191,6 +207,11 @@ error_t custom_decode_uuid_base(uint8_t const *const p_uuid_base,
     @param[in]  max_length        The maximum length of this characeristic
     @param[in]  has_variable_len  Whether the characteristic data has
                                   variable length.
+    @param[in]  vloc              BLE_GATTS_VLOC_STACK to have the value
+                                  copied to the SoftDevice attribute table,
+                                  BLE_GATTS_VLOC_USER to have the SoftDevice
+                                  use p_data in place; p_data must then
+                                  stay valid and hold max_length bytes.
     @param[out] p_char_handle
 
     @returns
@@ -209,6 +230,7 @@ error_t custom_add_in_characteristic(uint16_t                  service_handle,
                                      uint16_t                  userDescriptionDescriptorValueLen,
                                      bool                      readAuthorization,
                                      bool                      writeAuthorization,
+                                     uint8_t                   vloc,
                                      ble_gatts_char_handles_t *p_char_handle)
 {
     /* Characteristic metadata */
@@ -242,7 +264,7 @@ error_t custom_add_in_characteristic(uint16_t                  service_handle,
     attr_md.rd_auth = readAuthorization;
     attr_md.wr_auth = writeAuthorization;
 
-    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vloc = vloc;
     /* Always set variable size */
     attr_md.vlen = has_variable_len;
 
@@ -321,6 +343,8 @@ error_t custom_add_in_characteristic(uint16_t                  service_handle,
     @param[in]  max_length        The maximum length of this descriptor
     @param[in]  has_variable_len  Whether the characteristic data has
                                   variable length.
+    @param[in]  vloc              BLE_GATTS_VLOC_STACK or BLE_GATTS_VLOC_USER,
+                                  as for custom_add_in_characteristic.
 
     @returns
     @retval     ERROR_NONE        Everything executed normally
@@ -332,12 +356,13 @@ error_t custom_add_in_descriptor(uint16_t    char_handle,
                                  uint16_t    length,
                                  uint16_t    max_length,
                                  bool        has_variable_len,
+                                 uint8_t     vloc,
                                  uint16_t   *p_desc_handle)
 {
     /* Descriptor metadata */
     ble_gatts_attr_md_t   desc_md = {0};
 
-    desc_md.vloc = BLE_GATTS_VLOC_STACK;
+    desc_md.vloc = vloc;
     /* Always set variable size */
     desc_md.vlen = has_variable_len;
 
@@ -43,6 +43,7 @@ error_t custom_add_in_characteristic(uint16_t                  service_handle,
                                      uint16_t                  userDescriptionDescriptorValueLen,
                                      bool                      readAuthorization,
                                      bool                      writeAuthorization,
+                                     uint8_t                   vloc,
                                      ble_gatts_char_handles_t *p_char_handle);
 
 error_t custom_add_in_descriptor(uint16_t                      char_handle,
@@ -51,6 +52,7 @@ error_t custom_add_in_descriptor(uint16_t                      char_handle,
                                      uint16_t                  length,
                                      uint16_t                  max_length,
                                      bool                      has_variable_len,
+                                     uint8_t                   vloc,
                                      uint16_t                 *p_desc_handle);
 
 #ifdef __cplusplus
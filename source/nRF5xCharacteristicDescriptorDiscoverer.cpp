@@ -16,6 +16,7 @@
 #include "nRF5xCharacteristicDescriptorDiscoverer.h"
 #include "ble_err.h"
 #include "ble/DiscoveredCharacteristicDescriptor.h"
+#include "btle/btle_instrumentation.h"
 
 nRF5xCharacteristicDescriptorDiscoverer::nRF5xCharacteristicDescriptorDiscoverer() :
     discoveryRunning() {
@@ -176,7 +177,7 @@ ble_error_t nRF5xCharacteristicDescriptorDiscoverer::gattc_descriptors_discover(
         start_handle,
         end_handle
     };
-    uint32_t err = sd_ble_gattc_descriptors_discover(connection_handle, &discoveryRange);
+    uint32_t err = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_DESCRIPTORS_DISCOVER, sd_ble_gattc_descriptors_discover(connection_handle, &discoveryRange));
 
     switch(err) {
         case NRF_SUCCESS:
@@ -61,3 +61,15 @@ nRF5xDiscoveredCharacteristic::setup(nRF5xGattClient         *gattcIn,
     props._indicate        = propsIn.indicate;
     props._authSignedWrite = propsIn.auth_signed_wr;
 }
+
+void
+nRF5xDiscoveredCharacteristic::setup(nRF5xGattClient         *gattcIn,
+                                     Gap::Handle_t            connectionHandleIn,
+                                     const UUID              &uuidIn,
+                                     ble_gatt_char_props_t    propsIn,
+                                     GattAttribute::Handle_t  declHandleIn,
+                                     GattAttribute::Handle_t  valueHandleIn)
+{
+    setup(gattcIn, connectionHandleIn, propsIn, declHandleIn, valueHandleIn);
+    uuid = uuidIn;
+}
@@ -37,6 +37,13 @@ public:
                GattAttribute::Handle_t  declHandleIn,
                GattAttribute::Handle_t  valueHandleIn);
 
+    void setup(nRF5xGattClient         *gattcIn,
+               Gap::Handle_t            connectionHandleIn,
+               const UUID              &uuidIn,
+               ble_gatt_char_props_t    propsIn,
+               GattAttribute::Handle_t  declHandleIn,
+               GattAttribute::Handle_t  valueHandleIn);
+
     void setLastHandle(GattAttribute::Handle_t last) {
       lastHandle = last;
     }
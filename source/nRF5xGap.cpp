@@ -25,6 +25,7 @@
 #include "common/common.h"
 #include "ble_advdata.h"
 #include "ble_hci.h"
+#include "btle/btle_instrumentation.h"
 
 void radioNotificationStaticCallback(bool param) {
     nRF5xGap &gap = (nRF5xGap &) nRF5xn::Instance(BLE::DEFAULT_INSTANCE).getGap();
@@ -196,7 +197,7 @@ ble_error_t nRF5xGap::startAdvertising(const GapAdvertisingParams &params)
     adv_para.interval    = params.getIntervalInADVUnits(); // advertising interval (in units of 0.625 ms)
     adv_para.timeout     = params.getTimeout();
 
-    ASSERT(ERROR_NONE == sd_ble_gap_adv_start(&adv_para), BLE_ERROR_PARAM_OUT_OF_RANGE);
+    ASSERT(ERROR_NONE == BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_ADV_START, sd_ble_gap_adv_start(&adv_para)), BLE_ERROR_PARAM_OUT_OF_RANGE);
 
     return BLE_ERROR_NONE;
 }
@@ -232,7 +233,7 @@ ble_error_t nRF5xGap::startRadioScan(const GapScanningParams &scanningParams)
         .timeout     = scanningParams.getTimeout(),   /**< Scan timeout between 0x0001 and 0xFFFF in seconds, 0x0000 disables timeout. */
     };
 
-    if (sd_ble_gap_scan_start(&scanParams) != NRF_SUCCESS) {
+    if (BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_SCAN_START, sd_ble_gap_scan_start(&scanParams)) != NRF_SUCCESS) {
         return BLE_ERROR_PARAM_OUT_OF_RANGE;
     }
 
@@ -240,7 +241,7 @@ ble_error_t nRF5xGap::startRadioScan(const GapScanningParams &scanningParams)
 }
 
 ble_error_t nRF5xGap::stopScan(void) {
-    if (sd_ble_gap_scan_stop() == NRF_SUCCESS) {
+    if (BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_SCAN_STOP, sd_ble_gap_scan_stop()) == NRF_SUCCESS) {
         return BLE_ERROR_NONE;
     }
 
@@ -267,7 +268,7 @@ ble_error_t nRF5xGap::stopScan(void) {
 ble_error_t nRF5xGap::stopAdvertising(void)
 {
     /* Stop Advertising */
-    ASSERT(ERROR_NONE == sd_ble_gap_adv_stop(), BLE_ERROR_PARAM_OUT_OF_RANGE);
+    ASSERT(ERROR_NONE == BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_ADV_STOP, sd_ble_gap_adv_stop()), BLE_ERROR_PARAM_OUT_OF_RANGE);
 
     state.advertising = 0;
 
@@ -329,7 +330,7 @@ ble_error_t nRF5xGap::connect(const Address_t             peerAddr,
         scanParams.timeout     = _scanningParams.getTimeout();        /**< Scan timeout between 0x0001 and 0xFFFF in seconds, 0x0000 disables timeout. */
     }
 
-    uint32_t rc = sd_ble_gap_connect(&addr, &scanParams, &connParams);
+    uint32_t rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_CONNECT, sd_ble_gap_connect(&addr, &scanParams, &connParams));
     if (rc == NRF_SUCCESS) {
         return BLE_ERROR_NONE;
     }
@@ -367,7 +368,7 @@ ble_error_t nRF5xGap::disconnect(Handle_t connectionHandle, DisconnectionReason_
     }
 
     /* Disconnect if we are connected to a central device */
-    ASSERT_INT(ERROR_NONE, sd_ble_gap_disconnect(connectionHandle, code), BLE_ERROR_PARAM_OUT_OF_RANGE);
+    ASSERT_INT(ERROR_NONE, BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_DISCONNECT, sd_ble_gap_disconnect(connectionHandle, code)), BLE_ERROR_PARAM_OUT_OF_RANGE);
 
     return BLE_ERROR_NONE;
 }
@@ -407,7 +408,8 @@ ble_error_t nRF5xGap::updateConnectionParams(Handle_t handle, const ConnectionPa
 {
     uint32_t rc;
 
-    rc = sd_ble_gap_conn_param_update(handle, reinterpret_cast<ble_gap_conn_params_t *>(const_cast<ConnectionParams_t*>(newParams)));
+    rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_CONN_PARAM_UPDATE,
+                             sd_ble_gap_conn_param_update(handle, reinterpret_cast<ble_gap_conn_params_t *>(const_cast<ConnectionParams_t*>(newParams))));
     if (rc == NRF_SUCCESS) {
         return BLE_ERROR_NONE;
     } else {
@@ -434,6 +436,7 @@ ble_error_t nRF5xGap::reset(void)
 
     /* Clear derived class members */
     m_connectionHandle = BLE_CONN_HANDLE_INVALID;
+    connectionCount    = 0;
 
     /* Set the whitelist policy filter modes to IGNORE_WHITELIST */
     advertisingPolicyMode = Gap::ADV_POLICY_IGNORE_WHITELIST;
@@ -465,6 +468,28 @@ uint16_t nRF5xGap::getConnectionHandle(void)
     return m_connectionHandle;
 }
 
+void nRF5xGap::addConnection(Handle_t connectionHandle)
+{
+    for (unsigned i = 0; i < connectionCount; i++) {
+        if (connectionHandles[i] == connectionHandle) {
+            return;
+        }
+    }
+    if (connectionCount < MAX_CONNECTIONS) {
+        connectionHandles[connectionCount++] = connectionHandle;
+    }
+}
+
+void nRF5xGap::removeConnection(Handle_t connectionHandle)
+{
+    for (unsigned i = 0; i < connectionCount; i++) {
+        if (connectionHandles[i] == connectionHandle) {
+            connectionHandles[i] = connectionHandles[--connectionCount];
+            return;
+        }
+    }
+}
+
 /**************************************************************************/
 /*!
     @brief      Sets the BLE device address
@@ -34,6 +34,14 @@
     #undef YOTTA_CFG_IRK_TABLE_MAX_SIZE
     #define YOTTA_CFG_IRK_TABLE_MAX_SIZE BLE_GAP_WHITELIST_IRK_MAX_COUNT
 #endif
+/* Number of simultaneous connections the GAP keeps track of; at least the number of links enabled in the SoftDevice. */
+#ifndef YOTTA_CFG_NRF5X_GAP_MAX_CONNECTIONS
+    #if defined(TARGET_MCU_NRF51_16K_S110) || defined(TARGET_MCU_NRF51_32K_S110)
+        #define YOTTA_CFG_NRF5X_GAP_MAX_CONNECTIONS 1
+    #else
+        #define YOTTA_CFG_NRF5X_GAP_MAX_CONNECTIONS 4
+    #endif
+#endif
 #include "ble/blecommon.h"
 #include "nrf_ble.h"
 #include "ble/GapAdvertisingParams.h"
@@ -86,6 +94,24 @@ public:
     void     setConnectionHandle(uint16_t con_handle);
     uint16_t getConnectionHandle(void);
 
+    /**
+     * Track the connections which are open, for the modules which have to
+     * reach all of them; called from the GAP event handler.
+     */
+    void     addConnection(Handle_t connectionHandle);
+    void     removeConnection(Handle_t connectionHandle);
+
+    unsigned getConnectionCount(void) const {
+        return connectionCount;
+    }
+
+    /**
+     * @return the handle of an open connection, for index below getConnectionCount().
+     */
+    Handle_t getConnectionHandleAt(unsigned index) const {
+        return connectionHandles[index];
+    }
+
     virtual ble_error_t getPreferredConnectionParams(ConnectionParams_t *params);
     virtual ble_error_t setPreferredConnectionParams(const ConnectionParams_t *params);
     virtual ble_error_t updateConnectionParams(Handle_t handle, const ConnectionParams_t *params);
@@ -227,6 +253,11 @@ private:
 private:
     uint16_t m_connectionHandle;
 
+    static const unsigned MAX_CONNECTIONS = YOTTA_CFG_NRF5X_GAP_MAX_CONNECTIONS;
+
+    Handle_t connectionHandles[MAX_CONNECTIONS];
+    uint8_t  connectionCount;
+
     /*
      * Allow instantiation from nRF5xn when required.
      */
@@ -235,7 +266,9 @@ private:
     nRF5xGap() :
         advertisingPolicyMode(Gap::ADV_POLICY_IGNORE_WHITELIST),
         scanningPolicyMode(Gap::SCAN_POLICY_IGNORE_WHITELIST),
-        whitelistAddressesSize(0) {
+        whitelistAddressesSize(0),
+        connectionHandles(),
+        connectionCount(0) {
         m_connectionHandle = BLE_CONN_HANDLE_INVALID;
     }
 
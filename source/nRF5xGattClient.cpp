@@ -24,7 +24,17 @@ nRF5xGattClient::launchServiceDiscovery(Gap::Handle_t
                                         const UUID                                 &matchingServiceUUIDIn,
                                         const UUID                                 &matchingCharacteristicUUIDIn)
 {
-    return _discovery.launch(connectionHandle, sc, cc, matchingServiceUUIDIn, matchingCharacteristicUUIDIn);
+    if (isServiceDiscoveryActive(connectionHandle)) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+
+    for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+        if (!_discoveries[i].isActive()) {
+            return _discoveries[i].launch(connectionHandle, sc, cc, matchingServiceUUIDIn, matchingCharacteristicUUIDIn);
+        }
+    }
+
+    return BLE_ERROR_INVALID_STATE;
 }
 
 ble_error_t nRF5xGattClient::discoverCharacteristicDescriptors(
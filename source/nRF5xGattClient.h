@@ -20,6 +20,17 @@
 #include "ble/GattClient.h"
 #include "nRF5xServiceDiscovery.h"
 #include "nRF5xCharacteristicDescriptorDiscoverer.h"
+#include "nRF5xGattClientQueue.h"
+#include "nRF5xGattClientSubscriptions.h"
+#include "btle/btle_instrumentation.h"
+
+/*
+ * Number of connections on which service discovery can run at the same time;
+ * each of them takes a discovery context of a few hundred bytes.
+ */
+#ifndef YOTTA_CFG_NRF5X_GATTC_CONCURRENT_DISCOVERIES
+    #define YOTTA_CFG_NRF5X_GATTC_CONCURRENT_DISCOVERIES 3
+#endif
 
 class nRF5xGattClient : public GattClient
 {
@@ -76,8 +87,21 @@ public:
      *           UUID will result in complete service discovery--callbacks being
      *           called for every service and characteristic.
      *
+     * @Note     Discoveries on different connections proceed in parallel, up
+     *           to YOTTA_CFG_NRF5X_GATTC_CONCURRENT_DISCOVERIES of them.
+     *
+     * @Note     A complete discovery of a bonded peer (no UUID filters and a
+     *           characteristic callback) is cached in flash. While the cache
+     *           is valid, later discoveries of that peer are served from it:
+     *           all the callbacks, including the termination callback, are
+     *           invoked before this function returns. A Service Changed
+     *           indication from the peer invalidates the cache.
+     *
      * @return
-     *           BLE_ERROR_NONE if service discovery is launched successfully; else an appropriate error.
+     *           BLE_ERROR_NONE if service discovery is launched successfully;
+     *           BLE_ERROR_INVALID_STATE if a discovery is already active on
+     *           the connection or all the discovery contexts are in use; else
+     *           an appropriate error.
      */
     virtual ble_error_t launchServiceDiscovery(Gap::Handle_t                               connectionHandle,
                                                ServiceDiscovery::ServiceCallback_t         sc = NULL,
@@ -86,22 +110,52 @@ public:
                                                const UUID                                 &matchingCharacteristicUUIDIn = UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN));
 
     virtual void onServiceDiscoveryTermination(ServiceDiscovery::TerminationCallback_t callback) {
-        _discovery.onTermination(callback);
+        for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+            _discoveries[i].onTermination(callback);
+        }
     }
 
     /**
-     * Is service-discovery currently active?
+     * Is service-discovery currently active, on any connection?
      */
     virtual bool isServiceDiscoveryActive(void) const {
-        return _discovery.isActive();
+        for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+            if (_discoveries[i].isActive()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Is service-discovery currently active on a given connection?
+     */
+    bool isServiceDiscoveryActive(Gap::Handle_t connectionHandle) const {
+        for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+            if (_discoveries[i].isActive(connectionHandle)) {
+                return true;
+            }
+        }
+        return false;
     }
 
     /**
-     * Terminate an ongoing service-discovery. This should result in an
-     * invocation of the TerminationCallback if service-discovery is active.
+     * Terminate all ongoing service-discoveries. This should result in an
+     * invocation of the TerminationCallback for each of them.
      */
     virtual void terminateServiceDiscovery(void) {
-        _discovery.terminate();
+        for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+            _discoveries[i].terminate();
+        }
+    }
+
+    /**
+     * Terminate the service-discovery ongoing on a given connection, if any.
+     */
+    void terminateServiceDiscovery(Gap::Handle_t connectionHandle) {
+        for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+            _discoveries[i].terminate(connectionHandle);
+        }
     }
 
     /**
@@ -126,23 +180,25 @@ public:
      */
     virtual void terminateCharacteristicDescriptorsDiscovery(const DiscoveredCharacteristic& characteristic);
 
+    /**
+     * Read an attribute. The read goes through the operation queue: if the
+     * connection has a request in flight, it is issued once that request
+     * has been answered.
+     */
     virtual ble_error_t read(Gap::Handle_t connHandle, GattAttribute::Handle_t attributeHandle, uint16_t offset) const {
-        uint32_t rc = sd_ble_gattc_read(connHandle, attributeHandle, offset);
-        if (rc == NRF_SUCCESS) {
-            return BLE_ERROR_NONE;
-        }
-        switch (rc) {
-            case NRF_ERROR_BUSY:
-                return BLE_STACK_BUSY;
-            case BLE_ERROR_INVALID_CONN_HANDLE:
-            case NRF_ERROR_INVALID_STATE:
-            case NRF_ERROR_INVALID_ADDR:
-            default:
-                return BLE_ERROR_INVALID_STATE;
-        }
+        return _queue.read(connHandle, attributeHandle, offset, nRF5xGattClientQueue::Callback_t());
     }
 
+    /**
+     * Write an attribute. Values of up to nRF5xGattClientQueue::MAX_WRITE_SIZE
+     * bytes go through the operation queue, which copies them; write commands
+     * are queued until the SoftDevice has TX buffers for them.
+     */
     virtual ble_error_t write(GattClient::WriteOp_t cmd, Gap::Handle_t connHandle, GattAttribute::Handle_t attributeHandle, size_t length, const uint8_t *value) const {
+        if (length <= nRF5xGattClientQueue::MAX_WRITE_SIZE) {
+            return _queue.write(toQueueOperation(cmd), connHandle, attributeHandle, value, length, nRF5xGattClientQueue::Callback_t());
+        }
+
         ble_gattc_write_params_t writeParams;
         writeParams.write_op = cmd;
         writeParams.flags    = 0; /* this is inconsequential */
@@ -151,7 +207,7 @@ public:
         writeParams.len      = length;
         writeParams.p_value  = const_cast<uint8_t *>(value);
 
-        uint32_t rc = sd_ble_gattc_write(connHandle, &writeParams);
+        uint32_t rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_WRITE, sd_ble_gattc_write(connHandle, &writeParams));
         if (rc == NRF_SUCCESS) {
             return BLE_ERROR_NONE;
         }
@@ -168,6 +224,92 @@ public:
         }
     }
 
+    /**
+     * Queue a read, with a callback invoked upon its completion in addition
+     * to the onDataRead() callbacks.
+     *
+     * @see nRF5xGattClientQueue::read
+     */
+    ble_error_t queueRead(Gap::Handle_t                               connHandle,
+                          GattAttribute::Handle_t                     attributeHandle,
+                          uint16_t                                    offset,
+                          const nRF5xGattClientQueue::Callback_t     &callback) {
+        return _queue.read(connHandle, attributeHandle, offset, callback);
+    }
+
+    /**
+     * Queue a long read, which reads the whole value of an attribute into
+     * buffer and invokes the callback once, with the number of responses it
+     * took. onDataRead() callbacks are still invoked for each response.
+     *
+     * @see nRF5xGattClientQueue::readLong
+     */
+    ble_error_t readLong(Gap::Handle_t                               connHandle,
+                         GattAttribute::Handle_t                     attributeHandle,
+                         uint8_t                                    *buffer,
+                         uint16_t                                    size,
+                         const nRF5xGattClientQueue::Callback_t     &callback) {
+        return _queue.readLong(connHandle, attributeHandle, buffer, size, callback);
+    }
+
+    /**
+     * Read several attributes of known length in a single round trip. The
+     * callback is invoked for each attribute; onDataRead() callbacks aren't
+     * invoked for these reads.
+     *
+     * @see nRF5xGattClientQueue::readMultiple
+     */
+    ble_error_t readMultiple(Gap::Handle_t                               connHandle,
+                             const GattAttribute::Handle_t              *handles,
+                             const uint8_t                              *lengths,
+                             uint8_t                                     handleCount,
+                             const nRF5xGattClientQueue::Callback_t     &callback) {
+        return _queue.readMultiple(connHandle, handles, lengths, handleCount, callback);
+    }
+
+    /**
+     * Queue a write, with a callback invoked upon its completion in addition
+     * to the onDataWritten() callbacks.
+     *
+     * @see nRF5xGattClientQueue::write
+     */
+    ble_error_t queueWrite(GattClient::WriteOp_t                       cmd,
+                           Gap::Handle_t                               connHandle,
+                           GattAttribute::Handle_t                     attributeHandle,
+                           size_t                                      length,
+                           const uint8_t                              *value,
+                           const nRF5xGattClientQueue::Callback_t     &callback) {
+        if (length > nRF5xGattClientQueue::MAX_WRITE_SIZE) {
+            return BLE_ERROR_INVALID_PARAM;
+        }
+        return _queue.write(toQueueOperation(cmd), connHandle, attributeHandle, value, length, callback);
+    }
+
+    /**
+     * Route the notifications and indications of a characteristic straight to
+     * a callback; the onHVX() callbacks no longer see them. Subscriptions are
+     * dropped when their connection is closed.
+     *
+     * @see nRF5xGattClientSubscriptions::subscribe
+     */
+    ble_error_t subscribeHVX(Gap::Handle_t                                connHandle,
+                             GattAttribute::Handle_t                      valueHandle,
+                             const nRF5xGattClientSubscriptions::Callback_t &callback) {
+        return _subscriptions.subscribe(connHandle, valueHandle, callback);
+    }
+
+    ble_error_t unsubscribeHVX(Gap::Handle_t connHandle, GattAttribute::Handle_t valueHandle) {
+        return _subscriptions.unsubscribe(connHandle, valueHandle);
+    }
+
+    const nRF5xGattClientQueue::Statistics_t &getOperationQueueStatistics(void) const {
+        return _queue.getStatistics();
+    }
+
+    void resetOperationQueueStatistics(void) {
+        _queue.resetStatistics();
+    }
+
     /**
      * @brief  Clear nRF5xGattClient's state.
      *
@@ -181,7 +323,11 @@ public:
         }
 
         /* Clear derived class members */
-        _discovery.reset();
+        for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+            _discoveries[i].reset();
+        }
+        _queue.reset();
+        _subscriptions.reset();
 
         return BLE_ERROR_NONE;
     }
@@ -192,26 +338,56 @@ public:
      */
     friend class nRF5xn;
 
-    nRF5xGattClient() : _discovery(this) {
-        /* empty */
+    nRF5xGattClient() : _discoveries() {
+        for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+            _discoveries[i].setGattClient(this);
+        }
     }
 
-    nRF5xServiceDiscovery& discovery() {
-        return _discovery;
+    /**
+     * @return the discovery context active on a connection, or NULL.
+     */
+    nRF5xServiceDiscovery* discovery(Gap::Handle_t connectionHandle) {
+        for (unsigned i = 0; i < MAX_CONCURRENT_DISCOVERIES; i++) {
+            if (_discoveries[i].isActive(connectionHandle)) {
+                return &_discoveries[i];
+            }
+        }
+        return NULL;
     }
 
     nRF5xCharacteristicDescriptorDiscoverer& characteristicDescriptorDiscoverer() {
         return _characteristicDescriptorDiscoverer;
     }
 
+    nRF5xGattClientQueue& operationQueue() {
+        return _queue;
+    }
+
+    nRF5xGattClientSubscriptions& subscriptions() {
+        return _subscriptions;
+    }
+
+private:
+    static nRF5xGattClientQueue::Operation_t toQueueOperation(GattClient::WriteOp_t cmd) {
+        return (cmd == GattClient::GATT_OP_WRITE_CMD) ? nRF5xGattClientQueue::OP_WRITE_CMD : nRF5xGattClientQueue::OP_WRITE_REQ;
+    }
+
 private:
     nRF5xGattClient(const nRF5xGattClient &);
     const nRF5xGattClient& operator=(const nRF5xGattClient &);
 
 private:
-    nRF5xServiceDiscovery _discovery;
+    static const unsigned MAX_CONCURRENT_DISCOVERIES = YOTTA_CFG_NRF5X_GATTC_CONCURRENT_DISCOVERIES;
+
+    nRF5xServiceDiscovery _discoveries[MAX_CONCURRENT_DISCOVERIES];
     nRF5xCharacteristicDescriptorDiscoverer _characteristicDescriptorDiscoverer;
 
+    /* read() and write() are const in the GattClient API. */
+    mutable nRF5xGattClientQueue _queue;
+
+    nRF5xGattClientSubscriptions _subscriptions;
+
 #endif // if !S110
 };
 
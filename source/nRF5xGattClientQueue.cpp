@@ -0,0 +1,415 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nRF5xGattClientQueue.h"
+#ifdef YOTTA_CFG_MBED_OS
+    #include "mbed-drivers/mbed.h"
+#else
+    #include "mbed.h"
+#endif
+
+#include "ble_err.h"
+#include "btle/btle_instrumentation.h"
+
+#if !defined(TARGET_MCU_NRF51_16K_S110) && !defined(TARGET_MCU_NRF51_32K_S110)
+
+/* The SoftDevice will take the operation later: a request is in flight or the TX buffers are full. */
+static bool isDeferrable(uint32_t rc)
+{
+    return (rc == NRF_ERROR_BUSY) || (rc == BLE_ERROR_NO_TX_BUFFERS);
+}
+
+nRF5xGattClientQueue::nRF5xGattClientQueue() :
+    entries(),
+    head(0),
+    count(0),
+    statistics() {
+    /* empty */
+}
+
+ble_error_t nRF5xGattClientQueue::read(Gap::Handle_t           connectionHandle,
+                                       GattAttribute::Handle_t attributeHandle,
+                                       uint16_t                offset,
+                                       const Callback_t       &callback)
+{
+    Entry *entry = append(connectionHandle, attributeHandle, OP_READ, callback);
+    if (entry == NULL) {
+        return BLE_STACK_BUSY;
+    }
+    entry->offset = offset;
+    entry->len    = 0;
+
+    return issueFirst(count - 1);
+}
+
+ble_error_t nRF5xGattClientQueue::readLong(Gap::Handle_t           connectionHandle,
+                                           GattAttribute::Handle_t attributeHandle,
+                                           uint8_t                *buffer,
+                                           uint16_t                size,
+                                           const Callback_t       &callback)
+{
+    if ((buffer == NULL) || (size == 0)) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    Entry *entry = append(connectionHandle, attributeHandle, OP_READ_LONG, callback);
+    if (entry == NULL) {
+        return BLE_STACK_BUSY;
+    }
+    entry->offset     = 0;
+    entry->len        = 0;
+    entry->buffer     = buffer;
+    entry->bufferSize = size;
+
+    return issueFirst(count - 1);
+}
+
+ble_error_t nRF5xGattClientQueue::readMultiple(Gap::Handle_t                  connectionHandle,
+                                               const GattAttribute::Handle_t *handles,
+                                               const uint8_t                 *lengths,
+                                               uint8_t                        handleCount,
+                                               const Callback_t              &callback)
+{
+    if ((handleCount < 2) || (handleCount > MAX_READ_MULTIPLE_COUNT)) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    unsigned total = 0;
+    for (unsigned i = 0; i < handleCount; i++) {
+        if (lengths[i] == 0) {
+            return BLE_ERROR_INVALID_PARAM;
+        }
+        total += lengths[i];
+    }
+    if (total > MAX_READ_PDU_SIZE) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    Entry *entry = append(connectionHandle, handles[0], OP_READ_MULTIPLE, callback);
+    if (entry == NULL) {
+        return BLE_STACK_BUSY;
+    }
+    entry->offset = 0;
+    entry->len    = handleCount;
+    memcpy(entry->multiple.handles, handles, handleCount * sizeof(GattAttribute::Handle_t));
+    memcpy(entry->multiple.lengths, lengths, handleCount);
+
+    return issueFirst(count - 1);
+}
+
+ble_error_t nRF5xGattClientQueue::write(Operation_t              op,
+                                        Gap::Handle_t            connectionHandle,
+                                        GattAttribute::Handle_t  attributeHandle,
+                                        const uint8_t           *value,
+                                        uint16_t                 len,
+                                        const Callback_t        &callback)
+{
+    if (len > MAX_WRITE_SIZE) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    Entry *entry = append(connectionHandle, attributeHandle, op, callback);
+    if (entry == NULL) {
+        return BLE_STACK_BUSY;
+    }
+    entry->offset = 0;
+    entry->len    = len;
+    memcpy(entry->data, value, len);
+
+    return issueFirst(count - 1);
+}
+
+void nRF5xGattClientQueue::pump(void)
+{
+    unsigned i = 0;
+    while (i < count) {
+        Entry &entry = entryAt(i);
+        if (entry.issued || !isFirstOfConnection(i)) {
+            i++;
+            continue;
+        }
+
+        uint8_t  op = entry.op;
+        uint32_t rc = issue(i);
+        if (rc == NRF_SUCCESS) {
+            /* A command is already complete: the next operation of its connection takes its place. */
+            if (op != OP_WRITE_CMD) {
+                i++;
+            }
+        } else if (isDeferrable(rc)) {
+            i++;
+        } else {
+            complete(i, BLE_ERROR_INVALID_STATE, 0, NULL, 0);
+        }
+    }
+}
+
+void nRF5xGattClientQueue::processResponse(Gap::Handle_t            connectionHandle,
+                                           Operation_t              op,
+                                           GattAttribute::Handle_t  attributeHandle,
+                                           uint16_t                 gattStatus,
+                                           const uint8_t           *data,
+                                           uint16_t                 len)
+{
+    for (unsigned i = 0; i < count; i++) {
+        Entry &entry = entryAt(i);
+        if (entry.connectionHandle != connectionHandle) {
+            continue;
+        }
+
+        /* Only the first operation of a connection can be in flight. */
+        if (!entry.issued || ((op != OP_READ_MULTIPLE) && (entry.attributeHandle != attributeHandle))) {
+            return;
+        }
+        if ((op == OP_READ) && (entry.op == OP_READ_LONG)) {
+            processLongReadResponse(i, gattStatus, data, len);
+        } else if (entry.op == op) {
+            entry.pdus++;
+            complete(i, BLE_ERROR_NONE, gattStatus, data, len);
+        }
+        return;
+    }
+}
+
+void nRF5xGattClientQueue::abort(Gap::Handle_t connectionHandle, ble_error_t error)
+{
+    unsigned i = 0;
+    while (i < count) {
+        if (entryAt(i).connectionHandle == connectionHandle) {
+            complete(i, error, 0, NULL, 0);
+        } else {
+            i++;
+        }
+    }
+}
+
+void nRF5xGattClientQueue::reset(void)
+{
+    for (unsigned i = 0; i < QUEUE_SIZE; i++) {
+        entries[i].callback = Callback_t();
+    }
+    head  = 0;
+    count = 0;
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+nRF5xGattClientQueue::Entry *nRF5xGattClientQueue::append(Gap::Handle_t           connectionHandle,
+                                                          GattAttribute::Handle_t attributeHandle,
+                                                          uint8_t                 op,
+                                                          const Callback_t       &callback)
+{
+    if (count == QUEUE_SIZE) {
+        return NULL;
+    }
+
+    Entry *entry = &entryAt(count);
+    count++;
+
+    entry->queuedAt         = us_ticker_read();
+    entry->issuedAt         = 0;
+    entry->callback         = callback;
+    entry->connectionHandle = connectionHandle;
+    entry->attributeHandle  = attributeHandle;
+    entry->op               = op;
+    entry->issued           = false;
+    entry->pdus             = 0;
+    entry->buffer           = NULL;
+    entry->bufferSize       = 0;
+
+    statistics.depth = count;
+    if (count > statistics.maxDepth) {
+        statistics.maxDepth = count;
+    }
+
+    return entry;
+}
+
+bool nRF5xGattClientQueue::isFirstOfConnection(unsigned position)
+{
+    for (unsigned i = 0; i < position; i++) {
+        if (entryAt(i).connectionHandle == entryAt(position).connectionHandle) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t nRF5xGattClientQueue::issue(unsigned position)
+{
+    Entry   &entry = entryAt(position);
+    uint32_t rc;
+
+    if ((entry.op == OP_READ) || (entry.op == OP_READ_LONG)) {
+        rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_READ, sd_ble_gattc_read(entry.connectionHandle, entry.attributeHandle, entry.offset));
+    } else if (entry.op == OP_READ_MULTIPLE) {
+        rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_CHAR_VALUES_READ,
+                                 sd_ble_gattc_char_values_read(entry.connectionHandle, entry.multiple.handles, entry.len));
+    } else {
+        ble_gattc_write_params_t writeParams;
+        writeParams.write_op = (entry.op == OP_WRITE_CMD) ? BLE_GATT_OP_WRITE_CMD : BLE_GATT_OP_WRITE_REQ;
+        writeParams.flags    = 0; /* this is inconsequential */
+        writeParams.handle   = entry.attributeHandle;
+        writeParams.offset   = 0;
+        writeParams.len      = entry.len;
+        writeParams.p_value  = entry.data;
+
+        rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_WRITE, sd_ble_gattc_write(entry.connectionHandle, &writeParams));
+    }
+
+    if (rc == NRF_SUCCESS) {
+        if (entry.pdus == 0) {
+            entry.issuedAt = us_ticker_read();
+        }
+        entry.issued = true;
+        if (entry.op == OP_WRITE_CMD) {
+            /* The SoftDevice has copied the command to a TX buffer; there is no response. */
+            complete(position, BLE_ERROR_NONE, BLE_GATT_STATUS_SUCCESS, NULL, 0);
+        }
+    } else if (isDeferrable(rc)) {
+        statistics.deferred++;
+    }
+
+    return rc;
+}
+
+ble_error_t nRF5xGattClientQueue::issueFirst(unsigned position)
+{
+    if (!isFirstOfConnection(position)) {
+        return BLE_ERROR_NONE; /* Issued by pump() once the previous operations are done. */
+    }
+
+    uint32_t rc = issue(position);
+    if ((rc == NRF_SUCCESS) || isDeferrable(rc)) {
+        return BLE_ERROR_NONE;
+    }
+
+    /* Rejected outright, e.g. for an invalid connection: report it as read() and write() always have. */
+    removeAt(position);
+    return BLE_ERROR_INVALID_STATE;
+}
+
+/*
+ * Append a response to the value of a long read, and read the next part of
+ * the value unless the response was the last one.
+ */
+void nRF5xGattClientQueue::processLongReadResponse(unsigned position, uint16_t gattStatus, const uint8_t *data, uint16_t len)
+{
+    Entry &entry = entryAt(position);
+    entry.pdus++;
+
+    if (gattStatus != BLE_GATT_STATUS_SUCCESS) {
+        if ((gattStatus == BLE_GATT_STATUS_ATTERR_INVALID_OFFSET) && (entry.offset > 0)) {
+            /* The previous response ended exactly at the end of the value. */
+            complete(position, BLE_ERROR_NONE, BLE_GATT_STATUS_SUCCESS, entry.buffer, entry.offset);
+        } else {
+            complete(position, BLE_ERROR_NONE, gattStatus, NULL, 0);
+        }
+        return;
+    }
+
+    uint16_t room   = entry.bufferSize - entry.offset;
+    uint16_t copied = (len < room) ? len : room;
+    memcpy(&entry.buffer[entry.offset], data, copied);
+    entry.offset += copied;
+
+    if ((copied < len) || ((len == MAX_READ_PDU_SIZE) && (entry.offset == entry.bufferSize))) {
+        complete(position, BLE_ERROR_NO_MEM, BLE_GATT_STATUS_SUCCESS, entry.buffer, entry.offset);
+        return;
+    }
+    if (len < MAX_READ_PDU_SIZE) {
+        complete(position, BLE_ERROR_NONE, BLE_GATT_STATUS_SUCCESS, entry.buffer, entry.offset);
+        return;
+    }
+
+    /* The response has freed the connection: read the next part now, or from pump() if the SoftDevice is busy. */
+    entry.issued = false;
+    uint32_t rc  = issue(position);
+    if ((rc != NRF_SUCCESS) && !isDeferrable(rc)) {
+        complete(position, BLE_ERROR_INVALID_STATE, 0, entry.buffer, entry.offset);
+    }
+}
+
+void nRF5xGattClientQueue::complete(unsigned position, ble_error_t error, uint16_t gattStatus, const uint8_t *data, uint16_t len)
+{
+    Entry   &entry = entryAt(position);
+    uint32_t now   = us_ticker_read();
+
+    Completion_t completion;
+    completion.connHandle = entry.connectionHandle;
+    completion.handle     = entry.attributeHandle;
+    completion.op         = static_cast<Operation_t>(entry.op);
+    completion.error      = error;
+    completion.gattStatus = gattStatus;
+    completion.data       = data;
+    completion.len        = len;
+    completion.pduCount   = entry.pdus;
+    completion.waitUs     = (entry.issued ? entry.issuedAt : now) - entry.queuedAt;
+    completion.latencyUs  = now - entry.queuedAt;
+
+    if (error == BLE_ERROR_NONE) {
+        statistics.completed++;
+        statistics.totalLatencyUs += completion.latencyUs;
+        if (completion.latencyUs > statistics.maxLatencyUs) {
+            statistics.maxLatencyUs = completion.latencyUs;
+        }
+    } else {
+        statistics.failed++;
+    }
+
+    /* Free the entry first, so that the callback can queue the next operation. */
+    Callback_t callback = entry.callback;
+    if ((entry.op != OP_READ_MULTIPLE) || (error != BLE_ERROR_NONE)) {
+        removeAt(position);
+        callback.call(&completion);
+        return;
+    }
+
+    /* Split the response to a Read Multiple request into the values of its attributes. */
+    uint8_t                 valueCount = entry.len;
+    GattAttribute::Handle_t handles[MAX_READ_MULTIPLE_COUNT];
+    uint8_t                 lengths[MAX_READ_MULTIPLE_COUNT];
+    memcpy(handles, entry.multiple.handles, sizeof(handles));
+    memcpy(lengths, entry.multiple.lengths, sizeof(lengths));
+    removeAt(position);
+
+    uint16_t consumed = 0;
+    for (unsigned i = 0; i < valueCount; i++) {
+        uint16_t left = len - consumed;
+
+        completion.handle = handles[i];
+        completion.data   = (data != NULL) ? &data[consumed] : NULL;
+        completion.len    = (lengths[i] < left) ? lengths[i] : left;
+        consumed += completion.len;
+
+        callback.call(&completion);
+    }
+}
+
+void nRF5xGattClientQueue::removeAt(unsigned position)
+{
+    if (position == 0) {
+        head = (head + 1) % QUEUE_SIZE;
+    } else {
+        /* Close the gap while preserving the order of the remaining entries. */
+        for (unsigned i = position; i < (unsigned)(count - 1); i++) {
+            entryAt(i) = entryAt(i + 1);
+        }
+    }
+
+    count--;
+    statistics.depth = count;
+}
+
+#endif
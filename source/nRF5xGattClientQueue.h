@@ -0,0 +1,257 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NRF5x_GATT_CLIENT_QUEUE_H__
+#define __NRF5x_GATT_CLIENT_QUEUE_H__
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ble/blecommon.h"
+#include "ble/Gap.h"
+#include "ble/GattAttribute.h"
+#include "ble/FunctionPointerWithContext.h"
+#include "nrf_ble.h"
+
+#ifndef YOTTA_CFG_NRF5X_GATTC_QUEUE_SIZE
+    #define YOTTA_CFG_NRF5X_GATTC_QUEUE_SIZE 4
+#endif
+
+/**
+ * @brief Fixed-size pool of GATT client reads and writes waiting for their
+ * connection to be available.
+ * @details ATT allows a single request in flight per connection, and the
+ * SoftDevice rejects the others with NRF_ERROR_BUSY. Operations are kept in
+ * FIFO order per connection: a read or a write request is issued once the
+ * previous one has been answered, and consecutive write commands are handed
+ * to the SoftDevice until it runs out of TX buffers. pump() issues what it
+ * can; it is meant to be called after every GATT client event and
+ * BLE_EVT_TX_COMPLETE.
+ */
+class nRF5xGattClientQueue
+{
+public:
+    /**
+     * Maximum value of a queued write; the ATT_MTU is fixed to its default
+     * value by the SoftDevice.
+     */
+    static const unsigned MAX_WRITE_SIZE = BLE_GATT_ATT_MTU_DEFAULT - 3;
+
+    /**
+     * Payload of a full read response; a shorter one ends a long read.
+     */
+    static const unsigned MAX_READ_PDU_SIZE = BLE_GATT_ATT_MTU_DEFAULT - 1;
+
+    /**
+     * Maximum number of handles in a Read Multiple request.
+     */
+    static const unsigned MAX_READ_MULTIPLE_COUNT = (BLE_GATT_ATT_MTU_DEFAULT - 1) / sizeof(GattAttribute::Handle_t);
+
+    enum Operation_t {
+        OP_READ,
+        OP_WRITE_REQ,
+        OP_WRITE_CMD,
+        OP_READ_LONG,
+        OP_READ_MULTIPLE,
+    };
+
+    /**
+     * Outcome of a queued operation.
+     */
+    struct Completion_t {
+        Gap::Handle_t           connHandle;
+        GattAttribute::Handle_t handle;
+        Operation_t             op;
+        ble_error_t             error;      /**< BLE_ERROR_NONE if the peer answered (see gattStatus) or the SoftDevice took the command. */
+        uint16_t                gattStatus; /**< BLE_GATT_STATUS_* of the response. */
+        const uint8_t          *data;       /**< Value read; NULL for writes. */
+        uint16_t                len;
+        uint16_t                pduCount;   /**< Number of responses received for the operation. */
+        uint32_t                waitUs;     /**< Time spent queued before the SoftDevice accepted the operation. */
+        uint32_t                latencyUs;  /**< Time from queuing to completion. */
+    };
+    typedef FunctionPointerWithContext<const Completion_t *> Callback_t;
+
+    /**
+     * Counters describing the activity of the queue.
+     */
+    struct Statistics_t {
+        uint32_t completed;      /**< Number of operations answered by the peer, or of commands taken by the SoftDevice. */
+        uint32_t failed;         /**< Number of operations rejected by the SoftDevice or cancelled by a disconnection. */
+        uint32_t deferred;       /**< Number of attempts put off because the SoftDevice was busy or out of TX buffers. */
+        uint32_t totalLatencyUs; /**< Sum of the latencies of the completed operations. */
+        uint32_t maxLatencyUs;   /**< Longest latency of a completed operation. */
+        uint8_t  depth;          /**< Number of operations currently queued or in flight. */
+        uint8_t  maxDepth;       /**< Highest value reached by depth. */
+    };
+
+public:
+    nRF5xGattClientQueue();
+
+    /**
+     * Queue a read, which is issued at once if the connection is available.
+     *
+     * @return BLE_ERROR_NONE if the read has been queued or issued,
+     *         BLE_STACK_BUSY if the pool is exhausted, or the error of the
+     *         SoftDevice if it rejected the read outright; the callback isn't
+     *         invoked in those cases.
+     */
+    ble_error_t read(Gap::Handle_t           connectionHandle,
+                     GattAttribute::Handle_t attributeHandle,
+                     uint16_t                offset,
+                     const Callback_t       &callback);
+
+    /**
+     * Queue a long read: the attribute is read at increasing offsets until
+     * a response shorter than MAX_READ_PDU_SIZE arrives, and the value is
+     * assembled in buffer. The callback is invoked once, with the whole
+     * value; the error is BLE_ERROR_NO_MEM if the buffer was filled before
+     * the end of the value was seen.
+     *
+     * @param buffer Memory owned by the caller until the callback is invoked.
+     * @param size   Size of buffer.
+     *
+     * @return as for read().
+     */
+    ble_error_t readLong(Gap::Handle_t           connectionHandle,
+                         GattAttribute::Handle_t attributeHandle,
+                         uint8_t                *buffer,
+                         uint16_t                size,
+                         const Callback_t       &callback);
+
+    /**
+     * Queue a Read Multiple request, which reads several attributes in a
+     * single round trip. The response is the concatenation of the values,
+     * so their lengths must be known in advance. The callback is invoked
+     * once per attribute, in the order of the handles, including for an
+     * error response; if the operation fails on the local side (error other
+     * than BLE_ERROR_NONE), it is invoked once, for the first handle.
+     *
+     * @param handles Handles of the attributes; they are copied.
+     * @param lengths Length of the value of each attribute.
+     * @param handleCount Number of handles, from 2 to MAX_READ_MULTIPLE_COUNT.
+     *
+     * @return as for read(); BLE_ERROR_INVALID_PARAM if handleCount is out of range,
+     *         or if the values can't fit in a single response.
+     */
+    ble_error_t readMultiple(Gap::Handle_t                  connectionHandle,
+                             const GattAttribute::Handle_t *handles,
+                             const uint8_t                 *lengths,
+                             uint8_t                        handleCount,
+                             const Callback_t              &callback);
+
+    /**
+     * Queue a write request or command; the value is copied. The callback of
+     * a command accepted at once is invoked before returning.
+     *
+     * @return as for read(); BLE_ERROR_INVALID_PARAM if the value is longer
+     *         than MAX_WRITE_SIZE.
+     */
+    ble_error_t write(Operation_t              op,
+                      Gap::Handle_t            connectionHandle,
+                      GattAttribute::Handle_t  attributeHandle,
+                      const uint8_t           *value,
+                      uint16_t                 len,
+                      const Callback_t        &callback);
+
+    /**
+     * Issue the queued operations of every connection which can take one.
+     */
+    void pump(void);
+
+    /**
+     * Complete the request in flight on a connection, if the response is for
+     * it; responses to requests issued outside of the queue are ignored. The
+     * attribute handle isn't checked for OP_READ_MULTIPLE, whose response
+     * doesn't carry one.
+     */
+    void processResponse(Gap::Handle_t            connectionHandle,
+                         Operation_t              op,
+                         GattAttribute::Handle_t  attributeHandle,
+                         uint16_t                 gattStatus,
+                         const uint8_t           *data,
+                         uint16_t                 len);
+
+    /**
+     * Fail the operations of a connection which has been closed, or whose
+     * ATT bearer has timed out.
+     */
+    void abort(Gap::Handle_t connectionHandle, ble_error_t error);
+
+    /**
+     * Discard all the operations, without invoking their callbacks, and clear
+     * the statistics.
+     */
+    void reset(void);
+
+    const Statistics_t &getStatistics(void) const {
+        return statistics;
+    }
+
+    void resetStatistics(void) {
+        memset(&statistics, 0, sizeof(statistics));
+        statistics.depth = count;
+    }
+
+private:
+    struct Entry {
+        uint32_t                queuedAt;
+        uint32_t                issuedAt;
+        Callback_t              callback;
+        Gap::Handle_t           connectionHandle;
+        GattAttribute::Handle_t attributeHandle;
+        uint16_t                offset;
+        uint8_t                 op;
+        bool                    issued; /**< A request waiting for its response. */
+        uint8_t                 len;    /**< Length of a write, or number of handles of a Read Multiple. */
+        uint8_t                 pdus;
+        union {
+            uint8_t             data[MAX_WRITE_SIZE];
+            struct {
+                GattAttribute::Handle_t handles[MAX_READ_MULTIPLE_COUNT];
+                uint8_t                 lengths[MAX_READ_MULTIPLE_COUNT];
+            } multiple;
+        };
+        uint8_t                *buffer; /**< Destination of a long read, of bufferSize bytes. */
+        uint16_t                bufferSize;
+    };
+
+    static const unsigned QUEUE_SIZE = YOTTA_CFG_NRF5X_GATTC_QUEUE_SIZE;
+
+    Entry &entryAt(unsigned position) {
+        return entries[(head + position) % QUEUE_SIZE];
+    }
+
+    Entry *append(Gap::Handle_t connectionHandle, GattAttribute::Handle_t attributeHandle, uint8_t op, const Callback_t &callback);
+    bool isFirstOfConnection(unsigned position);
+    uint32_t issue(unsigned position);
+    ble_error_t issueFirst(unsigned position);
+    void processLongReadResponse(unsigned position, uint16_t gattStatus, const uint8_t *data, uint16_t len);
+    void complete(unsigned position, ble_error_t error, uint16_t gattStatus, const uint8_t *data, uint16_t len);
+    void removeAt(unsigned position);
+
+private:
+    nRF5xGattClientQueue(const nRF5xGattClientQueue &);
+    const nRF5xGattClientQueue& operator=(const nRF5xGattClientQueue &);
+
+private:
+    Entry        entries[QUEUE_SIZE];
+    uint8_t      head;
+    uint8_t      count;
+    Statistics_t statistics;
+};
+
+#endif /* __NRF5x_GATT_CLIENT_QUEUE_H__ */
@@ -0,0 +1,132 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nRF5xGattClientSubscriptions.h"
+
+#if !defined(TARGET_MCU_NRF51_16K_S110) && !defined(TARGET_MCU_NRF51_32K_S110)
+
+nRF5xGattClientSubscriptions::nRF5xGattClientSubscriptions() :
+    entries() {
+    reset();
+}
+
+ble_error_t nRF5xGattClientSubscriptions::subscribe(Gap::Handle_t           connectionHandle,
+                                                    GattAttribute::Handle_t valueHandle,
+                                                    const Callback_t       &callback)
+{
+    int existing = find(connectionHandle, valueHandle);
+    if (existing >= 0) {
+        entries[existing].callback = callback;
+        return BLE_ERROR_NONE;
+    }
+
+    /* Take the first slot which doesn't hold a subscription along the probe sequence. */
+    unsigned index = hash(connectionHandle, valueHandle);
+    for (unsigned probes = 0; probes < TABLE_SIZE; probes++) {
+        Entry &entry = entries[index];
+        if (entry.state != SLOT_USED) {
+            entry.callback         = callback;
+            entry.connectionHandle = connectionHandle;
+            entry.valueHandle      = valueHandle;
+            entry.state            = SLOT_USED;
+            return BLE_ERROR_NONE;
+        }
+        index = (index + 1) % TABLE_SIZE;
+    }
+
+    return BLE_ERROR_NO_MEM;
+}
+
+ble_error_t nRF5xGattClientSubscriptions::unsubscribe(Gap::Handle_t connectionHandle, GattAttribute::Handle_t valueHandle)
+{
+    int index = find(connectionHandle, valueHandle);
+    if (index < 0) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    release(index);
+    return BLE_ERROR_NONE;
+}
+
+void nRF5xGattClientSubscriptions::removeConnection(Gap::Handle_t connectionHandle)
+{
+    for (unsigned i = 0; i < TABLE_SIZE; i++) {
+        if ((entries[i].state == SLOT_USED) && (entries[i].connectionHandle == connectionHandle)) {
+            release(i);
+        }
+    }
+}
+
+bool nRF5xGattClientSubscriptions::dispatch(const GattHVXCallbackParams *params)
+{
+    int index = find(params->connHandle, params->handle);
+    if (index < 0) {
+        return false;
+    }
+
+    /* Copy the callback: it may unsubscribe itself. */
+    Callback_t callback = entries[index].callback;
+    callback.call(params);
+    return true;
+}
+
+void nRF5xGattClientSubscriptions::reset(void)
+{
+    for (unsigned i = 0; i < TABLE_SIZE; i++) {
+        entries[i].callback = Callback_t();
+        entries[i].state    = SLOT_FREE;
+    }
+}
+
+int nRF5xGattClientSubscriptions::find(Gap::Handle_t connectionHandle, GattAttribute::Handle_t valueHandle) const
+{
+    unsigned index = hash(connectionHandle, valueHandle);
+    for (unsigned probes = 0; probes < TABLE_SIZE; probes++) {
+        const Entry &entry = entries[index];
+        if (entry.state == SLOT_FREE) {
+            break;
+        }
+        if ((entry.state == SLOT_USED) &&
+            (entry.connectionHandle == connectionHandle) &&
+            (entry.valueHandle == valueHandle)) {
+            return index;
+        }
+        index = (index + 1) % TABLE_SIZE;
+    }
+
+    return -1;
+}
+
+void nRF5xGattClientSubscriptions::release(unsigned index)
+{
+    entries[index].callback = Callback_t();
+    entries[index].state    = SLOT_DELETED;
+
+    /*
+     * A deleted slot followed by a free one ends no probe sequence: free it,
+     * along with the deleted slots which precede it, so that lookups don't
+     * slow down as subscriptions come and go.
+     */
+    if (entries[(index + 1) % TABLE_SIZE].state != SLOT_FREE) {
+        return;
+    }
+    for (unsigned freed = 0; (freed < TABLE_SIZE) && (entries[index].state == SLOT_DELETED); freed++) {
+        entries[index].state = SLOT_FREE;
+        index = (index + TABLE_SIZE - 1) % TABLE_SIZE;
+    }
+}
+
+#endif
@@ -0,0 +1,119 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NRF5x_GATT_CLIENT_SUBSCRIPTIONS_H__
+#define __NRF5x_GATT_CLIENT_SUBSCRIPTIONS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ble/blecommon.h"
+#include "ble/Gap.h"
+#include "ble/GattAttribute.h"
+#include "ble/GattClient.h"
+
+/*
+ * Number of characteristics, across all the connections, whose notifications
+ * and indications can be routed to a dedicated callback. Lookups stay short
+ * as long as the table isn't close to full.
+ */
+#ifndef YOTTA_CFG_NRF5X_GATTC_SUBSCRIPTIONS
+    #define YOTTA_CFG_NRF5X_GATTC_SUBSCRIPTIONS 16
+#endif
+
+/**
+ * @brief Hash table of the callbacks handling the notifications and
+ * indications of given characteristics, keyed by connection and value handle.
+ * @details GattClient::onHVX() callbacks all receive every HVX event, and each
+ * of them has to filter on the connection and handle. A subscription routes
+ * the events of one characteristic straight to its callback; the table uses
+ * open addressing with linear probing, so a lookup touches a single slot in
+ * the common case.
+ */
+class nRF5xGattClientSubscriptions
+{
+public:
+    typedef GattClient::HVXCallback_t Callback_t;
+
+public:
+    nRF5xGattClientSubscriptions();
+
+    /**
+     * Route the HVX events of a characteristic to a callback, replacing the
+     * callback it had, if any.
+     *
+     * @return BLE_ERROR_NONE if successful, or BLE_ERROR_NO_MEM if the table
+     *         is full.
+     */
+    ble_error_t subscribe(Gap::Handle_t connectionHandle, GattAttribute::Handle_t valueHandle, const Callback_t &callback);
+
+    /**
+     * Return the HVX events of a characteristic to the onHVX() callbacks.
+     *
+     * @return BLE_ERROR_NONE if successful, or BLE_ERROR_INVALID_PARAM if the
+     *         characteristic had no subscription.
+     */
+    ble_error_t unsubscribe(Gap::Handle_t connectionHandle, GattAttribute::Handle_t valueHandle);
+
+    /**
+     * Drop the subscriptions of a connection which has been closed.
+     */
+    void removeConnection(Gap::Handle_t connectionHandle);
+
+    /**
+     * Invoke the callback subscribed to the characteristic of an HVX event.
+     *
+     * @return false if there is no such subscription.
+     */
+    bool dispatch(const GattHVXCallbackParams *params);
+
+    /**
+     * Drop all the subscriptions.
+     */
+    void reset(void);
+
+private:
+    enum {
+        SLOT_FREE,
+        SLOT_USED,
+        SLOT_DELETED, /**< Removed, but lookups must probe past it. */
+    };
+
+    struct Entry {
+        Callback_t              callback;
+        Gap::Handle_t           connectionHandle;
+        GattAttribute::Handle_t valueHandle;
+        uint8_t                 state;
+    };
+
+    static const unsigned TABLE_SIZE = YOTTA_CFG_NRF5X_GATTC_SUBSCRIPTIONS;
+
+    static unsigned hash(Gap::Handle_t connectionHandle, GattAttribute::Handle_t valueHandle) {
+        return ((uint32_t)valueHandle * 2654435761u + connectionHandle) % TABLE_SIZE;
+    }
+
+    int find(Gap::Handle_t connectionHandle, GattAttribute::Handle_t valueHandle) const;
+    void release(unsigned index);
+
+private:
+    nRF5xGattClientSubscriptions(const nRF5xGattClientSubscriptions &);
+    const nRF5xGattClientSubscriptions& operator=(const nRF5xGattClientSubscriptions &);
+
+private:
+    Entry entries[TABLE_SIZE];
+};
+
+#endif /* __NRF5x_GATT_CLIENT_SUBSCRIPTIONS_H__ */
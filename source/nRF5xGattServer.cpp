@@ -23,9 +23,19 @@
 
 #include "common/common.h"
 #include "btle/custom/custom_helper.h"
+#include "btle/btle_security.h"
+#include "btle/btle_instrumentation.h"
 
 #include "nRF5xn.h"
 
+/* Kept in the image so that it can be read from the ELF file, e.g. with gdb or objdump. */
+__attribute__((used)) const size_t nRF5xGattServerFootprint = sizeof(nRF5xGattServer);
+
+#ifdef YOTTA_CFG_NRF5X_GATTS_MAX_FOOTPRINT
+/* Fails to compile (negative array size) if the configured capacity takes more RAM than budgeted. */
+typedef char nRF5xGattServerFootprintCheck[(sizeof(nRF5xGattServer) <= YOTTA_CFG_NRF5X_GATTS_MAX_FOOTPRINT) ? 1 : -1] __attribute__((unused));
+#endif
+
 /**************************************************************************/
 /*!
     @brief  Adds a new service to the GATT table on the peripheral
@@ -59,6 +69,11 @@ ble_error_t nRF5xGattServer::addService(GattService &service)
             BLE_ERROR_PARAM_OUT_OF_RANGE );
     service.setHandle(serviceHandle);
 
+    /* Handles are allocated in increasing order; anchor the lookup table at the first service. */
+    if (attributeHandleMapBase == BLE_GATT_HANDLE_INVALID) {
+        attributeHandleMapBase = serviceHandle;
+    }
+
     /* Add characteristics to the service */
     for (uint8_t i = 0; i < service.getCharacteristicCount(); i++) {
         if (characteristicCount >= BLE_TOTAL_CHARACTERISTICS) {
@@ -75,18 +90,27 @@ ble_error_t nRF5xGattServer::addService(GattService &service)
 
         nordicUUID = custom_convert_to_nordic_uuid(p_char->getValueAttribute().getUUID());
 
+        bool userLocated = takePendingUserLocatedValue(&p_char->getValueAttribute());
+
         /* The user-description descriptor is a special case which needs to be
          * handled at the time of adding the characteristic. The following block
-         * is meant to discover its presence. */
+         * is meant to discover its presence; the others are counted so that a
+         * lack of room is detected before anything is added to the SoftDevice. */
         const uint8_t *userDescriptionDescriptorValuePtr = NULL;
         uint16_t userDescriptionDescriptorValueLen = 0;
+        int userDescriptionDescriptorIndex = -1;
         for (uint8_t j = 0; j < p_char->getDescriptorCount(); j++) {
             GattAttribute *p_desc = p_char->getDescriptor(j);
             if (p_desc->getUUID() == BLE_UUID_DESCRIPTOR_CHAR_USER_DESC) {
                 userDescriptionDescriptorValuePtr = p_desc->getValuePtr();
                 userDescriptionDescriptorValueLen = p_desc->getLength();
+                userDescriptionDescriptorIndex    = j;
             }
         }
+        unsigned otherDescriptorCount = p_char->getDescriptorCount() - ((userDescriptionDescriptorIndex != -1) ? 1 : 0);
+        if ((descriptorCount + otherDescriptorCount) > BLE_TOTAL_DESCRIPTORS) {
+            return BLE_ERROR_NO_MEM;
+        }
 
         ASSERT ( ERROR_NONE ==
                  custom_add_in_characteristic(BLE_GATT_HANDLE_INVALID,
@@ -99,28 +123,29 @@ ble_error_t nRF5xGattServer::addService(GattService &service)
                                               p_char->getValueAttribute().hasVariableLength(),
                                               userDescriptionDescriptorValuePtr,
                                               userDescriptionDescriptorValueLen,
-                                              p_char->isReadAuthorizationEnabled(),
+                                              p_char->isReadAuthorizationEnabled() || (getReadProvider(p_char) != NULL),
                                               p_char->isWriteAuthorizationEnabled(),
+                                              userLocated ? BLE_GATTS_VLOC_USER : BLE_GATTS_VLOC_STACK,
                                               &nrfCharacteristicHandles[characteristicCount]),
                  BLE_ERROR_PARAM_OUT_OF_RANGE );
 
         /* Update the characteristic handle */
         p_characteristics[characteristicCount] = p_char;
         p_char->getValueAttribute().setHandle(nrfCharacteristicHandles[characteristicCount].value_handle);
+        mapAttributeHandle(nrfCharacteristicHandles[characteristicCount].value_handle, characteristicCount, false);
+        mapAttributeHandle(nrfCharacteristicHandles[characteristicCount].cccd_handle,  characteristicCount, true);
+        assignBit(userLocatedValues, characteristicCount, userLocated);
         characteristicCount++;
 
         /* Add optional descriptors if any */
         for (uint8_t j = 0; j < p_char->getDescriptorCount(); j++) {
-            if (descriptorCount >= BLE_TOTAL_DESCRIPTORS) {
-                return BLE_ERROR_NO_MEM;
-            }
-
-            GattAttribute *p_desc = p_char->getDescriptor(j);
             /* skip the user-description-descriptor here; this has already been handled when adding the characteristic (above). */
-            if (p_desc->getUUID() == BLE_UUID_DESCRIPTOR_CHAR_USER_DESC) {
+            if (j == userDescriptionDescriptorIndex) {
                 continue;
             }
 
+            GattAttribute *p_desc = p_char->getDescriptor(j);
+
             nordicUUID = custom_convert_to_nordic_uuid(p_desc->getUUID());
 
             ASSERT(ERROR_NONE ==
@@ -130,6 +155,7 @@ ble_error_t nRF5xGattServer::addService(GattService &service)
                                             p_desc->getLength(),
                                             p_desc->getMaxLength(),
                                             p_desc->hasVariableLength(),
+                                            takePendingUserLocatedValue(p_desc) ? BLE_GATTS_VLOC_USER : BLE_GATTS_VLOC_STACK,
                                             &nrfDescriptorHandles[descriptorCount]),
                 BLE_ERROR_PARAM_OUT_OF_RANGE);
 
@@ -178,7 +204,7 @@ ble_error_t nRF5xGattServer::read(Gap::Handle_t connectionHandle, GattAttribute:
     };
 
     ASSERT( ERROR_NONE ==
-            sd_ble_gatts_value_get(connectionHandle, attributeHandle, &value),
+            BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTS_VALUE_GET, sd_ble_gatts_value_get(connectionHandle, attributeHandle, &value)),
             BLE_ERROR_PARAM_OUT_OF_RANGE);
     *lengthP = value.len;
 
@@ -213,63 +239,34 @@ ble_error_t nRF5xGattServer::write(Gap::Handle_t connectionHandle, GattAttribute
 {
     ble_error_t returnValue = BLE_ERROR_NONE;
 
-    ble_gatts_value_t value = {
-        .len     = len,
-        .offset  = 0,
-        .p_value = const_cast<uint8_t *>(buffer),
-    };
+    int characteristicIndex = resolveValueHandleToCharIndex(attributeHandle);
 
     if (localOnly) {
         /* Only update locally regardless of notify/indicate */
         ASSERT_INT( ERROR_NONE,
-                    sd_ble_gatts_value_set(connectionHandle, attributeHandle, &value),
+                    setValue(connectionHandle, attributeHandle, characteristicIndex, buffer, len),
                     BLE_ERROR_PARAM_OUT_OF_RANGE );
         return BLE_ERROR_NONE;
     }
 
-    int characteristicIndex = resolveValueHandleToCharIndex(attributeHandle);
     if ((characteristicIndex != -1) &&
         (p_characteristics[characteristicIndex]->getProperties() & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY))) {
-        /* HVX update for the characteristic value */
-        ble_gatts_hvx_params_t hvx_params;
-
-        hvx_params.handle = attributeHandle;
-        hvx_params.type   =
-            (p_characteristics[characteristicIndex]->getProperties() & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY) ? BLE_GATT_HVX_NOTIFICATION : BLE_GATT_HVX_INDICATION;
-        hvx_params.offset = 0;
-        hvx_params.p_data = const_cast<uint8_t *>(buffer);
-        hvx_params.p_len  = &len;
+        if (connectionHandle == BLE_CONN_HANDLE_INVALID) {
+            if (broadcastUpdatesEnabled) {
+                return broadcastUpdate(characteristicIndex, buffer, len);
+            }
 
-        if (connectionHandle == BLE_CONN_HANDLE_INVALID) { /* use the default connection handle if the caller hasn't specified a valid connectionHandle. */
+            /* use the default connection handle if the caller hasn't specified a valid connectionHandle. */
             nRF5xGap &gap = (nRF5xGap &) nRF5xn::Instance(BLE::DEFAULT_INSTANCE).getGap();
             connectionHandle = gap.getConnectionHandle();
         }
-        error_t error = (error_t) sd_ble_gatts_hvx(connectionHandle, &hvx_params);
-        if (error != ERROR_NONE) {
-            switch (error) {
-                case ERROR_BLE_NO_TX_BUFFERS: /*  Notifications consume application buffers. The return value can be used for resending notifications. */
-                case ERROR_BUSY:
-                    returnValue = BLE_STACK_BUSY;
-                    break;
-
-                case ERROR_INVALID_STATE:
-                case ERROR_BLEGATTS_SYS_ATTR_MISSING:
-                    returnValue = BLE_ERROR_INVALID_STATE;
-                    break;
-
-                default :
-                    ASSERT_INT( ERROR_NONE,
-                                sd_ble_gatts_value_set(connectionHandle, attributeHandle, &value),
-                                BLE_ERROR_PARAM_OUT_OF_RANGE );
 
-                    /* Notifications consume application buffers. The return value can
-                     * be used for resending notifications. */
-                    returnValue = BLE_STACK_BUSY;
-                    break;
-            }
-        }
+        /* HVX update for the characteristic value */
+        uint8_t type =
+            (p_characteristics[characteristicIndex]->getProperties() & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY) ? BLE_GATT_HVX_NOTIFICATION : BLE_GATT_HVX_INDICATION;
+        returnValue = sendUpdate(connectionHandle, characteristicIndex, type, buffer, len);
     } else {
-        uint32_t err = sd_ble_gatts_value_set(connectionHandle, attributeHandle, &value);
+        uint32_t err = setValue(connectionHandle, attributeHandle, characteristicIndex, buffer, len);
         switch(err) {
             case NRF_SUCCESS:
                 returnValue = BLE_ERROR_NONE;
@@ -296,6 +293,145 @@ ble_error_t nRF5xGattServer::write(Gap::Handle_t connectionHandle, GattAttribute
     return returnValue;
 }
 
+uint32_t nRF5xGattServer::setValue(Gap::Handle_t connectionHandle, GattAttribute::Handle_t attributeHandle, int charIndex, const uint8_t buffer[], uint16_t len)
+{
+    if ((charIndex != -1) && isBitSet(userLocatedValues, charIndex)) {
+        /* The SoftDevice reads user-located values in place; only the length of variable-length ones needs an SVC. */
+        GattAttribute &attribute = p_characteristics[charIndex]->getValueAttribute();
+        if (!attribute.hasVariableLength() && (len == attribute.getMaxLength())) {
+            memmove(attribute.getValuePtr(), buffer, len);
+            return NRF_SUCCESS;
+        }
+    }
+
+    ble_gatts_value_t value = {
+        .len     = len,
+        .offset  = 0,
+        .p_value = const_cast<uint8_t *>(buffer),
+    };
+    return BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTS_VALUE_SET, sd_ble_gatts_value_set(connectionHandle, attributeHandle, &value));
+}
+
+ble_error_t nRF5xGattServer::sendUpdate(Gap::Handle_t connectionHandle, unsigned charIndex, uint8_t type, const uint8_t buffer[], uint16_t len)
+{
+    GattAttribute::Handle_t attributeHandle = nrfCharacteristicHandles[charIndex].value_handle;
+
+    ble_gatts_hvx_params_t hvx_params;
+    hvx_params.handle = attributeHandle;
+    hvx_params.type   = type;
+    hvx_params.offset = 0;
+    hvx_params.p_data = const_cast<uint8_t *>(buffer);
+    hvx_params.p_len  = &len;
+
+    uint32_t rc;
+    if (notificationQueueEnabled && notificationQueue.hasPending(connectionHandle, type)) {
+        /* Values of this kind are already waiting for this connection; go behind them to preserve ordering. */
+        rc = BLE_ERROR_NO_TX_BUFFERS;
+    } else {
+        rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTS_HVX, sd_ble_gatts_hvx(connectionHandle, &hvx_params));
+    }
+
+    if (notificationQueueEnabled && ((rc == BLE_ERROR_NO_TX_BUFFERS) || (rc == NRF_ERROR_BUSY))) {
+        /* The SoftDevice only updates the value once the HVX goes out; keep reads consistent meanwhile. */
+        ASSERT_INT( ERROR_NONE,
+                    setValue(connectionHandle, attributeHandle, charIndex, buffer, len),
+                    BLE_ERROR_PARAM_OUT_OF_RANGE );
+
+        ble_error_t returnValue = notificationQueue.enqueue(connectionHandle, attributeHandle, type, buffer, len,
+                                                            isBitSet(notificationCoalescing, charIndex));
+        if (returnValue == BLE_ERROR_NO_MEM) {
+            /* The pool is exhausted; fall back to the caller resending from onDataSent(). */
+            returnValue = BLE_STACK_BUSY;
+        }
+        return returnValue;
+    }
+
+    switch ((error_t) rc) {
+        case ERROR_NONE:
+            return BLE_ERROR_NONE;
+
+        case ERROR_BLE_NO_TX_BUFFERS: /*  Notifications consume application buffers. The return value can be used for resending notifications. */
+        case ERROR_BUSY:
+            return BLE_STACK_BUSY;
+
+        case ERROR_INVALID_STATE:
+        case ERROR_BLEGATTS_SYS_ATTR_MISSING:
+            return BLE_ERROR_INVALID_STATE;
+
+        default :
+            ASSERT_INT( ERROR_NONE,
+                        setValue(connectionHandle, attributeHandle, charIndex, buffer, len),
+                        BLE_ERROR_PARAM_OUT_OF_RANGE );
+
+            /* Notifications consume application buffers. The return value can
+             * be used for resending notifications. */
+            return BLE_STACK_BUSY;
+    }
+}
+
+ble_error_t nRF5xGattServer::broadcastUpdate(unsigned charIndex, const uint8_t buffer[], uint16_t len)
+{
+    /* Update the value first, so that it is current even if no one is subscribed. */
+    ASSERT_INT( ERROR_NONE,
+                setValue(BLE_CONN_HANDLE_INVALID, nrfCharacteristicHandles[charIndex].value_handle, charIndex, buffer, len),
+                BLE_ERROR_PARAM_OUT_OF_RANGE );
+
+    /* Keep going if a peer fails so that the others still get the update; report the first failure. */
+    ble_error_t returnValue = BLE_ERROR_NONE;
+    for (unsigned i = 0; i < MAX_CONNECTIONS; i++) {
+        const ConnectionCCCDs_t &cccds = cccdCache[i];
+        if (cccds.connectionHandle == BLE_CONN_HANDLE_INVALID) {
+            continue;
+        }
+
+        uint8_t type;
+        if (isBitSet(cccds.notify, charIndex)) {
+            type = BLE_GATT_HVX_NOTIFICATION;
+        } else if (isBitSet(cccds.indicate, charIndex)) {
+            type = BLE_GATT_HVX_INDICATION;
+        } else {
+            continue;
+        }
+
+        ble_error_t rc = sendUpdate(cccds.connectionHandle, charIndex, type, buffer, len);
+        if ((rc != BLE_ERROR_NONE) && (returnValue == BLE_ERROR_NONE)) {
+            returnValue = rc;
+        }
+    }
+
+    if (cccdCacheOverflow) {
+        /* Connections may have subscribed while no cache slot was available; ask the GATT server about them. */
+        nRF5xGap &gap = (nRF5xGap &) nRF5xn::Instance(BLE::DEFAULT_INSTANCE).getGap();
+        for (unsigned i = 0; i < gap.getConnectionCount(); i++) {
+            Gap::Handle_t connectionHandle = gap.getConnectionHandleAt(i);
+            if (getConnectionCCCDs(connectionHandle, false) != NULL) {
+                continue;
+            }
+
+            uint16_t cccdValue;
+            if (readCCCD(connectionHandle, charIndex, &cccdValue) != BLE_ERROR_NONE) {
+                continue;
+            }
+
+            uint8_t type;
+            if (cccdValue & BLE_GATT_HVX_NOTIFICATION) {
+                type = BLE_GATT_HVX_NOTIFICATION;
+            } else if (cccdValue & BLE_GATT_HVX_INDICATION) {
+                type = BLE_GATT_HVX_INDICATION;
+            } else {
+                continue;
+            }
+
+            ble_error_t rc = sendUpdate(connectionHandle, charIndex, type, buffer, len);
+            if ((rc != BLE_ERROR_NONE) && (returnValue == BLE_ERROR_NONE)) {
+                returnValue = rc;
+            }
+        }
+    }
+
+    return returnValue;
+}
+
 ble_error_t nRF5xGattServer::areUpdatesEnabled(const GattCharacteristic &characteristic, bool *enabledP)
 {
     /* Forward the call with the default connection handle. */
@@ -310,26 +446,549 @@ ble_error_t nRF5xGattServer::areUpdatesEnabled(Gap::Handle_t connectionHandle, c
         return BLE_ERROR_INVALID_PARAM;
     }
 
-    /* Read the cccd value from the GATT server. */
-    GattAttribute::Handle_t cccdHandle = nrfCharacteristicHandles[characteristicIndex].cccd_handle;
+    const ConnectionCCCDs_t *cccds = getConnectionCCCDs(connectionHandle, false);
+    if ((cccds == NULL) && cccdCacheOverflow) {
+        /* The connection may have subscribed while no cache slot was available. */
+        uint16_t cccdValue;
+        ble_error_t rc = readCCCD(connectionHandle, characteristicIndex, &cccdValue);
+        if (rc != BLE_ERROR_NONE) {
+            return rc;
+        }
+        *enabledP = (cccdValue & (BLE_GATT_HVX_NOTIFICATION | BLE_GATT_HVX_INDICATION)) != 0;
+        return BLE_ERROR_NONE;
+    }
+
+    /* Check for NOTFICATION or INDICATION in the cached CCCD. */
+    *enabledP = (cccds != NULL) && (isBitSet(cccds->notify, characteristicIndex) || isBitSet(cccds->indicate, characteristicIndex));
+
+#if CFG_DEBUG >= 2
+    /* Cross-check the cache against the GATT server. */
     uint16_t cccdValue;
-    uint16_t length = sizeof(cccdValue);
-    ble_error_t rc = read(connectionHandle, cccdHandle, reinterpret_cast<uint8_t *>(&cccdValue), &length);
+    if (readCCCD(connectionHandle, characteristicIndex, &cccdValue) == BLE_ERROR_NONE) {
+        ASSERT_INT((cccdValue & (BLE_GATT_HVX_NOTIFICATION | BLE_GATT_HVX_INDICATION)) != 0, *enabledP, BLE_ERROR_INVALID_STATE);
+    }
+#endif
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t nRF5xGattServer::readCCCD(Gap::Handle_t connectionHandle, unsigned charIndex, uint16_t *cccdValueP)
+{
+    /* Read the cccd value from the GATT server. */
+    GattAttribute::Handle_t cccdHandle = nrfCharacteristicHandles[charIndex].cccd_handle;
+    uint16_t length = sizeof(*cccdValueP);
+    ble_error_t rc = read(connectionHandle, cccdHandle, reinterpret_cast<uint8_t *>(cccdValueP), &length);
     if (rc != BLE_ERROR_NONE) {
         return rc;
     }
-    if (length != sizeof(cccdValue)) {
+    if (length != sizeof(*cccdValueP)) {
         return BLE_ERROR_INVALID_STATE;
     }
 
-    /* Check for NOTFICATION or INDICATION in CCCD. */
-    if ((cccdValue & BLE_GATT_HVX_NOTIFICATION) || (cccdValue & BLE_GATT_HVX_INDICATION)) {
-        *enabledP = true;
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t nRF5xGattServer::setUserLocatedValue(const GattAttribute &attribute)
+{
+    for (unsigned i = 0; i < MAX_PENDING_USER_LOCATED_VALUES; i++) {
+        if ((pendingUserLocatedValues[i] == NULL) || (pendingUserLocatedValues[i] == &attribute)) {
+            pendingUserLocatedValues[i] = &attribute;
+            return BLE_ERROR_NONE;
+        }
+    }
+
+    return BLE_ERROR_NO_MEM;
+}
+
+bool nRF5xGattServer::takePendingUserLocatedValue(GattAttribute *attribute)
+{
+    for (unsigned i = 0; i < MAX_PENDING_USER_LOCATED_VALUES; i++) {
+        if (pendingUserLocatedValues[i] == attribute) {
+            pendingUserLocatedValues[i] = NULL;
+            return attribute->getValuePtr() != NULL;
+        }
+    }
+
+    return false;
+}
+
+ble_error_t nRF5xGattServer::setNotificationCoalescing(GattAttribute::Handle_t valueHandle, bool coalesce)
+{
+    int characteristicIndex = resolveValueHandleToCharIndex(valueHandle);
+    if (characteristicIndex == -1) {
+        return BLE_ERROR_INVALID_PARAM;
     }
 
+    assignBit(notificationCoalescing, characteristicIndex, coalesce);
+
     return BLE_ERROR_NONE;
 }
 
+nRF5xGattServer::ConnectionCCCDs_t *nRF5xGattServer::getConnectionCCCDs(Gap::Handle_t connectionHandle, bool allocate)
+{
+    ConnectionCCCDs_t *freeSlot = NULL;
+    for (unsigned i = 0; i < MAX_CONNECTIONS; i++) {
+        if (cccdCache[i].connectionHandle == connectionHandle) {
+            return &cccdCache[i];
+        }
+        if ((freeSlot == NULL) && (cccdCache[i].connectionHandle == BLE_CONN_HANDLE_INVALID)) {
+            freeSlot = &cccdCache[i];
+        }
+    }
+
+    if (!allocate) {
+        return NULL;
+    }
+    if (freeSlot == NULL) {
+        /* areUpdatesEnabled() falls back to the GATT server for connections without a slot. */
+        cccdCacheOverflow = true;
+        return NULL;
+    }
+
+    freeSlot->connectionHandle = connectionHandle;
+    memset(freeSlot->notify,   0, sizeof(freeSlot->notify));
+    memset(freeSlot->indicate, 0, sizeof(freeSlot->indicate));
+    return freeSlot;
+}
+
+void nRF5xGattServer::updateCachedCCCD(Gap::Handle_t connectionHandle, unsigned charIndex, uint16_t cccdValue)
+{
+    ConnectionCCCDs_t *cccds = getConnectionCCCDs(connectionHandle, (cccdValue != 0));
+    if (cccds == NULL) {
+        return;
+    }
+
+    assignBit(cccds->notify,   charIndex, (cccdValue & BLE_GATT_HVX_NOTIFICATION) != 0);
+    assignBit(cccds->indicate, charIndex, (cccdValue & BLE_GATT_HVX_INDICATION)   != 0);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Refresh the cached CCCD state of a connection from the GATT
+            server, after its system attributes have been restored.
+*/
+/**************************************************************************/
+void nRF5xGattServer::reloadCachedCCCDs(Gap::Handle_t connectionHandle)
+{
+    releaseConnectionCCCDs(connectionHandle);
+
+    for (unsigned charIndex = 0; charIndex < characteristicCount; charIndex++) {
+        if (nrfCharacteristicHandles[charIndex].cccd_handle == BLE_GATT_HANDLE_INVALID) {
+            continue;
+        }
+
+        uint16_t cccdValue;
+        if (readCCCD(connectionHandle, charIndex, &cccdValue) == BLE_ERROR_NONE) {
+            updateCachedCCCD(connectionHandle, charIndex, cccdValue);
+        }
+    }
+}
+
+void nRF5xGattServer::releaseConnectionCCCDs(Gap::Handle_t connectionHandle)
+{
+    ConnectionCCCDs_t *cccds = getConnectionCCCDs(connectionHandle, false);
+    if (cccds != NULL) {
+        cccds->connectionHandle = BLE_CONN_HANDLE_INVALID;
+    }
+}
+
+void nRF5xGattServer::resetCCCDCache(void)
+{
+    memset(cccdCache, 0, sizeof(cccdCache));
+    for (unsigned i = 0; i < MAX_CONNECTIONS; i++) {
+        cccdCache[i].connectionHandle = BLE_CONN_HANDLE_INVALID;
+    }
+    cccdCacheOverflow = false;
+}
+
+ble_error_t nRF5xGattServer::setIngressBuffer(GattAttribute::Handle_t        valueHandle,
+                                              uint8_t                       *storage,
+                                              uint16_t                       size,
+                                              uint16_t                       highWatermark,
+                                              uint16_t                       lowWatermark,
+                                              const IngressCallback_t       &callback,
+                                              const Gap::ConnectionParams_t *throttleParams)
+{
+    if (resolveValueHandleToCharIndex(valueHandle) == -1) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    IngressChannel_t *channel = getIngressChannel(valueHandle);
+    if (storage == NULL) {
+        if (channel != NULL) {
+            channel->buffer.attach(NULL, 0);
+            channel->valueHandle = BLE_GATT_HANDLE_INVALID;
+        }
+        return BLE_ERROR_NONE;
+    }
+
+    if ((size == 0) || (highWatermark > size) || (lowWatermark > highWatermark)) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    if (channel == NULL) {
+        channel = getIngressChannel(BLE_GATT_HANDLE_INVALID);
+        if (channel == NULL) {
+            return BLE_ERROR_NO_MEM;
+        }
+    }
+
+    channel->valueHandle        = valueHandle;
+    channel->buffer.attach(storage, size);
+    channel->highWatermark      = highWatermark;
+    channel->lowWatermark       = lowWatermark;
+    channel->aboveHighWatermark = false;
+    channel->connectionHandle   = BLE_CONN_HANDLE_INVALID;
+    channel->throttleParams     = throttleParams;
+    channel->overruns           = 0;
+    channel->callback           = callback;
+
+    return BLE_ERROR_NONE;
+}
+
+uint16_t nRF5xGattServer::readIngress(GattAttribute::Handle_t valueHandle, uint8_t *buffer, uint16_t length)
+{
+    IngressChannel_t *channel = getIngressChannel(valueHandle);
+    if (channel == NULL) {
+        return 0;
+    }
+
+    uint16_t read = channel->buffer.read(buffer, length);
+
+    if (channel->aboveHighWatermark && (channel->buffer.available() <= channel->lowWatermark)) {
+        channel->aboveHighWatermark = false;
+        if (channel->throttleParams != NULL) {
+            /* Back to the preferred connection parameters. */
+            BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_CONN_PARAM_UPDATE, sd_ble_gap_conn_param_update(channel->connectionHandle, NULL));
+        }
+
+        if (channel->callback) {
+            IngressEvent_t event = {
+                .connHandle         = channel->connectionHandle,
+                .handle             = valueHandle,
+                .available          = channel->buffer.available(),
+                .aboveHighWatermark = false
+            };
+            channel->callback.call(&event);
+        }
+    }
+
+    return read;
+}
+
+uint16_t nRF5xGattServer::getIngressAvailable(GattAttribute::Handle_t valueHandle) const
+{
+    const IngressChannel_t *channel = getIngressChannel(valueHandle);
+    return (channel != NULL) ? channel->buffer.available() : 0;
+}
+
+uint32_t nRF5xGattServer::getIngressOverruns(GattAttribute::Handle_t valueHandle) const
+{
+    const IngressChannel_t *channel = getIngressChannel(valueHandle);
+    return (channel != NULL) ? channel->overruns : 0;
+}
+
+nRF5xGattServer::IngressChannel_t *nRF5xGattServer::getIngressChannel(GattAttribute::Handle_t valueHandle)
+{
+    for (unsigned i = 0; i < MAX_INGRESS_BUFFERS; i++) {
+        if (ingressChannels[i].valueHandle == valueHandle) {
+            return &ingressChannels[i];
+        }
+    }
+
+    return NULL;
+}
+
+const nRF5xGattServer::IngressChannel_t *nRF5xGattServer::getIngressChannel(GattAttribute::Handle_t valueHandle) const
+{
+    return const_cast<nRF5xGattServer *>(this)->getIngressChannel(valueHandle);
+}
+
+void nRF5xGattServer::pushIngress(IngressChannel_t &channel, Gap::Handle_t connectionHandle, const uint8_t *data, uint16_t len)
+{
+    channel.connectionHandle = connectionHandle;
+    channel.overruns        += len - channel.buffer.write(data, len);
+
+    if (!channel.aboveHighWatermark && (channel.buffer.available() >= channel.highWatermark)) {
+        channel.aboveHighWatermark = true;
+        if (channel.throttleParams != NULL) {
+            BTLE_INSTRUMENT_SVC(BTLE_SVC_GAP_CONN_PARAM_UPDATE,
+                                sd_ble_gap_conn_param_update(connectionHandle, reinterpret_cast<const ble_gap_conn_params_t *>(channel.throttleParams)));
+        }
+
+        if (channel.callback) {
+            IngressEvent_t event = {
+                .connHandle         = connectionHandle,
+                .handle             = channel.valueHandle,
+                .available          = channel.buffer.available(),
+                .aboveHighWatermark = true
+            };
+            channel.callback.call(&event);
+        }
+    }
+}
+
+void nRF5xGattServer::resetIngressChannels(void)
+{
+    for (unsigned i = 0; i < MAX_INGRESS_BUFFERS; i++) {
+        ingressChannels[i].valueHandle = BLE_GATT_HANDLE_INVALID;
+        ingressChannels[i].buffer.attach(NULL, 0);
+        ingressChannels[i].callback    = IngressCallback_t();
+    }
+}
+
+bool nRF5xGattServer::attachStream(nRF5xGattStream *stream)
+{
+    for (unsigned i = 0; i < MAX_STREAMS; i++) {
+        if (streams[i] == NULL) {
+            streams[i] = stream;
+            return true;
+        }
+    }
+    return false;
+}
+
+void nRF5xGattServer::detachStream(nRF5xGattStream *stream)
+{
+    for (unsigned i = 0; i < MAX_STREAMS; i++) {
+        if (streams[i] == stream) {
+            streams[i] = NULL;
+        }
+    }
+}
+
+void nRF5xGattServer::pumpStreams(void)
+{
+    /* A stream detaches itself from its slot on completion. */
+    for (unsigned i = 0; i < MAX_STREAMS; i++) {
+        if (streams[i] != NULL) {
+            streams[i]->pump();
+        }
+    }
+}
+
+void nRF5xGattServer::abortStreams(Gap::Handle_t connectionHandle)
+{
+    for (unsigned i = 0; i < MAX_STREAMS; i++) {
+        if ((streams[i] != NULL) &&
+            ((connectionHandle == BLE_CONN_HANDLE_INVALID) || (streams[i]->connectionHandle == connectionHandle))) {
+            streams[i]->finish(BLE_ERROR_INVALID_STATE);
+        }
+    }
+}
+
+ble_error_t nRF5xGattServer::setReadProvider(GattCharacteristic &characteristic, const ReadProvider_t &provider)
+{
+    ReadProviderEntry_t *entry = getReadProvider(&characteristic);
+    if (!provider) {
+        if (entry != NULL) {
+            entry->characteristic = NULL;
+            entry->provider       = ReadProvider_t();
+        }
+        return BLE_ERROR_NONE;
+    }
+
+    /* Read authorization requests are the only way to be asked for the value. */
+    if ((resolveValueHandleToCharIndex(characteristic.getValueHandle()) != -1) &&
+        !characteristic.isReadAuthorizationEnabled() && (entry == NULL)) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+
+    if (entry == NULL) {
+        entry = getReadProvider(NULL);
+        if (entry == NULL) {
+            return BLE_ERROR_NO_MEM;
+        }
+    }
+
+    entry->characteristic = &characteristic;
+    entry->provider       = provider;
+    return BLE_ERROR_NONE;
+}
+
+nRF5xGattServer::ReadProviderEntry_t *nRF5xGattServer::getReadProvider(const GattCharacteristic *characteristic)
+{
+    for (unsigned i = 0; i < MAX_READ_PROVIDERS; i++) {
+        if (readProviders[i].characteristic == characteristic) {
+            return &readProviders[i];
+        }
+    }
+    return NULL;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Let a read provider fill the reply buffer, and hand the buffer
+            to the SoftDevice with the authorization reply: it updates the
+            attribute value and answers the peer in a single call.
+*/
+/**************************************************************************/
+void nRF5xGattServer::replyFromReadProvider(ReadProviderEntry_t &entry, Gap::Handle_t connectionHandle, GattAttribute::Handle_t handle, uint16_t offset)
+{
+    uint16_t maxLength = entry.characteristic->getValueAttribute().getMaxLength();
+    uint16_t capacity  = (offset < maxLength) ? (maxLength - offset) : 0;
+    if (capacity > READ_PROVIDER_BUFFER_SIZE) {
+        capacity = READ_PROVIDER_BUFFER_SIZE;
+    }
+
+    ReadProviderParams_t params = {
+        .connHandle         = connectionHandle,
+        .handle             = handle,
+        .offset             = offset,
+        .data               = readProviderBuffer,
+        .maxLen             = capacity,
+        .len                = 0,
+        .authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS
+    };
+    entry.provider.call(&params);
+
+    ble_gatts_rw_authorize_reply_params_t reply = {
+        .type = BLE_GATTS_AUTHORIZE_TYPE_READ,
+        .params = {
+            .read = {
+                .gatt_status = static_cast<uint16_t>(params.authorizationReply)
+            }
+        }
+    };
+    if (params.authorizationReply == AUTH_CALLBACK_REPLY_SUCCESS) {
+        reply.params.read.update = 1;
+        reply.params.read.offset = offset;
+        reply.params.read.len    = (params.len < capacity) ? params.len : capacity;
+        reply.params.read.p_data = readProviderBuffer;
+    }
+
+    BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTS_RW_AUTHORIZE_REPLY, sd_ble_gatts_rw_authorize_reply(connectionHandle, &reply));
+}
+
+/**************************************************************************/
+/*!
+    @brief  Lend a free block of the queued-writes pool to the SoftDevice so
+            that a peer can use prepared writes (long and reliable writes).
+*/
+/**************************************************************************/
+void nRF5xGattServer::replyUserMemRequest(Gap::Handle_t connectionHandle, uint8_t type)
+{
+    ble_user_mem_block_t        block;
+    const ble_user_mem_block_t *reply = NULL; /* Without memory, the SoftDevice rejects the prepared writes. */
+
+    if (type == BLE_USER_MEM_TYPE_GATTS_QUEUED_WRITES) {
+        for (unsigned i = 0; i < QUEUED_WRITES_BLOCKS; i++) {
+            if (queuedWritesOwners[i] == BLE_CONN_HANDLE_INVALID) {
+                queuedWritesOwners[i] = connectionHandle;
+                block.p_mem = reinterpret_cast<uint8_t *>(queuedWritesPool[i]);
+                block.len   = sizeof(queuedWritesPool[i]);
+                reply       = &block;
+                break;
+            }
+        }
+    }
+
+    sd_ble_user_mem_reply(connectionHandle, reply);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return the blocks lent for a connection to the pool; all of them
+            if connectionHandle is BLE_CONN_HANDLE_INVALID.
+*/
+/**************************************************************************/
+void nRF5xGattServer::releaseUserMem(Gap::Handle_t connectionHandle)
+{
+    for (unsigned i = 0; i < QUEUED_WRITES_BLOCKS; i++) {
+        if ((connectionHandle == BLE_CONN_HANDLE_INVALID) || (queuedWritesOwners[i] == connectionHandle)) {
+            queuedWritesOwners[i] = BLE_CONN_HANDLE_INVALID;
+        }
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  The SoftDevice has applied the queued writes of a connection to
+            the attribute values. It leaves them in the lent block as a list
+            of {handle, offset, length, data} records terminated by an
+            invalid handle; contiguous fragments of the same attribute are
+            merged in place so that each written range is reported at once.
+*/
+/**************************************************************************/
+void nRF5xGattServer::processQueuedWrites(Gap::Handle_t connectionHandle)
+{
+    uint8_t *block = NULL;
+    for (unsigned i = 0; i < QUEUED_WRITES_BLOCKS; i++) {
+        if (queuedWritesOwners[i] == connectionHandle) {
+            block = reinterpret_cast<uint8_t *>(queuedWritesPool[i]);
+            break;
+        }
+    }
+    if (block == NULL) {
+        return;
+    }
+
+    const unsigned  RECORD_HEADER_SIZE = 6;
+    const uint8_t  *end                = block + QUEUED_WRITES_BLOCK_SIZE;
+    const uint8_t  *record             = block;
+
+    GattAttribute::Handle_t runHandle = BLE_GATT_HANDLE_INVALID;
+    uint16_t                runOffset = 0;
+    uint16_t                runLength = 0;
+    uint8_t                *runData   = NULL;
+
+    while ((record + RECORD_HEADER_SIZE) <= end) {
+        GattAttribute::Handle_t handle = (record[1] << 8) | record[0]; /* Little Endian but M0 may be mis-aligned */
+        if (handle == BLE_GATT_HANDLE_INVALID) {
+            break;
+        }
+        uint16_t offset = (record[3] << 8) | record[2];
+        uint16_t length = (record[5] << 8) | record[4];
+        uint8_t *data   = const_cast<uint8_t *>(record) + RECORD_HEADER_SIZE;
+        if ((data + length) > end) {
+            break;
+        }
+
+        if ((runData != NULL) && (handle == runHandle) && (offset == (runOffset + runLength))) {
+            /* Slide the fragment over its header so that it follows the previous one. */
+            memmove(runData + runLength, data, length);
+            runLength += length;
+        } else {
+            if (runData != NULL) {
+                dispatchQueuedWrite(connectionHandle, runHandle, runOffset, runData, runLength);
+            }
+            runHandle = handle;
+            runOffset = offset;
+            runLength = length;
+            runData   = data;
+        }
+
+        record = data + length;
+    }
+
+    if (runData != NULL) {
+        dispatchQueuedWrite(connectionHandle, runHandle, runOffset, runData, runLength);
+    }
+}
+
+void nRF5xGattServer::dispatchQueuedWrite(Gap::Handle_t connectionHandle, GattAttribute::Handle_t handle, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+    if (resolveValueHandleToCharIndex(handle) == -1) {
+        return;
+    }
+
+    IngressChannel_t *channel = getIngressChannel(handle);
+    if (channel != NULL) {
+        pushIngress(*channel, connectionHandle, data, len);
+        return;
+    }
+
+    GattWriteCallbackParams cbParams = {
+        .connHandle = connectionHandle,
+        .handle     = handle,
+        .writeOp    = static_cast<GattWriteCallbackParams::WriteOp_t>(BLE_GATTS_OP_EXEC_WRITE_REQ_NOW),
+        .offset     = offset,
+        .len        = len,
+        .data       = data
+    };
+    handleDataWrittenEvent(&cbParams);
+}
+
 /**************************************************************************/
 /*!
     @brief  Clear nRF5xGattServer's state.
@@ -354,6 +1013,28 @@ ble_error_t nRF5xGattServer::reset(void)
     memset(nrfDescriptorHandles,     0, sizeof(nrfDescriptorHandles));
     descriptorCount = 0;
 
+    memset(attributeHandleMap,       0, sizeof(attributeHandleMap));
+    attributeHandleMapBase     = BLE_GATT_HANDLE_INVALID;
+    attributeHandleMapOverflow = false;
+
+    notificationQueue.reset();
+    notificationQueueEnabled = false;
+    memset(notificationCoalescing,   0, sizeof(notificationCoalescing));
+
+    broadcastUpdatesEnabled = false;
+    resetCCCDCache();
+
+    memset(userLocatedValues,        0, sizeof(userLocatedValues));
+    memset(pendingUserLocatedValues, 0, sizeof(pendingUserLocatedValues));
+
+    resetIngressChannels();
+    abortStreams(BLE_CONN_HANDLE_INVALID);
+    for (unsigned i = 0; i < MAX_READ_PROVIDERS; i++) {
+        readProviders[i].characteristic = NULL;
+        readProviders[i].provider       = ReadProvider_t();
+    }
+    releaseUserMem(BLE_CONN_HANDLE_INVALID);
+
     return BLE_ERROR_NONE;
 }
 
@@ -372,14 +1053,23 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
         case BLE_GATTS_EVT_WRITE: {
                 /* There are 2 use case here: Values being updated & CCCD (indicate/notify) enabled */
 
+                /* Queued writes have already been applied; the values are in the block lent to the SoftDevice. */
+                if (gattsEventP->params.write.op == BLE_GATTS_OP_EXEC_WRITE_REQ_NOW) {
+                    processQueuedWrites(gattsEventP->conn_handle);
+                    return;
+                }
+
                 /* 1.) Handle CCCD changes */
                 handle_value = gattsEventP->params.write.handle;
-                int characteristicIndex = resolveCCCDHandleToCharIndex(handle_value);
-                if ((characteristicIndex != -1) &&
+                bool isCCCD;
+                int characteristicIndex = resolveAttributeHandleToCharIndex(handle_value, &isCCCD);
+                if ((characteristicIndex != -1) && isCCCD &&
                     (p_characteristics[characteristicIndex]->getProperties() &
                         (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY))) {
 
                     uint16_t cccd_value = (gattsEventP->params.write.data[1] << 8) | gattsEventP->params.write.data[0]; /* Little Endian but M0 may be mis-aligned */
+                    updateCachedCCCD(gattsEventP->conn_handle, characteristicIndex, cccd_value);
+                    btle_noteSystemAttributesWritten(gattsEventP->conn_handle);
 
                     if (((p_characteristics[characteristicIndex]->getProperties() & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE) && (cccd_value & BLE_GATT_HVX_INDICATION)) ||
                         ((p_characteristics[characteristicIndex]->getProperties() & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY) && (cccd_value & BLE_GATT_HVX_NOTIFICATION))) {
@@ -398,18 +1088,39 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
             break;
 
         case BLE_GATTS_EVT_HVC:
-            /* Indication confirmation received */
+            /* Indication confirmation received; a queued indication may now be sent. */
+            notificationQueue.drain();
             eventType    = GattServerEvents::GATT_EVENT_CONFIRMATION_RECEIVED;
             handle_value = gattsEventP->params.hvc.handle;
             break;
 
         case BLE_EVT_TX_COMPLETE: {
+            /* Refill the freed TX buffers before letting the application send more. */
+            notificationQueue.drain();
+            pumpStreams();
             handleDataSentEvent(p_ble_evt->evt.common_evt.params.tx_complete.count);
             return;
         }
 
+        case BLE_GAP_EVT_DISCONNECTED:
+            btle_storeSystemAttributes(p_ble_evt->evt.gap_evt.conn_handle);
+            notificationQueue.purge(p_ble_evt->evt.gap_evt.conn_handle);
+            releaseConnectionCCCDs(p_ble_evt->evt.gap_evt.conn_handle);
+            releaseUserMem(p_ble_evt->evt.gap_evt.conn_handle);
+            abortStreams(p_ble_evt->evt.gap_evt.conn_handle);
+            return;
+
+        case BLE_EVT_USER_MEM_REQUEST:
+            replyUserMemRequest(p_ble_evt->evt.common_evt.conn_handle, p_ble_evt->evt.common_evt.params.user_mem_request.type);
+            return;
+
+        case BLE_EVT_USER_MEM_RELEASE:
+            releaseUserMem(p_ble_evt->evt.common_evt.conn_handle);
+            return;
+
         case BLE_GATTS_EVT_SYS_ATTR_MISSING:
-            sd_ble_gatts_sys_attr_set(gattsEventP->conn_handle, NULL, 0, 0);
+            btle_restoreSystemAttributes(gattsEventP->conn_handle);
+            reloadCachedCCCDs(gattsEventP->conn_handle);
             return;
 
         case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
@@ -439,6 +1150,14 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
     /* Find index (charHandle) in the pool */
     switch (eventType) {
         case GattServerEvents::GATT_EVENT_DATA_WRITTEN: {
+            if ((gattsEventP->params.write.op == BLE_GATTS_OP_WRITE_CMD) || (gattsEventP->params.write.op == BLE_GATTS_OP_WRITE_REQ)) {
+                IngressChannel_t *channel = getIngressChannel(handle_value);
+                if (channel != NULL) {
+                    pushIngress(*channel, gattsEventP->conn_handle, gattsEventP->params.write.data, gattsEventP->params.write.len);
+                    break;
+                }
+            }
+
             GattWriteCallbackParams cbParams = {
                 .connHandle = gattsEventP->conn_handle,
                 .handle     = handle_value,
@@ -469,7 +1188,7 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
                     }
                 }
             };
-            sd_ble_gatts_rw_authorize_reply(gattsEventP->conn_handle, &reply);
+            BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTS_RW_AUTHORIZE_REPLY, sd_ble_gatts_rw_authorize_reply(gattsEventP->conn_handle, &reply));
 
             /*
              * If write-authorization is enabled for a characteristic,
@@ -492,6 +1211,12 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
             break;
         }
         case GattServerEvents::GATT_EVENT_READ_AUTHORIZATION_REQ: {
+            ReadProviderEntry_t *entry = getReadProvider(p_characteristics[characteristicIndex]);
+            if (entry != NULL) {
+                replyFromReadProvider(*entry, gattsEventP->conn_handle, handle_value, gattsEventP->params.authorize_request.request.read.offset);
+                break;
+            }
+
             GattReadAuthCallbackParams cbParams = {
                 .connHandle         = gattsEventP->conn_handle,
                 .handle             = handle_value,
@@ -521,7 +1246,7 @@ void nRF5xGattServer::hwCallback(ble_evt_t *p_ble_evt)
                 }
             }
 
-            sd_ble_gatts_rw_authorize_reply(gattsEventP->conn_handle, &reply);
+            BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTS_RW_AUTHORIZE_REPLY, sd_ble_gatts_rw_authorize_reply(gattsEventP->conn_handle, &reply));
             break;
         }
 
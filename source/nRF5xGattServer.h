@@ -23,6 +23,78 @@
 #include "nrf_ble.h" /* nordic ble */
 #include "ble/Gap.h"
 #include "ble/GattServer.h"
+#include "nRF5xNotificationQueue.h"
+#include "nRF5xIngressBuffer.h"
+#include "nRF5xGattStream.h"
+
+/*
+ * Capacity of the GATT server. Every characteristic costs about 17 bytes of
+ * RAM, plus 2 bits per cached connection, and every descriptor 7 bytes,
+ * whether they are used or not. The resulting size of the GATT server is
+ * available as nRF5xGattServerFootprint; defining
+ * YOTTA_CFG_NRF5X_GATTS_MAX_FOOTPRINT makes the build fail if it is exceeded.
+ */
+#ifndef YOTTA_CFG_NRF5X_GATTS_MAX_CHARACTERISTICS
+    #define YOTTA_CFG_NRF5X_GATTS_MAX_CHARACTERISTICS 20
+#endif
+#ifndef YOTTA_CFG_NRF5X_GATTS_MAX_DESCRIPTORS
+    #define YOTTA_CFG_NRF5X_GATTS_MAX_DESCRIPTORS 8
+#endif
+
+#if (YOTTA_CFG_NRF5X_GATTS_MAX_CHARACTERISTICS > 126)
+    #error "YOTTA_CFG_NRF5X_GATTS_MAX_CHARACTERISTICS must not exceed 126 (the attribute-handle lookup table stores 7-bit indices)"
+#endif
+#if (YOTTA_CFG_NRF5X_GATTS_MAX_DESCRIPTORS > 255)
+    #error "YOTTA_CFG_NRF5X_GATTS_MAX_DESCRIPTORS must not exceed 255"
+#endif
+
+/* Number of attributes which can be marked user-located ahead of their service being added. */
+#ifndef YOTTA_CFG_NRF5X_GATTS_PENDING_USER_LOCATED_VALUES
+    #define YOTTA_CFG_NRF5X_GATTS_PENDING_USER_LOCATED_VALUES 4
+#endif
+
+/*
+ * Memory pool lent to the SoftDevice for queued (prepared) writes: number of
+ * peers which can have queued writes in progress at the same time, and bytes
+ * available to each of them. Every prepared fragment takes 6 bytes of header
+ * in addition to its data.
+ */
+#ifndef YOTTA_CFG_NRF5X_GATTS_QUEUED_WRITES_BLOCKS
+    #define YOTTA_CFG_NRF5X_GATTS_QUEUED_WRITES_BLOCKS 1
+#endif
+#ifndef YOTTA_CFG_NRF5X_GATTS_QUEUED_WRITES_BLOCK_SIZE
+    #define YOTTA_CFG_NRF5X_GATTS_QUEUED_WRITES_BLOCK_SIZE 128
+#endif
+
+/* Number of characteristics which can have their writes accumulated in an ingress buffer. */
+#ifndef YOTTA_CFG_NRF5X_GATTS_INGRESS_BUFFERS
+    #define YOTTA_CFG_NRF5X_GATTS_INGRESS_BUFFERS 2
+#endif
+
+/*
+ * Number of characteristics whose reads can be served by a read provider,
+ * and size of the buffer the providers fill (one ATT_MTU worth of value).
+ */
+#ifndef YOTTA_CFG_NRF5X_GATTS_READ_PROVIDERS
+    #define YOTTA_CFG_NRF5X_GATTS_READ_PROVIDERS 2
+#endif
+#ifndef YOTTA_CFG_NRF5X_GATTS_READ_PROVIDER_BUFFER_SIZE
+    #define YOTTA_CFG_NRF5X_GATTS_READ_PROVIDER_BUFFER_SIZE (GATT_MTU_SIZE_DEFAULT - 1)
+#endif
+
+/* Number of nRF5xGattStream transfers which can be in progress at the same time. */
+#ifndef YOTTA_CFG_NRF5X_GATTS_STREAMS
+    #define YOTTA_CFG_NRF5X_GATTS_STREAMS 2
+#endif
+
+/* Number of connections for which the CCCD state of the characteristics is cached. */
+#ifndef YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS
+    #if defined(TARGET_MCU_NRF51_16K_S110) || defined(TARGET_MCU_NRF51_32K_S110)
+        #define YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS 1
+    #else
+        #define YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS 4
+    #endif
+#endif
 
 class nRF5xGattServer : public GattServer
 {
@@ -40,45 +112,398 @@ public:
     /* nRF51 Functions */
     void eventCallback(void);
     void hwCallback(ble_evt_t *p_ble_evt);
+    void reloadCachedCCCDs(Gap::Handle_t connectionHandle);
+
+    /**
+     * Enable or disable the notification queue. When enabled, a notification
+     * or indication which can't be sent immediately because the SoftDevice
+     * is out of TX buffers is queued by write() instead of failing with
+     * BLE_STACK_BUSY; queued values are sent as TX buffers are released.
+     * @note Disabling the queue discards the values still queued.
+     */
+    void enableNotificationQueue(bool enable = true) {
+        notificationQueueEnabled = enable;
+        if (!enable) {
+            notificationQueue.reset();
+        }
+    }
+
+    /**
+     * Select latest-value-wins behaviour for the queued updates of a
+     * characteristic: a new value replaces the one still waiting in the
+     * queue for the same connection instead of being queued after it.
+     * @param  valueHandle value handle of the characteristic.
+     * @param  coalesce    true to coalesce queued updates.
+     * @return BLE_ERROR_INVALID_PARAM if valueHandle isn't a characteristic value handle.
+     */
+    ble_error_t setNotificationCoalescing(GattAttribute::Handle_t valueHandle, bool coalesce);
+
+    const nRF5xNotificationQueue::Statistics_t &getNotificationQueueStatistics(void) const {
+        return notificationQueue.getStatistics();
+    }
+
+    void resetNotificationQueueStatistics(void) {
+        notificationQueue.resetStatistics();
+    }
+
+    /**
+     * Enable or disable broadcast of updates. When enabled, a write() to a
+     * notifiable or indicatable characteristic with BLE_CONN_HANDLE_INVALID
+     * as connection handle updates the value and sends it to every connected
+     * peer which has subscribed to it, rather than only to the connection
+     * last reported by Gap.
+     */
+    void enableBroadcastUpdates(bool enable = true) {
+        broadcastUpdatesEnabled = enable;
+    }
+
+    /**
+     * Have the SoftDevice use the application's buffer for the value of an
+     * attribute (BLE_GATTS_VLOC_USER) instead of keeping a copy of it in its
+     * attribute table. Local updates of fixed-length characteristic values
+     * then become plain memory writes.
+     *
+     * @note Must be called before the service holding the attribute is
+     *       added. The value buffer must hold getMaxLength() bytes and stay
+     *       valid for as long as the GATT server is in use; the SoftDevice
+     *       reads and writes it directly.
+     *
+     * @param  attribute the value attribute of a characteristic, or one of its descriptors.
+     * @return BLE_ERROR_NO_MEM if too many attributes are pending.
+     */
+    ble_error_t setUserLocatedValue(const GattAttribute &attribute);
+
+    /**
+     * Watermark notification of an ingress buffer.
+     */
+    struct IngressEvent_t {
+        Gap::Handle_t           connHandle; /**< Connection which wrote last. */
+        GattAttribute::Handle_t handle;     /**< Value handle of the characteristic. */
+        uint16_t                available;  /**< Number of bytes waiting to be read. */
+        bool                    aboveHighWatermark; /**< true when the high watermark has been reached, false once the buffer has drained to the low watermark. */
+    };
+    typedef FunctionPointerWithContext<const IngressEvent_t *> IngressCallback_t;
+
+    /**
+     * Accumulate the values written to a characteristic (with write commands
+     * or write requests) in a ring buffer, instead of reporting every write
+     * through onDataWritten(). The application then pulls the data with
+     * readIngress().
+     *
+     * @param valueHandle    Value handle of the characteristic.
+     * @param storage        Memory backing the buffer; NULL to stop buffering.
+     * @param size           Size of storage.
+     * @param highWatermark  Fill level at which callback is invoked with
+     *                       aboveHighWatermark set.
+     * @param lowWatermark   Fill level at which callback is invoked again,
+     *                       once the high watermark has been reached.
+     * @param callback       Watermark callback; may be empty.
+     * @param throttleParams If not NULL, connection parameters requested from
+     *                       the central while the buffer is above its high
+     *                       watermark, to slow down the incoming traffic; the
+     *                       preferred connection parameters are requested
+     *                       again at the low watermark.
+     *
+     * @return BLE_ERROR_INVALID_PARAM if valueHandle isn't a characteristic
+     *         value handle, BLE_ERROR_NO_MEM if all the ingress buffers are
+     *         in use.
+     *
+     * @note Written data which doesn't fit in the buffer is dropped and
+     *       counted by getIngressOverruns().
+     */
+    ble_error_t setIngressBuffer(GattAttribute::Handle_t        valueHandle,
+                                 uint8_t                       *storage,
+                                 uint16_t                       size,
+                                 uint16_t                       highWatermark,
+                                 uint16_t                       lowWatermark,
+                                 const IngressCallback_t       &callback,
+                                 const Gap::ConnectionParams_t *throttleParams = NULL);
 
+    /**
+     * Pull data accumulated in the ingress buffer of a characteristic.
+     * @return the number of bytes copied into buffer.
+     */
+    uint16_t readIngress(GattAttribute::Handle_t valueHandle, uint8_t *buffer, uint16_t length);
+
+    /**
+     * @return the number of bytes waiting in the ingress buffer of a characteristic.
+     */
+    uint16_t getIngressAvailable(GattAttribute::Handle_t valueHandle) const;
+
+    /**
+     * @return the number of bytes dropped because the ingress buffer of a characteristic was full.
+     */
+    uint32_t getIngressOverruns(GattAttribute::Handle_t valueHandle) const;
+
+    /**
+     * Request passed to a read provider. The provider writes the value to
+     * return, starting at offset, into data and sets len.
+     */
+    struct ReadProviderParams_t {
+        Gap::Handle_t           connHandle;
+        GattAttribute::Handle_t handle;  /**< Value handle of the characteristic. */
+        uint16_t                offset;  /**< Offset requested by the peer; non-zero for the continuation of a long read. */
+        uint8_t                *data;    /**< Reply buffer owned by the GATT server. */
+        uint16_t                maxLen;  /**< Capacity of data. */
+        uint16_t                len;     /**< Set by the provider to the number of bytes written to data. */
+        GattAuthCallbackReply_t authorizationReply; /**< Left to AUTH_CALLBACK_REPLY_SUCCESS if the read is to proceed. */
+    };
+    typedef FunctionPointerWithContext<ReadProviderParams_t *> ReadProvider_t;
+
+    /**
+     * Compute the value of a characteristic when a peer reads it. The
+     * provider fills a reply buffer which is handed to the SoftDevice along
+     * with the read authorization reply, so the value doesn't need to be set
+     * beforehand.
+     *
+     * @note Read authorization is enabled for the characteristic if the
+     *       provider is set before its service is added. Afterwards, only
+     *       characteristics which already have read authorization enabled
+     *       can take a provider.
+     *
+     * @param  characteristic the characteristic to serve.
+     * @param  provider       the provider; an empty one removes it.
+     * @return BLE_ERROR_INVALID_STATE if the characteristic has been added
+     *         without read authorization, BLE_ERROR_NO_MEM if all the
+     *         providers are in use.
+     */
+    ble_error_t setReadProvider(GattCharacteristic &characteristic, const ReadProvider_t &provider);
 
 private:
-    const static unsigned BLE_TOTAL_CHARACTERISTICS = 20;
-    const static unsigned BLE_TOTAL_DESCRIPTORS     = 8;
+    const static unsigned BLE_TOTAL_CHARACTERISTICS = YOTTA_CFG_NRF5X_GATTS_MAX_CHARACTERISTICS;
+    const static unsigned BLE_TOTAL_DESCRIPTORS     = YOTTA_CFG_NRF5X_GATTS_MAX_DESCRIPTORS;
+
+    /*
+     * Number of entries in the attribute-handle lookup table. The SoftDevice
+     * allocates handles densely and in order, so the attributes added through
+     * addService() occupy a contiguous range: at most four handles per
+     * characteristic (declaration, value, CCCD and user description), one per
+     * additional descriptor, plus some room for the service declarations.
+     */
+    const static unsigned BLE_TOTAL_ATTRIBUTE_HANDLES = (BLE_TOTAL_CHARACTERISTICS * 4) + BLE_TOTAL_DESCRIPTORS + 8;
+
+    /*
+     * Layout of an entry in the attribute-handle lookup table: the low bits
+     * hold (characteristic index + 1), zero meaning that the handle doesn't
+     * belong to a characteristic value or CCCD; the top bit is set for CCCDs.
+     */
+    const static uint8_t HANDLE_MAP_CCCD_FLAG       = 0x80;
+    const static uint8_t HANDLE_MAP_CHAR_INDEX_MASK = 0x7F;
+
+    const static unsigned CHARACTERISTIC_BITSET_SIZE = (BLE_TOTAL_CHARACTERISTICS + 7) / 8;
+    const static unsigned MAX_CONNECTIONS            = YOTTA_CFG_NRF5X_GATTS_MAX_CONNECTIONS;
+
+    const static unsigned MAX_PENDING_USER_LOCATED_VALUES = YOTTA_CFG_NRF5X_GATTS_PENDING_USER_LOCATED_VALUES;
+
+    const static unsigned MAX_INGRESS_BUFFERS = YOTTA_CFG_NRF5X_GATTS_INGRESS_BUFFERS;
+
+    const static unsigned MAX_READ_PROVIDERS        = YOTTA_CFG_NRF5X_GATTS_READ_PROVIDERS;
+    const static unsigned READ_PROVIDER_BUFFER_SIZE = YOTTA_CFG_NRF5X_GATTS_READ_PROVIDER_BUFFER_SIZE;
+
+    const static unsigned MAX_STREAMS = YOTTA_CFG_NRF5X_GATTS_STREAMS;
+
+    const static unsigned QUEUED_WRITES_BLOCKS     = YOTTA_CFG_NRF5X_GATTS_QUEUED_WRITES_BLOCKS;
+    const static unsigned QUEUED_WRITES_BLOCK_SIZE = (YOTTA_CFG_NRF5X_GATTS_QUEUED_WRITES_BLOCK_SIZE + 3) & ~3;
+
+    struct IngressChannel_t {
+        GattAttribute::Handle_t        valueHandle; /**< BLE_GATT_HANDLE_INVALID if the channel is free. */
+        nRF5xIngressBuffer             buffer;
+        uint16_t                       highWatermark;
+        uint16_t                       lowWatermark;
+        bool                           aboveHighWatermark;
+        Gap::Handle_t                  connectionHandle;
+        const Gap::ConnectionParams_t *throttleParams;
+        uint32_t                       overruns;
+        IngressCallback_t              callback;
+    };
+
+    struct ReadProviderEntry_t {
+        const GattCharacteristic *characteristic; /**< NULL if the entry is free. */
+        ReadProvider_t            provider;
+    };
+
+    /*
+     * CCCD state of the characteristics for a connection, as last written by
+     * the peer; one bit per characteristic index.
+     */
+    struct ConnectionCCCDs_t {
+        Gap::Handle_t connectionHandle; /**< BLE_CONN_HANDLE_INVALID if the slot is free. */
+        uint8_t       notify[CHARACTERISTIC_BITSET_SIZE];
+        uint8_t       indicate[CHARACTERISTIC_BITSET_SIZE];
+    };
 
 private:
     /**
-     * resolve a value attribute to its owning characteristic.
-     * @param  valueHandle the value handle to be resolved.
-     * @return             characteristic index if a resolution is found, else -1.
+     * Record an attribute handle of a characteristic in the lookup table.
+     * @param handle    the attribute handle.
+     * @param charIndex index of the owning characteristic.
+     * @param isCCCD    true if the handle is the characteristic's CCCD, false
+     *                  if it is the characteristic's value.
      */
-    int resolveValueHandleToCharIndex(GattAttribute::Handle_t valueHandle) const {
-        unsigned charIndex;
-        for (charIndex = 0; charIndex < characteristicCount; charIndex++) {
-            if (nrfCharacteristicHandles[charIndex].value_handle == valueHandle) {
-                return charIndex;
+    void mapAttributeHandle(GattAttribute::Handle_t handle, unsigned charIndex, bool isCCCD) {
+        if (handle == BLE_GATT_HANDLE_INVALID) {
+            return;
+        }
+        if ((handle < attributeHandleMapBase) || ((unsigned)(handle - attributeHandleMapBase) >= BLE_TOTAL_ATTRIBUTE_HANDLES)) {
+            /* Lookups for this handle will fall back to a linear search. */
+            attributeHandleMapOverflow = true;
+            return;
+        }
+
+        attributeHandleMap[handle - attributeHandleMapBase] = (uint8_t)(charIndex + 1) | (isCCCD ? HANDLE_MAP_CCCD_FLAG : 0);
+    }
+
+    /**
+     * resolve an attribute handle to its owning characteristic in constant time.
+     * @param  handle  the attribute handle to be resolved.
+     * @param  isCCCDP set to true if the handle is a CCCD and false if it is a
+     *                 characteristic value; only valid if a resolution is found.
+     * @return         characteristic index if a resolution is found, else -1.
+     */
+    int resolveAttributeHandleToCharIndex(GattAttribute::Handle_t handle, bool *isCCCDP) const {
+        if ((handle >= attributeHandleMapBase) && ((unsigned)(handle - attributeHandleMapBase) < BLE_TOTAL_ATTRIBUTE_HANDLES)) {
+            uint8_t entry = attributeHandleMap[handle - attributeHandleMapBase];
+            if (entry != 0) {
+                *isCCCDP = (entry & HANDLE_MAP_CCCD_FLAG) != 0;
+                return (entry & HANDLE_MAP_CHAR_INDEX_MASK) - 1;
+            }
+        }
+
+        if (attributeHandleMapOverflow) {
+            unsigned charIndex;
+            for (charIndex = 0; charIndex < characteristicCount; charIndex++) {
+                if (nrfCharacteristicHandles[charIndex].value_handle == handle) {
+                    *isCCCDP = false;
+                    return charIndex;
+                }
+                if (nrfCharacteristicHandles[charIndex].cccd_handle == handle) {
+                    *isCCCDP = true;
+                    return charIndex;
+                }
             }
         }
 
         return -1;
     }
 
+    /**
+     * resolve a value attribute to its owning characteristic.
+     * @param  valueHandle the value handle to be resolved.
+     * @return             characteristic index if a resolution is found, else -1.
+     */
+    int resolveValueHandleToCharIndex(GattAttribute::Handle_t valueHandle) const {
+        bool isCCCD;
+        int charIndex = resolveAttributeHandleToCharIndex(valueHandle, &isCCCD);
+        return ((charIndex != -1) && !isCCCD) ? charIndex : -1;
+    }
+
     /**
      * resolve a CCCD attribute handle to its owning characteristic.
      * @param  cccdHandle the CCCD handle to be resolved.
      * @return             characteristic index if a resolution is found, else -1.
      */
     int resolveCCCDHandleToCharIndex(GattAttribute::Handle_t cccdHandle) const {
-        unsigned charIndex;
-        for (charIndex = 0; charIndex < characteristicCount; charIndex++) {
-            if (nrfCharacteristicHandles[charIndex].cccd_handle == cccdHandle) {
-                return charIndex;
-            }
-        }
+        bool isCCCD;
+        int charIndex = resolveAttributeHandleToCharIndex(cccdHandle, &isCCCD);
+        return ((charIndex != -1) && isCCCD) ? charIndex : -1;
+    }
 
-        return -1;
+    static bool isBitSet(const uint8_t bitset[], unsigned charIndex) {
+        return (bitset[charIndex / 8] & (1 << (charIndex % 8))) != 0;
     }
 
+    static void assignBit(uint8_t bitset[], unsigned charIndex, bool value) {
+        if (value) {
+            bitset[charIndex / 8] |= (1 << (charIndex % 8));
+        } else {
+            bitset[charIndex / 8] &= ~(1 << (charIndex % 8));
+        }
+    }
+
+    /**
+     * Look up the cached CCCD state of a connection.
+     * @param  connectionHandle the connection.
+     * @param  allocate         claim a free slot if the connection has none.
+     * @return                  the cache slot, or NULL if there isn't any.
+     */
+    ConnectionCCCDs_t *getConnectionCCCDs(Gap::Handle_t connectionHandle, bool allocate);
+
+    ble_error_t readCCCD(Gap::Handle_t connectionHandle, unsigned charIndex, uint16_t *cccdValueP);
+
+    /**
+     * Remove an attribute from the pending user-located ones.
+     * @return true if the attribute is to be added as user-located.
+     */
+    bool takePendingUserLocatedValue(GattAttribute *attribute);
+
+    /**
+     * Update an attribute value locally, bypassing the SoftDevice for
+     * user-located characteristic values when possible.
+     * @return an NRF_ERROR code, as sd_ble_gatts_value_set().
+     */
+    uint32_t setValue(Gap::Handle_t connectionHandle, GattAttribute::Handle_t attributeHandle, int charIndex, const uint8_t buffer[], uint16_t len);
+
+    IngressChannel_t *getIngressChannel(GattAttribute::Handle_t valueHandle);
+    const IngressChannel_t *getIngressChannel(GattAttribute::Handle_t valueHandle) const;
+
+    /**
+     * Append written data to an ingress buffer and signal the high watermark.
+     */
+    void pushIngress(IngressChannel_t &channel, Gap::Handle_t connectionHandle, const uint8_t *data, uint16_t len);
+    void resetIngressChannels(void);
+
+    /**
+     * Track a stream with a transfer in progress, so that it is resumed when
+     * TX buffers are released.
+     * @return false if too many streams are in progress.
+     */
+    bool attachStream(nRF5xGattStream *stream);
+    void detachStream(nRF5xGattStream *stream);
+
+    /**
+     * Resume the streams waiting for TX buffers; terminate those bound to a
+     * connection which has been closed, or all of them if connectionHandle
+     * is BLE_CONN_HANDLE_INVALID.
+     */
+    void pumpStreams(void);
+    void abortStreams(Gap::Handle_t connectionHandle);
+
+    ReadProviderEntry_t *getReadProvider(const GattCharacteristic *characteristic);
+
+    /**
+     * Serve a read authorization request through a read provider.
+     */
+    void replyFromReadProvider(ReadProviderEntry_t &entry, Gap::Handle_t connectionHandle, GattAttribute::Handle_t handle, uint16_t offset);
+
+    /**
+     * Lend a block of the queued-writes pool to the SoftDevice, or refuse
+     * the request if the pool is exhausted.
+     */
+    void replyUserMemRequest(Gap::Handle_t connectionHandle, uint8_t type);
+    void releaseUserMem(Gap::Handle_t connectionHandle);
+
+    /**
+     * Report the queued writes executed on a connection, once per written
+     * range of each characteristic value.
+     */
+    void processQueuedWrites(Gap::Handle_t connectionHandle);
+    void dispatchQueuedWrite(Gap::Handle_t connectionHandle, GattAttribute::Handle_t handle, uint16_t offset, const uint8_t *data, uint16_t len);
+
+    void updateCachedCCCD(Gap::Handle_t connectionHandle, unsigned charIndex, uint16_t cccdValue);
+    void releaseConnectionCCCDs(Gap::Handle_t connectionHandle);
+    void resetCCCDCache(void);
+
+    /**
+     * Send a notification or an indication to one peer, queuing it if the
+     * notification queue is enabled and no TX buffer is available.
+     */
+    ble_error_t sendUpdate(Gap::Handle_t connectionHandle, unsigned charIndex, uint8_t type, const uint8_t buffer[], uint16_t len);
+
+    /**
+     * Send an update of a characteristic to all the connections subscribed to it.
+     */
+    ble_error_t broadcastUpdate(unsigned charIndex, const uint8_t buffer[], uint16_t len);
+
 private:
     GattCharacteristic       *p_characteristics[BLE_TOTAL_CHARACTERISTICS];
     ble_gatts_char_handles_t  nrfCharacteristicHandles[BLE_TOTAL_CHARACTERISTICS];
@@ -86,13 +511,46 @@ private:
     uint8_t                   descriptorCount;
     uint16_t                  nrfDescriptorHandles[BLE_TOTAL_DESCRIPTORS];
 
+    GattAttribute::Handle_t   attributeHandleMapBase;     /**< Handle of the first service added; the lookup table is indexed relative to it. */
+    bool                      attributeHandleMapOverflow; /**< Set if some handles didn't fit in the lookup table. */
+    uint8_t                   attributeHandleMap[BLE_TOTAL_ATTRIBUTE_HANDLES];
+
+    nRF5xNotificationQueue    notificationQueue;
+    bool                      notificationQueueEnabled;
+    uint8_t                   notificationCoalescing[CHARACTERISTIC_BITSET_SIZE]; /**< One bit per characteristic index. */
+
+    bool                      broadcastUpdatesEnabled;
+    ConnectionCCCDs_t         cccdCache[MAX_CONNECTIONS];
+    bool                      cccdCacheOverflow;          /**< Set if a connection subscribed while all the cache slots were in use. */
+
+    uint8_t                   userLocatedValues[CHARACTERISTIC_BITSET_SIZE]; /**< One bit per characteristic index. */
+    const GattAttribute      *pendingUserLocatedValues[MAX_PENDING_USER_LOCATED_VALUES];
+
+    IngressChannel_t          ingressChannels[MAX_INGRESS_BUFFERS];
+
+    nRF5xGattStream          *streams[MAX_STREAMS];
+
+    ReadProviderEntry_t       readProviders[MAX_READ_PROVIDERS];
+    uint8_t                   readProviderBuffer[READ_PROVIDER_BUFFER_SIZE];
+
+    uint32_t                  queuedWritesPool[QUEUED_WRITES_BLOCKS][QUEUED_WRITES_BLOCK_SIZE / sizeof(uint32_t)]; /**< Word-aligned, as the SoftDevice requires. */
+    Gap::Handle_t             queuedWritesOwners[QUEUED_WRITES_BLOCKS];                                        /**< BLE_CONN_HANDLE_INVALID if the block is free. */
+
     /*
      * Allow instantiation from nRF5xn when required.
      */
     friend class nRF5xn;
+    friend class nRF5xGattStream;
 
-    nRF5xGattServer() : GattServer(), p_characteristics(), nrfCharacteristicHandles(), p_descriptors(), descriptorCount(0), nrfDescriptorHandles() {
-        /* empty */
+    nRF5xGattServer() : GattServer(), p_characteristics(), nrfCharacteristicHandles(), p_descriptors(), descriptorCount(0), nrfDescriptorHandles(),
+        attributeHandleMapBase(BLE_GATT_HANDLE_INVALID), attributeHandleMapOverflow(false), attributeHandleMap(),
+        notificationQueue(), notificationQueueEnabled(false), notificationCoalescing(),
+        broadcastUpdatesEnabled(false), cccdCache(), cccdCacheOverflow(false),
+        userLocatedValues(), pendingUserLocatedValues(), ingressChannels(),
+        streams(), readProviders(), readProviderBuffer(), queuedWritesPool(), queuedWritesOwners() {
+        resetCCCDCache();
+        resetIngressChannels();
+        releaseUserMem(BLE_CONN_HANDLE_INVALID);
     }
 
 private:
@@ -100,4 +558,9 @@ private:
     const nRF5xGattServer& operator=(const nRF5xGattServer &);
 };
 
+/**
+ * RAM taken by the GATT server with the configured capacity, in bytes.
+ */
+extern const size_t nRF5xGattServerFootprint;
+
 #endif // ifndef __NRF51822_GATT_SERVER_H__
@@ -0,0 +1,198 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "nRF5xGattStream.h"
+#include "nRF5xGattServer.h"
+#ifdef YOTTA_CFG_MBED_OS
+    #include "mbed-drivers/mbed.h"
+#else
+    #include "mbed.h"
+#endif
+
+#include "ble_err.h"
+#include "btle/btle_instrumentation.h"
+
+nRF5xGattStream::nRF5xGattStream(nRF5xGattServer &_server, GattAttribute::Handle_t _valueHandle, Gap::Handle_t _connectionHandle) :
+    server(_server),
+    valueHandle(_valueHandle),
+    connectionHandle(_connectionHandle),
+    singleSegment(),
+    segments(NULL),
+    segmentCount(0),
+    segmentIndex(0),
+    segmentOffset(0),
+    bytesSent(0),
+    startTime(0),
+    callback() {
+    /* empty */
+}
+
+ble_error_t nRF5xGattStream::send(const uint8_t *data, uint32_t len, const CompletionCallback_t &_callback)
+{
+    if (isBusy()) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+
+    singleSegment.data = data;
+    singleSegment.len  = len;
+    return send(&singleSegment, 1, _callback);
+}
+
+ble_error_t nRF5xGattStream::send(const Segment_t *_segments, unsigned count, const CompletionCallback_t &_callback)
+{
+    if (isBusy()) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+    if ((_segments == NULL) && (count != 0)) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    if (!server.attachStream(this)) {
+        return BLE_ERROR_NO_MEM;
+    }
+
+    segments      = _segments;
+    segmentCount  = count;
+    segmentIndex  = 0;
+    segmentOffset = 0;
+    bytesSent     = 0;
+    startTime     = us_ticker_read();
+    callback      = _callback;
+
+    pump();
+    return BLE_ERROR_NONE;
+}
+
+void nRF5xGattStream::abort(void)
+{
+    if (isBusy()) {
+        finish(BLE_ERROR_INVALID_STATE);
+    }
+}
+
+void nRF5xGattStream::pump(void)
+{
+    uint8_t chunk[CHUNK_SIZE];
+
+    advance(0); /* Skip empty segments. */
+    while (segmentIndex < segmentCount) {
+        uint16_t len = gather(chunk);
+
+        ble_gatts_hvx_params_t hvx_params;
+        hvx_params.handle = valueHandle;
+        hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+        hvx_params.offset = 0;
+        hvx_params.p_data = chunk;
+        hvx_params.p_len  = &len; /* Updated with the length actually sent if the value is shorter. */
+
+        uint32_t rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTS_HVX, sd_ble_gatts_hvx(connectionHandle, &hvx_params));
+        switch (rc) {
+            case NRF_SUCCESS:
+                break;
+
+            case BLE_ERROR_NO_TX_BUFFERS:
+            case NRF_ERROR_BUSY:
+                return; /* The server calls back on BLE_EVT_TX_COMPLETE. */
+
+            case NRF_ERROR_INVALID_STATE:
+            case BLE_ERROR_GATTS_SYS_ATTR_MISSING:
+                finish(BLE_ERROR_INVALID_STATE); /* Notifications not enabled by the peer, or the link has gone. */
+                return;
+
+            case NRF_ERROR_INVALID_PARAM:
+            case BLE_ERROR_INVALID_CONN_HANDLE:
+                finish(BLE_ERROR_INVALID_PARAM);
+                return;
+
+            default:
+                finish(BLE_ERROR_UNSPECIFIED);
+                return;
+        }
+
+        if (len == 0) {
+            finish(BLE_ERROR_PARAM_OUT_OF_RANGE); /* The characteristic value can't hold any data. */
+            return;
+        }
+
+        bytesSent += len;
+        advance(len);
+    }
+
+    finish(BLE_ERROR_NONE);
+}
+
+uint16_t nRF5xGattStream::gather(uint8_t *chunk) const
+{
+    uint16_t len    = 0;
+    unsigned index  = segmentIndex;
+    uint32_t offset = segmentOffset;
+
+    while ((len < CHUNK_SIZE) && (index < segmentCount)) {
+        uint32_t n = segments[index].len - offset;
+        if (n > (CHUNK_SIZE - len)) {
+            n = CHUNK_SIZE - len;
+        }
+        memcpy(&chunk[len], segments[index].data + offset, n);
+        len    += n;
+        offset += n;
+
+        if (offset == segments[index].len) {
+            index++;
+            offset = 0;
+        }
+    }
+
+    return len;
+}
+
+void nRF5xGattStream::advance(uint32_t len)
+{
+    while (segmentIndex < segmentCount) {
+        uint32_t n = segments[segmentIndex].len - segmentOffset;
+        if (n > len) {
+            segmentOffset += len;
+            return;
+        }
+
+        len          -= n;
+        segmentIndex++;
+        segmentOffset = 0;
+    }
+}
+
+void nRF5xGattStream::finish(ble_error_t status)
+{
+    Completion_t completion = {
+        .connHandle     = connectionHandle,
+        .handle         = valueHandle,
+        .status         = status,
+        .bytesSent      = bytesSent,
+        .durationUs     = us_ticker_read() - startTime,
+        .bytesPerSecond = 0
+    };
+    if (completion.durationUs != 0) {
+        completion.bytesPerSecond = (uint32_t)(((uint64_t)bytesSent * 1000000) / completion.durationUs);
+    }
+
+    /* Go idle first, so that the callback can start the next transfer. */
+    server.detachStream(this);
+    segments = NULL;
+
+    CompletionCallback_t completionCallback = callback;
+    completionCallback.call(&completion);
+}
@@ -0,0 +1,144 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NRF5x_GATT_STREAM_H__
+#define __NRF5x_GATT_STREAM_H__
+
+#include <stddef.h>
+
+#include "ble/blecommon.h"
+#include "ble/Gap.h"
+#include "ble/GattAttribute.h"
+#include "ble/FunctionPointerWithContext.h"
+#include "nrf_ble.h"
+
+class nRF5xGattServer;
+
+/**
+ * @brief Sends a large buffer to a peer as a sequence of notifications of a
+ * characteristic.
+ * @details The data is cut into chunks of the largest notification payload.
+ * The stream hands chunks to the SoftDevice until it runs out of TX buffers,
+ * then resumes when they are released (BLE_EVT_TX_COMPLETE). The buffers
+ * passed to send() are read in place and must stay valid until completion.
+ */
+class nRF5xGattStream
+{
+public:
+    /**
+     * Payload of a notification; the ATT_MTU is fixed to its default value by
+     * the SoftDevice.
+     */
+    static const unsigned CHUNK_SIZE = BLE_GATT_ATT_MTU_DEFAULT - 3;
+
+    /**
+     * Element of a scatter list.
+     */
+    struct Segment_t {
+        const uint8_t *data;
+        uint32_t       len;
+    };
+
+    /**
+     * Outcome of a transfer.
+     */
+    struct Completion_t {
+        Gap::Handle_t           connHandle;
+        GattAttribute::Handle_t handle;
+        ble_error_t             status;         /**< BLE_ERROR_NONE once all the data has been handed to the SoftDevice. */
+        uint32_t                bytesSent;
+        uint32_t                durationUs;     /**< Time from send() to the last chunk being accepted. */
+        uint32_t                bytesPerSecond;
+    };
+    typedef FunctionPointerWithContext<const Completion_t *> CompletionCallback_t;
+
+public:
+    /**
+     * @param server           The GATT server holding the characteristic.
+     * @param valueHandle      Value handle of a characteristic with the notify property.
+     * @param connectionHandle The connection to stream to.
+     */
+    nRF5xGattStream(nRF5xGattServer &server, GattAttribute::Handle_t valueHandle, Gap::Handle_t connectionHandle);
+
+    /**
+     * Start sending a buffer.
+     *
+     * @return BLE_ERROR_INVALID_STATE if a transfer is in progress,
+     *         BLE_ERROR_NO_MEM if the server can't track more streams.
+     *         Failures happening after the transfer has started are
+     *         reported through the completion callback.
+     */
+    ble_error_t send(const uint8_t *data, uint32_t len, const CompletionCallback_t &callback);
+
+    /**
+     * Start sending the concatenation of a scatter list; the list itself
+     * must stay valid until completion as well.
+     */
+    ble_error_t send(const Segment_t *segments, unsigned count, const CompletionCallback_t &callback);
+
+    /**
+     * Stop the transfer in progress. The completion callback is invoked
+     * with BLE_ERROR_INVALID_STATE.
+     */
+    void abort(void);
+
+    bool isBusy(void) const {
+        return segments != NULL;
+    }
+
+private:
+    friend class nRF5xGattServer;
+
+    /**
+     * Hand chunks to the SoftDevice until it runs out of TX buffers or the
+     * data is exhausted.
+     */
+    void pump(void);
+
+    /**
+     * Copy the next chunk into chunk, without consuming it.
+     * @return the length of the chunk.
+     */
+    uint16_t gather(uint8_t *chunk) const;
+
+    /**
+     * Consume len bytes from the scatter list.
+     */
+    void advance(uint32_t len);
+
+    void finish(ble_error_t status);
+
+private:
+    nRF5xGattStream(const nRF5xGattStream &);
+    const nRF5xGattStream& operator=(const nRF5xGattStream &);
+
+private:
+    nRF5xGattServer         &server;
+    GattAttribute::Handle_t  valueHandle;
+    Gap::Handle_t            connectionHandle;
+
+    Segment_t                singleSegment; /**< Scatter list of the plain-buffer variant of send(). */
+    const Segment_t         *segments;      /**< NULL when idle. */
+    unsigned                 segmentCount;
+    unsigned                 segmentIndex;
+    uint32_t                 segmentOffset;
+
+    uint32_t                 bytesSent;
+    uint32_t                 startTime;
+    CompletionCallback_t     callback;
+};
+
+#endif /* __NRF5x_GATT_STREAM_H__ */
@@ -0,0 +1,63 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "nRF5xIngressBuffer.h"
+
+void nRF5xIngressBuffer::attach(uint8_t *_storage, uint16_t _size)
+{
+    storage = _storage;
+    size    = (_storage != NULL) ? _size : 0;
+    clear();
+}
+
+uint16_t nRF5xIngressBuffer::write(const uint8_t *data, uint16_t len)
+{
+    if (len > space()) {
+        len = space();
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    /* Copy in at most two chunks: up to the end of the storage, then from its start. */
+    uint16_t tail  = (head + count) % size;
+    uint16_t first = ((size - tail) < len) ? (size - tail) : len;
+    memcpy(&storage[tail], data, first);
+    memcpy(storage, &data[first], len - first);
+
+    count += len;
+    return len;
+}
+
+uint16_t nRF5xIngressBuffer::read(uint8_t *data, uint16_t len)
+{
+    if (len > count) {
+        len = count;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    uint16_t first = ((size - head) < len) ? (size - head) : len;
+    memcpy(data, &storage[head], first);
+    memcpy(&data[first], storage, len - first);
+
+    head   = (head + len) % size;
+    count -= len;
+    return len;
+}
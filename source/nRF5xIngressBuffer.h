@@ -0,0 +1,85 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NRF5x_INGRESS_BUFFER_H__
+#define __NRF5x_INGRESS_BUFFER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Byte ring buffer over storage provided by the application, used to
+ * accumulate the values written by a peer to a characteristic.
+ * @details The buffer doesn't preserve the boundaries between writes; it is
+ * meant for stream-like traffic (firmware images, logs) where the application
+ * consumes the data in large chunks.
+ */
+class nRF5xIngressBuffer
+{
+public:
+    nRF5xIngressBuffer() : storage(NULL), size(0), head(0), count(0) {
+        /* empty */
+    }
+
+    /**
+     * Set the storage backing the buffer and empty it.
+     * @param storage Memory owned by the application; NULL to detach it.
+     * @param size    Size of storage in bytes.
+     */
+    void attach(uint8_t *storage, uint16_t size);
+
+    /**
+     * Append data to the buffer.
+     * @return the number of bytes stored, which is less than len if the
+     *         buffer is full.
+     */
+    uint16_t write(const uint8_t *data, uint16_t len);
+
+    /**
+     * Remove data from the buffer.
+     * @return the number of bytes copied to data.
+     */
+    uint16_t read(uint8_t *data, uint16_t len);
+
+    void clear(void) {
+        head  = 0;
+        count = 0;
+    }
+
+    bool isAttached(void) const {
+        return storage != NULL;
+    }
+
+    uint16_t available(void) const {
+        return count;
+    }
+
+    uint16_t space(void) const {
+        return size - count;
+    }
+
+private:
+    nRF5xIngressBuffer(const nRF5xIngressBuffer &);
+    const nRF5xIngressBuffer& operator=(const nRF5xIngressBuffer &);
+
+private:
+    uint8_t  *storage;
+    uint16_t  size;
+    uint16_t  head;  /**< Offset of the oldest byte. */
+    uint16_t  count;
+};
+
+#endif /* __NRF5x_INGRESS_BUFFER_H__ */
@@ -0,0 +1,192 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nRF5xNotificationQueue.h"
+#ifdef YOTTA_CFG_MBED_OS
+    #include "mbed-drivers/mbed.h"
+#else
+    #include "mbed.h"
+#endif
+
+#include "ble_err.h"
+#include "btle/btle_instrumentation.h"
+
+nRF5xNotificationQueue::nRF5xNotificationQueue() :
+    entries(),
+    head(0),
+    count(0),
+    statistics() {
+    /* empty */
+}
+
+ble_error_t nRF5xNotificationQueue::enqueue(Gap::Handle_t           connectionHandle,
+                                            GattAttribute::Handle_t valueHandle,
+                                            uint8_t                 type,
+                                            const uint8_t          *data,
+                                            uint16_t                len,
+                                            bool                    coalesce)
+{
+    if (len > MAX_PAYLOAD_SIZE) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    Entry *entry = NULL;
+    if (coalesce) {
+        for (unsigned i = 0; i < count; i++) {
+            Entry &candidate = entryAt(i);
+            if ((candidate.connectionHandle == connectionHandle) && (candidate.valueHandle == valueHandle)) {
+                entry = &candidate;
+                statistics.coalesced++;
+                break;
+            }
+        }
+    }
+
+    if (entry == NULL) {
+        if (count == QUEUE_SIZE) {
+            statistics.dropped++;
+            return BLE_ERROR_NO_MEM;
+        }
+
+        entry = &entryAt(count);
+        count++;
+
+        entry->timestamp        = us_ticker_read();
+        entry->connectionHandle = connectionHandle;
+        entry->valueHandle      = valueHandle;
+
+        statistics.queued++;
+        statistics.depth = count;
+        if (count > statistics.maxDepth) {
+            statistics.maxDepth = count;
+        }
+    }
+
+    /* A coalesced entry keeps its timestamp and its position in the queue. */
+    entry->type = type;
+    entry->len  = len;
+    memcpy(entry->data, data, len);
+
+    return BLE_ERROR_NONE;
+}
+
+void nRF5xNotificationQueue::drain(void)
+{
+    /* Connections, with the kind of update, which answered NRF_ERROR_BUSY during this pass. */
+    Gap::Handle_t busyConnections[QUEUE_SIZE];
+    uint8_t       busyTypes[QUEUE_SIZE];
+    unsigned      busyCount = 0;
+
+    unsigned i = 0;
+    while (i < count) {
+        Entry   &entry = entryAt(i);
+        uint16_t len   = entry.len;
+
+        bool busy = false;
+        for (unsigned j = 0; j < busyCount; j++) {
+            if ((busyConnections[j] == entry.connectionHandle) && (busyTypes[j] == entry.type)) {
+                busy = true;
+                break;
+            }
+        }
+        if (busy) {
+            /* Stay behind the value which is waiting. */
+            i++;
+            continue;
+        }
+
+        ble_gatts_hvx_params_t hvx_params;
+        hvx_params.handle = entry.valueHandle;
+        hvx_params.type   = entry.type;
+        hvx_params.offset = 0;
+        hvx_params.p_data = entry.data;
+        hvx_params.p_len  = &len;
+
+        uint32_t rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTS_HVX, sd_ble_gatts_hvx(entry.connectionHandle, &hvx_params));
+        if (rc == BLE_ERROR_NO_TX_BUFFERS) {
+            /* TX buffers are shared by all the connections; wait for the next TX_COMPLETE. */
+            return;
+        }
+        if (rc == NRF_ERROR_BUSY) {
+            /* An indication is waiting for its confirmation on this connection; wait for the HVC. */
+            busyConnections[busyCount] = entry.connectionHandle;
+            busyTypes[busyCount]       = entry.type;
+            busyCount++;
+            i++;
+            continue;
+        }
+
+        if (rc == NRF_SUCCESS) {
+            uint32_t latency = us_ticker_read() - entry.timestamp;
+            statistics.drained++;
+            statistics.totalDrainLatencyUs += latency;
+            if (latency > statistics.maxDrainLatencyUs) {
+                statistics.maxDrainLatencyUs = latency;
+            }
+        } else {
+            /* The peer unsubscribed, disconnected, etc. */
+            statistics.dropped++;
+        }
+
+        removeAt(i);
+    }
+}
+
+bool nRF5xNotificationQueue::hasPending(Gap::Handle_t connectionHandle, uint8_t type)
+{
+    for (unsigned i = 0; i < count; i++) {
+        if ((entryAt(i).connectionHandle == connectionHandle) && (entryAt(i).type == type)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void nRF5xNotificationQueue::purge(Gap::Handle_t connectionHandle)
+{
+    unsigned i = 0;
+    while (i < count) {
+        if (entryAt(i).connectionHandle == connectionHandle) {
+            statistics.dropped++;
+            removeAt(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void nRF5xNotificationQueue::reset(void)
+{
+    head  = 0;
+    count = 0;
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+void nRF5xNotificationQueue::removeAt(unsigned position)
+{
+    if (position == 0) {
+        head = (head + 1) % QUEUE_SIZE;
+    } else {
+        /* Close the gap while preserving the order of the remaining entries. */
+        for (unsigned i = position; i < (unsigned)(count - 1); i++) {
+            entryAt(i) = entryAt(i + 1);
+        }
+    }
+
+    count--;
+    statistics.depth = count;
+}
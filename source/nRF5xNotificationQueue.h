@@ -0,0 +1,162 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2006-2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NRF5x_NOTIFICATION_QUEUE_H__
+#define __NRF5x_NOTIFICATION_QUEUE_H__
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ble/blecommon.h"
+#include "ble/Gap.h"
+#include "ble/GattAttribute.h"
+#include "nrf_ble.h"
+
+#ifndef YOTTA_CFG_NRF5X_NOTIFICATION_QUEUE_SIZE
+    #define YOTTA_CFG_NRF5X_NOTIFICATION_QUEUE_SIZE 4
+#endif
+
+/**
+ * @brief Fixed-size pool of notifications and indications waiting for a
+ * SoftDevice TX buffer.
+ * @details Entries are sent by drain(), which is meant to be called whenever
+ * the SoftDevice releases TX buffers (BLE_EVT_TX_COMPLETE) or receives an
+ * indication confirmation (BLE_GATTS_EVT_HVC). Order is preserved per
+ * connection and per kind of update: an indication waiting for the
+ * confirmation of the previous one doesn't hold up notifications, nor the
+ * updates of other connections.
+ * An entry can optionally be coalesced: a newer value for the same
+ * (connection, attribute) pair then replaces the queued one instead of being
+ * appended.
+ */
+class nRF5xNotificationQueue
+{
+public:
+    /**
+     * Maximum payload of a queued notification; the ATT_MTU is fixed to its
+     * default value by the SoftDevice.
+     */
+    static const unsigned MAX_PAYLOAD_SIZE = BLE_GATT_ATT_MTU_DEFAULT - 3;
+
+    /**
+     * Counters describing the activity of the queue.
+     */
+    struct Statistics_t {
+        uint32_t queued;              /**< Number of values queued because no TX buffer was available. */
+        uint32_t coalesced;           /**< Number of queued values replaced by a newer one. */
+        uint32_t dropped;             /**< Number of values lost, either because the pool was full or because the SoftDevice rejected them. */
+        uint32_t drained;             /**< Number of queued values handed over to the SoftDevice. */
+        uint32_t totalDrainLatencyUs; /**< Sum of the time spent in the queue by the drained values. */
+        uint32_t maxDrainLatencyUs;   /**< Longest time spent in the queue by a drained value. */
+        uint8_t  depth;               /**< Number of values currently queued. */
+        uint8_t  maxDepth;            /**< Highest value reached by depth. */
+    };
+
+public:
+    nRF5xNotificationQueue();
+
+    /**
+     * Queue a notification or an indication.
+     *
+     * @param connectionHandle The connection to send the value to.
+     * @param valueHandle      Handle of the characteristic value.
+     * @param type             BLE_GATT_HVX_NOTIFICATION or BLE_GATT_HVX_INDICATION.
+     * @param data             The value to send; it is copied.
+     * @param len              Length of data.
+     * @param coalesce         If true and a value is already queued for the
+     *                         same connection and attribute, that value is
+     *                         replaced instead of queuing a new one.
+     *
+     * @return BLE_ERROR_NONE if the value has been queued,
+     *         BLE_ERROR_INVALID_PARAM if it doesn't fit in a queue entry and
+     *         BLE_ERROR_NO_MEM if the pool is exhausted.
+     */
+    ble_error_t enqueue(Gap::Handle_t           connectionHandle,
+                        GattAttribute::Handle_t valueHandle,
+                        uint8_t                 type,
+                        const uint8_t          *data,
+                        uint16_t                len,
+                        bool                    coalesce);
+
+    /**
+     * Hand queued values to the SoftDevice until it runs out of TX buffers
+     * or the queue is empty. Values for a connection which can't take an
+     * update of their kind yet (NRF_ERROR_BUSY) are skipped.
+     */
+    void drain(void);
+
+    /**
+     * Is a value of the given kind queued for a connection? A new value must
+     * then be queued behind it to preserve ordering.
+     *
+     * @param type BLE_GATT_HVX_NOTIFICATION or BLE_GATT_HVX_INDICATION.
+     */
+    bool hasPending(Gap::Handle_t connectionHandle, uint8_t type);
+
+    /**
+     * Discard the values queued for a connection.
+     * @param connectionHandle The connection which has been closed.
+     */
+    void purge(Gap::Handle_t connectionHandle);
+
+    /**
+     * Discard all the queued values and clear the statistics.
+     */
+    void reset(void);
+
+    bool isEmpty(void) const {
+        return count == 0;
+    }
+
+    const Statistics_t &getStatistics(void) const {
+        return statistics;
+    }
+
+    void resetStatistics(void) {
+        memset(&statistics, 0, sizeof(statistics));
+        statistics.depth = count;
+    }
+
+private:
+    struct Entry {
+        uint32_t                timestamp;
+        Gap::Handle_t           connectionHandle;
+        GattAttribute::Handle_t valueHandle;
+        uint8_t                 type;
+        uint8_t                 len;
+        uint8_t                 data[MAX_PAYLOAD_SIZE];
+    };
+
+    static const unsigned QUEUE_SIZE = YOTTA_CFG_NRF5X_NOTIFICATION_QUEUE_SIZE;
+
+    Entry &entryAt(unsigned position) {
+        return entries[(head + position) % QUEUE_SIZE];
+    }
+
+    void removeAt(unsigned position);
+
+private:
+    nRF5xNotificationQueue(const nRF5xNotificationQueue &);
+    const nRF5xNotificationQueue& operator=(const nRF5xNotificationQueue &);
+
+private:
+    Entry        entries[QUEUE_SIZE];
+    uint8_t      head;
+    uint8_t      count;
+    Statistics_t statistics;
+};
+
+#endif /* __NRF5x_NOTIFICATION_QUEUE_H__ */
@@ -27,7 +27,7 @@ nRF5xServiceDiscovery::launchCharacteristicDiscovery(Gap::Handle_t connectionHan
         .start_handle = startHandle,
         .end_handle   = endHandle
     };
-    uint32_t rc = sd_ble_gattc_characteristics_discover(connectionHandle, &handleRange);
+    uint32_t rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_CHARACTERISTICS_DISCOVER, sd_ble_gattc_characteristics_discover(connectionHandle, &handleRange));
     ble_error_t err = BLE_ERROR_NONE;
 
     switch (rc) {
@@ -55,13 +55,53 @@ nRF5xServiceDiscovery::launchCharacteristicDiscovery(Gap::Handle_t connectionHan
     return err;
 }
 
+bool
+nRF5xServiceDiscovery::replayDatabaseCache(Gap::Handle_t connectionHandle)
+{
+    btle_databaseCacheCursor_t cursor;
+    if (!btle_openDatabaseCache(connectionHandle, &cursor)) {
+        return false;
+    }
+
+    serviceDiscoveryStarted(connectionHandle);
+
+    /* Apply the filters the same way as progressServiceDiscovery() and progressCharacteristicDiscovery(). */
+    bool                      serviceMatches = false;
+    btle_databaseCacheEntry_t entry;
+    while ((state == SERVICE_DISCOVERY_ACTIVE) && btle_readDatabaseCache(&cursor, &entry)) {
+        if (entry.type == BTLE_DATABASE_CACHE_SERVICE) {
+            serviceMatches = (matchingServiceUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) ||
+                             (matchingServiceUUID == entry.uuid);
+
+            if (serviceMatches && serviceCallback && (matchingCharacteristicUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN))) {
+                DiscoveredService service;
+                service.setup(entry.uuid, entry.startHandle, entry.endHandle);
+                serviceCallback(&service);
+            }
+        } else if (serviceMatches && characteristicCallback) {
+            if ((matchingCharacteristicUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) ||
+                ((matchingCharacteristicUUID == entry.uuid) &&
+                 (matchingServiceUUID != UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)))) {
+                nRF5xDiscoveredCharacteristic characteristic;
+                characteristic.setup(gattc, connHandle, entry.uuid, entry.properties, entry.startHandle, entry.valueHandle);
+                characteristic.setLastHandle(entry.endHandle);
+                characteristicCallback(&characteristic);
+            }
+        }
+    }
+
+    terminateServiceDiscovery();
+    return true;
+}
+
 void
 nRF5xServiceDiscovery::setupDiscoveredServices(const ble_gattc_evt_prim_srvc_disc_rsp_t *response)
 {
     serviceIndex = 0;
     numServices  = response->count;
 
-    /* Account for the limitation on the number of discovered services we can handle at a time. */
+    /* Account for the limitation on the number of discovered services we can handle at a time;
+     * the services which don't fit are discovered again after the last one retained. */
     if (numServices > BLE_DB_DISCOVERY_MAX_SRV) {
         numServices = BLE_DB_DISCOVERY_MAX_SRV;
     }
@@ -90,7 +130,8 @@ nRF5xServiceDiscovery::setupDiscoveredCharacteristics(const ble_gattc_evt_char_d
 {
     numCharacteristics  = response->count;
 
-    /* Account for the limitation on the number of discovered characteristics we can handle at a time. */
+    /* Account for the limitation on the number of discovered characteristics we can handle at a time;
+     * the characteristics which don't fit are discovered again after the last one retained. */
     if (numCharacteristics > BLE_DB_DISCOVERY_MAX_CHAR_PER_SRV) {
         numCharacteristics = BLE_DB_DISCOVERY_MAX_CHAR_PER_SRV;
     }
@@ -129,6 +170,9 @@ nRF5xServiceDiscovery::progressCharacteristicDiscovery(void)
 
     if ((discoveredCharacteristic != nRF5xDiscoveredCharacteristic()) && (numCharacteristics > 0)) {
         discoveredCharacteristic.setLastHandle(characteristics[0].getDeclHandle() - 1);
+        if (recording) {
+            btle_recordDiscoveredCharacteristic(connHandle, discoveredCharacteristic);
+        }
 
         if ((matchingCharacteristicUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) ||
             ((matchingCharacteristicUUID == discoveredCharacteristic.getUUID()) &&
@@ -151,6 +195,10 @@ nRF5xServiceDiscovery::progressCharacteristicDiscovery(void)
             characteristics[i].setLastHandle(characteristics[i + 1].getDeclHandle() - 1);
         }
 
+        if (recording) {
+            btle_recordDiscoveredCharacteristic(connHandle, characteristics[i]);
+        }
+
         if ((matchingCharacteristicUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) ||
             ((matchingCharacteristicUUID == characteristics[i].getUUID()) &&
              (matchingServiceUUID != UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)))) {
@@ -173,7 +221,7 @@ nRF5xServiceDiscovery::progressCharacteristicDiscovery(void)
             .start_handle = startHandle,
             .end_handle   = endHandle
         };
-        if (sd_ble_gattc_characteristics_discover(connHandle, &handleRange) != NRF_SUCCESS) {
+        if (BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_CHARACTERISTICS_DISCOVER, sd_ble_gattc_characteristics_discover(connHandle, &handleRange)) != NRF_SUCCESS) {
             terminateCharacteristicDiscovery(BLE_ERROR_UNSPECIFIED);
         }
     } else {
@@ -188,6 +236,9 @@ nRF5xServiceDiscovery::progressServiceDiscovery(void)
     while ((state == SERVICE_DISCOVERY_ACTIVE) && (serviceIndex < numServices)) {
         if ((matchingServiceUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) ||
             (matchingServiceUUID == services[serviceIndex].getUUID())) {
+            if (recording) {
+                btle_recordDiscoveredService(connHandle, services[serviceIndex]);
+            }
 
             if (serviceCallback && (matchingCharacteristicUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN))) {
                 serviceCallback(&services[serviceIndex]);
@@ -210,9 +261,9 @@ nRF5xServiceDiscovery::progressServiceDiscovery(void)
         resetDiscoveredServices(); /* Note: resetDiscoveredServices() must come after fetching endHandle. */
 
         if (endHandle == SRV_DISC_END_HANDLE) {
-            terminateServiceDiscovery();
+            terminateServiceDiscovery(true);
         } else {
-            if (sd_ble_gattc_primary_services_discover(connHandle, endHandle, NULL) != NRF_SUCCESS) {
+            if (BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_PRIMARY_SERVICES_DISCOVER, sd_ble_gattc_primary_services_discover(connHandle, endHandle, NULL)) != NRF_SUCCESS) {
                 terminateServiceDiscovery();
             }
         }
@@ -234,7 +285,8 @@ nRF5xServiceDiscovery::ServiceUUIDDiscoveryQueue::triggerFirst(void)
             .start_handle = parentDiscoveryObject->services[serviceIndex].getStartHandle(),
             .end_handle   = parentDiscoveryObject->services[serviceIndex].getEndHandle(),
         };
-        if (sd_ble_gattc_char_value_by_uuid_read(parentDiscoveryObject->connHandle, &uuid, &handleRange) == NRF_SUCCESS) {
+        if (BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_CHAR_VALUE_BY_UUID_READ,
+                                sd_ble_gattc_char_value_by_uuid_read(parentDiscoveryObject->connHandle, &uuid, &handleRange)) == NRF_SUCCESS) {
             return;
         }
 
@@ -263,7 +315,8 @@ nRF5xServiceDiscovery::CharUUIDDiscoveryQueue::triggerFirst(void)
         ble_gattc_handle_range_t handleRange = { };
         handleRange.start_handle = parentDiscoveryObject->characteristics[charIndex].getDeclHandle();
         handleRange.end_handle   = parentDiscoveryObject->characteristics[charIndex].getDeclHandle() + 1;
-        if (sd_ble_gattc_char_value_by_uuid_read(parentDiscoveryObject->connHandle, &uuid, &handleRange) == NRF_SUCCESS) {
+        if (BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_CHAR_VALUE_BY_UUID_READ,
+                                sd_ble_gattc_char_value_by_uuid_read(parentDiscoveryObject->connHandle, &uuid, &handleRange)) == NRF_SUCCESS) {
             return;
         }
 
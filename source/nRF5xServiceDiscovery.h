@@ -23,6 +23,22 @@
 
 #include "nrf_ble.h"
 #include "ble_gattc.h"
+#include "btle/btle_instrumentation.h"
+#include "btle/btle_databaseCache.h"
+
+/*
+ * Number of services and characteristics retained from a single discovery
+ * response. The defaults hold every entry a peer can fit in one response at
+ * the default ATT_MTU: a 2 byte header followed by 6 bytes per service (16-bit
+ * UUID) or 7 bytes per characteristic declaration. Smaller values work, at
+ * the cost of fetching the entries which didn't fit again.
+ */
+#ifndef YOTTA_CFG_NRF5X_GATTC_DISCOVERY_SERVICES
+    #define YOTTA_CFG_NRF5X_GATTC_DISCOVERY_SERVICES ((GATT_MTU_SIZE_DEFAULT - 2) / 6)
+#endif
+#ifndef YOTTA_CFG_NRF5X_GATTC_DISCOVERY_CHARACTERISTICS
+    #define YOTTA_CFG_NRF5X_GATTC_DISCOVERY_CHARACTERISTICS ((GATT_MTU_SIZE_DEFAULT - 2) / 7)
+#endif
 
 class nRF5xGattClient; /* forward declaration */
 
@@ -33,16 +49,17 @@ public:
     static const uint16_t SRV_DISC_END_HANDLE               = 0xFFFF; /**< The end handle value used during service discovery. */
 
 public:
-    static const unsigned BLE_DB_DISCOVERY_MAX_SRV          = 4;      /**< Maximum number of services we can retain information for after a single discovery. */
-    static const unsigned BLE_DB_DISCOVERY_MAX_CHAR_PER_SRV = 4;      /**< Maximum number of characteristics per service we can retain information for. */
+    static const unsigned BLE_DB_DISCOVERY_MAX_SRV          = YOTTA_CFG_NRF5X_GATTC_DISCOVERY_SERVICES;        /**< Maximum number of services we can retain information for after a single discovery. */
+    static const unsigned BLE_DB_DISCOVERY_MAX_CHAR_PER_SRV = YOTTA_CFG_NRF5X_GATTC_DISCOVERY_CHARACTERISTICS; /**< Maximum number of characteristics per service we can retain information for. */
 
 public:
-    nRF5xServiceDiscovery(nRF5xGattClient *gattcIn) :
+    nRF5xServiceDiscovery(nRF5xGattClient *gattcIn = NULL) :
         gattc(gattcIn),
         serviceIndex(0),
         numServices(0),
         numCharacteristics(0),
         state(INACTIVE),
+        recording(false),
         services(),
         characteristics(),
         serviceUUIDDiscoveryQueue(this),
@@ -66,10 +83,22 @@ public:
         matchingServiceUUID        = matchingServiceUUIDIn;
         matchingCharacteristicUUID = matchingCharacteristicUUIDIn;
 
+        /* Bonded peers whose database is cached aren't discovered again. */
+        if (replayDatabaseCache(connectionHandle)) {
+            return BLE_ERROR_NONE;
+        }
+
         serviceDiscoveryStarted(connectionHandle);
 
+        /* A discovery of every service and characteristic is recorded to the cache. */
+        recording = characteristicCallback &&
+                    (matchingServiceUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) &&
+                    (matchingCharacteristicUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) &&
+                    btle_startDatabaseRecording(connectionHandle);
+
         uint32_t rc;
-        if ((rc = sd_ble_gattc_primary_services_discover(connectionHandle, SRV_DISC_START_HANDLE, NULL)) != NRF_SUCCESS) {
+        if ((rc = BTLE_INSTRUMENT_SVC(BTLE_SVC_GATTC_PRIMARY_SERVICES_DISCOVER,
+                                      sd_ble_gattc_primary_services_discover(connectionHandle, SRV_DISC_START_HANDLE, NULL))) != NRF_SUCCESS) {
             terminate();
             switch (rc) {
                 case NRF_ERROR_INVALID_PARAM:
@@ -90,12 +119,27 @@ public:
         return state != INACTIVE;
     }
 
+    /**
+     * Test whether a discovery is in progress on a given connection.
+     */
+    bool isActive(Gap::Handle_t connectionHandle) const {
+        return isActive() && (connHandle == connectionHandle);
+    }
+
+    /**
+     * Set the GATT client passed to the discovered characteristics; for
+     * discovery objects created as part of an array.
+     */
+    void setGattClient(nRF5xGattClient *gattcIn) {
+        gattc = gattcIn;
+    }
+
     virtual void terminate(void) {
         terminateServiceDiscovery();
     }
 
     void terminate(Gap::Handle_t connectionHandle) {
-        if(connHandle == connectionHandle) {
+        if (isActive(connectionHandle)) {
             terminate();
         }
     }
@@ -123,6 +167,11 @@ public:
 
         state = INACTIVE;
 
+        if (recording) {
+            recording = false;
+            btle_stopDatabaseRecording(connHandle, false);
+        }
+
         serviceUUIDDiscoveryQueue.reset();
         charUUIDDiscoveryQueue.reset();
 
@@ -134,6 +183,15 @@ public:
 private:
     ble_error_t launchCharacteristicDiscovery(Gap::Handle_t connectionHandle, Gap::Handle_t startHandle, Gap::Handle_t endHandle);
 
+    /**
+     * Report the services and characteristics cached for the peer of a
+     * connection, as a discovery would; the callbacks, including the
+     * termination callback, are invoked before returning.
+     *
+     * @return false if the database of the peer isn't cached.
+     */
+    bool replayDatabaseCache(Gap::Handle_t connectionHandle);
+
 private:
     void setupDiscoveredServices(const ble_gattc_evt_prim_srvc_disc_rsp_t *response);
     void setupDiscoveredCharacteristics(const ble_gattc_evt_char_disc_rsp_t *response);
@@ -142,12 +200,21 @@ private:
     void processDiscoverUUIDResponse(const ble_gattc_evt_char_val_by_uuid_read_rsp_t *response);
     void removeFirstServiceNeedingUUIDDiscovery(void);
 
-    void terminateServiceDiscovery(void) {
+    /**
+     * @param[in] complete
+     *              true if the whole database has been discovered.
+     */
+    void terminateServiceDiscovery(bool complete = false) {
         discoveredCharacteristic = nRF5xDiscoveredCharacteristic();
 
         bool wasActive = isActive();
         state = INACTIVE;
 
+        if (recording) {
+            recording = false;
+            btle_stopDatabaseRecording(connHandle, complete);
+        }
+
         if (wasActive && onTerminationCallback) {
             onTerminationCallback(connHandle);
         }
@@ -159,6 +226,9 @@ private:
                if(err == BLE_ERROR_NONE) {
                     // fullfill the last characteristic
                     discoveredCharacteristic.setLastHandle(services[serviceIndex].getEndHandle());
+                    if (recording) {
+                        btle_recordDiscoveredCharacteristic(connHandle, discoveredCharacteristic);
+                    }
 
                     if ((matchingCharacteristicUUID == UUID::ShortUUIDBytes_t(BLE_UUID_UNKNOWN)) ||
                         ((matchingCharacteristicUUID == discoveredCharacteristic.getUUID()) &&
@@ -173,6 +243,11 @@ private:
 
             state = SERVICE_DISCOVERY_ACTIVE;
         }
+        if ((err != BLE_ERROR_NONE) && recording) {
+            /* Some characteristics are missing. */
+            recording = false;
+            btle_stopDatabaseRecording(connHandle, false);
+        }
         serviceIndex++; /* Progress service index to keep discovery alive. */
     }
 
@@ -276,7 +351,7 @@ private:
     public:
         void reset(void) {
             numIndices = 0;
-            for (unsigned i = 0; i < BLE_DB_DISCOVERY_MAX_SRV; i++) {
+            for (unsigned i = 0; i < BLE_DB_DISCOVERY_MAX_CHAR_PER_SRV; i++) {
                 charIndices[i] = INVALID_INDEX;
             }
         }
@@ -320,7 +395,7 @@ private:
     friend class CharUUIDDiscoveryQueue;
 
 private:
-    friend void bleGattcEventHandler(const ble_evt_t *p_ble_evt);
+    friend void bleGattcEventHandler(ble_evt_t *p_ble_evt);
     void progressCharacteristicDiscovery(void);
     void progressServiceDiscovery(void);
 
@@ -340,6 +415,8 @@ private:
         DISCOVER_CHARACTERISTIC_UUIDS,
     } state;
 
+    bool                        recording; /**< The discovery is being recorded to the database cache. */
+
     DiscoveredService           services[BLE_DB_DISCOVERY_MAX_SRV];  /**< Information related to the current service being discovered.
                                                                       *  This is intended for internal use during service discovery. */
     nRF5xDiscoveredCharacteristic characteristics[BLE_DB_DISCOVERY_MAX_CHAR_PER_SRV];
@@ -206,12 +206,19 @@ void
 nRF5xn::waitForEvent(void)
 {
     processEvents();
-    sd_app_evt_wait();
+
+    /* Don't sleep on events signaled since processEvents() returned. An event
+     * signaled after this test still wakes sd_app_evt_wait() up, as the SWI2
+     * interrupt sets the event register that it waits on. */
+    if (!btle_hasPendingEvents()) {
+        sd_app_evt_wait();
+    }
 }
 
 void nRF5xn::processEvents() {
-    if (isEventsSignaled) {
-        isEventsSignaled = false;
-        intern_softdevice_events_execute();
-    }
+    btle_processEvents(0, 0);
+}
+
+bool nRF5xn::processEvents(unsigned maxEvents, uint32_t budgetUs) {
+    return btle_processEvents(maxEvents, budgetUs);
 }
@@ -27,6 +27,7 @@
 #include "nRF5xSecurityManager.h"
 
 #include "btle.h"
+#include "btle_discovery.h"
 
 class nRF5xn : public BLEInstanceBase
 {
@@ -80,6 +81,12 @@ public:
     virtual nRF5xGattClient &getGattClient() {
         if (gattClientInstance == NULL) {
             gattClientInstance = new nRF5xGattClient();
+#if !defined(TARGET_MCU_NRF51_16K_S110) && !defined(TARGET_MCU_NRF51_32K_S110)
+            /* Applications which never use the GATT client don't pay for its event handling. */
+            btle_registerEventHandler(bleGattcEventHandler,
+                                      BTLE_EVENT_GROUP_COMMON | BTLE_EVENT_GROUP_DISCONNECTED | BTLE_EVENT_GROUP_GATTC,
+                                      BTLE_EVENT_ORDER_GATT_CLIENT);
+#endif
         }
         return *gattClientInstance;
     }
@@ -154,6 +161,16 @@ public:
 
     virtual void processEvents();
 
+    /**
+     * Variant of processEvents() which gives control back to the application
+     * once maxEvents events have been dispatched or budgetUs microseconds
+     * have elapsed (0 meaning no limit). Remaining events are signaled again
+     * through signalEventsToProcess().
+     *
+     * @return true if events are left to process.
+     */
+    bool processEvents(unsigned maxEvents, uint32_t budgetUs);
+
 public:
     static nRF5xn& Instance(BLE::InstanceID_t instanceId);
 